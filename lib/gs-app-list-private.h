@@ -31,6 +31,7 @@ G_BEGIN_DECLS
  * @GS_APP_LIST_FLAG_NONE:		No flags set
  * @GS_APP_LIST_FLAG_IS_RANDOMIZED:	List has been randomized
  * @GS_APP_LIST_FLAG_IS_TRUNCATED:	List has been truncated
+ * @GS_APP_LIST_FLAG_TRACK_USED:	Record when each application was last used
  *
  * Flags used to describe the list.
  **/
@@ -38,6 +39,7 @@ typedef enum {
 	GS_APP_LIST_FLAG_NONE			= 0,
 	GS_APP_LIST_FLAG_IS_RANDOMIZED		= 1 << 0,
 	GS_APP_LIST_FLAG_IS_TRUNCATED		= 1 << 1,
+	GS_APP_LIST_FLAG_TRACK_USED		= 1 << 2,
 	/*< private >*/
 	GS_APP_LIST_FLAG_LAST
 } GsAppListFlags;
@@ -69,6 +71,12 @@ void		 gs_app_list_randomize		(GsAppList	*list);
 void		 gs_app_list_remove_all		(GsAppList	*list);
 void		 gs_app_list_truncate		(GsAppList	*list,
 						 guint		 length);
+guint		 gs_app_list_trim_unused	(GsAppList	*list,
+						 guint		 length);
+GsApp		*gs_app_list_lookup_ref		(GsAppList	*list,
+						 const gchar	*unique_id);
+void		 gs_app_list_add_flag		(GsAppList	*list,
+						 GsAppListFlags	 flag);
 gboolean	 gs_app_list_has_flag		(GsAppList	*list,
 						 GsAppListFlags	 flag);
 
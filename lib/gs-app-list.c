@@ -32,6 +32,7 @@
 #include "config.h"
 
 #include <glib.h>
+#include <string.h>
 
 #include "gs-app-private.h"
 #include "gs-app-list-private.h"
@@ -40,12 +41,38 @@ struct _GsAppList
 {
 	GObject			 parent_instance;
 	GPtrArray		*array;
-	GHashTable		*hash_by_id;		/* app-id : app */
-	GMutex			 mutex;
+	GHashTable		*hash_by_id;		/* app-id : app, or NULL */
+	GArray			*dedupe_slots;		/* of GsAppListSlot */
+	GRWLock			 lock;			/* lookups only need to read */
 	guint			 size_peak;
 	GsAppListFlags		 flags;
+	gint			 used_tick;		/* atomic */
+	GHashTable		*evicted;		/* unique-id : GWeakRef, or NULL */
 };
 
+/* takes the lock for writing until the end of the scope */
+typedef GRWLock GsAppListLocker;
+
+static GsAppListLocker *
+gs_app_list_lock (GsAppList *list)
+{
+	g_rw_lock_writer_lock (&list->lock);
+	return &list->lock;
+}
+
+static void
+gs_app_list_unlock (GsAppListLocker *locker)
+{
+	g_rw_lock_writer_unlock (locker);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GsAppListLocker, gs_app_list_unlock)
+
+typedef struct {
+	guint64			 hash;
+	guint			 pos;			/* index + 1, or 0 if unused */
+} GsAppListSlot;
+
 G_DEFINE_TYPE (GsAppList, gs_app_list, G_TYPE_OBJECT)
 
 /**
@@ -64,6 +91,171 @@ gs_app_list_get_size_peak (GsAppList *list)
 	return list->size_peak;
 }
 
+/* the hash is only built when needed, as most copies are only iterated */
+static GHashTable *
+gs_app_list_ensure_hash (GsAppList *list)
+{
+	if (list->hash_by_id != NULL)
+		return list->hash_by_id;
+	list->hash_by_id = g_hash_table_new_full ((GHashFunc) as_utils_unique_id_hash,
+						  (GEqualFunc) as_utils_unique_id_equal,
+						  g_free,
+						  (GDestroyNotify) g_object_unref);
+	for (guint i = 0; i < list->array->len; i++) {
+		GsApp *app = g_ptr_array_index (list->array, i);
+		const gchar *id = gs_app_get_unique_id (app);
+		if (id == NULL)
+			continue;
+
+		/* a later app replaces an earlier wildcard, as when adding */
+		g_hash_table_insert (list->hash_by_id, g_strdup (id), g_object_ref (app));
+	}
+	return list->hash_by_id;
+}
+
+/* removes @app from the hash if it is the app stored for its unique-id */
+static void
+gs_app_list_remove_from_hash (GsAppList *list, GsApp *app)
+{
+	GsApp *app_tmp;
+	const gchar *unique_id;
+
+	if (list->hash_by_id == NULL)
+		return;
+	unique_id = gs_app_get_unique_id (app);
+	if (unique_id == NULL)
+		return;
+	app_tmp = g_hash_table_lookup (list->hash_by_id, unique_id);
+	if (app_tmp == app)
+		g_hash_table_remove (list->hash_by_id, unique_id);
+}
+
+static GQuark
+gs_app_list_used_quark (void)
+{
+	return g_quark_from_static_string ("GsAppList::last-used");
+}
+
+/* records the order the apps were last used in; the qdata is thread-safe so
+ * this only needs the list lock for reading */
+static void
+gs_app_list_mark_used (GsAppList *list, GsApp *app)
+{
+	guint tick;
+	if ((list->flags & GS_APP_LIST_FLAG_TRACK_USED) == 0)
+		return;
+	tick = (guint) g_atomic_int_add (&list->used_tick, 1) + 1;
+	g_object_set_qdata (G_OBJECT (app), gs_app_list_used_quark (),
+			    GUINT_TO_POINTER (tick));
+}
+
+static void
+gs_app_list_weak_ref_free (GWeakRef *weak)
+{
+	g_weak_ref_clear (weak);
+	g_free (weak);
+}
+
+/* remembers an app that was trimmed, so that if it is still being used
+ * elsewhere a lookup finds the same object rather than a new one being
+ * created for the same unique-id; the lock must be held for writing */
+static void
+gs_app_list_add_evicted (GsAppList *list, GsApp *app)
+{
+	GWeakRef *weak;
+	const gchar *unique_id = gs_app_get_unique_id (app);
+
+	if (unique_id == NULL)
+		return;
+	if (list->evicted == NULL) {
+		list->evicted = g_hash_table_new_full ((GHashFunc) as_utils_unique_id_hash,
+						       (GEqualFunc) as_utils_unique_id_equal,
+						       g_free,
+						       (GDestroyNotify) gs_app_list_weak_ref_free);
+	}
+	weak = g_new0 (GWeakRef, 1);
+	g_weak_ref_init (weak, app);
+	g_hash_table_insert (list->evicted, g_strdup (unique_id), weak);
+}
+
+/* forgets the trimmed apps that have since been freed; the lock must be
+ * held for writing */
+static void
+gs_app_list_prune_evicted (GsAppList *list)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	if (list->evicted == NULL)
+		return;
+	g_hash_table_iter_init (&iter, list->evicted);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		g_autoptr(GsApp) app = g_weak_ref_get ((GWeakRef *) value);
+		if (app == NULL)
+			g_hash_table_iter_remove (&iter);
+	}
+}
+
+static void gs_app_list_add_safe (GsAppList *list, GsApp *app);
+
+/* adds back a trimmed app that is still in use; the lock must be held for
+ * writing */
+static GsApp *
+gs_app_list_restore_evicted (GsAppList *list, const gchar *unique_id)
+{
+	GWeakRef *weak;
+	g_autoptr(GsApp) app = NULL;
+
+	if (list->evicted == NULL)
+		return NULL;
+	weak = g_hash_table_lookup (list->evicted, unique_id);
+	if (weak == NULL)
+		return NULL;
+	app = g_weak_ref_get (weak);
+	g_hash_table_remove (list->evicted, unique_id);
+	if (app == NULL)
+		return NULL;
+	gs_app_list_add_safe (list, app);
+	return app;
+}
+
+static GsApp *
+gs_app_list_lookup_internal (GsAppList *list, const gchar *unique_id, gboolean ref)
+{
+	GsApp *app;
+
+	/* concurrent lookups do not block each other once the hash exists */
+	g_rw_lock_reader_lock (&list->lock);
+	if (list->hash_by_id != NULL) {
+		app = g_hash_table_lookup (list->hash_by_id, unique_id);
+		if (app != NULL) {
+			gs_app_list_mark_used (list, app);
+			if (ref)
+				g_object_ref (app);
+			g_rw_lock_reader_unlock (&list->lock);
+			return app;
+		}
+		if (list->evicted == NULL || g_hash_table_size (list->evicted) == 0) {
+			g_rw_lock_reader_unlock (&list->lock);
+			return NULL;
+		}
+	}
+	g_rw_lock_reader_unlock (&list->lock);
+
+	/* build the hash, or find a trimmed app that is still in use */
+	g_rw_lock_writer_lock (&list->lock);
+	app = g_hash_table_lookup (gs_app_list_ensure_hash (list), unique_id);
+	if (app == NULL)
+		app = gs_app_list_restore_evicted (list, unique_id);
+	if (app != NULL) {
+		gs_app_list_mark_used (list, app);
+		if (ref)
+			g_object_ref (app);
+	}
+	g_rw_lock_writer_unlock (&list->lock);
+	return app;
+}
+
 /**
  * gs_app_list_lookup:
  * @list: A #GsAppList
@@ -79,8 +271,26 @@ gs_app_list_get_size_peak (GsAppList *list)
 GsApp *
 gs_app_list_lookup (GsAppList *list, const gchar *unique_id)
 {
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&list->mutex);
-	return g_hash_table_lookup (list->hash_by_id, unique_id);
+	return gs_app_list_lookup_internal (list, unique_id, FALSE);
+}
+
+/**
+ * gs_app_list_lookup_ref:
+ * @list: A #GsAppList
+ * @unique_id: A unique_id
+ *
+ * Finds the first matching application in the list, taking a reference
+ * before the list lock is released. Use this rather than
+ * gs_app_list_lookup() when another thread may remove the application.
+ *
+ * Returns: (transfer full): a #GsApp, or %NULL if not found
+ *
+ * Since: 3.26
+ **/
+GsApp *
+gs_app_list_lookup_ref (GsAppList *list, const gchar *unique_id)
+{
+	return gs_app_list_lookup_internal (list, unique_id, TRUE);
 }
 
 /**
@@ -100,6 +310,22 @@ gs_app_list_has_flag (GsAppList *list, GsAppListFlags flag)
 	return (list->flags & flag) > 0;
 }
 
+/**
+ * gs_app_list_add_flag:
+ * @list: A #GsAppList
+ * @flag: A flag to set, e.g. %GS_APP_LIST_FLAG_TRACK_USED
+ *
+ * Sets a flag on the list.
+ *
+ * Since: 3.26
+ **/
+void
+gs_app_list_add_flag (GsAppList *list, GsAppListFlags flag)
+{
+	g_autoptr(GsAppListLocker) locker = gs_app_list_lock (list);
+	list->flags |= flag;
+}
+
 static gboolean
 gs_app_list_check_for_duplicate (GsAppList *list, GsApp *app)
 {
@@ -109,7 +335,7 @@ gs_app_list_check_for_duplicate (GsAppList *list, GsApp *app)
 
 	/* does not exist */
 	id = gs_app_get_unique_id (app);
-	app_old = g_hash_table_lookup (list->hash_by_id, id);
+	app_old = g_hash_table_lookup (gs_app_list_ensure_hash (list), id);
 	if (app_old == NULL) {
 		g_debug ("adding %s as nothing matched hash", id);
 		return TRUE;
@@ -153,6 +379,7 @@ gs_app_list_add_safe (GsAppList *list, GsApp *app)
 	/* just use the ref */
 	g_ptr_array_add (list->array, g_object_ref (app));
 	g_hash_table_insert (list->hash_by_id, g_strdup (id), g_object_ref (app));
+	gs_app_list_mark_used (list, app);
 
 	/* update the historical max */
 	if (list->array->len > list->size_peak)
@@ -177,7 +404,7 @@ gs_app_list_add_safe (GsAppList *list, GsApp *app)
 void
 gs_app_list_add (GsAppList *list, GsApp *app)
 {
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&list->mutex);
+	g_autoptr(GsAppListLocker) locker = gs_app_list_lock (list);
 	g_return_if_fail (GS_IS_APP_LIST (list));
 	g_return_if_fail (GS_IS_APP (app));
 	gs_app_list_add_safe (list, app);
@@ -198,7 +425,7 @@ gs_app_list_remove (GsAppList *list, GsApp *app)
 {
 	GsApp *app_tmp;
 	const gchar *unique_id;
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&list->mutex);
+	g_autoptr(GsAppListLocker) locker = gs_app_list_lock (list);
 
 	g_return_if_fail (GS_IS_APP_LIST (list));
 	g_return_if_fail (GS_IS_APP (app));
@@ -206,11 +433,14 @@ gs_app_list_remove (GsAppList *list, GsApp *app)
 	/* remove, or ignore if not found */
 	unique_id = gs_app_get_unique_id (app);
 	if (unique_id != NULL) {
-		app_tmp = g_hash_table_lookup (list->hash_by_id, unique_id);
+		GHashTable *hash_by_id = gs_app_list_ensure_hash (list);
+		if (list->evicted != NULL)
+			g_hash_table_remove (list->evicted, unique_id);
+		app_tmp = g_hash_table_lookup (hash_by_id, unique_id);
 		if (app_tmp == NULL)
 			return;
-		g_hash_table_remove (list->hash_by_id, unique_id);
 		g_ptr_array_remove (list->array, app_tmp);
+		g_hash_table_remove (hash_by_id, unique_id);
 	} else {
 		g_ptr_array_remove (list->array, app);
 	}
@@ -229,12 +459,24 @@ void
 gs_app_list_add_list (GsAppList *list, GsAppList *donor)
 {
 	guint i;
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&list->mutex);
+	g_autoptr(GsAppListLocker) locker = gs_app_list_lock (list);
 
 	g_return_if_fail (GS_IS_APP_LIST (list));
 	g_return_if_fail (GS_IS_APP_LIST (donor));
 	g_return_if_fail (list != donor);
 
+	/* the donor has no duplicates, so there is nothing to check */
+	if (list->array->len == 0) {
+		g_clear_pointer (&list->hash_by_id, g_hash_table_unref);
+		for (i = 0; i < donor->array->len; i++) {
+			GsApp *app = gs_app_list_index (donor, i);
+			g_ptr_array_add (list->array, g_object_ref (app));
+		}
+		if (list->array->len > list->size_peak)
+			list->size_peak = list->array->len;
+		return;
+	}
+
 	/* add each app */
 	for (i = 0; i < donor->array->len; i++) {
 		GsApp *app = gs_app_list_index (donor, i);
@@ -280,7 +522,10 @@ static void
 gs_app_list_remove_all_safe (GsAppList *list)
 {
 	g_ptr_array_set_size (list->array, 0);
-	g_hash_table_remove_all (list->hash_by_id);
+	if (list->hash_by_id != NULL)
+		g_hash_table_remove_all (list->hash_by_id);
+	if (list->evicted != NULL)
+		g_hash_table_remove_all (list->evicted);
 }
 
 /**
@@ -294,7 +539,7 @@ gs_app_list_remove_all_safe (GsAppList *list)
 void
 gs_app_list_remove_all (GsAppList *list)
 {
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&list->mutex);
+	g_autoptr(GsAppListLocker) locker = gs_app_list_lock (list);
 	g_return_if_fail (GS_IS_APP_LIST (list));
 	gs_app_list_remove_all_safe (list);
 }
@@ -312,24 +557,27 @@ gs_app_list_remove_all (GsAppList *list)
 void
 gs_app_list_filter (GsAppList *list, GsAppListFilterFunc func, gpointer user_data)
 {
-	guint i;
-	GsApp *app;
-	g_autoptr(GsAppList) old = NULL;
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&list->mutex);
+	guint n_keep = 0;
+	g_autoptr(GsAppListLocker) locker = gs_app_list_lock (list);
 
 	g_return_if_fail (GS_IS_APP_LIST (list));
 	g_return_if_fail (func != NULL);
 
-	/* deep copy to a temp list and clear the current one */
-	old = gs_app_list_copy (list);
-	gs_app_list_remove_all_safe (list);
-
-	/* see if any of the apps need filtering */
-	for (i = 0; i < old->array->len; i++) {
-		app = gs_app_list_index (old, i);
-		if (func (app, user_data))
-			gs_app_list_add_safe (list, app);
+	/* move the apps to keep to the front, and the rest to the back */
+	for (guint i = 0; i < list->array->len; i++) {
+		GsApp *app = g_ptr_array_index (list->array, i);
+		if (!func (app, user_data))
+			continue;
+		list->array->pdata[i] = list->array->pdata[n_keep];
+		list->array->pdata[n_keep++] = app;
 	}
+	if (n_keep == list->array->len)
+		return;
+
+	/* drop the filtered apps */
+	for (guint i = n_keep; i < list->array->len; i++)
+		gs_app_list_remove_from_hash (list, g_ptr_array_index (list->array, i));
+	g_ptr_array_set_size (list->array, n_keep);
 }
 
 typedef struct {
@@ -358,7 +606,7 @@ gs_app_list_sort_cb (gconstpointer a, gconstpointer b, gpointer user_data)
 void
 gs_app_list_sort (GsAppList *list, GsAppListSortFunc func, gpointer user_data)
 {
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&list->mutex);
+	g_autoptr(GsAppListLocker) locker = gs_app_list_lock (list);
 	GsAppListSortHelper helper;
 	g_return_if_fail (GS_IS_APP_LIST (list));
 	helper.func = func;
@@ -379,7 +627,7 @@ gs_app_list_sort (GsAppList *list, GsAppListSortFunc func, gpointer user_data)
 void
 gs_app_list_truncate (GsAppList *list, guint length)
 {
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(GsAppListLocker) locker = NULL;
 
 	g_return_if_fail (GS_IS_APP_LIST (list));
 	g_return_if_fail (length <= list->array->len);
@@ -394,12 +642,12 @@ gs_app_list_truncate (GsAppList *list, guint length)
 	}
 
 	/* remove the apps in the positions larger than the length */
-	locker = g_mutex_locker_new (&list->mutex);
+	locker = gs_app_list_lock (list);
 	for (guint i = length; i < list->array->len; i++) {
 		GsApp *app = g_ptr_array_index (list->array, i);
 		const gchar *unique_id;
 		unique_id = gs_app_get_unique_id (app);
-		if (unique_id != NULL) {
+		if (unique_id != NULL && list->hash_by_id != NULL) {
 			GsApp *app_tmp = g_hash_table_lookup (list->hash_by_id, unique_id);
 			if (app_tmp != NULL)
 				g_hash_table_remove (list->hash_by_id, unique_id);
@@ -409,6 +657,89 @@ gs_app_list_truncate (GsAppList *list, guint length)
 	g_ptr_array_set_size (list->array, length);
 }
 
+typedef struct {
+	guint			 used;
+	guint			 idx;
+} GsAppListUsed;
+
+static gint
+gs_app_list_used_sort_cb (gconstpointer a, gconstpointer b)
+{
+	const GsAppListUsed *used1 = a;
+	const GsAppListUsed *used2 = b;
+	if (used1->used != used2->used)
+		return used1->used < used2->used ? -1 : 1;
+	return used1->idx < used2->idx ? -1 : 1;
+}
+
+/**
+ * gs_app_list_trim_unused:
+ * @list: A #GsAppList
+ * @length: the length to trim to
+ *
+ * Removes applications from the list until it is no longer than @length.
+ * If the list has %GS_APP_LIST_FLAG_TRACK_USED set then the least recently
+ * used applications are removed first, and any that are still being used
+ * elsewhere are added back by the next lookup for them. Otherwise the
+ * oldest applications are removed first.
+ *
+ * Returns: the number of applications removed
+ *
+ * Since: 3.26
+ **/
+guint
+gs_app_list_trim_unused (GsAppList *list, guint length)
+{
+	guint n_keep = 0;
+	guint n_remove;
+	g_autoptr(GArray) used = NULL;
+	g_autoptr(GHashTable) remove = NULL;
+	g_autoptr(GsAppListLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_APP_LIST (list), 0);
+
+	locker = gs_app_list_lock (list);
+	if (list->array->len <= length)
+		return 0;
+	n_remove = list->array->len - length;
+	gs_app_list_prune_evicted (list);
+
+	/* remove the least recently used */
+	used = g_array_sized_new (FALSE, FALSE, sizeof (GsAppListUsed),
+				  list->array->len);
+	for (guint i = 0; i < list->array->len; i++) {
+		GsApp *app = g_ptr_array_index (list->array, i);
+		GsAppListUsed item;
+		item.used = GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (app),
+								  gs_app_list_used_quark ()));
+		item.idx = i;
+		g_array_append_val (used, item);
+	}
+	if (list->flags & GS_APP_LIST_FLAG_TRACK_USED)
+		g_array_sort (used, gs_app_list_used_sort_cb);
+	remove = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (guint i = 0; i < n_remove; i++) {
+		GsAppListUsed *item = &g_array_index (used, GsAppListUsed, i);
+		g_hash_table_add (remove, g_ptr_array_index (list->array, item->idx));
+	}
+	for (guint i = 0; i < list->array->len; i++) {
+		GsApp *app = g_ptr_array_index (list->array, i);
+		if (g_hash_table_contains (remove, app))
+			continue;
+		list->array->pdata[i] = list->array->pdata[n_keep];
+		list->array->pdata[n_keep++] = app;
+	}
+	n_remove = list->array->len - n_keep;
+	for (guint i = n_keep; i < list->array->len; i++) {
+		GsApp *app = g_ptr_array_index (list->array, i);
+		if (list->flags & GS_APP_LIST_FLAG_TRACK_USED)
+			gs_app_list_add_evicted (list, app);
+		gs_app_list_remove_from_hash (list, app);
+	}
+	g_ptr_array_set_size (list->array, n_keep);
+	return n_remove;
+}
+
 static gint
 gs_app_list_randomize_cb (gconstpointer a, gconstpointer b, gpointer user_data)
 {
@@ -442,7 +773,7 @@ gs_app_list_randomize (GsAppList *list)
 	gchar sort_key[] = { '\0', '\0', '\0', '\0' };
 	g_autoptr(GDateTime) date = NULL;
 	g_autofree gchar *key = NULL;
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&list->mutex);
+	g_autoptr(GsAppListLocker) locker = gs_app_list_lock (list);
 
 	g_return_if_fail (GS_IS_APP_LIST (list));
 
@@ -468,107 +799,170 @@ gs_app_list_randomize (GsAppList *list)
 	g_rand_free (rand);
 }
 
+/* FNV-1a, with a terminator so that "ab","c" and "a","bc" differ */
+static guint64
+gs_app_list_hash_str (guint64 hash, const gchar *str)
+{
+	if (str == NULL)
+		return (hash ^ 0xff) * G_GUINT64_CONSTANT (0x100000001b3);
+	for (const guchar *tmp = (const guchar *) str; *tmp != '\0'; tmp++)
+		hash = (hash ^ *tmp) * G_GUINT64_CONSTANT (0x100000001b3);
+	return hash * G_GUINT64_CONSTANT (0x100000001b3);
+}
+
+/* returns FALSE if the app has nothing to deduplicate on */
+static gboolean
+gs_app_list_get_key_hash (GsApp *app, GsAppListFilterFlags flags, guint64 *hash)
+{
+	const gchar *tmp;
+	gboolean has_key = FALSE;
+	guint64 hash_tmp = G_GUINT64_CONSTANT (0xcbf29ce484222325);
+
+	if (flags == GS_APP_LIST_FILTER_FLAG_NONE) {
+		tmp = gs_app_get_unique_id (app);
+		if (tmp == NULL || tmp[0] == '\0')
+			return FALSE;
+		*hash = gs_app_list_hash_str (hash_tmp, tmp);
+		return TRUE;
+	}
+	if (flags & GS_APP_LIST_FILTER_FLAG_KEY_ID) {
+		tmp = gs_app_get_id (app);
+		if (tmp != NULL && tmp[0] != '\0')
+			has_key = TRUE;
+		hash_tmp = gs_app_list_hash_str (hash_tmp, tmp);
+	}
+	if (flags & GS_APP_LIST_FILTER_FLAG_KEY_SOURCE) {
+		tmp = gs_app_get_source_default (app);
+		if (tmp != NULL)
+			has_key = TRUE;
+		hash_tmp = gs_app_list_hash_str (hash_tmp, tmp);
+	}
+	if (flags & GS_APP_LIST_FILTER_FLAG_KEY_VERSION) {
+		tmp = gs_app_get_version (app);
+		if (tmp != NULL)
+			has_key = TRUE;
+		hash_tmp = gs_app_list_hash_str (hash_tmp, tmp);
+	}
+	*hash = hash_tmp;
+	return has_key;
+}
+
+static gboolean
+gs_app_list_key_equal (GsApp *app1, GsApp *app2, GsAppListFilterFlags flags)
+{
+	if (flags == GS_APP_LIST_FILTER_FLAG_NONE) {
+		return g_strcmp0 (gs_app_get_unique_id (app1),
+				  gs_app_get_unique_id (app2)) == 0;
+	}
+	if ((flags & GS_APP_LIST_FILTER_FLAG_KEY_ID) > 0 &&
+	    g_strcmp0 (gs_app_get_id (app1), gs_app_get_id (app2)) != 0)
+		return FALSE;
+	if ((flags & GS_APP_LIST_FILTER_FLAG_KEY_SOURCE) > 0 &&
+	    g_strcmp0 (gs_app_get_source_default (app1),
+		       gs_app_get_source_default (app2)) != 0)
+		return FALSE;
+	if ((flags & GS_APP_LIST_FILTER_FLAG_KEY_VERSION) > 0 &&
+	    g_strcmp0 (gs_app_get_version (app1), gs_app_get_version (app2)) != 0)
+		return FALSE;
+	return TRUE;
+}
+
 /**
  * gs_app_list_filter_duplicates:
  * @list: A #GsAppList
+ * @flags: a #GsAppListFilterFlags, e.g. %GS_APP_LIST_FILTER_FLAG_KEY_ID
  *
- * Filter any duplicate applications from the list.
+ * Filter any duplicate applications from the list, keeping the order of the
+ * applications that remain.
  *
  * Since: 3.22
  **/
 void
 gs_app_list_filter_duplicates (GsAppList *list, GsAppListFilterFlags flags)
 {
-	g_autoptr(GHashTable) hash = NULL;
-	g_autoptr(GList) values = NULL;
-	g_autoptr(GPtrArray) apps_no_id = NULL;
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&list->mutex);
+	GsAppListSlot *slots;
+	guint mask;
+	guint n_slots = 16;
+	guint n_keep = 0;
+	g_autoptr(GsAppListLocker) locker = gs_app_list_lock (list);
 
 	g_return_if_fail (GS_IS_APP_LIST (list));
 
-	/* a hash table to hold apps with unique app ids */
-	hash = g_hash_table_new_full (g_str_hash, g_str_equal,
-				      g_free, (GDestroyNotify) g_object_unref);
-	/* an array to hold apps that have NULL app ids */
-	apps_no_id = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	/* nothing to do */
+	if (list->array->len < 2)
+		return;
 
+	/* an open-addressing table of list positions, reused between calls */
+	while (n_slots < list->array->len * 2)
+		n_slots *= 2;
+	mask = n_slots - 1;
+	if (list->dedupe_slots == NULL)
+		list->dedupe_slots = g_array_new (FALSE, FALSE, sizeof (GsAppListSlot));
+	g_array_set_size (list->dedupe_slots, n_slots);
+	slots = (GsAppListSlot *) list->dedupe_slots->data;
+	memset (slots, 0, n_slots * sizeof (GsAppListSlot));
+
+	/* the apps to keep are moved to the front, and the rest to the back */
 	for (guint i = 0; i < list->array->len; i++) {
-		GsApp *app;
+		GsApp *app = g_ptr_array_index (list->array, i);
 		GsApp *found;
-		g_autoptr(GString) key = NULL;
+		GsAppListSlot *slot;
+		guint64 hash;
 
-		app = gs_app_list_index (list, i);
-		if (flags == GS_APP_LIST_FILTER_FLAG_NONE) {
-			key = g_string_new (gs_app_get_unique_id (app));
-		} else {
-			key = g_string_new (NULL);
-			if (flags & GS_APP_LIST_FILTER_FLAG_KEY_ID) {
-				const gchar *tmp = gs_app_get_id (app);
-				if (tmp != NULL)
-					g_string_append (key, gs_app_get_id (app));
-			}
-			if (flags & GS_APP_LIST_FILTER_FLAG_KEY_SOURCE) {
-				const gchar *tmp = gs_app_get_source_default (app);
-				if (tmp != NULL)
-					g_string_append_printf (key, ":%s", tmp);
-			}
-			if (flags & GS_APP_LIST_FILTER_FLAG_KEY_VERSION) {
-				const gchar *tmp = gs_app_get_version (app);
-				if (tmp != NULL)
-					g_string_append_printf (key, ":%s", tmp);
-			}
-		}
-		if (key->len == 0) {
+		if (!gs_app_list_get_key_hash (app, flags, &hash)) {
 			g_autofree gchar *str = gs_app_to_string (app);
 			g_debug ("adding without deduplication as no app key: %s", str);
-			g_ptr_array_add (apps_no_id, g_object_ref (app));
+			list->array->pdata[i] = list->array->pdata[n_keep];
+			list->array->pdata[n_keep++] = app;
 			continue;
 		}
-		found = g_hash_table_lookup (hash, key->str);
-		if (found == NULL) {
-			g_debug ("found new %s", key->str);
-			g_hash_table_insert (hash,
-					     g_strdup (key->str),
-					     g_object_ref (app));
+		for (guint j = (guint) hash & mask; ; j = (j + 1) & mask) {
+			slot = &slots[j];
+			if (slot->pos == 0)
+				break;
+			if (slot->hash != hash)
+				continue;
+			found = g_ptr_array_index (list->array, slot->pos - 1);
+			if (gs_app_list_key_equal (app, found, flags))
+				break;
+		}
+		if (slot->pos == 0) {
+			g_debug ("found new %s", gs_app_get_unique_id (app));
+			slot->hash = hash;
+			slot->pos = n_keep + 1;
+			list->array->pdata[i] = list->array->pdata[n_keep];
+			list->array->pdata[n_keep++] = app;
 			continue;
 		}
 
 		/* better? */
+		found = g_ptr_array_index (list->array, slot->pos - 1);
 		if (flags != GS_APP_LIST_FILTER_FLAG_NONE) {
 			if (gs_app_get_priority (app) >
 			    gs_app_get_priority (found)) {
 				g_debug ("using better %s (priority %u > %u)",
-					 key->str,
+					 gs_app_get_unique_id (app),
 					 gs_app_get_priority (app),
 					 gs_app_get_priority (found));
-				g_hash_table_insert (hash,
-						     g_strdup (key->str),
-						     g_object_ref (app));
+				list->array->pdata[slot->pos - 1] = app;
+				list->array->pdata[i] = found;
 				continue;
 			}
 			g_debug ("ignoring worse duplicate %s (priority %u > %u)",
-				 key->str,
+				 gs_app_get_unique_id (app),
 				 gs_app_get_priority (app),
 				 gs_app_get_priority (found));
 			continue;
 		}
-		g_debug ("ignoring duplicate %s", key->str);
-		continue;
-	}
-
-	/* add back the best results to the existing list */
-	gs_app_list_remove_all_safe (list);
-	values = g_hash_table_get_values (hash);
-	for (GList *l = values; l != NULL; l = l->next) {
-		GsApp *app = GS_APP (l->data);
-		gs_app_list_add_safe (list, app);
+		g_debug ("ignoring duplicate %s", gs_app_get_unique_id (app));
 	}
+	if (n_keep == list->array->len)
+		return;
 
-	/* add back apps with NULL app ids to the existing list */
-	for (guint i = 0; i < apps_no_id->len; i++) {
-		GsApp *app = g_ptr_array_index (apps_no_id, i);
-		gs_app_list_add_safe (list, app);
-	}
+	/* drop the duplicates */
+	for (guint i = n_keep; i < list->array->len; i++)
+		gs_app_list_remove_from_hash (list, g_ptr_array_index (list->array, i));
+	g_ptr_array_set_size (list->array, n_keep);
 }
 
 /**
@@ -585,15 +979,21 @@ GsAppList *
 gs_app_list_copy (GsAppList *list)
 {
 	GsAppList *new;
-	guint i;
 
 	g_return_val_if_fail (GS_IS_APP_LIST (list), NULL);
 
+	/* the apps are already unique, so just take a ref on each one */
+	g_rw_lock_reader_lock (&list->lock);
 	new = gs_app_list_new ();
-	for (i = 0; i < gs_app_list_length (list); i++) {
-		GsApp *app = gs_app_list_index (list, i);
-		gs_app_list_add_safe (new, app);
+	g_ptr_array_unref (new->array);
+	new->array = g_ptr_array_new_full (list->array->len,
+					   (GDestroyNotify) g_object_unref);
+	for (guint i = 0; i < list->array->len; i++) {
+		GsApp *app = g_ptr_array_index (list->array, i);
+		g_ptr_array_add (new->array, g_object_ref (app));
 	}
+	new->size_peak = new->array->len;
+	g_rw_lock_reader_unlock (&list->lock);
 	return new;
 }
 
@@ -602,8 +1002,13 @@ gs_app_list_finalize (GObject *object)
 {
 	GsAppList *list = GS_APP_LIST (object);
 	g_ptr_array_unref (list->array);
-	g_hash_table_unref (list->hash_by_id);
-	g_mutex_clear (&list->mutex);
+	if (list->hash_by_id != NULL)
+		g_hash_table_unref (list->hash_by_id);
+	if (list->dedupe_slots != NULL)
+		g_array_unref (list->dedupe_slots);
+	if (list->evicted != NULL)
+		g_hash_table_unref (list->evicted);
+	g_rw_lock_clear (&list->lock);
 	G_OBJECT_CLASS (gs_app_list_parent_class)->finalize (object);
 }
 
@@ -617,12 +1022,8 @@ gs_app_list_class_init (GsAppListClass *klass)
 static void
 gs_app_list_init (GsAppList *list)
 {
-	g_mutex_init (&list->mutex);
+	g_rw_lock_init (&list->lock);
 	list->array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
-	list->hash_by_id = g_hash_table_new_full ((GHashFunc) as_utils_unique_id_hash,
-						  (GEqualFunc) as_utils_unique_id_equal,
-						  g_free,
-						  (GDestroyNotify) g_object_unref);
 }
 
 /**
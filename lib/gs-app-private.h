@@ -33,6 +33,13 @@ void		 gs_app_set_unique_id		(GsApp		*app,
 						 const gchar	*unique_id);
 void		 gs_app_remove_addon		(GsApp		*app,
 						 GsApp		*addon);
+void		 gs_app_add_refined_flags	(GsApp		*app,
+						 guint64	 refine_flags,
+						 guint		 generation);
+gboolean	 gs_app_has_refined_flags	(GsApp		*app,
+						 guint64	 refine_flags,
+						 guint		 generation);
+void		 gs_app_invalidate_refined_flags (GsApp		*app);
 
 G_END_DECLS
 
@@ -95,6 +95,8 @@ struct _GsApp
 	gchar			*management_plugin;
 	guint			 match_value;
 	guint			 priority;
+	guint64			 refined_flags;
+	guint			 refined_generation;
 	gint			 rating;
 	GArray			*review_ratings;
 	GPtrArray		*reviews; /* of AsReview */
@@ -123,6 +125,7 @@ struct _GsApp
 	AsContentRating		*content_rating;
 	GdkPixbuf		*pixbuf;
 	GsPrice			*price;
+	guint			 notify_pending;	/* bitmask of PROP_ */
 };
 
 enum {
@@ -141,6 +144,13 @@ enum {
 	PROP_LAST
 };
 
+static GParamSpec *obj_props[PROP_LAST] = { NULL, };
+
+/* apps with queued property changes, all dispatched from one idle */
+static GMutex		 notify_mutex;
+static GPtrArray	*notify_apps = NULL;
+static guint		 notify_source_id = 0;
+
 G_DEFINE_TYPE (GsApp, gs_app, G_TYPE_OBJECT)
 
 static gboolean
@@ -579,36 +589,55 @@ gs_app_to_string (GsApp *app)
 	return g_string_free (str, FALSE);
 }
 
-typedef struct {
-	GsApp *app;
-	gchar *property_name;
-} AppNotifyData;
-
 static gboolean
 notify_idle_cb (gpointer data)
 {
-	AppNotifyData *notify_data = data;
-
-	g_object_notify (G_OBJECT (notify_data->app),
-			 notify_data->property_name);
-
-	g_object_unref (notify_data->app);
-	g_free (notify_data->property_name);
-	g_free (notify_data);
-
+	guint i;
+	guint j;
+	g_autoptr(GPtrArray) apps = NULL;
+	g_autoptr(GArray) pending = NULL;
+
+	/* take everything queued so far */
+	g_mutex_lock (&notify_mutex);
+	apps = notify_apps;
+	notify_apps = NULL;
+	notify_source_id = 0;
+	pending = g_array_sized_new (FALSE, FALSE, sizeof (guint), apps->len);
+	for (i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		g_array_append_val (pending, app->notify_pending);
+		app->notify_pending = 0;
+	}
+	g_mutex_unlock (&notify_mutex);
+
+	/* emit each changed property once per app */
+	for (i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		guint props = g_array_index (pending, guint, i);
+		g_object_freeze_notify (G_OBJECT (app));
+		for (j = PROP_0 + 1; j < PROP_LAST; j++) {
+			if (props & (1u << j))
+				g_object_notify_by_pspec (G_OBJECT (app), obj_props[j]);
+		}
+		g_object_thaw_notify (G_OBJECT (app));
+	}
 	return G_SOURCE_REMOVE;
 }
 
 static void
-gs_app_queue_notify (GsApp *app, const gchar *property_name)
+gs_app_queue_notify (GsApp *app, guint prop_id)
 {
-	AppNotifyData *notify_data;
-
-	notify_data = g_new (AppNotifyData, 1);
-	notify_data->app = g_object_ref (app);
-	notify_data->property_name = g_strdup (property_name);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&notify_mutex);
 
-	g_idle_add (notify_idle_cb, notify_data);
+	/* the array holds a ref until the notification is dispatched */
+	if (app->notify_pending == 0) {
+		if (notify_apps == NULL)
+			notify_apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+		g_ptr_array_add (notify_apps, g_object_ref (app));
+	}
+	app->notify_pending |= 1u << prop_id;
+	if (notify_source_id == 0)
+		notify_source_id = g_idle_add (notify_idle_cb, NULL);
 }
 
 /**
@@ -787,7 +816,7 @@ gs_app_set_state_recover (GsApp *app)
 	gs_app_set_progress (app, 0);
 
 	app->state = app->state_recover;
-	gs_app_queue_notify (app, "state");
+	gs_app_queue_notify (app, PROP_STATE);
 }
 
 /* mutex must be held */
@@ -909,6 +938,10 @@ gs_app_set_state_internal (GsApp *app, AsAppState state)
 
 	app->state = state;
 
+	/* plugins refine differently depending on the state */
+	app->refined_flags = 0;
+	app->refined_generation = 0;
+
 	if (state == AS_APP_STATE_UNKNOWN ||
 	    state == AS_APP_STATE_AVAILABLE_LOCAL ||
 	    state == AS_APP_STATE_AVAILABLE)
@@ -957,7 +990,7 @@ gs_app_set_progress (GsApp *app, guint percentage)
 		percentage = 100;
 	}
 	app->progress = percentage;
-	gs_app_queue_notify (app, "progress");
+	gs_app_queue_notify (app, PROP_PROGRESS);
 }
 
 /**
@@ -991,7 +1024,7 @@ gs_app_set_state (GsApp *app, AsAppState state)
 	g_return_if_fail (GS_IS_APP (app));
 
 	if (gs_app_set_state_internal (app, state))
-		gs_app_queue_notify (app, "state");
+		gs_app_queue_notify (app, PROP_STATE);
 }
 
 /**
@@ -1078,7 +1111,7 @@ gs_app_set_kind (GsApp *app, AsAppKind kind)
 	}
 
 	app->kind = kind;
-	gs_app_queue_notify (app, "kind");
+	gs_app_queue_notify (app, PROP_KIND);
 
 	/* no longer valid */
 	app->unique_id_valid = FALSE;
@@ -1797,7 +1830,7 @@ gs_app_ui_versions_populate (GsApp *app)
 		app->version_ui = gs_app_get_ui_version (app->version, flags[i]);
 		app->update_version_ui = gs_app_get_ui_version (app->update_version, flags[i]);
 		if (g_strcmp0 (app->version_ui, app->update_version_ui) != 0) {
-			gs_app_queue_notify (app, "version");
+			gs_app_queue_notify (app, PROP_VERSION);
 			return;
 		}
 		gs_app_ui_versions_invalidate (app);
@@ -1867,7 +1900,7 @@ gs_app_set_version (GsApp *app, const gchar *version)
 
 	if (_g_set_str (&app->version, version)) {
 		gs_app_ui_versions_invalidate (app);
-		gs_app_queue_notify (app, "version");
+		gs_app_queue_notify (app, PROP_VERSION);
 	}
 }
 
@@ -2370,7 +2403,7 @@ gs_app_set_update_version (GsApp *app, const gchar *update_version)
 	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&app->mutex);
 	g_return_if_fail (GS_IS_APP (app));
 	gs_app_set_update_version_internal (app, update_version);
-	gs_app_queue_notify (app, "version");
+	gs_app_queue_notify (app, PROP_VERSION);
 }
 
 /**
@@ -2545,7 +2578,7 @@ gs_app_set_rating (GsApp *app, gint rating)
 	if (rating == app->rating)
 		return;
 	app->rating = rating;
-	gs_app_queue_notify (app, "rating");
+	gs_app_queue_notify (app, PROP_RATING);
 }
 
 /**
@@ -3445,7 +3478,7 @@ gs_app_add_quirk (GsApp *app, AsAppQuirk quirk)
 	g_return_if_fail (GS_IS_APP (app));
 
 	app->quirk |= quirk;
-	gs_app_queue_notify (app, "quirk");
+	gs_app_queue_notify (app, PROP_QUIRK);
 }
 
 /**
@@ -3464,7 +3497,7 @@ gs_app_remove_quirk (GsApp *app, AsAppQuirk quirk)
 	g_return_if_fail (GS_IS_APP (app));
 
 	app->quirk &= ~quirk;
-	gs_app_queue_notify (app, "quirk");
+	gs_app_queue_notify (app, PROP_QUIRK);
 }
 
 /**
@@ -3540,6 +3573,75 @@ gs_app_get_priority (GsApp *app)
 	return app->priority;
 }
 
+/**
+ * gs_app_add_refined_flags:
+ * @app: a #GsApp
+ * @refine_flags: some #GsPluginRefineFlags, e.g. %GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON
+ * @generation: the metadata generation the flags were satisfied at
+ *
+ * Records that all the plugins have refined the application with
+ * @refine_flags. If @generation is newer than the generation previously
+ * recorded then any flags satisfied at the older generation are forgotten.
+ *
+ * Since: 3.26
+ **/
+void
+gs_app_add_refined_flags (GsApp *app, guint64 refine_flags, guint generation)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_return_if_fail (GS_IS_APP (app));
+	locker = g_mutex_locker_new (&app->mutex);
+	if (app->refined_generation != generation) {
+		app->refined_flags = 0;
+		app->refined_generation = generation;
+	}
+	app->refined_flags |= refine_flags;
+}
+
+/**
+ * gs_app_has_refined_flags:
+ * @app: a #GsApp
+ * @refine_flags: some #GsPluginRefineFlags, e.g. %GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON
+ * @generation: the current metadata generation
+ *
+ * Finds out if the application has already been refined with all of
+ * @refine_flags at @generation. Applications that have never been refined,
+ * or were refined against older metadata, always return %FALSE.
+ *
+ * Returns: %TRUE if refining again would be redundant
+ *
+ * Since: 3.26
+ **/
+gboolean
+gs_app_has_refined_flags (GsApp *app, guint64 refine_flags, guint generation)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_return_val_if_fail (GS_IS_APP (app), FALSE);
+	locker = g_mutex_locker_new (&app->mutex);
+	if (generation == 0 || app->refined_generation != generation)
+		return FALSE;
+	return (app->refined_flags & refine_flags) == refine_flags;
+}
+
+/**
+ * gs_app_invalidate_refined_flags:
+ * @app: a #GsApp
+ *
+ * Forgets which #GsPluginRefineFlags have been satisfied, so that the next
+ * refine runs all the plugins again.
+ *
+ * Since: 3.26
+ **/
+void
+gs_app_invalidate_refined_flags (GsApp *app)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_return_if_fail (GS_IS_APP (app));
+	locker = g_mutex_locker_new (&app->mutex);
+	app->refined_flags = 0;
+	app->refined_generation = 0;
+}
+
 static void
 gs_app_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
 {
@@ -3718,6 +3820,7 @@ gs_app_class_init (GsAppClass *klass)
 	pspec = g_param_spec_string ("id", NULL, NULL,
 				     NULL,
 				     G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+	obj_props[PROP_ID] = pspec;
 	g_object_class_install_property (object_class, PROP_ID, pspec);
 
 	/**
@@ -3726,6 +3829,7 @@ gs_app_class_init (GsAppClass *klass)
 	pspec = g_param_spec_string ("name", NULL, NULL,
 				     NULL,
 				     G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+	obj_props[PROP_NAME] = pspec;
 	g_object_class_install_property (object_class, PROP_NAME, pspec);
 
 	/**
@@ -3734,6 +3838,7 @@ gs_app_class_init (GsAppClass *klass)
 	pspec = g_param_spec_string ("version", NULL, NULL,
 				     NULL,
 				     G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+	obj_props[PROP_VERSION] = pspec;
 	g_object_class_install_property (object_class, PROP_VERSION, pspec);
 
 	/**
@@ -3742,6 +3847,7 @@ gs_app_class_init (GsAppClass *klass)
 	pspec = g_param_spec_string ("summary", NULL, NULL,
 				     NULL,
 				     G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+	obj_props[PROP_SUMMARY] = pspec;
 	g_object_class_install_property (object_class, PROP_SUMMARY, pspec);
 
 	/**
@@ -3750,6 +3856,7 @@ gs_app_class_init (GsAppClass *klass)
 	pspec = g_param_spec_string ("description", NULL, NULL,
 				     NULL,
 				     G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+	obj_props[PROP_DESCRIPTION] = pspec;
 	g_object_class_install_property (object_class, PROP_DESCRIPTION, pspec);
 
 	/**
@@ -3758,6 +3865,7 @@ gs_app_class_init (GsAppClass *klass)
 	pspec = g_param_spec_int ("rating", NULL, NULL,
 				  -1, 100, -1,
 				  G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+	obj_props[PROP_RATING] = pspec;
 	g_object_class_install_property (object_class, PROP_RATING, pspec);
 
 	/**
@@ -3768,6 +3876,7 @@ gs_app_class_init (GsAppClass *klass)
 				   AS_APP_KIND_LAST,
 				   AS_APP_KIND_UNKNOWN,
 				   G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+	obj_props[PROP_KIND] = pspec;
 	g_object_class_install_property (object_class, PROP_KIND, pspec);
 
 	/**
@@ -3778,6 +3887,7 @@ gs_app_class_init (GsAppClass *klass)
 				   AS_APP_STATE_LAST,
 				   AS_APP_STATE_UNKNOWN,
 				   G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+	obj_props[PROP_STATE] = pspec;
 	g_object_class_install_property (object_class, PROP_STATE, pspec);
 
 	/**
@@ -3785,6 +3895,7 @@ gs_app_class_init (GsAppClass *klass)
 	 */
 	pspec = g_param_spec_uint ("progress", NULL, NULL, 0, 100, 0,
 				   G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+	obj_props[PROP_PROGRESS] = pspec;
 	g_object_class_install_property (object_class, PROP_PROGRESS, pspec);
 
 	/**
@@ -3793,6 +3904,7 @@ gs_app_class_init (GsAppClass *klass)
 	pspec = g_param_spec_uint64 ("install-date", NULL, NULL,
 				     0, G_MAXUINT64, 0,
 				     G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+	obj_props[PROP_INSTALL_DATE] = pspec;
 	g_object_class_install_property (object_class, PROP_INSTALL_DATE, pspec);
 
 	/**
@@ -3801,6 +3913,7 @@ gs_app_class_init (GsAppClass *klass)
 	pspec = g_param_spec_uint64 ("quirk", NULL, NULL,
 				     0, G_MAXUINT64, 0,
 				     G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+	obj_props[PROP_QUIRK] = pspec;
 	g_object_class_install_property (object_class, PROP_QUIRK, pspec);
 }
 
@@ -135,6 +135,62 @@ gs_plugin_job_to_string (GsPluginJob *self)
 	return g_string_free (str, FALSE);
 }
 
+/* the same for any two jobs that are only queries and would return the same
+ * results, or %NULL if the job cannot be shared with another caller */
+gchar *
+gs_plugin_job_get_fingerprint (GsPluginJob *self)
+{
+	GString *str;
+
+	g_return_val_if_fail (GS_IS_PLUGIN_JOB (self), NULL);
+
+	switch (self->action) {
+	case GS_PLUGIN_ACTION_GET_UPDATES:
+	case GS_PLUGIN_ACTION_GET_DISTRO_UPDATES:
+	case GS_PLUGIN_ACTION_GET_UNVOTED_REVIEWS:
+	case GS_PLUGIN_ACTION_GET_SOURCES:
+	case GS_PLUGIN_ACTION_GET_INSTALLED:
+	case GS_PLUGIN_ACTION_GET_POPULAR:
+	case GS_PLUGIN_ACTION_GET_FEATURED:
+	case GS_PLUGIN_ACTION_SEARCH:
+	case GS_PLUGIN_ACTION_SEARCH_FILES:
+	case GS_PLUGIN_ACTION_SEARCH_PROVIDES:
+	case GS_PLUGIN_ACTION_GET_CATEGORY_APPS:
+	case GS_PLUGIN_ACTION_GET_RECENT:
+	case GS_PLUGIN_ACTION_GET_UPDATES_HISTORICAL:
+		break;
+	default:
+		return NULL;
+	}
+	if (self->app != NULL || self->file != NULL || self->auth != NULL ||
+	    self->review != NULL || self->price != NULL)
+		return NULL;
+	if (self->list != NULL && gs_app_list_length (self->list) > 0)
+		return NULL;
+
+	str = g_string_new (gs_plugin_action_to_string (self->action));
+	g_string_append_printf (str, ":%" G_GUINT64_FORMAT
+				":%" G_GUINT64_FORMAT
+				":%" G_GUINT64_FORMAT
+				":%u:%" G_GUINT64_FORMAT ":%p:%p",
+				(guint64) self->refine_flags,
+				(guint64) self->refresh_flags,
+				(guint64) self->failure_flags,
+				self->max_results,
+				self->age,
+				self->sort_func,
+				self->sort_func_data);
+	if (self->category != NULL) {
+		GsCategory *parent = gs_category_get_parent (self->category);
+		g_string_append_printf (str, ":%s/%s",
+					parent != NULL ? gs_category_get_id (parent) : "",
+					gs_category_get_id (self->category));
+	}
+	if (self->search != NULL)
+		g_string_append_printf (str, ":%s", self->search);
+	return g_string_free (str, FALSE);
+}
+
 void
 gs_plugin_job_set_refine_flags (GsPluginJob *self, GsPluginRefineFlags refine_flags)
 {
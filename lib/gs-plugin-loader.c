@@ -33,10 +33,14 @@
 #include "gs-plugin-event.h"
 #include "gs-plugin-job-private.h"
 #include "gs-plugin-private.h"
+#include "gs-refine-cache.h"
 #include "gs-utils.h"
 
 #define GS_PLUGIN_LOADER_UPDATES_CHANGED_DELAY	3	/* s */
 #define GS_PLUGIN_LOADER_RELOAD_DELAY		5	/* s */
+#define GS_PLUGIN_LOADER_JOBS_INTERACTIVE_MIN	10
+#define GS_PLUGIN_LOADER_JOBS_BACKGROUND_MAX	1
+#define GS_PLUGIN_LOADER_BACKGROUND_DEFER_MAX	30	/* s */
 
 typedef struct
 {
@@ -45,6 +49,8 @@ typedef struct
 	gchar			*locale;
 	gchar			*language;
 	GsAppList		*global_cache;
+	guint			 global_cache_size_max;
+	guint			 global_cache_evictions;	/* atomic */
 	AsProfile		*profile;
 	SoupSession		*soup_session;
 	GPtrArray		*auth_array;
@@ -68,6 +74,21 @@ typedef struct
 
 	GNetworkMonitor		*network_monitor;
 	gulong			 network_changed_handler;
+
+	GThreadPool		*worker_pool;
+	gint			 generation;		/* atomic */
+	gint			 refine_id;		/* atomic */
+
+	GThreadPool		*job_pool_interactive;
+	GThreadPool		*job_pool_background;
+	GMutex			 job_mutex;
+	GCond			 job_cond;
+	guint			 jobs_interactive;	/* queued or running */
+	GHashTable		*jobs_shared;		/* fingerprint : GsPluginLoaderJobShared */
+
+	GsRefineCache		*refine_cache;		/* allow-none */
+	GMutex			 refine_cache_mutex;
+	gint64			 refine_cache_saved;	/* monotonic */
 } GsPluginLoaderPrivate;
 
 static void gs_plugin_loader_monitor_network (GsPluginLoader *plugin_loader);
@@ -178,12 +199,15 @@ typedef void		 (*GsPluginAdoptAppFunc)	(GsPlugin	*plugin,
 /* async helper */
 typedef struct {
 	GsPluginLoader			*plugin_loader;
-	const gchar			*function_name;
+	GsPluginVfunc			 vfunc;
 	const gchar			*function_name_parent;
 	GPtrArray			*catlist;
 	GsPluginJob			*plugin_job;
 	gboolean			 anything_ran;
 	gchar				**tokens;
+	gboolean			 background;
+	gint64				 defer_until;	/* monotonic */
+	guint				 refine_id;
 } GsPluginLoaderHelper;
 
 static GsPluginLoaderHelper *
@@ -193,7 +217,8 @@ gs_plugin_loader_helper_new (GsPluginLoader *plugin_loader, GsPluginJob *plugin_
 	GsPluginAction action = gs_plugin_job_get_action (plugin_job);
 	helper->plugin_loader = g_object_ref (plugin_loader);
 	helper->plugin_job = g_object_ref (plugin_job);
-	helper->function_name = gs_plugin_action_to_function_name (action);
+	helper->vfunc = gs_plugin_action_to_vfunc (action);
+	helper->background = gs_plugin_loader_job_is_background (plugin_job);
 	return helper;
 }
 
@@ -218,6 +243,151 @@ gs_plugin_loader_job_debug (GsPluginLoaderHelper *helper)
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(GsPluginLoaderHelper, gs_plugin_loader_helper_free)
 
+/* work that nobody is waiting on, and so can give way to the user */
+static gboolean
+gs_plugin_loader_job_is_background (GsPluginJob *plugin_job)
+{
+	switch (gs_plugin_job_get_action (plugin_job)) {
+	case GS_PLUGIN_ACTION_REFRESH:
+	case GS_PLUGIN_ACTION_GET_UPDATES_HISTORICAL:
+		return TRUE;
+	case GS_PLUGIN_ACTION_UNKNOWN:
+		/* the update monitor refreshes like this */
+		return gs_plugin_job_get_refresh_flags (plugin_job) != GS_PLUGIN_REFRESH_FLAGS_NONE;
+	default:
+		return FALSE;
+	}
+}
+
+/* jobs mostly wait on the network or other processes, so allow more than
+ * there are processors; GNOME_SOFTWARE_MAX_JOBS overrides this */
+static gint
+gs_plugin_loader_get_jobs_interactive_max (void)
+{
+	const gchar *tmp = g_getenv ("GNOME_SOFTWARE_MAX_JOBS");
+	if (tmp != NULL) {
+		guint64 value = g_ascii_strtoull (tmp, NULL, 10);
+		if (value > 0 && value <= G_MAXINT)
+			return (gint) value;
+		g_warning ("ignoring invalid GNOME_SOFTWARE_MAX_JOBS=%s", tmp);
+	}
+	return (gint) MAX (g_get_num_processors () * 2,
+			   GS_PLUGIN_LOADER_JOBS_INTERACTIVE_MIN);
+}
+
+/* waits for any interactive jobs to finish, but only while the background
+ * job has not already been held up for too long in total */
+static void
+gs_plugin_loader_job_defer (GsPluginLoaderHelper *helper,
+			    GCancellable *cancellable)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (helper->plugin_loader);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	if (!helper->background || helper->defer_until == 0)
+		return;
+	locker = g_mutex_locker_new (&priv->job_mutex);
+	while (priv->jobs_interactive > 0) {
+		if (g_cancellable_is_cancelled (cancellable))
+			return;
+		if (!g_cond_wait_until (&priv->job_cond, &priv->job_mutex,
+					helper->defer_until)) {
+			g_debug ("not deferring background job any longer");
+			helper->defer_until = 0;
+			return;
+		}
+	}
+}
+
+typedef struct {
+	GTask		*task;
+	GTaskThreadFunc	 func;
+} GsPluginLoaderJobItem;
+
+static gboolean
+gs_plugin_loader_job_unref_cb (gpointer user_data)
+{
+	g_object_unref (user_data);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+gs_plugin_loader_job_thread_cb (gpointer data, gpointer user_data)
+{
+	GsPluginLoaderJobItem *item = (GsPluginLoaderJobItem *) data;
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (user_data);
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	GsPluginLoaderHelper *helper = g_task_get_task_data (item->task);
+	GCancellable *cancellable = g_task_get_cancellable (item->task);
+
+	if (helper->background) {
+		helper->defer_until = g_get_monotonic_time () +
+			GS_PLUGIN_LOADER_BACKGROUND_DEFER_MAX * G_TIME_SPAN_SECOND;
+		gs_plugin_loader_job_defer (helper, cancellable);
+	}
+	item->func (item->task,
+		    g_task_get_source_object (item->task),
+		    helper,
+		    cancellable);
+
+	/* let any deferred background jobs continue */
+	if (!helper->background) {
+		g_mutex_lock (&priv->job_mutex);
+		if (--priv->jobs_interactive == 0)
+			g_cond_broadcast (&priv->job_cond);
+		g_mutex_unlock (&priv->job_mutex);
+	}
+
+	/* the task may hold the last reference to the loader, which must not
+	 * be disposed from inside one of its own pools */
+	g_idle_add (gs_plugin_loader_job_unref_cb, item->task);
+	g_slice_free (GsPluginLoaderJobItem, item);
+}
+
+/* runs the task in a thread, in the same way as g_task_run_in_thread(), but
+ * with background jobs in their own pool so they cannot hold up the UI */
+static void
+gs_plugin_loader_job_schedule (GsPluginLoader *plugin_loader,
+			       GTask *task,
+			       GTaskThreadFunc func)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	GsPluginLoaderHelper *helper = g_task_get_task_data (task);
+	GsPluginLoaderJobItem *item;
+
+	item = g_slice_new0 (GsPluginLoaderJobItem);
+	item->task = g_object_ref (task);
+	item->func = func;
+	if (helper->background) {
+		g_thread_pool_push (priv->job_pool_background, item, NULL);
+		return;
+	}
+	g_mutex_lock (&priv->job_mutex);
+	priv->jobs_interactive++;
+	g_mutex_unlock (&priv->job_mutex);
+	g_thread_pool_push (priv->job_pool_interactive, item, NULL);
+}
+
+/* a plugin being run on the worker pool */
+typedef gboolean	 (*GsPluginLoaderWorkerFunc)	(GsPluginLoaderHelper *helper,
+							 GsPlugin	*plugin,
+							 GsAppList	*list,
+							 GCancellable	*cancellable,
+							 GError		**error);
+typedef struct {
+	GsPluginLoaderHelper		*helper;
+	GsPlugin			*plugin;
+	GsAppList			*list;
+	GCancellable			*cancellable;
+	GsPluginLoaderWorkerFunc	 func;
+	gboolean			 ret;
+	GError				*error;
+	GMutex				*mutex;
+	GCond				*cond;
+	guint				*pending;
+	gboolean			*failed;
+} GsPluginLoaderWorkItem;
+
 static gint
 gs_plugin_loader_app_sort_name_cb (GsApp *app1, GsApp *app2, gpointer user_data)
 {
@@ -362,6 +532,32 @@ gs_plugin_loader_is_error_fatal (GsPluginFailureFlags failure_flags,
 	return FALSE;
 }
 
+/* a plugin could not add its data to @app, e.g. when offline, so the refine
+ * should not be remembered as done */
+static void
+gs_plugin_loader_refine_failed (GsPluginLoaderHelper *helper, GsApp *app)
+{
+	if (app == NULL || helper->refine_id == 0)
+		return;
+	g_object_set_data (G_OBJECT (app), "GsPluginLoader::refine-failed",
+			   GUINT_TO_POINTER (helper->refine_id));
+}
+
+static void
+gs_plugin_loader_refine_failed_list (GsPluginLoaderHelper *helper, GsAppList *list)
+{
+	for (guint i = 0; i < gs_app_list_length (list); i++)
+		gs_plugin_loader_refine_failed (helper, gs_app_list_index (list, i));
+}
+
+static gboolean
+gs_plugin_loader_get_refine_failed (GsPluginLoaderHelper *helper, GsApp *app)
+{
+	gpointer refine_id = g_object_get_data (G_OBJECT (app),
+						"GsPluginLoader::refine-failed");
+	return GPOINTER_TO_UINT (refine_id) == helper->refine_id;
+}
+
 static gboolean
 gs_plugin_error_handle_failure (GsPluginLoaderHelper *helper,
 				GsPlugin *plugin,
@@ -374,7 +570,7 @@ gs_plugin_error_handle_failure (GsPluginLoaderHelper *helper,
 	if (error_local == NULL) {
 		g_critical ("%s did not set error for %s",
 			    gs_plugin_get_name (plugin),
-			    helper->function_name);
+			    gs_plugin_vfunc_to_function_name (helper->vfunc));
 		return TRUE;
 	}
 
@@ -401,7 +597,7 @@ gs_plugin_error_handle_failure (GsPluginLoaderHelper *helper,
 				      GS_PLUGIN_ERROR,
 				      GS_PLUGIN_ERROR_CANCELLED)) {
 			g_warning ("failed to call %s on %s: %s",
-				   helper->function_name,
+				   gs_plugin_vfunc_to_function_name (helper->vfunc),
 				   gs_plugin_get_name (plugin),
 				   error_local->message);
 		}
@@ -421,7 +617,7 @@ gs_plugin_loader_run_adopt (GsPluginLoader *plugin_loader, GsAppList *list)
 	for (i = 0; i < priv->plugins->len; i++) {
 		GsPluginAdoptAppFunc adopt_app_func = NULL;
 		GsPlugin *plugin = g_ptr_array_index (priv->plugins, i);
-		adopt_app_func = gs_plugin_get_symbol (plugin, "gs_plugin_adopt_app");
+		adopt_app_func = gs_plugin_get_vfunc (plugin, GS_PLUGIN_VFUNC_ADOPT_APP);
 		if (adopt_app_func == NULL)
 			continue;
 		for (j = 0; j < gs_app_list_length (list); j++) {
@@ -473,32 +669,35 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (helper->plugin_loader);
 	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
 	gboolean ret = TRUE;
+	gdouble elapsed;
+	gint64 time_start;
 	gpointer func = NULL;
 	g_autoptr(GError) error_local = NULL;
-	g_autoptr(GTimer) timer = g_timer_new ();
 	g_autoptr(AsProfileTask) ptask = NULL;
 
 	/* load the possible symbol */
-	func = gs_plugin_get_symbol (plugin, helper->function_name);
+	func = gs_plugin_get_vfunc (plugin, helper->vfunc);
 	if (func == NULL)
 		return TRUE;
 
 	/* profile */
-	if (g_strcmp0 (helper->function_name, "gs_plugin_refine_app") != 0) {
+	if (helper->vfunc != GS_PLUGIN_VFUNC_REFINE_APP) {
+		const gchar *function_name = gs_plugin_vfunc_to_function_name (helper->vfunc);
 		if (helper->function_name_parent == NULL) {
 			ptask = as_profile_start (priv->profile,
 						  "GsPlugin::%s(%s)",
 						  gs_plugin_get_name (plugin),
-						  helper->function_name);
+						  function_name);
 		} else {
 			ptask = as_profile_start (priv->profile,
 						  "GsPlugin::%s(%s;%s)",
 						  gs_plugin_get_name (plugin),
 						  helper->function_name_parent,
-						  helper->function_name);
+						  function_name);
 		}
 		g_assert (ptask != NULL);
 	}
+	time_start = g_get_monotonic_time ();
 
 	/* fallback if unset */
 	if (app == NULL)
@@ -506,6 +705,17 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 	if (list == NULL)
 		list = gs_plugin_job_get_list (helper->plugin_job);
 
+	/* give way to the user, and to other jobs using the same plugin */
+	gs_plugin_loader_job_defer (helper, cancellable);
+	if (!gs_plugin_acquire_job_slot (plugin, cancellable)) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_CANCELLED,
+			     "cancelled while waiting for %s",
+			     gs_plugin_get_name (plugin));
+		return FALSE;
+	}
+
 	/* run the correct vfunc */
 	gs_plugin_loader_action_start (helper->plugin_loader, plugin, FALSE);
 	switch (action) {
@@ -523,37 +733,37 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 		}
 		break;
 	case GS_PLUGIN_ACTION_REFINE:
-		if (g_strcmp0 (helper->function_name, "gs_plugin_refine_wildcard") == 0) {
+		if (helper->vfunc == GS_PLUGIN_VFUNC_REFINE_WILDCARD) {
 			GsPluginRefineWildcardFunc plugin_func = func;
 			ret = plugin_func (plugin, app, list,
 					   gs_plugin_job_get_refine_flags (helper->plugin_job),
 					   cancellable, &error_local);
-		} else if (g_strcmp0 (helper->function_name, "gs_plugin_refine_app") == 0) {
+		} else if (helper->vfunc == GS_PLUGIN_VFUNC_REFINE_APP) {
 			GsPluginRefineAppFunc plugin_func = func;
 			ret = plugin_func (plugin, app,
 					   gs_plugin_job_get_refine_flags (helper->plugin_job),
 					   cancellable, &error_local);
-		} else if (g_strcmp0 (helper->function_name, "gs_plugin_refine") == 0) {
+		} else if (helper->vfunc == GS_PLUGIN_VFUNC_REFINE) {
 			GsPluginRefineFunc plugin_func = func;
 			ret = plugin_func (plugin, list,
 					   gs_plugin_job_get_refine_flags (helper->plugin_job),
 					   cancellable, &error_local);
 		} else {
 			g_critical ("function_name %s invalid for %s",
-				    helper->function_name,
+				    gs_plugin_vfunc_to_function_name (helper->vfunc),
 				    gs_plugin_action_to_string (action));
 		}
 		break;
 	case GS_PLUGIN_ACTION_UPDATE:
-		if (g_strcmp0 (helper->function_name, "gs_plugin_update_app") == 0) {
+		if (helper->vfunc == GS_PLUGIN_VFUNC_UPDATE_APP) {
 			GsPluginActionFunc plugin_func = func;
 			ret = plugin_func (plugin, app, cancellable, &error_local);
-		} else if (g_strcmp0 (helper->function_name, "gs_plugin_update") == 0) {
+		} else if (helper->vfunc == GS_PLUGIN_VFUNC_UPDATE) {
 			GsPluginUpdateFunc plugin_func = func;
 			ret = plugin_func (plugin, list, cancellable, &error_local);
 		} else {
 			g_critical ("function_name %s invalid for %s",
-				    helper->function_name,
+				    gs_plugin_vfunc_to_function_name (helper->vfunc),
 				    gs_plugin_action_to_string (action));
 		}
 		break;
@@ -682,11 +892,19 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 		}
 		break;
 	default:
-		g_critical ("no handler for %s", helper->function_name);
+		g_critical ("no handler for %s",
+			    gs_plugin_vfunc_to_function_name (helper->vfunc));
 		break;
 	}
 	gs_plugin_loader_action_stop (helper->plugin_loader, plugin);
+	gs_plugin_release_job_slot (plugin);
 	if (!ret) {
+		if (action == GS_PLUGIN_ACTION_REFINE) {
+			if (list != NULL && helper->vfunc == GS_PLUGIN_VFUNC_REFINE)
+				gs_plugin_loader_refine_failed_list (helper, list);
+			else
+				gs_plugin_loader_refine_failed (helper, app);
+		}
 		return gs_plugin_error_handle_failure (helper,
 							plugin,
 							error_local,
@@ -694,22 +912,23 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 	}
 
 	/* check the plugin didn't take too long */
+	elapsed = (gdouble) (g_get_monotonic_time () - time_start) / G_USEC_PER_SEC;
 	switch (action) {
 	case GS_PLUGIN_ACTION_INITIALIZE:
 	case GS_PLUGIN_ACTION_DESTROY:
 	case GS_PLUGIN_ACTION_SETUP:
-		if (g_timer_elapsed (timer, NULL) > 0.5f) {
+		if (elapsed > 0.5f) {
 			g_warning ("plugin %s took %.1f seconds to do %s",
 				   gs_plugin_get_name (plugin),
-				   g_timer_elapsed (timer, NULL),
+				   elapsed,
 				   gs_plugin_action_to_string (action));
 		}
 		break;
 	default:
-		if (g_timer_elapsed (timer, NULL) > 0.5f) {
+		if (elapsed > 0.5f) {
 			g_debug ("plugin %s took %.1f seconds to do %s",
 				 gs_plugin_get_name (plugin),
-				 g_timer_elapsed (timer, NULL),
+				 elapsed,
 				 gs_plugin_action_to_string (action));
 			}
 		break;
@@ -720,13 +939,316 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 	return TRUE;
 }
 
+static void
+gs_plugin_loader_worker_cb (gpointer data, gpointer user_data)
+{
+	GsPluginLoaderWorkItem *item = (GsPluginLoaderWorkItem *) data;
+	gboolean failed;
+
+	/* another plugin in the stage has already failed the job */
+	g_mutex_lock (item->mutex);
+	failed = *item->failed;
+	g_mutex_unlock (item->mutex);
+	if (failed) {
+		item->ret = TRUE;
+	} else {
+		item->ret = item->func (item->helper,
+					item->plugin,
+					item->list,
+					item->cancellable,
+					&item->error);
+	}
+
+	/* wake up the thread waiting for the stage to finish */
+	g_mutex_lock (item->mutex);
+	if (!item->ret)
+		*item->failed = TRUE;
+	if (--(*item->pending) == 0)
+		g_cond_signal (item->cond);
+	g_mutex_unlock (item->mutex);
+}
+
+/* apply the changes made by a plugin to its private copy of the list */
+static void
+gs_plugin_loader_merge_list (GsAppList *list,
+			     GsAppList *list_old,
+			     GsAppList *list_new)
+{
+	g_autoptr(GHashTable) old = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_autoptr(GHashTable) new = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	for (guint i = 0; i < gs_app_list_length (list_old); i++)
+		g_hash_table_add (old, gs_app_list_index (list_old, i));
+	for (guint i = 0; i < gs_app_list_length (list_new); i++)
+		g_hash_table_add (new, gs_app_list_index (list_new, i));
+	for (guint i = 0; i < gs_app_list_length (list_old); i++) {
+		GsApp *app = gs_app_list_index (list_old, i);
+		if (!g_hash_table_contains (new, app))
+			gs_app_list_remove (list, app);
+	}
+	for (guint i = 0; i < gs_app_list_length (list_new); i++) {
+		GsApp *app = gs_app_list_index (list_new, i);
+		if (!g_hash_table_contains (old, app))
+			gs_app_list_add (list, app);
+	}
+}
+
+/* runs @func on each plugin at the same time and waits for them all to finish,
+ * returning the error from the first plugin in @plugins that failed */
+static gboolean
+gs_plugin_loader_run_parallel (GsPluginLoaderHelper *helper,
+			       GPtrArray *plugins,
+			       GsAppList *list,
+			       GsPluginLoaderWorkerFunc func,
+			       GCancellable *cancellable,
+			       GError **error)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (helper->plugin_loader);
+	GMutex mutex;
+	GCond cond;
+	guint pending = plugins->len;
+	gboolean failed = FALSE;
+	gboolean ret = TRUE;
+	g_autoptr(GsAppList) list_old = NULL;
+	g_autofree GsPluginLoaderWorkItem *items = NULL;
+
+	/* no point using a thread */
+	if (plugins->len == 0)
+		return TRUE;
+	if (plugins->len == 1) {
+		return func (helper, g_ptr_array_index (plugins, 0), list,
+			     cancellable, error);
+	}
+
+	/* wait here rather than in the workers, which are shared with the
+	 * interactive jobs */
+	gs_plugin_loader_job_defer (helper, cancellable);
+
+	/* each plugin gets its own helper and copy of the list as the vfuncs
+	 * are allowed to modify them */
+	g_mutex_init (&mutex);
+	g_cond_init (&cond);
+	if (list != NULL)
+		list_old = gs_app_list_copy (list);
+	items = g_new0 (GsPluginLoaderWorkItem, plugins->len);
+	for (guint i = 0; i < plugins->len; i++) {
+		GsPluginLoaderWorkItem *item = &items[i];
+		item->helper = gs_plugin_loader_helper_new (helper->plugin_loader,
+							    helper->plugin_job);
+		item->helper->function_name_parent = helper->function_name_parent;
+		item->helper->background = helper->background;
+		item->helper->refine_id = helper->refine_id;
+		item->plugin = g_ptr_array_index (plugins, i);
+		if (list != NULL)
+			item->list = gs_app_list_copy (list);
+		item->cancellable = cancellable;
+		item->func = func;
+		item->mutex = &mutex;
+		item->cond = &cond;
+		item->pending = &pending;
+		item->failed = &failed;
+	}
+	g_mutex_lock (&mutex);
+	for (guint i = 0; i < plugins->len; i++)
+		g_thread_pool_push (priv->worker_pool, &items[i], NULL);
+	while (pending > 0)
+		g_cond_wait (&cond, &mutex);
+	g_mutex_unlock (&mutex);
+
+	/* merge back the results in plugin order, unless the job failed */
+	for (guint i = 0; i < plugins->len; i++) {
+		GsPluginLoaderWorkItem *item = &items[i];
+		if (item->helper->anything_ran)
+			helper->anything_ran = TRUE;
+		if (item->list != NULL) {
+			if (!failed)
+				gs_plugin_loader_merge_list (list, list_old, item->list);
+			g_object_unref (item->list);
+		}
+		if (!item->ret && ret) {
+			g_propagate_error (error, item->error);
+			item->error = NULL;
+			ret = FALSE;
+		}
+		g_clear_error (&item->error);
+		gs_plugin_loader_helper_free (item->helper);
+	}
+	g_cond_clear (&cond);
+	g_mutex_clear (&mutex);
+	return ret;
+}
+
+/* adapts the per-app refine vfunc to a batch, so that plugins not providing
+ * gs_plugin_refine() only pay the profiling and locking cost once per list */
+static gboolean
+gs_plugin_loader_run_refine_app_batch (GsPluginLoaderHelper *helper,
+				       GsPlugin *plugin,
+				       GsAppList *list,
+				       GCancellable *cancellable,
+				       GError **error)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (helper->plugin_loader);
+	GsPluginRefineAppFunc plugin_func;
+	GsPluginRefineFlags refine_flags;
+	gboolean ret = TRUE;
+	g_autoptr(AsProfileTask) ptask = NULL;
+
+	/* load the possible symbol */
+	helper->vfunc = GS_PLUGIN_VFUNC_REFINE_APP;
+	plugin_func = gs_plugin_get_vfunc (plugin, helper->vfunc);
+	if (plugin_func == NULL)
+		return TRUE;
+
+	/* profile the entire batch */
+	if (helper->function_name_parent == NULL) {
+		ptask = as_profile_start (priv->profile,
+					  "GsPlugin::%s(gs_plugin_refine_app)",
+					  gs_plugin_get_name (plugin));
+	} else {
+		ptask = as_profile_start (priv->profile,
+					  "GsPlugin::%s(%s;gs_plugin_refine_app)",
+					  gs_plugin_get_name (plugin),
+					  helper->function_name_parent);
+	}
+	g_assert (ptask != NULL);
+
+	/* give way to the user, and to other jobs using the same plugin */
+	gs_plugin_loader_job_defer (helper, cancellable);
+	if (!gs_plugin_acquire_job_slot (plugin, cancellable)) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_CANCELLED,
+			     "cancelled while waiting for %s",
+			     gs_plugin_get_name (plugin));
+		return FALSE;
+	}
+
+	/* run for each app that is not a wildcard */
+	refine_flags = gs_plugin_job_get_refine_flags (helper->plugin_job);
+	gs_plugin_loader_action_start (helper->plugin_loader, plugin, FALSE);
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		g_autoptr(GError) error_local = NULL;
+		if (gs_app_has_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX))
+			continue;
+		if (!plugin_func (plugin, app, refine_flags,
+				  cancellable, &error_local)) {
+			gs_plugin_loader_refine_failed (helper, app);
+			if (!gs_plugin_error_handle_failure (helper,
+							     plugin,
+							     error_local,
+							     error)) {
+				ret = FALSE;
+				break;
+			}
+		}
+	}
+	gs_plugin_loader_action_stop (helper->plugin_loader, plugin);
+	gs_plugin_release_job_slot (plugin);
+	if (!ret)
+		return FALSE;
+
+	/* success */
+	helper->anything_ran = TRUE;
+	return TRUE;
+}
+
+static gboolean
+gs_plugin_loader_run_refine_plugin (GsPluginLoaderHelper *helper,
+				    GsPlugin *plugin,
+				    GsAppList *list,
+				    GCancellable *cancellable,
+				    GError **error)
+{
+	g_autoptr(GsAppList) app_list = NULL;
+
+	/* run the batched plugin symbol */
+	helper->vfunc = GS_PLUGIN_VFUNC_REFINE;
+	if (!gs_plugin_loader_call_vfunc (helper, plugin, NULL, list,
+					  cancellable, error)) {
+		return FALSE;
+	}
+
+	/* use a copy of the list for the loop because a function called
+	 * on the plugin may affect the list which can lead to problems
+	 * (e.g. inserting an app in the list on every call results in
+	 * an infinite loop) */
+	app_list = gs_app_list_copy (list);
+
+	/* then the per-app plugin symbol */
+	if (!gs_plugin_loader_run_refine_app_batch (helper, plugin, app_list,
+						    cancellable, error)) {
+		return FALSE;
+	}
+
+	/* then any wildcards */
+	helper->vfunc = GS_PLUGIN_VFUNC_REFINE_WILDCARD;
+	if (gs_plugin_get_vfunc (plugin, helper->vfunc) != NULL) {
+		for (guint j = 0; j < gs_app_list_length (app_list); j++) {
+			GsApp *app = gs_app_list_index (app_list, j);
+			if (!gs_app_has_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX))
+				continue;
+			if (!gs_plugin_loader_call_vfunc (helper, plugin, app, NULL,
+							  cancellable, error)) {
+				return FALSE;
+			}
+		}
+	}
+	gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
+	return TRUE;
+}
+
+static gboolean
+gs_plugin_loader_plugin_has_refine (GsPlugin *plugin)
+{
+	if (gs_plugin_get_vfunc (plugin, GS_PLUGIN_VFUNC_REFINE) != NULL)
+		return TRUE;
+	if (gs_plugin_get_vfunc (plugin, GS_PLUGIN_VFUNC_REFINE_APP) != NULL)
+		return TRUE;
+	if (gs_plugin_get_vfunc (plugin, GS_PLUGIN_VFUNC_REFINE_WILDCARD) != NULL)
+		return TRUE;
+	return FALSE;
+}
+
+/* the depsolver guarantees that plugins with the same order have no
+ * run-after or run-before rules between them, so each set of plugins with
+ * the same order is a stage that can be run at the same time */
+static gboolean
+gs_plugin_loader_run_refine_stages (GsPluginLoaderHelper *helper,
+				    GsAppList *list,
+				    GCancellable *cancellable,
+				    GError **error)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (helper->plugin_loader);
+	g_autoptr(GPtrArray) stage = g_ptr_array_new ();
+
+	for (guint i = 0; i < priv->plugins->len; i++) {
+		GsPlugin *plugin = g_ptr_array_index (priv->plugins, i);
+		if (!gs_plugin_loader_plugin_has_refine (plugin))
+			continue;
+		if (stage->len > 0) {
+			GsPlugin *plugin_tmp = g_ptr_array_index (stage, 0);
+			if (gs_plugin_get_order (plugin) != gs_plugin_get_order (plugin_tmp)) {
+				if (!gs_plugin_loader_run_parallel (helper, stage, list,
+								    gs_plugin_loader_run_refine_plugin,
+								    cancellable, error))
+					return FALSE;
+				g_ptr_array_set_size (stage, 0);
+			}
+		}
+		g_ptr_array_add (stage, plugin);
+	}
+	return gs_plugin_loader_run_parallel (helper, stage, list,
+					      gs_plugin_loader_run_refine_plugin,
+					      cancellable, error);
+}
+
 static gboolean
 gs_plugin_loader_run_refine_internal (GsPluginLoaderHelper *helper,
 				      GsAppList *list,
 				      GCancellable *cancellable,
 				      GError **error)
 {
-	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (helper->plugin_loader);
 	guint i;
 	guint j;
 	GPtrArray *addons;
@@ -736,38 +1258,10 @@ gs_plugin_loader_run_refine_internal (GsPluginLoaderHelper *helper,
 	/* try to adopt each application with a plugin */
 	gs_plugin_loader_run_adopt (helper->plugin_loader, list);
 
-	/* run each plugin */
-	for (i = 0; i < priv->plugins->len; i++) {
-		g_autoptr(AsProfileTask) ptask = NULL;
-		GsPlugin *plugin = g_ptr_array_index (priv->plugins, i);
-		g_autoptr(GsAppList) app_list = NULL;
-
-		/* run the batched plugin symbol then the per-app plugin */
-		helper->function_name = "gs_plugin_refine";
-		if (!gs_plugin_loader_call_vfunc (helper, plugin, NULL, list,
-						  cancellable, error)) {
-			return FALSE;
-		}
-
-		/* use a copy of the list for the loop because a function called
-		 * on the plugin may affect the list which can lead to problems
-		 * (e.g. inserting an app in the list on every call results in
-		 * an infinite loop) */
-		app_list = gs_app_list_copy (list);
-		for (j = 0; j < gs_app_list_length (app_list); j++) {
-			app = gs_app_list_index (app_list, j);
-			if (!gs_app_has_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX)) {
-				helper->function_name = "gs_plugin_refine_app";
-			} else {
-				helper->function_name = "gs_plugin_refine_wildcard";
-			}
-			if (!gs_plugin_loader_call_vfunc (helper, plugin, app, NULL,
-							  cancellable, error)) {
-				return FALSE;
-			}
-		}
-		gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
-	}
+	/* run each plugin, where plugins that have no ordering rules between
+	 * each other are run at the same time */
+	if (!gs_plugin_loader_run_refine_stages (helper, list, cancellable, error))
+		return FALSE;
 
 	/* ensure these are sorted by score */
 	if (gs_plugin_job_has_refine_flags (helper->plugin_job,
@@ -864,21 +1358,163 @@ gs_plugin_loader_run_refine_internal (GsPluginLoaderHelper *helper,
 	return TRUE;
 }
 
+/* the metadata has changed, so any previous refine may now be stale */
+static void
+gs_plugin_loader_invalidate_refined (GsPluginLoader *plugin_loader)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	g_atomic_int_inc (&priv->generation);
+}
+
+/* the installed apps have changed, so the refine cache is also stale */
+static void
+gs_plugin_loader_invalidate_refine_cache (GsPluginLoader *plugin_loader)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	gs_plugin_loader_invalidate_refined (plugin_loader);
+	if (priv->refine_cache != NULL)
+		gs_refine_cache_invalidate (priv->refine_cache);
+}
+
+/* saves the refine cache, but not more often than every few seconds */
+static void
+gs_plugin_loader_save_refine_cache (GsPluginLoader *plugin_loader, gboolean force)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	gint64 now = g_get_monotonic_time ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	if (priv->refine_cache == NULL)
+		return;
+	if (!gs_refine_cache_is_dirty (priv->refine_cache))
+		return;
+	locker = g_mutex_locker_new (&priv->refine_cache_mutex);
+	if (!force && now - priv->refine_cache_saved < 10 * G_USEC_PER_SEC)
+		return;
+	if (!gs_refine_cache_save (priv->refine_cache, &error)) {
+		g_warning ("failed to save refine cache: %s", error->message);
+		return;
+	}
+	priv->refine_cache_saved = now;
+}
+
+/* the state stamp of the plugin that manages @app, or NULL */
+static gchar *
+gs_plugin_loader_dup_state_stamp (GsPluginLoader *plugin_loader, GsApp *app)
+{
+	GsPlugin *plugin;
+	const gchar *plugin_name = gs_app_get_management_plugin (app);
+
+	if (plugin_name == NULL)
+		return NULL;
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, plugin_name);
+	if (plugin == NULL || !gs_plugin_get_enabled (plugin))
+		return NULL;
+	return gs_plugin_dup_state_stamp (plugin);
+}
+
+/* sets the data that was found by a previous session, which the plugins
+ * then do not have to find again */
+static void
+gs_plugin_loader_refine_from_cache (GsPluginLoader *plugin_loader,
+				    GsApp *app,
+				    GsPluginRefineFlags refine_flags)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	g_autofree gchar *state_stamp = NULL;
+
+	if (priv->refine_cache == NULL)
+		return;
+	if ((refine_flags & GS_REFINE_CACHE_FLAGS) == 0)
+		return;
+	state_stamp = gs_plugin_loader_dup_state_stamp (plugin_loader, app);
+	gs_refine_cache_apply (priv->refine_cache, app, state_stamp, refine_flags);
+}
+
+static gboolean gs_plugin_loader_run_refine_list (GsPluginLoaderHelper *helper,
+						  GsAppList *list_orig,
+						  GsAppList *list,
+						  GsPluginRefineFlags refine_flags,
+						  guint generation,
+						  GCancellable *cancellable,
+						  GError **error);
+
 static gboolean
 gs_plugin_loader_run_refine (GsPluginLoaderHelper *helper,
-			     GsAppList *list,
+			     GsAppList *list_orig,
 			     GCancellable *cancellable,
 			     GError **error)
 {
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (helper->plugin_loader);
+	GsPluginRefineFlags refine_flags;
+	guint generation;
+	g_autoptr(GsAppList) list = NULL;
+
+	/* nothing to do */
+	if (gs_app_list_length (list_orig) == 0)
+		return TRUE;
+
+	/* only refine the apps that have not already been refined with these
+	 * flags since the metadata last changed; wildcards always need to be
+	 * adopted */
+	refine_flags = gs_plugin_job_get_refine_flags (helper->plugin_job);
+	generation = (guint) g_atomic_int_get (&priv->generation);
+	list = gs_app_list_new ();
+	for (guint i = 0; i < gs_app_list_length (list_orig); i++) {
+		GsApp *app = gs_app_list_index (list_orig, i);
+		if (gs_app_has_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX)) {
+			gs_app_list_add (list, app);
+			continue;
+		}
+		if (gs_app_has_refined_flags (app, refine_flags, generation))
+			continue;
+
+		/* the slow data may be known from a previous session; the
+		 * plugins are still run as they may set other data too */
+		gs_plugin_loader_refine_from_cache (helper->plugin_loader,
+						    app, refine_flags);
+		gs_app_list_add (list, app);
+	}
+	if (gs_app_list_length (list) == 0) {
+		g_debug ("all %u apps already refined with 0x%" G_GINT64_MODIFIER "x",
+			 gs_app_list_length (list_orig), refine_flags);
+		return TRUE;
+	}
+	if (gs_app_list_length (list) < gs_app_list_length (list_orig)) {
+		g_debug ("skipping refine of %u/%u apps",
+			 gs_app_list_length (list_orig) - gs_app_list_length (list),
+			 gs_app_list_length (list_orig));
+	}
+	return gs_plugin_loader_run_refine_list (helper, list_orig, list,
+						 refine_flags, generation,
+						 cancellable, error);
+}
+
+/* refines @list, which is a subset of @list_orig */
+static gboolean
+gs_plugin_loader_run_refine_list (GsPluginLoaderHelper *helper,
+				  GsAppList *list_orig,
+				  GsAppList *list,
+				  GsPluginRefineFlags refine_flags,
+				  guint generation,
+				  GCancellable *cancellable,
+				  GError **error)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (helper->plugin_loader);
 	gboolean has_match_any_prefix = FALSE;
 	gboolean ret;
+	guint cache_generation = 0;
 	g_autoptr(GsAppList) freeze_list = NULL;
+	g_autoptr(GsAppList) list_old = NULL;
 	g_autoptr(GsPluginLoaderHelper) helper2 = NULL;
 	g_autoptr(GsPluginJob) plugin_job = NULL;
 
-	/* nothing to do */
-	if (gs_app_list_length (list) == 0)
-		return TRUE;
+	/* the cache on disk is only invalidated when the installed apps
+	 * change, not every time the refined flags are */
+	if (priv->refine_cache != NULL)
+		cache_generation = gs_refine_cache_get_generation (priv->refine_cache);
+	list_old = gs_app_list_copy (list);
 
 	/* freeze all apps */
 	freeze_list = gs_app_list_copy (list);
@@ -890,11 +1526,14 @@ gs_plugin_loader_run_refine (GsPluginLoaderHelper *helper,
 	/* first pass */
 	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
 					 "list", list,
-					 "refine-flags", gs_plugin_job_get_refine_flags (helper->plugin_job),
+					 "refine-flags", refine_flags,
 					 "failure-flags", gs_plugin_job_get_failure_flags (helper->plugin_job),
 					 NULL);
 	helper2 = gs_plugin_loader_helper_new (helper->plugin_loader, plugin_job);
-	helper2->function_name_parent = helper->function_name;
+	helper2->function_name_parent = gs_plugin_vfunc_to_function_name (helper->vfunc);
+	helper2->background = helper->background;
+	helper2->defer_until = helper->defer_until;
+	helper2->refine_id = (guint) g_atomic_int_add (&priv->refine_id, 1) + 1;
 	ret = gs_plugin_loader_run_refine_internal (helper2, list, cancellable, error);
 	if (!ret)
 		goto out;
@@ -944,6 +1583,30 @@ gs_plugin_loader_run_refine (GsPluginLoaderHelper *helper,
 		}
 	}
 
+	/* remember what has been satisfied at this generation, and for the
+	 * next session if the managing plugin can tell if it is still valid */
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		if (gs_app_has_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX))
+			continue;
+		if (gs_plugin_loader_get_refine_failed (helper2, app)) {
+			g_debug ("not marking %s as refined as a plugin failed",
+				 gs_app_get_unique_id (app));
+			continue;
+		}
+		gs_app_add_refined_flags (app, refine_flags, generation);
+		if (priv->refine_cache != NULL &&
+		    (refine_flags & GS_REFINE_CACHE_FLAGS) > 0) {
+			g_autofree gchar *state_stamp = NULL;
+			state_stamp = gs_plugin_loader_dup_state_stamp (helper->plugin_loader, app);
+			gs_refine_cache_add (priv->refine_cache, app, state_stamp,
+					     refine_flags, cache_generation);
+		}
+	}
+
+	/* apply any adopted or removed apps to the caller's list */
+	gs_plugin_loader_merge_list (list_orig, list_old, list);
+
 out:
 	/* now emit all the changed signals */
 	for (guint i = 0; i < gs_app_list_length (freeze_list); i++) {
@@ -1017,7 +1680,7 @@ gs_plugin_loader_run_results (GsPluginLoaderHelper *helper,
 
 	/* profile */
 	ptask = as_profile_start (priv->profile, "GsPlugin::*(%s)",
-				  helper->function_name);
+				  gs_plugin_vfunc_to_function_name (helper->vfunc));
 	g_assert (ptask != NULL);
 
 	/* run each plugin */
@@ -1552,7 +2215,8 @@ gs_plugin_loader_job_get_categories_async (GsPluginLoader *plugin_loader,
 	/* run in a thread */
 	task = g_task_new (plugin_loader, cancellable, callback, user_data);
 	g_task_set_task_data (task, helper, (GDestroyNotify) gs_plugin_loader_helper_free);
-	g_task_run_in_thread (task, gs_plugin_loader_job_get_categories_thread_cb);
+	gs_plugin_loader_job_schedule (plugin_loader, task,
+				       gs_plugin_loader_job_get_categories_thread_cb);
 }
 
 /**
@@ -1991,6 +2655,7 @@ gs_plugin_loader_job_actions_changed_delay_cb (gpointer user_data)
 
 	/* notify shells */
 	g_debug ("updates-changed");
+	gs_plugin_loader_invalidate_refine_cache (plugin_loader);
 	g_signal_emit (plugin_loader, signals[SIGNAL_UPDATES_CHANGED], 0);
 	priv->updates_changed_id = 0;
 
@@ -2019,6 +2684,7 @@ gs_plugin_loader_reload_delay_cb (gpointer user_data)
 
 	/* notify shells */
 	g_debug ("emitting ::reload");
+	gs_plugin_loader_invalidate_refine_cache (plugin_loader);
 	g_signal_emit (plugin_loader, signals[SIGNAL_RELOAD], 0);
 	priv->reload_id = 0;
 
@@ -2075,6 +2741,9 @@ gs_plugin_loader_open_plugin (GsPluginLoader *plugin_loader,
 	gs_plugin_set_language (plugin, priv->language);
 	gs_plugin_set_scale (plugin, gs_plugin_loader_get_scale (plugin_loader));
 	gs_plugin_set_global_cache (plugin, priv->global_cache);
+	gs_plugin_cache_set_size_max (plugin,
+				      g_settings_get_uint (priv->settings,
+							   "plugin-cache-size-maximum"));
 	g_debug ("opened plugin %s: %s", filename, gs_plugin_get_name (plugin));
 
 	/* add to array */
@@ -2150,13 +2819,13 @@ gs_plugin_loader_plugin_dir_changed_cb (GFileMonitor *monitor,
 					GsPluginLoader *plugin_loader)
 {
 	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
-	GsApp *app;
+	g_autoptr(GsApp) app = NULL;
 	g_autoptr(GsPluginEvent) event = gs_plugin_event_new ();
 	g_autoptr(GError) error = NULL;
 
 	/* add app */
 	gs_plugin_event_set_action (event, GS_PLUGIN_ACTION_SETUP);
-	app = gs_app_list_lookup (priv->global_cache,
+	app = gs_app_list_lookup_ref (priv->global_cache,
 		"system/*/*/*/org.gnome.Software.desktop/*");
 	if (app != NULL)
 		gs_plugin_event_set_app (event, app);
@@ -2179,6 +2848,7 @@ gs_plugin_loader_clear_caches (GsPluginLoader *plugin_loader)
 		gs_plugin_cache_invalidate (plugin);
 	}
 	gs_app_list_remove_all (priv->global_cache);
+	gs_plugin_loader_invalidate_refine_cache (plugin_loader);
 }
 
 /**
@@ -2497,7 +3167,7 @@ gs_plugin_loader_setup (GsPluginLoader *plugin_loader,
 
 	/* run setup */
 	gs_plugin_job_set_action (helper->plugin_job, GS_PLUGIN_ACTION_SETUP);
-	helper->function_name = "gs_plugin_setup";
+	helper->vfunc = GS_PLUGIN_VFUNC_SETUP;
 	for (i = 0; i < priv->plugins->len; i++) {
 		g_autoptr(GError) error_local = NULL;
 		plugin = g_ptr_array_index (priv->plugins, i);
@@ -2510,6 +3180,15 @@ gs_plugin_loader_setup (GsPluginLoader *plugin_loader,
 		}
 	}
 
+	/* the plugins have now set their state stamps */
+	if (priv->refine_cache != NULL) {
+		g_autoptr(GError) error_local = NULL;
+		if (!gs_refine_cache_load (priv->refine_cache, &error_local)) {
+			g_warning ("failed to load refine cache: %s",
+				   error_local->message);
+		}
+	}
+
 	/* now we can load the install-queue */
 	if (!load_install_queue (plugin_loader, error))
 		return FALSE;
@@ -2539,6 +3218,17 @@ gs_plugin_loader_dump_state (GsPluginLoader *plugin_loader)
 		g_string_truncate (str_disabled, str_disabled->len - 2);
 	g_info ("enabled plugins: %s", str_enabled->str);
 	g_info ("disabled plugins: %s", str_disabled->str);
+
+	/* show how well the caches are working */
+	for (guint i = 0; i < priv->plugins->len; i++) {
+		GsPlugin *plugin = g_ptr_array_index (priv->plugins, i);
+		if (!gs_plugin_get_enabled (plugin))
+			continue;
+		gs_plugin_cache_dump_state (plugin);
+	}
+	g_debug ("global cache: %u apps, %u evictions",
+		 gs_app_list_length (priv->global_cache),
+		 (guint) g_atomic_int_get (&priv->global_cache_evictions));
 }
 
 static void
@@ -2581,6 +3271,10 @@ gs_plugin_loader_dispose (GObject *object)
 	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (object);
 	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
 
+	if (priv->refine_cache != NULL) {
+		gs_plugin_loader_save_refine_cache (plugin_loader, TRUE);
+		g_clear_object (&priv->refine_cache);
+	}
 	if (priv->plugins != NULL) {
 		g_autoptr(GsPluginLoaderHelper) helper = NULL;
 		g_autoptr(GsPluginJob) plugin_job = NULL;
@@ -2604,6 +3298,21 @@ gs_plugin_loader_dispose (GObject *object)
 	g_clear_object (&priv->settings);
 	g_clear_pointer (&priv->auth_array, g_ptr_array_unref);
 	g_clear_pointer (&priv->pending_apps, g_ptr_array_unref);
+	if (priv->worker_pool != NULL) {
+		g_thread_pool_free (priv->worker_pool, FALSE, TRUE);
+		priv->worker_pool = NULL;
+	}
+
+	/* each queued job holds a reference, and the job threads drop theirs
+	 * in the main context, so this is never run from a pool thread */
+	if (priv->job_pool_interactive != NULL) {
+		g_thread_pool_free (priv->job_pool_interactive, FALSE, TRUE);
+		priv->job_pool_interactive = NULL;
+	}
+	if (priv->job_pool_background != NULL) {
+		g_thread_pool_free (priv->job_pool_background, FALSE, TRUE);
+		priv->job_pool_background = NULL;
+	}
 
 	G_OBJECT_CLASS (gs_plugin_loader_parent_class)->dispose (object);
 }
@@ -2622,9 +3331,13 @@ gs_plugin_loader_finalize (GObject *object)
 	g_ptr_array_unref (priv->file_monitors);
 	g_hash_table_unref (priv->events_by_id);
 	g_hash_table_unref (priv->disallow_updates);
+	g_hash_table_unref (priv->jobs_shared);
 
 	g_mutex_clear (&priv->pending_apps_mutex);
 	g_mutex_clear (&priv->events_by_id_mutex);
+	g_mutex_clear (&priv->refine_cache_mutex);
+	g_mutex_clear (&priv->job_mutex);
+	g_cond_clear (&priv->job_cond);
 
 	G_OBJECT_CLASS (gs_plugin_loader_parent_class)->finalize (object);
 }
@@ -2699,8 +3412,36 @@ gs_plugin_loader_settings_changed_cb (GSettings *settings,
 				      const gchar *key,
 				      GsPluginLoader *plugin_loader)
 {
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+
 	if (g_strcmp0 (key, "allow-updates") == 0)
 		gs_plugin_loader_allow_updates_recheck (plugin_loader);
+	if (g_strcmp0 (key, "plugin-cache-size-maximum") == 0) {
+		guint size_max = g_settings_get_uint (settings, key);
+		for (guint i = 0; i < priv->plugins->len; i++) {
+			GsPlugin *plugin = g_ptr_array_index (priv->plugins, i);
+			gs_plugin_cache_set_size_max (plugin, size_max);
+		}
+	}
+	if (g_strcmp0 (key, "global-cache-size-maximum") == 0)
+		priv->global_cache_size_max = g_settings_get_uint (settings, key);
+}
+
+/* removes the oldest apps from the global cache that nothing is using */
+static void
+gs_plugin_loader_trim_global_cache (GsPluginLoader *plugin_loader)
+{
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	guint n_removed;
+
+	if (priv->global_cache_size_max == 0)
+		return;
+	n_removed = gs_app_list_trim_unused (priv->global_cache,
+					     priv->global_cache_size_max);
+	if (n_removed == 0)
+		return;
+	g_debug ("removed %u unused apps from the global cache", n_removed);
+	g_atomic_int_add (&priv->global_cache_evictions, (gint) n_removed);
 }
 
 static void
@@ -2711,9 +3452,13 @@ gs_plugin_loader_init (GsPluginLoader *plugin_loader)
 	gchar *match;
 	gchar **projects;
 	guint i;
+	g_autofree gchar *refine_cache_fn = NULL;
+	g_autoptr(GError) error_cache = NULL;
 
 	priv->scale = 1;
+	priv->generation = 1;
 	priv->global_cache = gs_app_list_new ();
+	gs_app_list_add_flag (priv->global_cache, GS_APP_LIST_FLAG_TRACK_USED);
 	priv->plugins = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	priv->pending_apps = g_ptr_array_new_with_free_func ((GFreeFunc) g_object_unref);
 	priv->auth_array = g_ptr_array_new_with_free_func ((GFreeFunc) g_object_unref);
@@ -2723,6 +3468,20 @@ gs_plugin_loader_init (GsPluginLoader *plugin_loader)
 	priv->settings = g_settings_new ("org.gnome.software");
 	g_signal_connect (priv->settings, "changed",
 			  G_CALLBACK (gs_plugin_loader_settings_changed_cb), plugin_loader);
+	priv->global_cache_size_max = g_settings_get_uint (priv->settings,
+							   "global-cache-size-maximum");
+
+	/* remember the slow refine results between sessions */
+	g_mutex_init (&priv->refine_cache_mutex);
+	refine_cache_fn = gs_utils_get_cache_filename ("refine",
+						       "refine-cache.ini",
+						       GS_UTILS_CACHE_FLAG_WRITEABLE,
+						       &error_cache);
+	if (refine_cache_fn == NULL) {
+		g_warning ("not using a refine cache: %s", error_cache->message);
+	} else {
+		priv->refine_cache = gs_refine_cache_new (refine_cache_fn);
+	}
 	priv->events_by_id = g_hash_table_new_full ((GHashFunc) as_utils_unique_id_hash,
 					            (GEqualFunc) as_utils_unique_id_equal,
 						    g_free,
@@ -2763,6 +3522,25 @@ gs_plugin_loader_init (GsPluginLoader *plugin_loader)
 	g_mutex_init (&priv->pending_apps_mutex);
 	g_mutex_init (&priv->events_by_id_mutex);
 
+	/* used to run plugins that do not depend on each other at once */
+	priv->worker_pool = g_thread_pool_new (gs_plugin_loader_worker_cb,
+					       plugin_loader,
+					       (gint) g_get_num_processors (),
+					       FALSE, NULL);
+
+	/* jobs from the UI are never held up by background refreshes */
+	g_mutex_init (&priv->job_mutex);
+	g_cond_init (&priv->job_cond);
+	priv->jobs_shared = g_hash_table_new (g_str_hash, g_str_equal);
+	priv->job_pool_interactive = g_thread_pool_new (gs_plugin_loader_job_thread_cb,
+							plugin_loader,
+							gs_plugin_loader_get_jobs_interactive_max (),
+							FALSE, NULL);
+	priv->job_pool_background = g_thread_pool_new (gs_plugin_loader_job_thread_cb,
+						       plugin_loader,
+						       GS_PLUGIN_LOADER_JOBS_BACKGROUND_MAX,
+						       FALSE, NULL);
+
 	/* monitor the network as the many UI operations need the network */
 	gs_plugin_loader_monitor_network (plugin_loader);
 
@@ -2849,6 +3627,10 @@ gs_plugin_loader_network_changed_cb (GNetworkMonitor *monitor,
 
 	if (available) {
 		g_autoptr(GsAppList) queue = NULL;
+
+		/* plugins that failed when offline can now add their data */
+		gs_plugin_loader_invalidate_refined (plugin_loader);
+
 		g_mutex_lock (&priv->pending_apps_mutex);
 		queue = gs_app_list_new ();
 		for (guint i = 0; i < priv->pending_apps->len; i++) {
@@ -2925,7 +3707,7 @@ gs_plugin_loader_generic_update (GsPluginLoader *plugin_loader,
 			gs_utils_error_convert_gio (error);
 			return FALSE;
 		}
-		plugin_app_func = gs_plugin_get_symbol (plugin, helper->function_name);
+		plugin_app_func = gs_plugin_get_vfunc (plugin, helper->vfunc);
 		if (plugin_app_func == NULL)
 			continue;
 
@@ -2940,7 +3722,7 @@ gs_plugin_loader_generic_update (GsPluginLoader *plugin_loader,
 			ptask = as_profile_start (priv->profile,
 						  "GsPlugin::%s(%s){%s}",
 						  gs_plugin_get_name (plugin),
-						  helper->function_name,
+						  gs_plugin_vfunc_to_function_name (helper->vfunc),
 						  gs_app_get_id (app));
 			g_assert (ptask != NULL);
 			gs_plugin_loader_action_start (plugin_loader, plugin, FALSE);
@@ -3003,7 +3785,7 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 
 	/* run per-app version */
 	if (action == GS_PLUGIN_ACTION_UPDATE) {
-		helper->function_name = "gs_plugin_update_app";
+		helper->vfunc = GS_PLUGIN_VFUNC_UPDATE_APP;
 		if (!gs_plugin_loader_generic_update (plugin_loader, helper,
 						      cancellable, &error)) {
 			g_task_return_error (task, error);
@@ -3015,10 +3797,41 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 	if (add_to_pending_array)
 		gs_plugin_loader_pending_apps_remove (plugin_loader, helper);
 
+	/* these change what refine would return */
+	switch (action) {
+	case GS_PLUGIN_ACTION_INSTALL:
+	case GS_PLUGIN_ACTION_REMOVE:
+	case GS_PLUGIN_ACTION_UPDATE:
+	case GS_PLUGIN_ACTION_UPGRADE_DOWNLOAD:
+	case GS_PLUGIN_ACTION_UPGRADE_TRIGGER:
+	case GS_PLUGIN_ACTION_UPDATE_CANCEL:
+	case GS_PLUGIN_ACTION_PURCHASE:
+		gs_plugin_loader_invalidate_refine_cache (plugin_loader);
+		break;
+	case GS_PLUGIN_ACTION_REFRESH:
+		/* the remote metadata may have changed, but the cache on disk
+		 * only has local data, which the state stamps already cover;
+		 * the refresh done at startup with an age of G_MAXUINT only
+		 * downloads what is missing */
+		if (gs_plugin_job_get_age (helper->plugin_job) != G_MAXUINT)
+			gs_plugin_loader_invalidate_refined (plugin_loader);
+		break;
+	case GS_PLUGIN_ACTION_REVIEW_SUBMIT:
+	case GS_PLUGIN_ACTION_REVIEW_UPVOTE:
+	case GS_PLUGIN_ACTION_REVIEW_DOWNVOTE:
+	case GS_PLUGIN_ACTION_REVIEW_REPORT:
+	case GS_PLUGIN_ACTION_REVIEW_REMOVE:
+	case GS_PLUGIN_ACTION_REVIEW_DISMISS:
+		gs_plugin_loader_invalidate_refined (plugin_loader);
+		break;
+	default:
+		break;
+	}
+
 	/* append extra things when we want the list of pending updates */
 	if (action == GS_PLUGIN_ACTION_GET_UPDATES &&
 	    !g_settings_get_boolean (priv->settings, "download-updates")) {
-		helper->function_name = "gs_plugin_add_updates_pending";
+		helper->vfunc = GS_PLUGIN_VFUNC_ADD_UPDATES_PENDING;
 		if (!gs_plugin_loader_run_results (helper, cancellable, &error)) {
 			g_task_return_error (task, error);
 			return;
@@ -3241,10 +4054,170 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 	/* sort these again as the refine may have added useful metadata */
 	gs_plugin_loader_job_sorted_truncation_again (helper);
 
+	/* the apps in the results are in use, so will not be removed */
+	gs_plugin_loader_trim_global_cache (plugin_loader);
+	gs_plugin_loader_save_refine_cache (plugin_loader, FALSE);
+
 	/* success */
 	g_task_return_pointer (task, g_object_ref (list), (GDestroyNotify) g_object_unref);
 }
 
+/* a running query job that identical jobs can attach to */
+typedef struct {
+	GsPluginLoader		*plugin_loader;
+	gchar			*fingerprint;
+	GPtrArray		*waiters;	/* of GsPluginLoaderJobWaiter */
+	GCancellable		*cancellable;
+	guint			 n_active;	/* locked by job_mutex */
+	gboolean		 cancelled;	/* locked by job_mutex */
+} GsPluginLoaderJobShared;
+
+/* a caller waiting on a job that may be shared with other callers */
+typedef struct {
+	GsPluginLoaderJobShared	*shared;
+	GTask			*task;
+	GCancellable		*cancellable;
+	gulong			 cancelled_id;
+	gboolean		 cancelled;	/* locked by job_mutex */
+} GsPluginLoaderJobWaiter;
+
+static void
+gs_plugin_loader_job_waiter_free (GsPluginLoaderJobWaiter *waiter)
+{
+	if (waiter->cancelled_id != 0)
+		g_cancellable_disconnect (waiter->cancellable, waiter->cancelled_id);
+	if (waiter->cancellable != NULL)
+		g_object_unref (waiter->cancellable);
+	g_object_unref (waiter->task);
+	g_slice_free (GsPluginLoaderJobWaiter, waiter);
+}
+
+static GsPluginLoaderJobShared *
+gs_plugin_loader_job_shared_new (GsPluginLoader *plugin_loader,
+				 const gchar *fingerprint)
+{
+	GsPluginLoaderJobShared *shared = g_slice_new0 (GsPluginLoaderJobShared);
+	shared->plugin_loader = plugin_loader;
+	shared->fingerprint = g_strdup (fingerprint);
+	shared->waiters = g_ptr_array_new ();
+	shared->cancellable = g_cancellable_new ();
+	return shared;
+}
+
+static void
+gs_plugin_loader_job_shared_free (GsPluginLoaderJobShared *shared)
+{
+	g_ptr_array_unref (shared->waiters);
+	g_object_unref (shared->cancellable);
+	g_free (shared->fingerprint);
+	g_slice_free (GsPluginLoaderJobShared, shared);
+}
+
+/* only cancel the running job when nobody wants the results; this must be
+ * called with job_mutex held, and returns %TRUE if the job should be
+ * cancelled once the mutex has been released */
+static gboolean
+gs_plugin_loader_job_waiter_cancel_locked (GsPluginLoaderJobWaiter *waiter)
+{
+	GsPluginLoaderJobShared *shared = waiter->shared;
+	if (waiter->cancelled)
+		return FALSE;
+	waiter->cancelled = TRUE;
+	if (--shared->n_active > 0)
+		return FALSE;
+
+	/* stop any new callers attaching before the job is cancelled */
+	shared->cancelled = TRUE;
+	return TRUE;
+}
+
+static void
+gs_plugin_loader_job_shared_cancelled_cb (GCancellable *cancellable,
+					  GsPluginLoaderJobWaiter *waiter)
+{
+	GsPluginLoaderJobShared *shared = waiter->shared;
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (shared->plugin_loader);
+	gboolean cancel;
+
+	g_mutex_lock (&priv->job_mutex);
+	cancel = gs_plugin_loader_job_waiter_cancel_locked (waiter);
+	g_mutex_unlock (&priv->job_mutex);
+
+	/* the shared job cannot be freed while this handler is running */
+	if (cancel)
+		g_cancellable_cancel (shared->cancellable);
+}
+
+/* this must be called with job_mutex held, and returns %TRUE if the job
+ * should be cancelled once the mutex has been released */
+static gboolean
+gs_plugin_loader_job_shared_add_waiter (GsPluginLoaderJobShared *shared,
+					GTask *task)
+{
+	GsPluginLoaderJobWaiter *waiter = g_slice_new0 (GsPluginLoaderJobWaiter);
+	GCancellable *cancellable = g_task_get_cancellable (task);
+
+	waiter->shared = shared;
+	waiter->task = g_object_ref (task);
+	g_ptr_array_add (shared->waiters, waiter);
+	shared->n_active++;
+	if (cancellable == NULL)
+		return FALSE;
+
+	/* g_cancellable_connect() would run the handler right away if already
+	 * cancelled, which would deadlock on job_mutex */
+	waiter->cancellable = g_object_ref (cancellable);
+	waiter->cancelled_id =
+		g_signal_connect (cancellable, "cancelled",
+				  G_CALLBACK (gs_plugin_loader_job_shared_cancelled_cb),
+				  waiter);
+	if (g_cancellable_is_cancelled (cancellable))
+		return gs_plugin_loader_job_waiter_cancel_locked (waiter);
+	return FALSE;
+}
+
+static void
+gs_plugin_loader_job_shared_cb (GObject *source_object,
+				GAsyncResult *res,
+				gpointer user_data)
+{
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source_object);
+	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	GsPluginLoaderJobShared *shared = (GsPluginLoaderJobShared *) user_data;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) waiters = NULL;
+
+	/* no more callers can attach, although a new job may have replaced
+	 * this one if it was cancelled before it completed */
+	g_mutex_lock (&priv->job_mutex);
+	if (g_hash_table_lookup (priv->jobs_shared, shared->fingerprint) == shared)
+		g_hash_table_remove (priv->jobs_shared, shared->fingerprint);
+	g_mutex_unlock (&priv->job_mutex);
+
+	/* stop watching the callers before returning to any of them */
+	waiters = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	for (guint i = 0; i < shared->waiters->len; i++) {
+		GsPluginLoaderJobWaiter *waiter = g_ptr_array_index (shared->waiters, i);
+		g_ptr_array_add (waiters, g_object_ref (waiter->task));
+		gs_plugin_loader_job_waiter_free (waiter);
+	}
+
+	/* each caller gets its own list so it can be filtered and sorted */
+	list = gs_plugin_loader_job_process_finish (plugin_loader, res, &error);
+	for (guint i = 0; i < waiters->len; i++) {
+		GTask *task = g_ptr_array_index (waiters, i);
+		if (list == NULL) {
+			g_task_return_error (task, g_error_copy (error));
+			continue;
+		}
+		g_task_return_pointer (task,
+				       gs_app_list_copy (list),
+				       (GDestroyNotify) g_object_unref);
+	}
+	gs_plugin_loader_job_shared_free (shared);
+}
+
 /**
  * gs_plugin_loader_job_process_async:
  *
@@ -3260,6 +4233,7 @@ gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
 	GsPluginAction action;
 	GsPluginLoaderHelper *helper;
 	GsPluginLoaderPrivate *priv = gs_plugin_loader_get_instance_private (plugin_loader);
+	g_autofree gchar *fingerprint = NULL;
 	g_autoptr(GTask) task = NULL;
 
 	g_return_if_fail (GS_IS_PLUGIN_LOADER (plugin_loader));
@@ -3390,6 +4364,36 @@ gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
 		break;
 	}
 
+	/* attach to an identical query if one is already running, otherwise
+	 * run this job on behalf of any identical ones that arrive later */
+	fingerprint = gs_plugin_job_get_fingerprint (plugin_job);
+	if (fingerprint != NULL) {
+		GsPluginLoaderJobShared *shared;
+		g_autoptr(GCancellable) cancellable_shared = NULL;
+
+		g_mutex_lock (&priv->job_mutex);
+		shared = g_hash_table_lookup (priv->jobs_shared, fingerprint);
+		if (shared != NULL && !shared->cancelled) {
+			g_debug ("attaching to running job %s", fingerprint);
+			if (gs_plugin_loader_job_shared_add_waiter (shared, task))
+				cancellable_shared = g_object_ref (shared->cancellable);
+			g_mutex_unlock (&priv->job_mutex);
+			if (cancellable_shared != NULL)
+				g_cancellable_cancel (cancellable_shared);
+			return;
+		}
+		shared = gs_plugin_loader_job_shared_new (plugin_loader, fingerprint);
+		g_hash_table_replace (priv->jobs_shared, shared->fingerprint, shared);
+		if (gs_plugin_loader_job_shared_add_waiter (shared, task))
+			cancellable_shared = g_object_ref (shared->cancellable);
+		g_object_unref (task);
+		task = g_task_new (plugin_loader, shared->cancellable,
+				   gs_plugin_loader_job_shared_cb, shared);
+		g_mutex_unlock (&priv->job_mutex);
+		if (cancellable_shared != NULL)
+			g_cancellable_cancel (cancellable_shared);
+	}
+
 	/* save helper */
 	helper = gs_plugin_loader_helper_new (plugin_loader, plugin_job);
 	g_task_set_task_data (task, helper, (GDestroyNotify) gs_plugin_loader_helper_free);
@@ -3409,7 +4413,8 @@ gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
 	}
 
 	/* run in a thread */
-	g_task_run_in_thread (task, gs_plugin_loader_process_thread_cb);
+	gs_plugin_loader_job_schedule (plugin_loader, task,
+				       gs_plugin_loader_process_thread_cb);
 }
 
 /******************************************************************************/
@@ -3448,9 +4453,9 @@ gs_plugin_loader_app_create (GsPluginLoader *plugin_loader, const gchar *unique_
 	GsApp *app;
 
 	/* already exists */
-	app = gs_app_list_lookup (priv->global_cache, unique_id);
+	app = gs_app_list_lookup_ref (priv->global_cache, unique_id);
 	if (app != NULL)
-		return g_object_ref (app);
+		return app;
 
 	/* create and add */
 	app = gs_app_new_from_unique_id (unique_id);
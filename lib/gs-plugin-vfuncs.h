@@ -426,13 +426,25 @@ gboolean	 gs_plugin_add_unvoted_reviews		(GsPlugin	*plugin,
  * @error: a #GError, or %NULL
  *
  * Adds required information to a list of #GsApp's.
- * This function is only really required when "batching up" requests, and most
- * plugins are better using the per-app gs_plugin_refine_app() function.
+ * This function is preferred to the per-app gs_plugin_refine_app() function
+ * as the plugin is only called once for each list, and it can share state such
+ * as locks or database transactions between all the applications.
  *
  * An example for when this is useful would be in the PackageKit plugin where
  * we want to do one transaction of GetDetails with multiple source-ids rather
  * than scheduling a large number of pending requests.
  *
+ * Plugins should skip any applications that already have the information
+ * requested in @flags, and any applications with the
+ * %AS_APP_QUIRK_MATCH_ANY_PREFIX quirk as these are handled using
+ * gs_plugin_refine_wildcard().
+ *
+ * Plugins that have no %GS_PLUGIN_RULE_RUN_AFTER or %GS_PLUGIN_RULE_RUN_BEFORE
+ * rules between them may be refined at the same time in different threads,
+ * and in this case @list is a copy of the list being refined. Any applications
+ * added or removed from @list are merged back when all the plugins have
+ * finished.
+ *
  * Returns: %TRUE for success or if not relevant
  **/
 gboolean	 gs_plugin_refine			(GsPlugin	*plugin,
@@ -451,6 +463,11 @@ gboolean	 gs_plugin_refine			(GsPlugin	*plugin,
  *
  * Adds required information to @app.
  *
+ * This is called for each application in the list being refined, after
+ * gs_plugin_refine() has been called with the entire list. Plugins that can
+ * process more than one application at a time should use gs_plugin_refine()
+ * instead.
+ *
  * The general idea for @flags is that this indicates what the UI needs at the
  * moment. This doesn't mean you can't add more information if you have it,
  * for example, if we requested %GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE and had
@@ -58,11 +58,23 @@
 #include "gs-plugin.h"
 #include "gs-utils.h"
 
+typedef struct {
+	gchar			*key;
+	GsApp			*app;
+	GList			 link;			/* in cache_lru */
+} GsPluginCacheItem;
+
 typedef struct
 {
 	AsProfile		*profile;
 	GPtrArray		*auth_array;
-	GHashTable		*cache;
+	GHashTable		*cache;			/* key : GsPluginCacheItem */
+	GQueue			 cache_lru;		/* most recently used first */
+	GHashTable		*cache_evicted;		/* key : GWeakRef */
+	guint			 cache_size_max;	/* 0 for no limit */
+	guint			 cache_hits;
+	guint			 cache_misses;
+	guint			 cache_evictions;
 	GMutex			 cache_mutex;
 	GModule			*module;
 	GRWLock			 rwlock;
@@ -73,6 +85,7 @@ typedef struct
 	GPtrArray		*rules[GS_PLUGIN_RULE_LAST];
 	GHashTable		*vfuncs;		/* string:pointer */
 	GMutex			 vfuncs_mutex;
+	gpointer		 vfuncs_table[GS_PLUGIN_VFUNC_LAST];
 	gboolean		 enabled;
 	gchar			*locale;		/* allow-none */
 	gchar			*language;		/* allow-none */
@@ -83,6 +96,19 @@ typedef struct
 	guint			 priority;
 	guint			 timer_id;
 	GMutex			 timer_mutex;
+	gchar			*state_stamp;		/* allow-none */
+	GMutex			 state_stamp_mutex;
+	GQueue			 status_pending;	/* of GsPluginStatusItem */
+	GHashTable		*status_pending_apps;	/* GsApp : GList link */
+	GsPluginStatus		 status_global;		/* for no app */
+	gboolean		 status_global_pending;
+	gint64			 status_emitted;	/* monotonic, in us */
+	guint			 status_id;
+	GMutex			 status_mutex;
+	gint			 jobs_max;		/* atomic, 0 for no limit */
+	guint			 jobs_active;
+	GMutex			 jobs_mutex;
+	GCond			 jobs_cond;
 } GsPluginPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (GsPlugin, gs_plugin, G_TYPE_OBJECT)
@@ -202,9 +228,27 @@ gs_plugin_create (const gchar *filename, GError **error)
 		return NULL;
 	}
 	gs_plugin_set_name (plugin, basename + 13);
+
+	/* resolve all the vfuncs now so they can be used without locking */
+	for (guint i = GS_PLUGIN_VFUNC_UNKNOWN + 1; i < GS_PLUGIN_VFUNC_LAST; i++) {
+		const gchar *function_name = gs_plugin_vfunc_to_function_name (i);
+		g_module_symbol (priv->module, function_name, &priv->vfuncs_table[i]);
+	}
 	return plugin;
 }
 
+typedef struct {
+	GsApp		*app;
+	GsPluginStatus	 status;
+} GsPluginStatusItem;
+
+static void
+gs_plugin_status_item_free (GsPluginStatusItem *item)
+{
+	g_object_unref (item->app);
+	g_slice_free (GsPluginStatusItem, item);
+}
+
 static void
 gs_plugin_finalize (GObject *object)
 {
@@ -222,6 +266,7 @@ gs_plugin_finalize (GObject *object)
 	g_free (priv->data);
 	g_free (priv->locale);
 	g_free (priv->language);
+	g_free (priv->state_stamp);
 	g_rw_lock_clear (&priv->rwlock);
 	g_object_unref (priv->profile);
 	if (priv->auth_array != NULL)
@@ -231,10 +276,18 @@ gs_plugin_finalize (GObject *object)
 	if (priv->global_cache != NULL)
 		g_object_unref (priv->global_cache);
 	g_hash_table_unref (priv->cache);
+	g_hash_table_unref (priv->cache_evicted);
 	g_hash_table_unref (priv->vfuncs);
+	while (!g_queue_is_empty (&priv->status_pending))
+		gs_plugin_status_item_free (g_queue_pop_head (&priv->status_pending));
+	g_hash_table_unref (priv->status_pending_apps);
 	g_mutex_clear (&priv->cache_mutex);
 	g_mutex_clear (&priv->timer_mutex);
 	g_mutex_clear (&priv->vfuncs_mutex);
+	g_mutex_clear (&priv->state_stamp_mutex);
+	g_mutex_clear (&priv->status_mutex);
+	g_mutex_clear (&priv->jobs_mutex);
+	g_cond_clear (&priv->jobs_cond);
 #ifndef RUNNING_ON_VALGRIND
 	if (priv->module != NULL)
 		g_module_close (priv->module);
@@ -324,6 +377,104 @@ gs_plugin_action_start (GsPlugin *plugin, gboolean exclusive)
 	gs_plugin_add_flags (plugin, GS_PLUGIN_FLAGS_RUNNING_SELF);
 }
 
+/**
+ * gs_plugin_set_max_jobs:
+ * @plugin: a #GsPlugin
+ * @jobs_max: the number of vfuncs that can run at once, or 0 for no limit
+ *
+ * Limits how many jobs can be calling into the plugin at the same time,
+ * for instance when the plugin talks to a service that handles requests
+ * one at a time. Other jobs wait until a vfunc has returned.
+ *
+ * This should only be called from gs_plugin_initialize().
+ *
+ * Since: 3.26
+ **/
+void
+gs_plugin_set_max_jobs (GsPlugin *plugin, guint jobs_max)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->jobs_mutex);
+	g_atomic_int_set (&priv->jobs_max, (gint) jobs_max);
+	g_cond_broadcast (&priv->jobs_cond);
+}
+
+static void
+gs_plugin_job_slot_cancelled_cb (GCancellable *cancellable, GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->jobs_mutex);
+	g_cond_broadcast (&priv->jobs_cond);
+}
+
+/**
+ * gs_plugin_acquire_job_slot:
+ * @plugin: a #GsPlugin
+ * @cancellable: a #GCancellable, or %NULL
+ *
+ * Waits until the plugin can run another vfunc, as set by
+ * gs_plugin_set_max_jobs(). Each successful call must be matched with
+ * gs_plugin_release_job_slot() once the vfunc has returned.
+ *
+ * Returns: %TRUE for success, or %FALSE if @cancellable was cancelled
+ *
+ * Since: 3.26
+ **/
+gboolean
+gs_plugin_acquire_job_slot (GsPlugin *plugin, GCancellable *cancellable)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	gboolean ret = TRUE;
+	gulong cancelled_id = 0;
+
+	/* most plugins have no limit, so avoid the lock */
+	if (g_atomic_int_get (&priv->jobs_max) == 0)
+		return TRUE;
+
+	/* this is called before the mutex is taken if already cancelled */
+	if (cancellable != NULL) {
+		cancelled_id = g_cancellable_connect (cancellable,
+						      G_CALLBACK (gs_plugin_job_slot_cancelled_cb),
+						      plugin, NULL);
+	}
+	g_mutex_lock (&priv->jobs_mutex);
+	while (priv->jobs_max > 0 && priv->jobs_active >= (guint) priv->jobs_max) {
+		if (g_cancellable_is_cancelled (cancellable)) {
+			ret = FALSE;
+			break;
+		}
+		g_cond_wait (&priv->jobs_cond, &priv->jobs_mutex);
+	}
+	if (ret)
+		priv->jobs_active++;
+	g_mutex_unlock (&priv->jobs_mutex);
+	g_cancellable_disconnect (cancellable, cancelled_id);
+	return ret;
+}
+
+/**
+ * gs_plugin_release_job_slot:
+ * @plugin: a #GsPlugin
+ *
+ * Lets another job call into the plugin.
+ *
+ * Since: 3.26
+ **/
+void
+gs_plugin_release_job_slot (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	/* the slot was never taken if there was no limit */
+	if (g_atomic_int_get (&priv->jobs_max) == 0)
+		return;
+	locker = g_mutex_locker_new (&priv->jobs_mutex);
+	g_return_if_fail (priv->jobs_active > 0);
+	priv->jobs_active--;
+	g_cond_broadcast (&priv->jobs_cond);
+}
+
 static gboolean
 gs_plugin_action_delay_cb (gpointer user_data)
 {
@@ -406,6 +557,34 @@ gs_plugin_get_symbol (GsPlugin *plugin, const gchar *function_name)
 	return func;
 }
 
+/**
+ * gs_plugin_get_vfunc (skip):
+ * @plugin: a #GsPlugin
+ * @vfunc: a #GsPluginVfunc, e.g. %GS_PLUGIN_VFUNC_REFINE_APP
+ *
+ * Gets the vfunc implemented by the plugin, as resolved when the plugin was
+ * created. If the plugin is not enabled then no vfunc is returned.
+ *
+ * Unlike gs_plugin_get_symbol() this does not take a lock and is safe to call
+ * for each application.
+ *
+ * Returns: the pointer to the vfunc, or %NULL
+ *
+ * Since: 3.26
+ **/
+gpointer
+gs_plugin_get_vfunc (GsPlugin *plugin, GsPluginVfunc vfunc)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+
+	g_return_val_if_fail (vfunc < GS_PLUGIN_VFUNC_LAST, NULL);
+
+	/* disabled plugins shouldn't be checked */
+	if (!priv->enabled)
+		return NULL;
+	return priv->vfuncs_table[vfunc];
+}
+
 /**
  * gs_plugin_get_enabled:
  * @plugin: a #GsPlugin
@@ -804,6 +983,48 @@ gs_plugin_set_global_cache (GsPlugin *plugin, GsAppList *global_cache)
 	g_set_object (&priv->global_cache, global_cache);
 }
 
+/**
+ * gs_plugin_set_state_stamp:
+ * @plugin: a #GsPlugin
+ * @state_stamp: (nullable): a string, or %NULL if unknown
+ *
+ * Sets a string that changes whenever the data the plugin adds to the
+ * applications it manages might have changed, for instance the modification
+ * time of the package database.
+ *
+ * If set, the origin, version, installed size and provenance of installed
+ * applications managed by the plugin are set by the next session before
+ * they are refined, as long as the stamp is the same.
+ *
+ * Since: 3.26
+ **/
+void
+gs_plugin_set_state_stamp (GsPlugin *plugin, const gchar *state_stamp)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->state_stamp_mutex);
+	g_free (priv->state_stamp);
+	priv->state_stamp = g_strdup (state_stamp);
+}
+
+/**
+ * gs_plugin_dup_state_stamp:
+ * @plugin: a #GsPlugin
+ *
+ * Gets the state stamp set by the plugin.
+ *
+ * Returns: (transfer full) (nullable): a string, or %NULL if unset
+ *
+ * Since: 3.26
+ **/
+gchar *
+gs_plugin_dup_state_stamp (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->state_stamp_mutex);
+	return g_strdup (priv->state_stamp);
+}
+
 /**
  * gs_plugin_has_flags:
  * @plugin: a #GsPlugin
@@ -948,24 +1169,46 @@ gs_plugin_check_distro_id (GsPlugin *plugin, const gchar *distro_id)
 	return TRUE;
 }
 
-typedef struct {
-	GsPlugin	*plugin;
-	GsApp		*app;
-	GsPluginStatus	 status;
-	guint		 percentage;
-} GsPluginStatusHelper;
+/* the UI cannot usefully show status changes any faster than this */
+#define GS_PLUGIN_STATUS_UPDATE_INTERVAL	100	/* ms */
 
 static gboolean
 gs_plugin_status_update_cb (gpointer user_data)
 {
-	GsPluginStatusHelper *helper = (GsPluginStatusHelper *) user_data;
-	g_signal_emit (helper->plugin,
-		       signals[SIGNAL_STATUS_CHANGED], 0,
-		       helper->app,
-		       helper->status);
-	if (helper->app != NULL)
-		g_object_unref (helper->app);
-	g_slice_free (GsPluginStatusHelper, helper);
+	GsPlugin *plugin = GS_PLUGIN (user_data);
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	GQueue pending;
+	GsPluginStatus status_global;
+	gboolean status_global_pending;
+
+	/* take the latest status of each app */
+	g_mutex_lock (&priv->status_mutex);
+	pending = priv->status_pending;
+	g_queue_init (&priv->status_pending);
+	g_hash_table_remove_all (priv->status_pending_apps);
+	status_global = priv->status_global;
+	status_global_pending = priv->status_global_pending;
+	priv->status_global_pending = FALSE;
+	priv->status_emitted = g_get_monotonic_time ();
+	priv->status_id = 0;
+	g_mutex_unlock (&priv->status_mutex);
+
+	/* in the order they were last set, with the overall status last so
+	 * it is what is left showing */
+	while (!g_queue_is_empty (&pending)) {
+		GsPluginStatusItem *item = g_queue_pop_head (&pending);
+		g_signal_emit (plugin,
+			       signals[SIGNAL_STATUS_CHANGED], 0,
+			       item->app,
+			       item->status);
+		gs_plugin_status_item_free (item);
+	}
+	if (status_global_pending) {
+		g_signal_emit (plugin,
+			       signals[SIGNAL_STATUS_CHANGED], 0,
+			       NULL,
+			       status_global);
+	}
 	return FALSE;
 }
 
@@ -977,18 +1220,60 @@ gs_plugin_status_update_cb (gpointer user_data)
  *
  * Update the state of the plugin so any UI can be updated.
  *
+ * Updates are emitted in the main thread at most ten times a second, and
+ * if the status of @app changes more than once in that time only the
+ * latest is emitted. Apps are emitted in the order their status was last
+ * set, and the status without an app is emitted after them.
+ *
  * Since: 3.22
  **/
 void
 gs_plugin_status_update (GsPlugin *plugin, GsApp *app, GsPluginStatus status)
 {
-	GsPluginStatusHelper *helper;
-	helper = g_slice_new0 (GsPluginStatusHelper);
-	helper->plugin = plugin;
-	helper->status = status;
-	if (app != NULL)
-		helper->app = g_object_ref (app);
-	g_idle_add (gs_plugin_status_update_cb, helper);
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	gint64 delay;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->status_mutex);
+
+	if (app == NULL) {
+		priv->status_global = status;
+		priv->status_global_pending = TRUE;
+	} else {
+		GList *link = g_hash_table_lookup (priv->status_pending_apps, app);
+		GsPluginStatusItem *item;
+
+		/* move to the end as this is now the latest */
+		if (link != NULL) {
+			item = link->data;
+			g_queue_unlink (&priv->status_pending, link);
+			g_list_free (link);
+		} else {
+			item = g_slice_new0 (GsPluginStatusItem);
+			item->app = g_object_ref (app);
+		}
+		item->status = status;
+		g_queue_push_tail (&priv->status_pending, item);
+		g_hash_table_insert (priv->status_pending_apps, app,
+				     g_queue_peek_tail_link (&priv->status_pending));
+	}
+	if (priv->status_id != 0)
+		return;
+
+	/* emit straight away if we've been quiet for a while */
+	delay = priv->status_emitted +
+		GS_PLUGIN_STATUS_UPDATE_INTERVAL * 1000 -
+		g_get_monotonic_time ();
+	if (delay <= 0) {
+		priv->status_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+						   gs_plugin_status_update_cb,
+						   g_object_ref (plugin),
+						   (GDestroyNotify) g_object_unref);
+	} else {
+		priv->status_id = g_timeout_add_full (G_PRIORITY_DEFAULT,
+						      (guint) (delay / 1000) + 1,
+						      gs_plugin_status_update_cb,
+						      g_object_ref (plugin),
+						      (GDestroyNotify) g_object_unref);
+	}
 }
 
 static gboolean
@@ -1100,48 +1385,48 @@ gs_plugin_reload (GsPlugin *plugin)
 	g_idle_add (gs_plugin_reload_cb, plugin);
 }
 
+/* the number of downloads in a batch to run at the same time */
+#define GS_PLUGIN_DOWNLOAD_BATCH_MAX		4
+
+#define GS_PLUGIN_DOWNLOAD_BUFFER_SIZE		(64 * 1024)
+
+/* saved on the downloaded file to revalidate or resume it later */
+#define GS_PLUGIN_DOWNLOAD_ATTR_URI		"xattr::gnome-software.uri"
+#define GS_PLUGIN_DOWNLOAD_ATTR_ETAG		"xattr::gnome-software.etag"
+#define GS_PLUGIN_DOWNLOAD_ATTR_LAST_MODIFIED	"xattr::gnome-software.last-modified"
+
 typedef struct {
 	GsPlugin	*plugin;
-	GsApp		*app;
-	GCancellable	*cancellable;
+	GsApp		*app;		/* allow-none */
+	guint		 percentage;
 } GsPluginDownloadHelper;
 
 static void
-gs_plugin_download_chunk_cb (SoupMessage *msg, SoupBuffer *chunk,
-			     GsPluginDownloadHelper *helper)
+gs_plugin_download_helper_init (GsPluginDownloadHelper *helper,
+				GsPlugin *plugin,
+				GsApp *app)
 {
-	GsPluginPrivate *priv = gs_plugin_get_instance_private (helper->plugin);
-	guint percentage;
-	goffset header_size;
-	goffset body_length;
-
-	/* cancelled? */
-	if (g_cancellable_is_cancelled (helper->cancellable)) {
-		g_debug ("cancelling download of %s",
-			 gs_app_get_id (helper->app));
-		soup_session_cancel_message (priv->soup_session,
-					     msg,
-					     SOUP_STATUS_CANCELLED);
-		return;
-	}
-
-	/* if it's returning "Found" or an error, ignore the percentage */
-	if (msg->status_code != SOUP_STATUS_OK) {
-		g_debug ("ignoring status code %u (%s)",
-			 msg->status_code, msg->reason_phrase);
-		return;
-	}
+	helper->plugin = plugin;
+	helper->app = app;
+	helper->percentage = G_MAXUINT;
+}
 
-	/* get data */
-	body_length = msg->response_body->length;
-	header_size = soup_message_headers_get_content_length (msg->response_headers);
+static void
+gs_plugin_download_set_progress (GsPluginDownloadHelper *helper,
+				 goffset done,
+				 goffset total)
+{
+	guint percentage;
 
 	/* size is not known */
-	if (header_size < body_length)
+	if (helper->app == NULL || total <= 0 || done > total)
 		return;
 
-	/* calulate percentage */
-	percentage = (guint) ((100 * body_length) / header_size);
+	/* only when it changes */
+	percentage = (guint) ((100 * done) / total);
+	if (percentage == helper->percentage)
+		return;
+	helper->percentage = percentage;
 	g_debug ("%s progress: %u%%", gs_app_get_id (helper->app), percentage);
 	gs_app_set_progress (helper->app, percentage);
 	gs_plugin_status_update (helper->plugin,
@@ -1149,6 +1434,116 @@ gs_plugin_download_chunk_cb (SoupMessage *msg, SoupBuffer *chunk,
 				 GS_PLUGIN_STATUS_DOWNLOADING);
 }
 
+static GInputStream *
+gs_plugin_download_send (GsPlugin *plugin,
+			 SoupMessage *msg,
+			 const gchar *uri,
+			 GCancellable *cancellable,
+			 GError **error)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	GInputStream *stream;
+	g_autoptr(GError) error_local = NULL;
+
+	stream = soup_session_send (priv->soup_session, msg, cancellable, &error_local);
+	if (stream == NULL) {
+		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_propagate_error (error, g_steal_pointer (&error_local));
+			gs_utils_error_convert_gio (error);
+			return NULL;
+		}
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
+			     "failed to download %s: %s",
+			     uri, error_local->message);
+		return NULL;
+	}
+	return stream;
+}
+
+/* the body of a failed request is often a useful message */
+static void
+gs_plugin_download_set_status_error (GError **error,
+				     const gchar *uri,
+				     SoupMessage *msg,
+				     GInputStream *stream,
+				     GCancellable *cancellable)
+{
+	gchar buf[1024];
+	gssize len;
+	g_autoptr(GString) str = g_string_new (NULL);
+
+	g_string_append (str, soup_status_get_phrase (msg->status_code));
+	len = g_input_stream_read (stream, buf, sizeof(buf) - 1, cancellable, NULL);
+	if (len > 0) {
+		buf[len] = '\0';
+		g_string_append (str, ": ");
+		g_string_append (str, buf);
+	}
+	g_set_error (error,
+		     GS_PLUGIN_ERROR,
+		     GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
+		     "failed to download %s: %s",
+		     uri, str->str);
+}
+
+/* copies the response to @ostream a chunk at a time */
+static gboolean
+gs_plugin_download_splice (GsPluginDownloadHelper *helper,
+			   const gchar *uri,
+			   GInputStream *stream,
+			   GOutputStream *ostream,
+			   goffset done,
+			   goffset total,
+			   GCancellable *cancellable,
+			   GError **error)
+{
+	g_autofree guint8 *buf = g_malloc (GS_PLUGIN_DOWNLOAD_BUFFER_SIZE);
+	g_autoptr(GError) error_local = NULL;
+
+	while (TRUE) {
+		gssize len = g_input_stream_read (stream, buf,
+						  GS_PLUGIN_DOWNLOAD_BUFFER_SIZE,
+						  cancellable, &error_local);
+		if (len < 0) {
+			if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+				g_propagate_error (error, g_steal_pointer (&error_local));
+				gs_utils_error_convert_gio (error);
+				return FALSE;
+			}
+			g_set_error (error,
+				     GS_PLUGIN_ERROR,
+				     GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
+				     "failed to download %s: %s",
+				     uri, error_local->message);
+			return FALSE;
+		}
+		if (len == 0)
+			break;
+		if (!g_output_stream_write_all (ostream, buf, (gsize) len, NULL,
+						cancellable, &error_local)) {
+			g_set_error (error,
+				     GS_PLUGIN_ERROR,
+				     GS_PLUGIN_ERROR_WRITE_FAILED,
+				     "Failed to save file: %s",
+				     error_local->message);
+			return FALSE;
+		}
+		done += len;
+		gs_plugin_download_set_progress (helper, done, total);
+	}
+	if (!g_output_stream_close (ostream, cancellable, &error_local)) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_WRITE_FAILED,
+			     "Failed to save file: %s",
+			     error_local->message);
+		return FALSE;
+	}
+	return TRUE;
+}
+
 /**
  * gs_plugin_download_data:
  * @plugin: a #GsPlugin
@@ -1172,7 +1567,8 @@ gs_plugin_download_data (GsPlugin *plugin,
 {
 	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
 	GsPluginDownloadHelper helper;
-	guint status_code;
+	g_autoptr(GInputStream) stream = NULL;
+	g_autoptr(GOutputStream) ostream = NULL;
 	g_autoptr(SoupMessage) msg = NULL;
 
 	g_return_val_if_fail (GS_IS_PLUGIN (plugin), NULL);
@@ -1199,31 +1595,256 @@ gs_plugin_download_data (GsPlugin *plugin,
 	/* remote */
 	g_debug ("downloading %s from plugin %s", uri, priv->name);
 	msg = soup_message_new (SOUP_METHOD_GET, uri);
-	if (app != NULL) {
-		helper.plugin = plugin;
-		helper.app = app;
-		helper.cancellable = cancellable;
-		g_signal_connect (msg, "got-chunk",
-				  G_CALLBACK (gs_plugin_download_chunk_cb),
-				  &helper);
-	}
-	status_code = soup_session_send_message (priv->soup_session, msg);
-	if (status_code != SOUP_STATUS_OK) {
-		g_autoptr(GString) str = g_string_new (NULL);
-		g_string_append (str, soup_status_get_phrase (status_code));
-		if (msg->response_body->data != NULL) {
-			g_string_append (str, ": ");
-			g_string_append (str, msg->response_body->data);
-		}
+	if (msg == NULL) {
 		g_set_error (error,
 			     GS_PLUGIN_ERROR,
 			     GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
-			     "failed to download %s: %s",
-			     uri, str->str);
+			     "failed to parse URI %s", uri);
+		return NULL;
+	}
+	stream = gs_plugin_download_send (plugin, msg, uri, cancellable, error);
+	if (stream == NULL)
+		return NULL;
+	if (msg->status_code != SOUP_STATUS_OK) {
+		gs_plugin_download_set_status_error (error, uri, msg, stream, cancellable);
+		return NULL;
+	}
+	gs_plugin_download_helper_init (&helper, plugin, app);
+	ostream = g_memory_output_stream_new_resizable ();
+	if (!gs_plugin_download_splice (&helper, uri, stream, ostream, 0,
+					soup_message_headers_get_content_length (msg->response_headers),
+					cancellable, error))
+		return NULL;
+	return g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (ostream));
+}
+
+/* the validators are only useful if @file was downloaded from @uri */
+static GFileInfo *
+gs_plugin_download_query_info (GFile *file, const gchar *uri)
+{
+	g_autoptr(GFileInfo) info = NULL;
+
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+				  GS_PLUGIN_DOWNLOAD_ATTR_URI ","
+				  GS_PLUGIN_DOWNLOAD_ATTR_ETAG ","
+				  GS_PLUGIN_DOWNLOAD_ATTR_LAST_MODIFIED,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL, NULL);
+	if (info == NULL)
 		return NULL;
+	if (g_strcmp0 (g_file_info_get_attribute_string (info, GS_PLUGIN_DOWNLOAD_ATTR_URI),
+		       uri) != 0) {
+		g_autofree gchar *path = g_file_get_path (file);
+		g_debug ("ignoring validators of %s from another URI", path);
+		return NULL;
+	}
+	return g_steal_pointer (&info);
+}
+
+/* not all filesystems support extended attributes, which just means the
+ * file cannot be revalidated or resumed */
+static void
+gs_plugin_download_set_validators (GFile *file, const gchar *uri, SoupMessage *msg)
+{
+	const gchar *etag;
+	const gchar *last_modified;
+
+	g_file_set_attribute_string (file, GS_PLUGIN_DOWNLOAD_ATTR_URI,
+				     uri, G_FILE_QUERY_INFO_NONE,
+				     NULL, NULL);
+	etag = soup_message_headers_get_one (msg->response_headers, "ETag");
+	if (etag != NULL) {
+		g_file_set_attribute_string (file, GS_PLUGIN_DOWNLOAD_ATTR_ETAG,
+					     etag, G_FILE_QUERY_INFO_NONE,
+					     NULL, NULL);
+	}
+	last_modified = soup_message_headers_get_one (msg->response_headers,
+						      "Last-Modified");
+	if (last_modified != NULL) {
+		g_file_set_attribute_string (file, GS_PLUGIN_DOWNLOAD_ATTR_LAST_MODIFIED,
+					     last_modified, G_FILE_QUERY_INFO_NONE,
+					     NULL, NULL);
+	}
+}
+
+/* sets @resumable if the download failed part way through but can be
+ * continued from @file_part next time */
+static gboolean
+gs_plugin_download_file_remote_part (GsPluginDownloadHelper *helper,
+				     const gchar *uri,
+				     GFile *file,
+				     GFile *file_part,
+				     gboolean *resumable,
+				     GCancellable *cancellable,
+				     GError **error)
+{
+	gboolean can_resume = FALSE;
+	goffset offset = 0;
+	goffset total;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GFileInfo) info = NULL;
+	g_autoptr(GFileInfo) info_part = NULL;
+	g_autoptr(GFileOutputStream) ostream = NULL;
+	g_autoptr(GInputStream) stream = NULL;
+	g_autoptr(SoupMessage) msg = NULL;
+
+	msg = soup_message_new (SOUP_METHOD_GET, uri);
+	if (msg == NULL) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
+			     "failed to parse URI %s", uri);
+		return FALSE;
+	}
+
+	/* only download the file again if it has changed */
+	info = gs_plugin_download_query_info (file, uri);
+	if (info != NULL) {
+		const gchar *tmp;
+		tmp = g_file_info_get_attribute_string (info, GS_PLUGIN_DOWNLOAD_ATTR_ETAG);
+		if (tmp != NULL)
+			soup_message_headers_append (msg->request_headers, "If-None-Match", tmp);
+		tmp = g_file_info_get_attribute_string (info, GS_PLUGIN_DOWNLOAD_ATTR_LAST_MODIFIED);
+		if (tmp != NULL)
+			soup_message_headers_append (msg->request_headers, "If-Modified-Since", tmp);
+	}
+
+	/* continue an earlier download, but only if it is the same file */
+	info_part = gs_plugin_download_query_info (file_part, uri);
+	if (info_part != NULL && g_file_info_get_size (info_part) > 0) {
+		const gchar *validator;
+		validator = g_file_info_get_attribute_string (info_part, GS_PLUGIN_DOWNLOAD_ATTR_ETAG);
+		if (validator != NULL && g_str_has_prefix (validator, "W/"))
+			validator = NULL;
+		if (validator == NULL)
+			validator = g_file_info_get_attribute_string (info_part, GS_PLUGIN_DOWNLOAD_ATTR_LAST_MODIFIED);
+		if (validator != NULL) {
+			offset = g_file_info_get_size (info_part);
+			soup_message_headers_set_range (msg->request_headers, offset, -1);
+			soup_message_headers_append (msg->request_headers, "If-Range", validator);
+		}
+	}
+
+	stream = gs_plugin_download_send (helper->plugin, msg, uri, cancellable, error);
+	if (stream == NULL)
+		return FALSE;
+	switch (msg->status_code) {
+	case SOUP_STATUS_NOT_MODIFIED:
+		/* callers use the modification time as the age of the data */
+		g_debug ("%s has not changed", uri);
+		if (!g_file_set_attribute_uint64 (file,
+						  G_FILE_ATTRIBUTE_TIME_MODIFIED,
+						  (guint64) g_get_real_time () / G_USEC_PER_SEC,
+						  G_FILE_QUERY_INFO_NONE,
+						  cancellable,
+						  &error_local)) {
+			g_autofree gchar *path = g_file_get_path (file);
+			g_debug ("failed to update %s: %s",
+				 path, error_local->message);
+		}
+		return TRUE;
+	case SOUP_STATUS_PARTIAL_CONTENT:
+	{
+		goffset start = 0;
+		goffset end = 0;
+		if (!soup_message_headers_get_content_range (msg->response_headers,
+							     &start, &end, NULL) ||
+		    start != offset) {
+			g_set_error (error,
+				     GS_PLUGIN_ERROR,
+				     GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
+				     "failed to download %s: unexpected range",
+				     uri);
+			return FALSE;
+		}
+		g_debug ("resuming download of %s at %" G_GOFFSET_FORMAT,
+			 uri, offset);
+		ostream = g_file_append_to (file_part, G_FILE_CREATE_NONE,
+					    cancellable, &error_local);
+		can_resume = TRUE;
+		break;
+	}
+	case SOUP_STATUS_OK:
+	{
+		const gchar *etag;
+		offset = 0;
+		ostream = g_file_replace (file_part, NULL, FALSE,
+					  G_FILE_CREATE_REPLACE_DESTINATION,
+					  cancellable, &error_local);
+		if (ostream != NULL)
+			gs_plugin_download_set_validators (file_part, uri, msg);
+		etag = soup_message_headers_get_one (msg->response_headers, "ETag");
+		if (etag != NULL && !g_str_has_prefix (etag, "W/"))
+			can_resume = TRUE;
+		if (soup_message_headers_get_one (msg->response_headers, "Last-Modified") != NULL)
+			can_resume = TRUE;
+		break;
+	}
+	default:
+		gs_plugin_download_set_status_error (error, uri, msg, stream, cancellable);
+		return FALSE;
+	}
+	if (ostream == NULL) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_WRITE_FAILED,
+			     "Failed to save file: %s",
+			     error_local->message);
+		return FALSE;
+	}
+
+	/* write to disk as it arrives, keeping what we have if interrupted */
+	total = soup_message_headers_get_content_length (msg->response_headers);
+	if (total > 0)
+		total += offset;
+	if (!gs_plugin_download_splice (helper, uri, stream,
+					G_OUTPUT_STREAM (ostream),
+					offset, total,
+					cancellable, error)) {
+		*resumable = can_resume;
+		return FALSE;
+	}
+
+	/* the validators are moved along with the file */
+	if (!g_file_move (file_part, file, G_FILE_COPY_OVERWRITE,
+			  cancellable, NULL, NULL, &error_local)) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_WRITE_FAILED,
+			     "Failed to save file: %s",
+			     error_local->message);
+		return FALSE;
 	}
-	return g_bytes_new (msg->response_body->data,
-			    (gsize) msg->response_body->length);
+	return TRUE;
+}
+
+static gboolean
+gs_plugin_download_file_remote (GsPluginDownloadHelper *helper,
+				const gchar *uri,
+				const gchar *filename,
+				GCancellable *cancellable,
+				GError **error)
+{
+	gboolean resumable = FALSE;
+	g_autofree gchar *filename_part = g_strdup_printf ("%s.part", filename);
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GFile) file = g_file_new_for_path (filename);
+	g_autoptr(GFile) file_part = g_file_new_for_path (filename_part);
+
+	if (gs_plugin_download_file_remote_part (helper, uri, file, file_part,
+						 &resumable, cancellable,
+						 &error_local))
+		return TRUE;
+
+	/* only keep what was downloaded if the connection failed part way
+	 * through and it can be continued next time */
+	if (!resumable ||
+	    !g_error_matches (error_local, GS_PLUGIN_ERROR,
+			      GS_PLUGIN_ERROR_DOWNLOAD_FAILED))
+		g_file_delete (file_part, NULL, NULL);
+	g_propagate_error (error, g_steal_pointer (&error_local));
+	return FALSE;
 }
 
 /**
@@ -1237,6 +1858,10 @@ gs_plugin_download_data (GsPlugin *plugin,
  *
  * Downloads data and saves it to a file.
  *
+ * The data is written to disk as it arrives. If @filename was downloaded
+ * before it is only downloaded again if it has changed on the server, and
+ * an interrupted download is continued where possible.
+ *
  * Returns: %TRUE for success
  *
  * Since: 3.22
@@ -1251,9 +1876,7 @@ gs_plugin_download_file (GsPlugin *plugin,
 {
 	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
 	GsPluginDownloadHelper helper;
-	guint status_code;
 	g_autoptr(GError) error_local = NULL;
-	g_autoptr(SoupMessage) msg = NULL;
 
 	g_return_val_if_fail (GS_IS_PLUGIN (plugin), FALSE);
 	g_return_val_if_fail (uri != NULL, FALSE);
@@ -1286,46 +1909,115 @@ gs_plugin_download_file (GsPlugin *plugin,
 
 	/* remote */
 	g_debug ("downloading %s to %s from plugin %s", uri, filename, priv->name);
-	msg = soup_message_new (SOUP_METHOD_GET, uri);
-	if (msg == NULL) {
-		g_set_error (error,
-			     GS_PLUGIN_ERROR,
-			     GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
-			     "failed to parse URI %s", uri);
-		return FALSE;
+	gs_plugin_download_helper_init (&helper, plugin, app);
+	return gs_plugin_download_file_remote (&helper, uri, filename,
+					       cancellable, error);
+}
+
+typedef struct {
+	GsPlugin	*plugin;
+	GsApp		*app;		/* allow-none */
+	GPtrArray	*uris;
+	GPtrArray	*filenames;
+	GCancellable	*cancellable;
+	GMutex		 mutex;
+	GError		*error;		/* the first failure */
+	guint		 n_done;
+} GsPluginDownloadBatch;
+
+static void
+gs_plugin_download_batch_cb (gpointer data, gpointer user_data)
+{
+	GsPluginDownloadBatch *batch = (GsPluginDownloadBatch *) user_data;
+	guint idx = GPOINTER_TO_UINT (data) - 1;
+	guint percentage;
+	g_autoptr(GError) error_local = NULL;
+
+	if (!gs_plugin_download_file (batch->plugin,
+				      NULL, /* app */
+				      g_ptr_array_index (batch->uris, idx),
+				      g_ptr_array_index (batch->filenames, idx),
+				      batch->cancellable,
+				      &error_local)) {
+		g_debug ("failed to download: %s", error_local->message);
 	}
-	if (app != NULL) {
-		helper.plugin = plugin;
-		helper.app = app;
-		helper.cancellable = cancellable;
-		g_signal_connect (msg, "got-chunk",
-				  G_CALLBACK (gs_plugin_download_chunk_cb),
-				  &helper);
+
+	/* the progress is the number of files done */
+	g_mutex_lock (&batch->mutex);
+	if (error_local != NULL && batch->error == NULL)
+		batch->error = g_steal_pointer (&error_local);
+	percentage = (100 * ++batch->n_done) / batch->uris->len;
+	g_mutex_unlock (&batch->mutex);
+	if (batch->app != NULL) {
+		gs_app_set_progress (batch->app, percentage);
+		gs_plugin_status_update (batch->plugin,
+					 batch->app,
+					 GS_PLUGIN_STATUS_DOWNLOADING);
 	}
-	status_code = soup_session_send_message (priv->soup_session, msg);
-	if (status_code != SOUP_STATUS_OK) {
-		g_autoptr(GString) str = g_string_new (NULL);
-		g_string_append (str, soup_status_get_phrase (status_code));
-		if (msg->response_body->data != NULL) {
-			g_string_append (str, ": ");
-			g_string_append (str, msg->response_body->data);
-		}
-		g_set_error (error,
-			     GS_PLUGIN_ERROR,
-			     GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
-			     "failed to download %s: %s",
-			     uri, str->str);
+}
+
+/**
+ * gs_plugin_download_files:
+ * @plugin: a #GsPlugin
+ * @app: a #GsApp, or %NULL
+ * @uris: (element-type utf8): remote URIs
+ * @filenames: (element-type filename): local filenames, one for each URI
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Downloads several files at the same time, in the same way as
+ * gs_plugin_download_file(). If a download fails the others are still
+ * completed, and the first error is returned.
+ *
+ * Returns: %TRUE if all the files were downloaded
+ *
+ * Since: 3.26
+ **/
+gboolean
+gs_plugin_download_files (GsPlugin *plugin,
+			  GsApp *app,
+			  GPtrArray *uris,
+			  GPtrArray *filenames,
+			  GCancellable *cancellable,
+			  GError **error)
+{
+	GsPluginDownloadBatch batch = { plugin, app, uris, filenames, cancellable };
+	GThreadPool *pool;
+
+	g_return_val_if_fail (GS_IS_PLUGIN (plugin), FALSE);
+	g_return_val_if_fail (uris != NULL, FALSE);
+	g_return_val_if_fail (filenames != NULL, FALSE);
+	g_return_val_if_fail (uris->len == filenames->len, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	/* nothing to do */
+	if (uris->len == 0)
+		return TRUE;
+
+	/* not worth a thread */
+	if (uris->len == 1) {
+		return gs_plugin_download_file (plugin, app,
+						g_ptr_array_index (uris, 0),
+						g_ptr_array_index (filenames, 0),
+						cancellable, error);
+	}
+
+	g_mutex_init (&batch.mutex);
+	pool = g_thread_pool_new (gs_plugin_download_batch_cb, &batch,
+				  (gint) MIN (uris->len, GS_PLUGIN_DOWNLOAD_BATCH_MAX),
+				  FALSE, error);
+	if (pool == NULL) {
+		g_mutex_clear (&batch.mutex);
 		return FALSE;
 	}
-	if (!g_file_set_contents (filename,
-				  msg->response_body->data,
-				  msg->response_body->length,
-				  &error_local)) {
-		g_set_error (error,
-			     GS_PLUGIN_ERROR,
-			     GS_PLUGIN_ERROR_WRITE_FAILED,
-			     "Failed to save file: %s",
-			     error_local->message);
+	for (guint i = 0; i < uris->len; i++)
+		g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), NULL);
+
+	/* wait for all the downloads to complete */
+	g_thread_pool_free (pool, FALSE, TRUE);
+	g_mutex_clear (&batch.mutex);
+	if (batch.error != NULL) {
+		g_propagate_error (error, batch.error);
 		return FALSE;
 	}
 	return TRUE;
@@ -1333,9 +2025,9 @@ gs_plugin_download_file (GsPlugin *plugin,
 
 static gchar *
 gs_plugin_download_rewrite_resource_uri (GsPlugin *plugin,
-					 GsApp *app,
 					 const gchar *uri,
-					 GCancellable *cancellable,
+					 GPtrArray *uris_dl,
+					 GPtrArray *filenames_dl,
 					 GError **error)
 {
 	g_autofree gchar *cachefn = NULL;
@@ -1366,11 +2058,13 @@ gs_plugin_download_rewrite_resource_uri (GsPlugin *plugin,
 	if (g_file_test (cachefn, G_FILE_TEST_EXISTS))
 		return g_steal_pointer (&cachefn);
 
-	/* download */
-	if (!gs_plugin_download_file (plugin, app, uri, cachefn,
-				      cancellable, error)) {
-		return NULL;
+	/* download with the others */
+	for (guint i = 0; i < filenames_dl->len; i++) {
+		if (g_strcmp0 (g_ptr_array_index (filenames_dl, i), cachefn) == 0)
+			return g_steal_pointer (&cachefn);
 	}
+	g_ptr_array_add (uris_dl, g_strdup (uri));
+	g_ptr_array_add (filenames_dl, g_strdup (cachefn));
 	return g_steal_pointer (&cachefn);
 }
 
@@ -1395,6 +2089,8 @@ gs_plugin_download_rewrite_resource (GsPlugin *plugin,
 				     GError **error)
 {
 	guint start = 0;
+	g_autoptr(GPtrArray) filenames_dl = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GPtrArray) uris_dl = g_ptr_array_new_with_free_func (g_free);
 	g_autoptr(GString) resource_str = g_string_new (resource);
 	g_autoptr(GString) str = g_string_new (NULL);
 
@@ -1431,9 +2127,9 @@ gs_plugin_download_rewrite_resource (GsPlugin *plugin,
 
 			/* download them to per-user cache */
 			cachefn = gs_plugin_download_rewrite_resource_uri (plugin,
-									   app,
 									   uri,
-									   cancellable,
+									   uris_dl,
+									   filenames_dl,
 									   error);
 			if (cachefn == NULL)
 				return NULL;
@@ -1442,9 +2138,132 @@ gs_plugin_download_rewrite_resource (GsPlugin *plugin,
 			start = 0;
 		}
 	}
+
+	/* get all the missing resources at the same time */
+	if (!gs_plugin_download_files (plugin, app, uris_dl, filenames_dl,
+				       cancellable, error))
+		return NULL;
 	return g_strdup (str->str);
 }
 
+static void
+gs_plugin_cache_item_free (GsPluginCacheItem *item)
+{
+	g_free (item->key);
+	g_object_unref (item->app);
+	g_slice_free (GsPluginCacheItem, item);
+}
+
+static void
+gs_plugin_cache_weak_ref_free (GWeakRef *weak)
+{
+	g_weak_ref_clear (weak);
+	g_free (weak);
+}
+
+/* cache_mutex must be held */
+static void
+gs_plugin_cache_remove_item (GsPlugin *plugin, GsPluginCacheItem *item)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_queue_unlink (&priv->cache_lru, &item->link);
+	g_hash_table_remove (priv->cache, item->key);
+}
+
+/* cache_mutex must be held */
+static void
+gs_plugin_cache_touch_item (GsPlugin *plugin, GsPluginCacheItem *item)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_queue_unlink (&priv->cache_lru, &item->link);
+	g_queue_push_head_link (&priv->cache_lru, &item->link);
+}
+
+/* cache_mutex must be held */
+static GsPluginCacheItem *
+gs_plugin_cache_insert_item (GsPlugin *plugin, const gchar *key, GsApp *app)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	GsPluginCacheItem *item = g_slice_new0 (GsPluginCacheItem);
+	item->key = g_strdup (key);
+	item->app = g_object_ref (app);
+	item->link.data = item;
+	g_hash_table_insert (priv->cache, item->key, item);
+	g_queue_push_head_link (&priv->cache_lru, &item->link);
+	g_hash_table_remove (priv->cache_evicted, key);
+	return item;
+}
+
+/* forgets the evicted apps that have since been freed; cache_mutex must
+ * be held */
+static void
+gs_plugin_cache_prune_evicted (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init (&iter, priv->cache_evicted);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		g_autoptr(GsApp) app = g_weak_ref_get ((GWeakRef *) value);
+		if (app == NULL)
+			g_hash_table_iter_remove (&iter);
+	}
+}
+
+/* drops the least recently used apps until the cache is small enough,
+ * keeping a weak reference so that a lookup for an app that is still in
+ * use elsewhere returns the same object rather than a plugin creating a
+ * second GsApp for the key; cache_mutex must be held */
+static void
+gs_plugin_cache_evict (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+
+	if (priv->cache_size_max == 0)
+		return;
+	if (g_hash_table_size (priv->cache) <= priv->cache_size_max)
+		return;
+	gs_plugin_cache_prune_evicted (plugin);
+	while (g_hash_table_size (priv->cache) > priv->cache_size_max) {
+		GsPluginCacheItem *item = priv->cache_lru.tail->data;
+		GWeakRef *weak = g_new0 (GWeakRef, 1);
+		g_weak_ref_init (weak, item->app);
+		g_hash_table_insert (priv->cache_evicted, g_strdup (item->key), weak);
+		gs_plugin_cache_remove_item (plugin, item);
+		priv->cache_evictions++;
+	}
+}
+
+/* a rough idea of the memory used by the largest parts of an app */
+static gsize
+gs_plugin_cache_get_app_size (GsApp *app)
+{
+	GdkPixbuf *pixbuf = gs_app_get_pixbuf (app);
+	GPtrArray *screenshots = gs_app_get_screenshots (app);
+	const gchar *tmp;
+	gsize sz = 0;
+
+	if (pixbuf != NULL) {
+		sz += (gsize) gdk_pixbuf_get_rowstride (pixbuf) *
+		      (gsize) gdk_pixbuf_get_height (pixbuf);
+	}
+	tmp = gs_app_get_description (app);
+	if (tmp != NULL)
+		sz += strlen (tmp);
+	for (guint i = 0; i < screenshots->len; i++) {
+		AsScreenshot *ss = g_ptr_array_index (screenshots, i);
+		GPtrArray *images = as_screenshot_get_images (ss);
+		for (guint j = 0; j < images->len; j++) {
+			AsImage *im = g_ptr_array_index (images, j);
+			tmp = as_image_get_url (im);
+			if (tmp != NULL)
+				sz += strlen (tmp);
+		}
+	}
+	return sz;
+}
+
 /**
  * gs_plugin_cache_lookup:
  * @plugin: a #GsPlugin
@@ -1460,7 +2279,7 @@ GsApp *
 gs_plugin_cache_lookup (GsPlugin *plugin, const gchar *key)
 {
 	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
-	GsApp *app;
+	GsApp *app = NULL;
 	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->cache_mutex);
 
 	g_return_val_if_fail (GS_IS_PLUGIN (plugin), NULL);
@@ -1472,13 +2291,30 @@ gs_plugin_cache_lookup (GsPlugin *plugin, const gchar *key)
 			g_critical ("key %s is not a unique_id", key);
 			return NULL;
 		}
-		app = gs_app_list_lookup (priv->global_cache, key);
+		/* ref under the list lock so a trim cannot free it */
+		app = gs_app_list_lookup_ref (priv->global_cache, key);
 	} else {
-		app = g_hash_table_lookup (priv->cache, key);
+		GsPluginCacheItem *item = g_hash_table_lookup (priv->cache, key);
+		if (item != NULL) {
+			gs_plugin_cache_touch_item (plugin, item);
+			app = g_object_ref (item->app);
+		} else {
+			/* evicted, but still being used elsewhere */
+			GWeakRef *weak = g_hash_table_lookup (priv->cache_evicted, key);
+			if (weak != NULL)
+				app = g_weak_ref_get (weak);
+			if (app != NULL) {
+				gs_plugin_cache_insert_item (plugin, key, app);
+				gs_plugin_cache_evict (plugin);
+			}
+		}
 	}
-	if (app == NULL)
+	if (app == NULL) {
+		priv->cache_misses++;
 		return NULL;
-	return g_object_ref (app);
+	}
+	priv->cache_hits++;
+	return app;
 }
 
 /**
@@ -1494,23 +2330,28 @@ void
 gs_plugin_cache_remove (GsPlugin *plugin, const gchar *key)
 {
 	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	GsPluginCacheItem *item;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->cache_mutex);
 
 	g_return_if_fail (GS_IS_PLUGIN (plugin));
 	g_return_if_fail (key != NULL);
 
 	/* global, so using internal unique_id */
 	if (gs_plugin_has_flags (plugin, GS_PLUGIN_FLAGS_GLOBAL_CACHE)) {
-		GsApp *app_tmp;
+		g_autoptr(GsApp) app_tmp = NULL;
 		if (!as_utils_unique_id_valid (key)) {
 			g_critical ("key %s is not a unique_id", key);
 			return;
 		}
-		app_tmp = gs_app_list_lookup (priv->global_cache, key);
+		app_tmp = gs_app_list_lookup_ref (priv->global_cache, key);
 		if (app_tmp != NULL)
 			gs_app_list_remove (priv->global_cache, app_tmp);
 		return;
 	}
-	g_hash_table_remove (priv->cache, key);
+	g_hash_table_remove (priv->cache_evicted, key);
+	item = g_hash_table_lookup (priv->cache, key);
+	if (item != NULL)
+		gs_plugin_cache_remove_item (plugin, item);
 }
 
 /**
@@ -1522,12 +2363,18 @@ gs_plugin_cache_remove (GsPlugin *plugin, const gchar *key)
  * Adds an application to the per-plugin cache. This is optional,
  * and the plugin can use the cache however it likes.
  *
+ * Applications that have not been used recently may be removed from the
+ * cache if it grows larger than the limit set by the user. An application
+ * that is removed while still being used elsewhere is returned again by
+ * gs_plugin_cache_lookup() rather than being lost.
+ *
  * Since: 3.22
  **/
 void
 gs_plugin_cache_add (GsPlugin *plugin, const gchar *key, GsApp *app)
 {
 	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	GsPluginCacheItem *item;
 	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->cache_mutex);
 
 	g_return_if_fail (GS_IS_PLUGIN (plugin));
@@ -1547,9 +2394,15 @@ gs_plugin_cache_add (GsPlugin *plugin, const gchar *key, GsApp *app)
 		return;
 	}
 
-	if (g_hash_table_lookup (priv->cache, key) == app)
+	/* replace the app, keeping the existing key */
+	item = g_hash_table_lookup (priv->cache, key);
+	if (item != NULL) {
+		g_set_object (&item->app, app);
+		gs_plugin_cache_touch_item (plugin, item);
 		return;
-	g_hash_table_insert (priv->cache, g_strdup (key), g_object_ref (app));
+	}
+	gs_plugin_cache_insert_item (plugin, key, app);
+	gs_plugin_cache_evict (plugin);
 }
 
 /**
@@ -1575,6 +2428,60 @@ gs_plugin_cache_invalidate (GsPlugin *plugin)
 	g_return_if_fail (GS_IS_PLUGIN (plugin));
 
 	g_hash_table_remove_all (priv->cache);
+	g_hash_table_remove_all (priv->cache_evicted);
+	g_queue_init (&priv->cache_lru);
+}
+
+/**
+ * gs_plugin_cache_set_size_max:
+ * @plugin: a #GsPlugin
+ * @size_max: the number of applications, or 0 for no limit
+ *
+ * Sets the number of applications kept in the per-plugin cache.
+ *
+ * Since: 3.26
+ **/
+void
+gs_plugin_cache_set_size_max (GsPlugin *plugin, guint size_max)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->cache_mutex);
+
+	g_return_if_fail (GS_IS_PLUGIN (plugin));
+
+	priv->cache_size_max = size_max;
+	gs_plugin_cache_evict (plugin);
+}
+
+/**
+ * gs_plugin_cache_dump_state:
+ * @plugin: a #GsPlugin
+ *
+ * Prints the size of the per-plugin cache and how well it is working.
+ *
+ * Since: 3.26
+ **/
+void
+gs_plugin_cache_dump_state (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	gsize sz = 0;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->cache_mutex);
+
+	g_return_if_fail (GS_IS_PLUGIN (plugin));
+
+	for (GList *l = priv->cache_lru.head; l != NULL; l = l->next) {
+		GsPluginCacheItem *item = l->data;
+		sz += gs_plugin_cache_get_app_size (item->app);
+	}
+	g_debug ("[%s]	cache: %u apps (%" G_GSIZE_FORMAT " kB), "
+		 "%u hits, %u misses, %u evictions",
+		 priv->name,
+		 g_hash_table_size (priv->cache),
+		 sz / 1024,
+		 priv->cache_hits,
+		 priv->cache_misses,
+		 priv->cache_evictions);
 }
 
 /**
@@ -1667,6 +2574,137 @@ gs_plugin_error_to_string (GsPluginError error)
 	return NULL;
 }
 
+static const gchar *vfunc_names[] = {
+	NULL,					/* unknown */
+	"gs_plugin_initialize",
+	"gs_plugin_destroy",
+	"gs_plugin_setup",
+	"gs_plugin_adopt_app",
+	"gs_plugin_add_search",
+	"gs_plugin_add_search_files",
+	"gs_plugin_add_search_what_provides",
+	"gs_plugin_add_installed",
+	"gs_plugin_add_updates",
+	"gs_plugin_add_updates_pending",
+	"gs_plugin_add_distro_upgrades",
+	"gs_plugin_add_sources",
+	"gs_plugin_add_updates_historical",
+	"gs_plugin_add_categories",
+	"gs_plugin_add_category_apps",
+	"gs_plugin_add_recent",
+	"gs_plugin_add_popular",
+	"gs_plugin_add_featured",
+	"gs_plugin_add_unvoted_reviews",
+	"gs_plugin_refine",
+	"gs_plugin_refine_app",
+	"gs_plugin_refine_wildcard",
+	"gs_plugin_launch",
+	"gs_plugin_add_shortcut",
+	"gs_plugin_remove_shortcut",
+	"gs_plugin_update_cancel",
+	"gs_plugin_app_purchase",
+	"gs_plugin_app_install",
+	"gs_plugin_app_remove",
+	"gs_plugin_app_set_rating",
+	"gs_plugin_update_app",
+	"gs_plugin_app_upgrade_download",
+	"gs_plugin_app_upgrade_trigger",
+	"gs_plugin_review_submit",
+	"gs_plugin_review_upvote",
+	"gs_plugin_review_downvote",
+	"gs_plugin_review_report",
+	"gs_plugin_review_remove",
+	"gs_plugin_review_dismiss",
+	"gs_plugin_refresh",
+	"gs_plugin_file_to_app",
+	"gs_plugin_url_to_app",
+	"gs_plugin_update",
+	"gs_plugin_auth_login",
+	"gs_plugin_auth_logout",
+	"gs_plugin_auth_lost_password",
+	"gs_plugin_auth_register",
+};
+G_STATIC_ASSERT (G_N_ELEMENTS (vfunc_names) == GS_PLUGIN_VFUNC_LAST);
+
+/**
+ * gs_plugin_vfunc_to_function_name: (skip)
+ * @vfunc: a #GsPluginVfunc, e.g. %GS_PLUGIN_VFUNC_REFINE_APP
+ *
+ * Converts the enumerated vfunc to the symbol name.
+ *
+ * Returns: a string, or %NULL for invalid
+ **/
+const gchar *
+gs_plugin_vfunc_to_function_name (GsPluginVfunc vfunc)
+{
+	if (vfunc >= GS_PLUGIN_VFUNC_LAST)
+		return NULL;
+	return vfunc_names[vfunc];
+}
+
+static const GsPluginVfunc action_vfuncs[] = {
+	GS_PLUGIN_VFUNC_UNKNOWN,		/* unknown */
+	GS_PLUGIN_VFUNC_SETUP,			/* setup */
+	GS_PLUGIN_VFUNC_APP_INSTALL,		/* install */
+	GS_PLUGIN_VFUNC_APP_REMOVE,		/* remove */
+	GS_PLUGIN_VFUNC_UPDATE,			/* update */
+	GS_PLUGIN_VFUNC_APP_SET_RATING,		/* set-rating */
+	GS_PLUGIN_VFUNC_APP_UPGRADE_DOWNLOAD,	/* upgrade-download */
+	GS_PLUGIN_VFUNC_APP_UPGRADE_TRIGGER,	/* upgrade-trigger */
+	GS_PLUGIN_VFUNC_LAUNCH,			/* launch */
+	GS_PLUGIN_VFUNC_UPDATE_CANCEL,		/* update-cancel */
+	GS_PLUGIN_VFUNC_ADD_SHORTCUT,		/* add-shortcut */
+	GS_PLUGIN_VFUNC_REMOVE_SHORTCUT,	/* remove-shortcut */
+	GS_PLUGIN_VFUNC_REVIEW_SUBMIT,		/* review-submit */
+	GS_PLUGIN_VFUNC_REVIEW_UPVOTE,		/* review-upvote */
+	GS_PLUGIN_VFUNC_REVIEW_DOWNVOTE,	/* review-downvote */
+	GS_PLUGIN_VFUNC_REVIEW_REPORT,		/* review-report */
+	GS_PLUGIN_VFUNC_REVIEW_REMOVE,		/* review-remove */
+	GS_PLUGIN_VFUNC_REVIEW_DISMISS,		/* review-dismiss */
+	GS_PLUGIN_VFUNC_ADD_UPDATES,		/* get-updates */
+	GS_PLUGIN_VFUNC_ADD_DISTRO_UPGRADES,	/* get-distro-updates */
+	GS_PLUGIN_VFUNC_ADD_UNVOTED_REVIEWS,	/* get-unvoted-reviews */
+	GS_PLUGIN_VFUNC_ADD_SOURCES,		/* get-sources */
+	GS_PLUGIN_VFUNC_ADD_INSTALLED,		/* get-installed */
+	GS_PLUGIN_VFUNC_ADD_POPULAR,		/* get-popular */
+	GS_PLUGIN_VFUNC_ADD_FEATURED,		/* get-featured */
+	GS_PLUGIN_VFUNC_ADD_SEARCH,		/* search */
+	GS_PLUGIN_VFUNC_ADD_SEARCH_FILES,	/* search-files */
+	GS_PLUGIN_VFUNC_ADD_SEARCH_WHAT_PROVIDES, /* search-provides */
+	GS_PLUGIN_VFUNC_ADD_CATEGORIES,		/* get-categories */
+	GS_PLUGIN_VFUNC_ADD_CATEGORY_APPS,	/* get-category-apps */
+	GS_PLUGIN_VFUNC_REFINE,			/* refine */
+	GS_PLUGIN_VFUNC_REFRESH,		/* refresh */
+	GS_PLUGIN_VFUNC_FILE_TO_APP,		/* file-to-app */
+	GS_PLUGIN_VFUNC_AUTH_LOGIN,		/* auth-login */
+	GS_PLUGIN_VFUNC_AUTH_LOGOUT,		/* auth-logout */
+	GS_PLUGIN_VFUNC_AUTH_REGISTER,		/* auth-register */
+	GS_PLUGIN_VFUNC_AUTH_LOST_PASSWORD,	/* auth-lost-password */
+	GS_PLUGIN_VFUNC_URL_TO_APP,		/* url-to-app */
+	GS_PLUGIN_VFUNC_ADD_RECENT,		/* get-recent */
+	GS_PLUGIN_VFUNC_ADD_UPDATES_HISTORICAL,	/* get-updates-historical */
+	GS_PLUGIN_VFUNC_INITIALIZE,		/* initialize */
+	GS_PLUGIN_VFUNC_DESTROY,		/* destroy */
+	GS_PLUGIN_VFUNC_APP_PURCHASE,		/* purchase */
+};
+G_STATIC_ASSERT (G_N_ELEMENTS (action_vfuncs) == GS_PLUGIN_ACTION_LAST);
+
+/**
+ * gs_plugin_action_to_vfunc: (skip)
+ * @action: a #GsPluginAction, e.g. %GS_PLUGIN_ACTION_REFINE
+ *
+ * Converts the enumerated action to the vfunc that is run by default.
+ *
+ * Returns: a #GsPluginVfunc, or %GS_PLUGIN_VFUNC_UNKNOWN for invalid
+ **/
+GsPluginVfunc
+gs_plugin_action_to_vfunc (GsPluginAction action)
+{
+	if (action >= GS_PLUGIN_ACTION_LAST)
+		return GS_PLUGIN_VFUNC_UNKNOWN;
+	return action_vfuncs[action];
+}
+
 /**
  * gs_plugin_action_to_function_name: (skip)
  * @action: a #GsPluginAction, e.g. %GS_PLUGIN_ERROR_NO_NETWORK
@@ -1678,89 +2716,7 @@ gs_plugin_error_to_string (GsPluginError error)
 const gchar *
 gs_plugin_action_to_function_name (GsPluginAction action)
 {
-	if (action == GS_PLUGIN_ACTION_REFRESH)
-		return "gs_plugin_refresh";
-	if (action == GS_PLUGIN_ACTION_REVIEW_SUBMIT)
-		return "gs_plugin_review_submit";
-	if (action == GS_PLUGIN_ACTION_REVIEW_UPVOTE)
-		return "gs_plugin_review_upvote";
-	if (action == GS_PLUGIN_ACTION_REVIEW_DOWNVOTE)
-		return "gs_plugin_review_downvote";
-	if (action == GS_PLUGIN_ACTION_REVIEW_REPORT)
-		return "gs_plugin_review_report";
-	if (action == GS_PLUGIN_ACTION_REVIEW_REMOVE)
-		return "gs_plugin_review_remove";
-	if (action == GS_PLUGIN_ACTION_REVIEW_DISMISS)
-		return "gs_plugin_review_dismiss";
-	if (action == GS_PLUGIN_ACTION_INSTALL)
-		return "gs_plugin_app_install";
-	if (action == GS_PLUGIN_ACTION_REMOVE)
-		return "gs_plugin_app_remove";
-	if (action == GS_PLUGIN_ACTION_SET_RATING)
-		return "gs_plugin_app_set_rating";
-	if (action == GS_PLUGIN_ACTION_UPGRADE_DOWNLOAD)
-		return "gs_plugin_app_upgrade_download";
-	if (action == GS_PLUGIN_ACTION_UPGRADE_TRIGGER)
-		return "gs_plugin_app_upgrade_trigger";
-	if (action == GS_PLUGIN_ACTION_LAUNCH)
-		return "gs_plugin_launch";
-	if (action == GS_PLUGIN_ACTION_UPDATE_CANCEL)
-		return "gs_plugin_update_cancel";
-	if (action == GS_PLUGIN_ACTION_ADD_SHORTCUT)
-		return "gs_plugin_add_shortcut";
-	if (action == GS_PLUGIN_ACTION_REMOVE_SHORTCUT)
-		return "gs_plugin_remove_shortcut";
-	if (action == GS_PLUGIN_ACTION_REFINE)
-		return "gs_plugin_refine";
-	if (action == GS_PLUGIN_ACTION_UPDATE)
-		return "gs_plugin_update";
-	if (action == GS_PLUGIN_ACTION_FILE_TO_APP)
-		return "gs_plugin_file_to_app";
-	if (action == GS_PLUGIN_ACTION_URL_TO_APP)
-		return "gs_plugin_url_to_app";
-	if (action == GS_PLUGIN_ACTION_GET_DISTRO_UPDATES)
-		return "gs_plugin_add_distro_upgrades";
-	if (action == GS_PLUGIN_ACTION_GET_SOURCES)
-		return "gs_plugin_add_sources";
-	if (action == GS_PLUGIN_ACTION_GET_INSTALLED)
-		return "gs_plugin_add_installed";
-	if (action == GS_PLUGIN_ACTION_GET_FEATURED)
-		return "gs_plugin_add_featured";
-	if (action == GS_PLUGIN_ACTION_GET_UPDATES_HISTORICAL)
-		return "gs_plugin_add_updates_historical";
-	if (action == GS_PLUGIN_ACTION_GET_UPDATES)
-		return "gs_plugin_add_updates";
-	if (action == GS_PLUGIN_ACTION_GET_POPULAR)
-		return "gs_plugin_add_popular";
-	if (action == GS_PLUGIN_ACTION_GET_RECENT)
-		return "gs_plugin_add_recent";
-	if (action == GS_PLUGIN_ACTION_SEARCH)
-		return "gs_plugin_add_search";
-	if (action == GS_PLUGIN_ACTION_SEARCH_FILES)
-		return "gs_plugin_add_search_files";
-	if (action == GS_PLUGIN_ACTION_SEARCH_PROVIDES)
-		return "gs_plugin_add_search_what_provides";
-	if (action == GS_PLUGIN_ACTION_AUTH_LOGIN)
-		return "gs_plugin_auth_login";
-	if (action == GS_PLUGIN_ACTION_AUTH_LOGOUT)
-		return "gs_plugin_auth_logout";
-	if (action == GS_PLUGIN_ACTION_AUTH_REGISTER)
-		return "gs_plugin_auth_register";
-	if (action == GS_PLUGIN_ACTION_AUTH_LOST_PASSWORD)
-		return "gs_plugin_auth_lost_password";
-	if (action == GS_PLUGIN_ACTION_GET_CATEGORY_APPS)
-		return "gs_plugin_add_category_apps";
-	if (action == GS_PLUGIN_ACTION_GET_CATEGORIES)
-		return "gs_plugin_add_categories";
-	if (action == GS_PLUGIN_ACTION_SETUP)
-		return "gs_plugin_setup";
-	if (action == GS_PLUGIN_ACTION_INITIALIZE)
-		return "gs_plugin_initialize";
-	if (action == GS_PLUGIN_ACTION_DESTROY)
-		return "gs_plugin_destroy";
-	if (action == GS_PLUGIN_ACTION_PURCHASE)
-		return "gs_plugin_app_purchase";
-	return NULL;
+	return gs_plugin_vfunc_to_function_name (gs_plugin_action_to_vfunc (action));
 }
 
 /**
@@ -2155,13 +3111,23 @@ gs_plugin_init (GsPlugin *plugin)
 	priv->profile = as_profile_new ();
 	priv->cache = g_hash_table_new_full ((GHashFunc) as_utils_unique_id_hash,
 					     (GEqualFunc) as_utils_unique_id_equal,
-					     g_free,
-					     (GDestroyNotify) g_object_unref);
+					     NULL,
+					     (GDestroyNotify) gs_plugin_cache_item_free);
+	priv->cache_evicted = g_hash_table_new_full ((GHashFunc) as_utils_unique_id_hash,
+						     (GEqualFunc) as_utils_unique_id_equal,
+						     g_free,
+						     (GDestroyNotify) gs_plugin_cache_weak_ref_free);
 	priv->vfuncs = g_hash_table_new_full (g_str_hash, g_str_equal,
 					      g_free, NULL);
+	g_queue_init (&priv->status_pending);
+	priv->status_pending_apps = g_hash_table_new (g_direct_hash, g_direct_equal);
 	g_mutex_init (&priv->cache_mutex);
 	g_mutex_init (&priv->timer_mutex);
 	g_mutex_init (&priv->vfuncs_mutex);
+	g_mutex_init (&priv->state_stamp_mutex);
+	g_mutex_init (&priv->status_mutex);
+	g_mutex_init (&priv->jobs_mutex);
+	g_cond_init (&priv->jobs_cond);
 	g_rw_lock_init (&priv->rwlock);
 }
 
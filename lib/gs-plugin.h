@@ -105,6 +105,12 @@ gboolean	 gs_plugin_download_file		(GsPlugin	*plugin,
 							 const gchar	*filename,
 							 GCancellable	*cancellable,
 							 GError		**error);
+gboolean	 gs_plugin_download_files		(GsPlugin	*plugin,
+							 GsApp		*app,
+							 GPtrArray	*uris,
+							 GPtrArray	*filenames,
+							 GCancellable	*cancellable,
+							 GError		**error);
 gchar		*gs_plugin_download_rewrite_resource	(GsPlugin	*plugin,
 							 GsApp		*app,
 							 const gchar	*resource,
@@ -121,6 +127,8 @@ void		 gs_plugin_cache_add			(GsPlugin	*plugin,
 void		 gs_plugin_cache_remove			(GsPlugin	*plugin,
 							 const gchar	*key);
 void		 gs_plugin_cache_invalidate		(GsPlugin	*plugin);
+void		 gs_plugin_set_state_stamp		(GsPlugin	*plugin,
+							 const gchar	*state_stamp);
 void		 gs_plugin_status_update		(GsPlugin	*plugin,
 							 GsApp		*app,
 							 GsPluginStatus	 status);
@@ -134,6 +142,8 @@ void		 gs_plugin_report_event			(GsPlugin	*plugin,
 							 GsPluginEvent	*event);
 void		 gs_plugin_set_allow_updates		(GsPlugin	*plugin,
 							 gboolean	 allow_updates);
+void		 gs_plugin_set_max_jobs			(GsPlugin	*plugin,
+							 guint		 jobs_max);
 
 G_END_DECLS
 
@@ -0,0 +1,432 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2017 Richard Hughes <richard@hughsie.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The refine cache remembers the data that is slow to find for each
+ * installed app, such as the origin, version and installed size, so that
+ * it can be set in the next session before the plugins are asked. Plugins
+ * skip the work for values that are already set.
+ *
+ * Each entry records the state stamp of the plugin that manages the app,
+ * which changes whenever that plugin's data might have changed, e.g. when
+ * a package is installed outside of GNOME Software. Entries are only used
+ * if the stamp is still the same and the app is still installed.
+ *
+ * Only the installed state is remembered as the state stamp says nothing
+ * about the remote metadata, e.g. the update version or download size.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "gs-refine-cache.h"
+
+#define GS_REFINE_CACHE_VERSION		2
+#define GS_REFINE_CACHE_AGE_MAX		(7 * 24 * 60 * 60)	/* s */
+
+typedef struct {
+	gchar		*unique_id;
+	gchar		*state_stamp;
+	guint64		 flags;
+	gint64		 timestamp;
+	gchar		*origin;
+	gchar		*version;
+	guint64		 size_installed;
+	gboolean	 provenance;
+} GsRefineCacheEntry;
+
+struct _GsRefineCache
+{
+	GObject			 parent_instance;
+	gchar			*filename;
+	GHashTable		*entries;	/* unique-id : GsRefineCacheEntry */
+	GMutex			 mutex;
+	guint			 generation;
+	gboolean		 dirty;
+};
+
+G_DEFINE_TYPE (GsRefineCache, gs_refine_cache, G_TYPE_OBJECT)
+
+static void
+gs_refine_cache_entry_free (GsRefineCacheEntry *entry)
+{
+	g_free (entry->unique_id);
+	g_free (entry->state_stamp);
+	g_free (entry->origin);
+	g_free (entry->version);
+	g_slice_free (GsRefineCacheEntry, entry);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GsRefineCacheEntry, gs_refine_cache_entry_free)
+
+static void
+gs_refine_cache_insert (GsRefineCache *cache, GsRefineCacheEntry *entry)
+{
+	g_hash_table_insert (cache->entries, entry->unique_id, entry);
+}
+
+/**
+ * gs_refine_cache_load:
+ * @cache: a #GsRefineCache
+ * @error: a #GError, or %NULL
+ *
+ * Loads the entries saved by a previous session. A missing file or a file
+ * written by a different version is not an error.
+ *
+ * Returns: %TRUE for success
+ **/
+gboolean
+gs_refine_cache_load (GsRefineCache *cache, GError **error)
+{
+	gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+	g_auto(GStrv) groups = NULL;
+	g_autoptr(GKeyFile) kf = g_key_file_new ();
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->mutex);
+
+	g_return_val_if_fail (GS_IS_REFINE_CACHE (cache), FALSE);
+
+	if (!g_file_test (cache->filename, G_FILE_TEST_EXISTS))
+		return TRUE;
+	if (!g_key_file_load_from_file (kf, cache->filename, G_KEY_FILE_NONE, error))
+		return FALSE;
+	if (g_key_file_get_integer (kf, "GsRefineCache", "Version", NULL) !=
+	    GS_REFINE_CACHE_VERSION) {
+		g_debug ("ignoring refine cache %s from another version",
+			 cache->filename);
+		return TRUE;
+	}
+	groups = g_key_file_get_groups (kf, NULL);
+	for (guint i = 0; groups[i] != NULL; i++) {
+		g_autoptr(GsRefineCacheEntry) entry = NULL;
+
+		if (g_strcmp0 (groups[i], "GsRefineCache") == 0)
+			continue;
+		entry = g_slice_new0 (GsRefineCacheEntry);
+		entry->unique_id = g_strdup (groups[i]);
+		entry->timestamp = g_key_file_get_int64 (kf, groups[i], "Timestamp", NULL);
+		if (now - entry->timestamp > GS_REFINE_CACHE_AGE_MAX)
+			continue;
+		entry->state_stamp = g_key_file_get_string (kf, groups[i], "StateStamp", NULL);
+		if (entry->state_stamp == NULL)
+			continue;
+		entry->flags = g_key_file_get_uint64 (kf, groups[i], "Flags", NULL);
+		entry->flags &= GS_REFINE_CACHE_FLAGS;
+		if (entry->flags == 0)
+			continue;
+		entry->origin = g_key_file_get_string (kf, groups[i], "Origin", NULL);
+		entry->version = g_key_file_get_string (kf, groups[i], "Version", NULL);
+		entry->size_installed = g_key_file_get_uint64 (kf, groups[i], "SizeInstalled", NULL);
+		entry->provenance = g_key_file_get_boolean (kf, groups[i], "Provenance", NULL);
+		gs_refine_cache_insert (cache, g_steal_pointer (&entry));
+	}
+	g_debug ("loaded %u entries from %s",
+		 g_hash_table_size (cache->entries), cache->filename);
+	cache->dirty = FALSE;
+	return TRUE;
+}
+
+/**
+ * gs_refine_cache_save:
+ * @cache: a #GsRefineCache
+ * @error: a #GError, or %NULL
+ *
+ * Saves all the entries so they can be used by the next session.
+ *
+ * Returns: %TRUE for success
+ **/
+gboolean
+gs_refine_cache_save (GsRefineCache *cache, GError **error)
+{
+	GHashTableIter iter;
+	gpointer value;
+	g_autoptr(GKeyFile) kf = g_key_file_new ();
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->mutex);
+
+	g_return_val_if_fail (GS_IS_REFINE_CACHE (cache), FALSE);
+
+	g_key_file_set_integer (kf, "GsRefineCache", "Version", GS_REFINE_CACHE_VERSION);
+	g_hash_table_iter_init (&iter, cache->entries);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		GsRefineCacheEntry *entry = value;
+		const gchar *group = entry->unique_id;
+
+		g_key_file_set_string (kf, group, "StateStamp", entry->state_stamp);
+		g_key_file_set_uint64 (kf, group, "Flags", entry->flags);
+		g_key_file_set_int64 (kf, group, "Timestamp", entry->timestamp);
+		if (entry->origin != NULL)
+			g_key_file_set_string (kf, group, "Origin", entry->origin);
+		if (entry->version != NULL)
+			g_key_file_set_string (kf, group, "Version", entry->version);
+		if (entry->flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE)
+			g_key_file_set_uint64 (kf, group, "SizeInstalled", entry->size_installed);
+		if (entry->flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_PROVENANCE)
+			g_key_file_set_boolean (kf, group, "Provenance", entry->provenance);
+	}
+	if (!g_key_file_save_to_file (kf, cache->filename, error))
+		return FALSE;
+	cache->dirty = FALSE;
+	return TRUE;
+}
+
+/**
+ * gs_refine_cache_is_dirty:
+ * @cache: a #GsRefineCache
+ *
+ * Gets if the cache has changed since it was last loaded or saved.
+ *
+ * Returns: %TRUE if the cache should be saved
+ **/
+gboolean
+gs_refine_cache_is_dirty (GsRefineCache *cache)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->mutex);
+	g_return_val_if_fail (GS_IS_REFINE_CACHE (cache), FALSE);
+	return cache->dirty;
+}
+
+/**
+ * gs_refine_cache_get_generation:
+ * @cache: a #GsRefineCache
+ *
+ * Gets the generation of the cache, which should be read when a refine is
+ * started and passed to gs_refine_cache_add() once it has finished.
+ *
+ * Returns: the generation, which is changed by gs_refine_cache_invalidate()
+ **/
+guint
+gs_refine_cache_get_generation (GsRefineCache *cache)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->mutex);
+	g_return_val_if_fail (GS_IS_REFINE_CACHE (cache), 0);
+	return cache->generation;
+}
+
+/**
+ * gs_refine_cache_invalidate:
+ * @cache: a #GsRefineCache
+ *
+ * Removes all the entries, and ignores any entries added for refines that
+ * were started before this was called.
+ **/
+void
+gs_refine_cache_invalidate (GsRefineCache *cache)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache->mutex);
+	g_return_if_fail (GS_IS_REFINE_CACHE (cache));
+	cache->generation++;
+	if (g_hash_table_size (cache->entries) == 0)
+		return;
+	g_hash_table_remove_all (cache->entries);
+	cache->dirty = TRUE;
+}
+
+/**
+ * gs_refine_cache_add:
+ * @cache: a #GsRefineCache
+ * @app: a #GsApp that has been refined
+ * @state_stamp: the state stamp of the plugin that manages @app
+ * @refine_flags: the flags @app was refined with
+ * @generation: the value of gs_refine_cache_get_generation() when the
+ *   refine was started
+ *
+ * Remembers the data for @refine_flags, which is ignored if the cache has
+ * been invalidated since the refine was started.
+ **/
+void
+gs_refine_cache_add (GsRefineCache *cache,
+		     GsApp *app,
+		     const gchar *state_stamp,
+		     guint64 refine_flags,
+		     guint generation)
+{
+	GsRefineCacheEntry *entry;
+	const gchar *unique_id;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_REFINE_CACHE (cache));
+	g_return_if_fail (GS_IS_APP (app));
+
+	refine_flags &= GS_REFINE_CACHE_FLAGS;
+	if (refine_flags == 0 || state_stamp == NULL)
+		return;
+	if (gs_app_get_state (app) != AS_APP_STATE_INSTALLED)
+		return;
+	unique_id = gs_app_get_unique_id (app);
+	if (unique_id == NULL)
+		return;
+
+	locker = g_mutex_locker_new (&cache->mutex);
+	if (generation != cache->generation)
+		return;
+
+	/* start again if the plugin data has changed */
+	entry = g_hash_table_lookup (cache->entries, unique_id);
+	if (entry != NULL && g_strcmp0 (entry->state_stamp, state_stamp) != 0) {
+		g_hash_table_remove (cache->entries, entry->unique_id);
+		entry = NULL;
+	}
+	if (entry == NULL) {
+		entry = g_slice_new0 (GsRefineCacheEntry);
+		entry->unique_id = g_strdup (unique_id);
+		entry->state_stamp = g_strdup (state_stamp);
+		gs_refine_cache_insert (cache, entry);
+	}
+	entry->timestamp = g_get_real_time () / G_USEC_PER_SEC;
+	entry->flags |= refine_flags;
+	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN) {
+		g_free (entry->origin);
+		entry->origin = g_strdup (gs_app_get_origin (app));
+	}
+	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_VERSION) {
+		g_free (entry->version);
+		entry->version = g_strdup (gs_app_get_version (app));
+	}
+	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE)
+		entry->size_installed = gs_app_get_size_installed (app);
+	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_PROVENANCE)
+		entry->provenance = gs_app_has_quirk (app, AS_APP_QUIRK_PROVENANCE);
+	cache->dirty = TRUE;
+}
+
+/**
+ * gs_refine_cache_apply:
+ * @cache: a #GsRefineCache
+ * @app: a #GsApp
+ * @state_stamp: the state stamp of the plugin that manages @app
+ * @refine_flags: the flags @app is being refined with
+ *
+ * Sets any data on @app that is remembered for @refine_flags, unless the
+ * plugin or the app has changed since it was added. The entry is removed
+ * if the state stamp of the plugin has changed. The app still needs to be
+ * refined as plugins may keep their own data for these flags.
+ *
+ * Returns: the refine flags that data was found for
+ **/
+guint64
+gs_refine_cache_apply (GsRefineCache *cache,
+		       GsApp *app,
+		       const gchar *state_stamp,
+		       guint64 refine_flags)
+{
+	GsRefineCacheEntry *entry;
+	const gchar *unique_id;
+	guint64 flags;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_REFINE_CACHE (cache), 0);
+	g_return_val_if_fail (GS_IS_APP (app), 0);
+
+	if (state_stamp == NULL)
+		return 0;
+	if ((refine_flags & GS_REFINE_CACHE_FLAGS) == 0)
+		return 0;
+	unique_id = gs_app_get_unique_id (app);
+	if (unique_id == NULL)
+		return 0;
+
+	locker = g_mutex_locker_new (&cache->mutex);
+	entry = g_hash_table_lookup (cache->entries, unique_id);
+	if (entry == NULL)
+		return 0;
+
+	/* the plugin data has changed, so this will never be valid again */
+	if (g_strcmp0 (entry->state_stamp, state_stamp) != 0) {
+		g_hash_table_remove (cache->entries, unique_id);
+		cache->dirty = TRUE;
+		return 0;
+	}
+	if (gs_app_get_state (app) != AS_APP_STATE_INSTALLED)
+		return 0;
+
+	/* a different version means the package has changed */
+	if ((entry->flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_VERSION) > 0 &&
+	    gs_app_get_version (app) != NULL &&
+	    g_strcmp0 (gs_app_get_version (app), entry->version) != 0)
+		return 0;
+
+	/* never replace data a plugin has already set */
+	flags = entry->flags & refine_flags;
+	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN) {
+		if (gs_app_get_origin (app) == NULL)
+			gs_app_set_origin (app, entry->origin);
+		else if (g_strcmp0 (gs_app_get_origin (app), entry->origin) != 0)
+			flags &= ~GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN;
+	}
+	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_VERSION) {
+		if (gs_app_get_version (app) == NULL)
+			gs_app_set_version (app, entry->version);
+	}
+	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE) {
+		if (gs_app_get_size_installed (app) == 0)
+			gs_app_set_size_installed (app, entry->size_installed);
+	}
+	if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_PROVENANCE) {
+		if (entry->provenance)
+			gs_app_add_quirk (app, AS_APP_QUIRK_PROVENANCE);
+	}
+	return flags;
+}
+
+static void
+gs_refine_cache_finalize (GObject *object)
+{
+	GsRefineCache *cache = GS_REFINE_CACHE (object);
+	g_free (cache->filename);
+	g_hash_table_unref (cache->entries);
+	g_mutex_clear (&cache->mutex);
+	G_OBJECT_CLASS (gs_refine_cache_parent_class)->finalize (object);
+}
+
+static void
+gs_refine_cache_class_init (GsRefineCacheClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = gs_refine_cache_finalize;
+}
+
+static void
+gs_refine_cache_init (GsRefineCache *cache)
+{
+	g_mutex_init (&cache->mutex);
+	cache->entries = g_hash_table_new_full ((GHashFunc) as_utils_unique_id_hash,
+						(GEqualFunc) as_utils_unique_id_equal,
+						NULL,
+						(GDestroyNotify) gs_refine_cache_entry_free);
+}
+
+/**
+ * gs_refine_cache_new:
+ * @filename: the file to load and save the entries to
+ *
+ * Creates a new cache of refined data.
+ *
+ * Returns: a #GsRefineCache
+ **/
+GsRefineCache *
+gs_refine_cache_new (const gchar *filename)
+{
+	GsRefineCache *cache = g_object_new (GS_TYPE_REFINE_CACHE, NULL);
+	cache->filename = g_strdup (filename);
+	return cache;
+}
+
+/* vim: set noexpandtab: */
@@ -0,0 +1,64 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2017 Richard Hughes <richard@hughsie.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __GS_REFINE_CACHE_H
+#define __GS_REFINE_CACHE_H
+
+#include <glib-object.h>
+
+#include "gs-app.h"
+#include "gs-plugin-types.h"
+
+G_BEGIN_DECLS
+
+/* the refine flags for local data that is cheap to store and slow to get */
+#define GS_REFINE_CACHE_FLAGS	(GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN | \
+				 GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE | \
+				 GS_PLUGIN_REFINE_FLAGS_REQUIRE_VERSION | \
+				 GS_PLUGIN_REFINE_FLAGS_REQUIRE_PROVENANCE)
+
+#define GS_TYPE_REFINE_CACHE (gs_refine_cache_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsRefineCache, gs_refine_cache, GS, REFINE_CACHE, GObject)
+
+GsRefineCache	*gs_refine_cache_new			(const gchar	*filename);
+gboolean	 gs_refine_cache_load			(GsRefineCache	*cache,
+							 GError		**error);
+gboolean	 gs_refine_cache_save			(GsRefineCache	*cache,
+							 GError		**error);
+gboolean	 gs_refine_cache_is_dirty		(GsRefineCache	*cache);
+guint		 gs_refine_cache_get_generation		(GsRefineCache	*cache);
+void		 gs_refine_cache_invalidate		(GsRefineCache	*cache);
+void		 gs_refine_cache_add			(GsRefineCache	*cache,
+							 GsApp		*app,
+							 const gchar	*state_stamp,
+							 guint64	 refine_flags,
+							 guint		 generation);
+guint64		 gs_refine_cache_apply			(GsRefineCache	*cache,
+							 GsApp		*app,
+							 const gchar	*state_stamp,
+							 guint64	 refine_flags);
+
+G_END_DECLS
+
+#endif /* __GS_REFINE_CACHE_H */
+
+/* vim: set noexpandtab: */
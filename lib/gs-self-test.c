@@ -21,8 +21,11 @@
 
 #include "config.h"
 
+#include <glib/gstdio.h>
+
 #include "gnome-software-private.h"
 
+#include "gs-refine-cache.h"
 #include "gs-test.h"
 
 static gboolean
@@ -166,6 +169,331 @@ gs_plugin_download_rewrite_func (void)
 	g_assert (css != NULL);
 }
 
+static void
+gs_plugin_status_changed_cb (GsPlugin *plugin,
+			     GsApp *app,
+			     GsPluginStatus status,
+			     gpointer user_data)
+{
+	GsPluginStatus *status_last = (GsPluginStatus *) user_data;
+	g_assert (*status_last == GS_PLUGIN_STATUS_UNKNOWN);
+	*status_last = status;
+}
+
+static void
+gs_plugin_status_order_cb (GsPlugin *plugin,
+			   GsApp *app,
+			   GsPluginStatus status,
+			   gpointer user_data)
+{
+	GString *str = (GString *) user_data;
+	g_string_append_printf (str, "%s:%s;",
+				app != NULL ? gs_app_get_id (app) : "none",
+				gs_plugin_status_to_string (status));
+}
+
+static void
+gs_plugin_status_update_func (void)
+{
+	GsPluginStatus status_last = GS_PLUGIN_STATUS_UNKNOWN;
+	g_autoptr(GsApp) app = gs_app_new ("gimp.desktop");
+	g_autoptr(GsApp) app2 = gs_app_new ("inkscape.desktop");
+	g_autoptr(GsPlugin) plugin = gs_plugin_new ();
+	g_autoptr(GString) str = g_string_new (NULL);
+
+	/* only the latest status gets emitted */
+	g_signal_connect (plugin, "status-changed",
+			  G_CALLBACK (gs_plugin_status_changed_cb), &status_last);
+	for (guint i = 0; i < 100; i++) {
+		gs_plugin_status_update (plugin, app, GS_PLUGIN_STATUS_DOWNLOADING);
+		gs_plugin_status_update (plugin, app, GS_PLUGIN_STATUS_INSTALLING);
+	}
+	while (status_last == GS_PLUGIN_STATUS_UNKNOWN)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_cmpint (status_last, ==, GS_PLUGIN_STATUS_INSTALLING);
+
+	/* and the next one is delayed, but still arrives */
+	status_last = GS_PLUGIN_STATUS_UNKNOWN;
+	gs_plugin_status_update (plugin, app, GS_PLUGIN_STATUS_FINISHED);
+	while (status_last == GS_PLUGIN_STATUS_UNKNOWN)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_cmpint (status_last, ==, GS_PLUGIN_STATUS_FINISHED);
+	g_signal_handlers_disconnect_by_func (plugin, gs_plugin_status_changed_cb, &status_last);
+
+	/* apps are emitted in the order they were last set, then the status
+	 * without an app */
+	g_signal_connect (plugin, "status-changed",
+			  G_CALLBACK (gs_plugin_status_order_cb), str);
+	gs_plugin_status_update (plugin, app, GS_PLUGIN_STATUS_DOWNLOADING);
+	gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_WAITING);
+	gs_plugin_status_update (plugin, app2, GS_PLUGIN_STATUS_DOWNLOADING);
+	gs_plugin_status_update (plugin, app, GS_PLUGIN_STATUS_INSTALLING);
+	while (str->len == 0)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_cmpstr (str->str, ==,
+			 "inkscape.desktop:downloading;"
+			 "gimp.desktop:installing;"
+			 "none:waiting;");
+}
+
+static void
+gs_plugin_download_files_func (void)
+{
+	gboolean ret;
+	g_autofree gchar *tmpdir = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) filenames = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GPtrArray) uris = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GsPlugin) plugin = NULL;
+
+	tmpdir = g_dir_make_tmp ("gs-self-test-XXXXXX", &error);
+	g_assert_no_error (error);
+	g_assert (tmpdir != NULL);
+
+	/* copy several files at once */
+	for (guint i = 0; i < 5; i++) {
+		g_autofree gchar *basename = g_strdup_printf ("src%u", i);
+		g_autofree gchar *fn_src = g_build_filename (tmpdir, basename, NULL);
+		g_autofree gchar *data = g_strdup_printf ("data%u", i);
+		ret = g_file_set_contents (fn_src, data, -1, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+		g_ptr_array_add (uris, g_strdup_printf ("file://%s", fn_src));
+		g_ptr_array_add (filenames, g_strdup_printf ("%s/dest%u", tmpdir, i));
+	}
+	plugin = gs_plugin_new ();
+	gs_plugin_set_name (plugin, "self-test");
+	ret = gs_plugin_download_files (plugin, NULL, uris, filenames, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	for (guint i = 0; i < filenames->len; i++) {
+		g_autofree gchar *data = NULL;
+		g_autofree gchar *data_expected = g_strdup_printf ("data%u", i);
+		ret = g_file_get_contents (g_ptr_array_index (filenames, i),
+					   &data, NULL, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+		g_assert_cmpstr (data, ==, data_expected);
+	}
+
+	/* one failure does not stop the others */
+	g_ptr_array_add (uris, g_strdup ("file:///this/does/not/exist"));
+	g_ptr_array_add (filenames, g_strdup_printf ("%s/dest-missing", tmpdir));
+	ret = gs_plugin_download_files (plugin, NULL, uris, filenames, NULL, &error);
+	g_assert_error (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_DOWNLOAD_FAILED);
+	g_assert (!ret);
+
+	ret = gs_utils_rmtree (tmpdir, NULL);
+	g_assert (ret);
+}
+
+typedef struct {
+	GMainContext	*context;
+	GMainLoop	*loop;
+	SoupServer	*server;
+	gchar		*uri;
+	gint		 status_last;
+} GsPluginDownloadServer;
+
+#define GS_SELF_TEST_DOWNLOAD_DATA	"hello world"
+#define GS_SELF_TEST_DOWNLOAD_ETAG	"\"abc\""
+
+static void
+gs_plugin_download_server_cb (SoupServer *server,
+			      SoupMessage *msg,
+			      const gchar *path,
+			      GHashTable *query,
+			      SoupClientContext *client,
+			      gpointer user_data)
+{
+	GsPluginDownloadServer *helper = (GsPluginDownloadServer *) user_data;
+	const gchar *data = GS_SELF_TEST_DOWNLOAD_DATA;
+	const gchar *tmp;
+	goffset offset = 0;
+	SoupRange *ranges = NULL;
+	gint n_ranges = 0;
+
+	if (g_strcmp0 (path, "/file") != 0) {
+		soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
+		g_atomic_int_set (&helper->status_last, (gint) msg->status_code);
+		return;
+	}
+	soup_message_headers_append (msg->response_headers, "ETag",
+				     GS_SELF_TEST_DOWNLOAD_ETAG);
+
+	/* revalidate */
+	tmp = soup_message_headers_get_one (msg->request_headers, "If-None-Match");
+	if (g_strcmp0 (tmp, GS_SELF_TEST_DOWNLOAD_ETAG) == 0) {
+		soup_message_set_status (msg, SOUP_STATUS_NOT_MODIFIED);
+		g_atomic_int_set (&helper->status_last, (gint) msg->status_code);
+		return;
+	}
+
+	/* resume */
+	tmp = soup_message_headers_get_one (msg->request_headers, "If-Range");
+	if (g_strcmp0 (tmp, GS_SELF_TEST_DOWNLOAD_ETAG) == 0 &&
+	    soup_message_headers_get_ranges (msg->request_headers,
+					     (goffset) strlen (data),
+					     &ranges, &n_ranges)) {
+		offset = ranges[0].start;
+		soup_message_headers_free_ranges (msg->request_headers, ranges);
+		soup_message_headers_set_content_range (msg->response_headers,
+							offset,
+							(goffset) strlen (data) - 1,
+							(goffset) strlen (data));
+		soup_message_set_status (msg, SOUP_STATUS_PARTIAL_CONTENT);
+	} else {
+		soup_message_set_status (msg, SOUP_STATUS_OK);
+	}
+	soup_message_set_response (msg, "text/plain", SOUP_MEMORY_COPY,
+				   data + offset, strlen (data) - (gsize) offset);
+	g_atomic_int_set (&helper->status_last, (gint) msg->status_code);
+}
+
+static gpointer
+gs_plugin_download_server_thread_cb (gpointer user_data)
+{
+	GsPluginDownloadServer *helper = (GsPluginDownloadServer *) user_data;
+	g_main_context_push_thread_default (helper->context);
+	g_main_loop_run (helper->loop);
+	g_main_context_pop_thread_default (helper->context);
+	return NULL;
+}
+
+static void
+gs_plugin_download_file_http_func (void)
+{
+	GsPluginDownloadServer helper = { NULL };
+	GSList *uris;
+	gboolean ret;
+	g_autofree gchar *data = NULL;
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *fn_missing = NULL;
+	g_autofree gchar *fn_missing_part = NULL;
+	g_autofree gchar *fn_part = NULL;
+	g_autofree gchar *tmpdir = NULL;
+	g_autofree gchar *uri_base = NULL;
+	g_autofree gchar *uri_missing = NULL;
+	g_autofree gchar *uri_other = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GFile) file_part = NULL;
+	g_autoptr(GThread) thread = NULL;
+	g_autoptr(GsPlugin) plugin = NULL;
+	g_autoptr(SoupSession) soup_session = NULL;
+
+	tmpdir = g_dir_make_tmp ("gs-self-test-XXXXXX", &error);
+	g_assert_no_error (error);
+	g_assert (tmpdir != NULL);
+	fn = g_build_filename (tmpdir, "dest", NULL);
+	fn_part = g_strdup_printf ("%s.part", fn);
+	fn_missing = g_build_filename (tmpdir, "missing", NULL);
+	fn_missing_part = g_strdup_printf ("%s.part", fn_missing);
+
+	/* the server runs in a thread as the download blocks */
+	helper.context = g_main_context_new ();
+	helper.loop = g_main_loop_new (helper.context, FALSE);
+	g_main_context_push_thread_default (helper.context);
+	helper.server = soup_server_new (NULL, NULL);
+	soup_server_add_handler (helper.server, NULL,
+				 gs_plugin_download_server_cb,
+				 &helper, NULL);
+	ret = soup_server_listen_local (helper.server, 0, 0, &error);
+	g_main_context_pop_thread_default (helper.context);
+	g_assert_no_error (error);
+	g_assert (ret);
+	uris = soup_server_get_uris (helper.server);
+	g_assert (uris != NULL);
+	uri_base = soup_uri_to_string (uris->data, FALSE);
+	helper.uri = g_strdup_printf ("%sfile", uri_base);
+	g_slist_free_full (uris, (GDestroyNotify) soup_uri_free);
+	thread = g_thread_new ("self-test-server",
+			       gs_plugin_download_server_thread_cb,
+			       &helper);
+	plugin = gs_plugin_new ();
+	gs_plugin_set_name (plugin, "self-test");
+	soup_session = soup_session_new ();
+	gs_plugin_set_soup_session (plugin, soup_session);
+
+	/* streamed to the file */
+	ret = gs_plugin_download_file (plugin, NULL, helper.uri, fn, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (g_atomic_int_get (&helper.status_last), ==, SOUP_STATUS_OK);
+	ret = g_file_get_contents (fn, &data, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpstr (data, ==, GS_SELF_TEST_DOWNLOAD_DATA);
+	g_assert (!g_file_test (fn_part, G_FILE_TEST_EXISTS));
+
+	/* a failed download does not leave a partial file behind */
+	uri_missing = g_strdup_printf ("%s-missing", helper.uri);
+	ret = g_file_set_contents (fn_missing_part, "stale", -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = gs_plugin_download_file (plugin, NULL, uri_missing, fn_missing, NULL, &error);
+	g_assert_error (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_DOWNLOAD_FAILED);
+	g_assert (!ret);
+	g_clear_error (&error);
+	g_assert_cmpint (g_atomic_int_get (&helper.status_last), ==, SOUP_STATUS_NOT_FOUND);
+	g_assert (!g_file_test (fn_missing_part, G_FILE_TEST_EXISTS));
+
+	/* the rest needs extended attributes */
+	file_part = g_file_new_for_path (fn_part);
+	ret = g_file_set_contents (fn_part, "hello ", -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	if (!g_file_set_attribute_string (file_part, "xattr::gnome-software.uri",
+					  helper.uri, G_FILE_QUERY_INFO_NONE,
+					  NULL, NULL)) {
+		g_test_skip ("no extended attribute support");
+		goto out;
+	}
+
+	/* not downloaded again if not modified */
+	g_unlink (fn_part);
+	ret = gs_plugin_download_file (plugin, NULL, helper.uri, fn, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (g_atomic_int_get (&helper.status_last), ==, SOUP_STATUS_NOT_MODIFIED);
+
+	/* but the validators are not used for a different URI */
+	uri_other = g_strdup_printf ("%s?other", helper.uri);
+	ret = gs_plugin_download_file (plugin, NULL, uri_other, fn, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (g_atomic_int_get (&helper.status_last), ==, SOUP_STATUS_OK);
+
+	/* an interrupted download is continued */
+	g_unlink (fn);
+	ret = g_file_set_contents (fn_part, "hello ", -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_file_set_attribute_string (file_part, "xattr::gnome-software.uri",
+				     helper.uri, G_FILE_QUERY_INFO_NONE,
+				     NULL, NULL);
+	g_file_set_attribute_string (file_part, "xattr::gnome-software.etag",
+				     GS_SELF_TEST_DOWNLOAD_ETAG,
+				     G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	ret = gs_plugin_download_file (plugin, NULL, helper.uri, fn, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (g_atomic_int_get (&helper.status_last), ==, SOUP_STATUS_PARTIAL_CONTENT);
+	g_free (data);
+	ret = g_file_get_contents (fn, &data, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpstr (data, ==, GS_SELF_TEST_DOWNLOAD_DATA);
+out:
+	g_main_loop_quit (helper.loop);
+	g_thread_join (g_steal_pointer (&thread));
+	g_object_unref (helper.server);
+	g_main_loop_unref (helper.loop);
+	g_main_context_unref (helper.context);
+	g_free (helper.uri);
+	ret = gs_utils_rmtree (tmpdir, NULL);
+	g_assert (ret);
+}
+
 static void
 gs_plugin_global_cache_func (void)
 {
@@ -202,6 +530,75 @@ gs_plugin_global_cache_func (void)
 	g_assert (app2 != NULL);
 }
 
+static void
+gs_plugin_global_cache_trim_func (void)
+{
+	GsApp *app;
+	g_autoptr(GsApp) app_used = gs_app_new ("2.desktop");
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+
+	/* the oldest app is the most recently used, so is kept */
+	gs_app_list_add_flag (list, GS_APP_LIST_FLAG_TRACK_USED);
+	for (guint i = 0; i < 2; i++) {
+		g_autofree gchar *id = g_strdup_printf ("%u.desktop", i);
+		g_autoptr(GsApp) app_tmp = gs_app_new (id);
+		gs_app_list_add (list, app_tmp);
+	}
+	gs_app_list_add (list, app_used);
+	app = gs_app_list_lookup_ref (list, "*/*/*/*/0.desktop/*");
+	g_assert (app != NULL);
+	g_object_unref (app);
+	g_assert_cmpint (gs_app_list_trim_unused (list, 1), ==, 2);
+	g_assert_cmpint (gs_app_list_length (list), ==, 1);
+	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 0)), ==, "0.desktop");
+
+	/* a trimmed app that is still in use is found again, not duplicated */
+	app = gs_app_list_lookup (list, "*/*/*/*/1.desktop/*");
+	g_assert (app == NULL);
+	app = gs_app_list_lookup (list, "*/*/*/*/2.desktop/*");
+	g_assert (app == app_used);
+	g_assert_cmpint (gs_app_list_length (list), ==, 2);
+}
+
+static void
+gs_plugin_cache_lru_func (void)
+{
+	g_autoptr(GsPlugin) plugin = gs_plugin_new ();
+	g_autoptr(GsApp) app_used = gs_app_new ("b.desktop");
+	g_autoptr(GsApp) app_tmp = NULL;
+	GsApp *app;
+
+	/* keep two apps, and make the first one the least recently used */
+	gs_plugin_cache_set_size_max (plugin, 2);
+	app = gs_app_new ("a.desktop");
+	gs_plugin_cache_add (plugin, "a", app);
+	g_object_unref (app);
+	gs_plugin_cache_add (plugin, "b", app_used);
+	app_tmp = gs_plugin_cache_lookup (plugin, "b");
+	g_assert (app_tmp == app_used);
+	g_clear_object (&app_tmp);
+
+	/* the unused app is evicted */
+	app = gs_app_new ("c.desktop");
+	gs_plugin_cache_add (plugin, "c", app);
+	g_object_unref (app);
+	app_tmp = gs_plugin_cache_lookup (plugin, "a");
+	g_assert (app_tmp == NULL);
+	app_tmp = gs_plugin_cache_lookup (plugin, "c");
+	g_assert (app_tmp != NULL);
+	g_clear_object (&app_tmp);
+
+	/* apps that are evicted while still in use are found again */
+	app = gs_app_new ("d.desktop");
+	gs_plugin_cache_add (plugin, "d", app);
+	g_object_unref (app);
+	app_tmp = gs_plugin_cache_lookup (plugin, "b");
+	g_assert (app_tmp == app_used);
+	g_clear_object (&app_tmp);
+	app_tmp = gs_plugin_cache_lookup (plugin, "c");
+	g_assert (app_tmp == NULL);
+}
+
 static void
 gs_plugin_func (void)
 {
@@ -217,6 +614,12 @@ gs_plugin_func (void)
 		g_assert (tmp != NULL);
 		g_assert_cmpint (gs_plugin_action_from_string (tmp), ==, i);
 	}
+	for (i = GS_PLUGIN_ACTION_UNKNOWN + 1; i < GS_PLUGIN_ACTION_LAST; i++)
+		g_assert (gs_plugin_action_to_function_name (i) != NULL);
+	for (i = GS_PLUGIN_VFUNC_UNKNOWN + 1; i < GS_PLUGIN_VFUNC_LAST; i++)
+		g_assert (gs_plugin_vfunc_to_function_name (i) != NULL);
+	g_assert_cmpstr (gs_plugin_action_to_function_name (GS_PLUGIN_ACTION_REFINE), ==,
+			 "gs_plugin_refine");
 
 	/* add a couple of duplicate IDs */
 	app = gs_app_new ("a");
@@ -230,8 +633,28 @@ gs_plugin_func (void)
 	g_object_unref (list);
 	g_assert_cmpint (gs_app_list_length (list_dup), ==, 1);
 	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list_dup, 0)), ==, "a");
+	g_assert (gs_app_list_lookup (list_dup, "*/*/*/*/a/*") != NULL);
+
 	g_object_unref (list_dup);
 
+	/* a later app replaces a wildcard, even when copied into a new list */
+	list = gs_app_list_new ();
+	app = gs_app_new ("a");
+	gs_app_add_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX);
+	gs_app_list_add (list, app);
+	g_object_unref (app);
+	app = gs_app_new ("a");
+	gs_app_set_origin (app, "fedora");
+	gs_app_list_add (list, app);
+	g_assert_cmpint (gs_app_list_length (list), ==, 2);
+	g_assert (gs_app_list_lookup (list, "*/*/*/*/a/*") == app);
+	list_dup = gs_app_list_new ();
+	gs_app_list_add_list (list_dup, list);
+	g_assert (gs_app_list_lookup (list_dup, "*/*/*/*/a/*") == app);
+	g_object_unref (app);
+	g_object_unref (list_dup);
+	g_object_unref (list);
+
 	/* test removing obects */
 	app = gs_app_new ("a");
 	list_remove = gs_app_list_new ();
@@ -323,6 +746,33 @@ gs_plugin_func (void)
 	g_assert_cmpstr (gs_app_get_unique_id (gs_app_list_index (list, 0)), ==, "user/bar/*/*/e/*");
 	g_object_unref (list);
 
+	/* keep the order when deduplicating */
+	list = gs_app_list_new ();
+	app = gs_app_new ("c");
+	gs_app_set_unique_id (app, "user/foo/*/*/c/*");
+	gs_app_list_add (list, app);
+	g_object_unref (app);
+	app = gs_app_new ("a");
+	gs_app_set_unique_id (app, "user/foo/*/*/a/*");
+	gs_app_list_add (list, app);
+	g_object_unref (app);
+	app = gs_app_new ("c");
+	gs_app_set_unique_id (app, "user/bar/*/*/c/*");
+	gs_app_list_add (list, app);
+	g_object_unref (app);
+	app = gs_app_new ("b");
+	gs_app_set_unique_id (app, "user/foo/*/*/b/*");
+	gs_app_list_add (list, app);
+	g_object_unref (app);
+	g_assert_cmpint (gs_app_list_length (list), ==, 4);
+	gs_app_list_filter_duplicates (list, GS_APP_LIST_FILTER_FLAG_KEY_ID);
+	g_assert_cmpint (gs_app_list_length (list), ==, 3);
+	g_assert_cmpstr (gs_app_get_unique_id (gs_app_list_index (list, 0)), ==, "user/foo/*/*/c/*");
+	g_assert_cmpstr (gs_app_get_unique_id (gs_app_list_index (list, 1)), ==, "user/foo/*/*/a/*");
+	g_assert_cmpstr (gs_app_get_unique_id (gs_app_list_index (list, 2)), ==, "user/foo/*/*/b/*");
+	g_assert (gs_app_list_lookup (list, "user/bar/*/*/c/*") == NULL);
+	g_object_unref (list);
+
 	/* respect priority (using name and version) when deduplicating */
 	list = gs_app_list_new ();
 	app = gs_app_new ("e");
@@ -475,6 +925,44 @@ gs_app_thread_func (void)
 	g_setenv ("G_MESSAGES_DEBUG", "all", TRUE);
 }
 
+static void
+gs_app_notify_cb (GsApp *app, GParamSpec *pspec, gpointer user_data)
+{
+	guint *cnt = (guint *) user_data;
+	(*cnt)++;
+}
+
+static gpointer
+gs_app_notify_thread_cb (gpointer data)
+{
+	GsApp *app = GS_APP (data);
+	for (guint i = 0; i <= 100; i++)
+		gs_app_set_progress (app, i);
+	return NULL;
+}
+
+static void
+gs_app_notify_func (void)
+{
+	guint cnt = 0;
+	g_autoptr(GsApp) app = gs_app_new ("gimp.desktop");
+	g_autoptr(GThread) thread = NULL;
+
+	/* lots of changes from a thread only get emitted once */
+	g_signal_connect (app, "notify::progress",
+			  G_CALLBACK (gs_app_notify_cb), &cnt);
+	thread = g_thread_new ("thread", gs_app_notify_thread_cb, app);
+	g_thread_join (thread);
+	while (g_main_context_iteration (NULL, FALSE));
+	g_assert_cmpint (cnt, ==, 1);
+	g_assert_cmpint (gs_app_get_progress (app), ==, 100);
+
+	/* and again after the first batch was dispatched */
+	gs_app_set_progress (app, 50);
+	while (g_main_context_iteration (NULL, FALSE));
+	g_assert_cmpint (cnt, ==, 2);
+}
+
 static void
 gs_app_unique_id_func (void)
 {
@@ -557,6 +1045,135 @@ gs_app_func (void)
 	g_assert_cmpuint (gs_app_get_progress (app), ==, 42);
 	gs_app_set_progress (app, 142);
 	g_assert_cmpuint (gs_app_get_progress (app), ==, 100);
+
+	/* check refined flags are tracked per-generation */
+	g_assert (!gs_app_has_refined_flags (app, GS_PLUGIN_REFINE_FLAGS_DEFAULT, 1));
+	gs_app_add_refined_flags (app, GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON, 1);
+	gs_app_add_refined_flags (app, GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE, 1);
+	g_assert (gs_app_has_refined_flags (app, GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON |
+						 GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE, 1));
+	g_assert (!gs_app_has_refined_flags (app, GS_PLUGIN_REFINE_FLAGS_REQUIRE_URL, 1));
+	g_assert (!gs_app_has_refined_flags (app, GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON, 2));
+	gs_app_add_refined_flags (app, GS_PLUGIN_REFINE_FLAGS_REQUIRE_URL, 2);
+	g_assert (!gs_app_has_refined_flags (app, GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON, 2));
+	gs_app_set_state (app, AS_APP_STATE_REMOVING);
+	g_assert (!gs_app_has_refined_flags (app, GS_PLUGIN_REFINE_FLAGS_REQUIRE_URL, 2));
+}
+
+static void
+gs_refine_cache_func (void)
+{
+	gboolean ret;
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *tmpdir = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsApp) app = gs_app_new ("a.desktop");
+	g_autoptr(GsApp) app2 = gs_app_new ("a.desktop");
+	g_autoptr(GsApp) app3 = gs_app_new ("a.desktop");
+	g_autoptr(GsRefineCache) cache = NULL;
+	g_autoptr(GsRefineCache) cache2 = NULL;
+	g_autoptr(GsRefineCache) cache3 = NULL;
+
+	tmpdir = g_dir_make_tmp ("gs-self-test-XXXXXX", &error);
+	g_assert_no_error (error);
+	g_assert (tmpdir != NULL);
+	fn = g_build_filename (tmpdir, "refine-cache.ini", NULL);
+
+	/* only installed apps are remembered */
+	cache = gs_refine_cache_new (fn);
+	gs_app_set_state (app, AS_APP_STATE_AVAILABLE);
+	gs_app_set_origin (app, "fedora");
+	gs_app_set_version (app, "1.2.3");
+	gs_app_set_size_installed (app, 1024);
+	gs_refine_cache_add (cache, app, "stamp1",
+			     GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN |
+			     GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE |
+			     GS_PLUGIN_REFINE_FLAGS_REQUIRE_RATING, 0);
+	g_assert (!gs_refine_cache_is_dirty (cache));
+	gs_app_set_state (app, AS_APP_STATE_UNKNOWN);
+	gs_app_set_state (app, AS_APP_STATE_INSTALLED);
+	gs_refine_cache_add (cache, app, "stamp1",
+			     GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN |
+			     GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE |
+			     GS_PLUGIN_REFINE_FLAGS_REQUIRE_RATING, 0);
+	g_assert (gs_refine_cache_is_dirty (cache));
+	ret = gs_refine_cache_save (cache, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* the data is only used with the same stamp */
+	cache2 = gs_refine_cache_new (fn);
+	ret = gs_refine_cache_load (cache2, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	gs_app_set_state (app2, AS_APP_STATE_INSTALLED);
+	g_assert_cmpint (gs_refine_cache_apply (cache2, app2, "stamp1",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN |
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE |
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_RATING), ==,
+			 GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN |
+			 GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE);
+	g_assert_cmpstr (gs_app_get_origin (app2), ==, "fedora");
+	g_assert_cmpint (gs_app_get_size_installed (app2), ==, 1024);
+
+	/* the data is not used once the app is no longer installed */
+	gs_app_set_state (app3, AS_APP_STATE_AVAILABLE);
+	g_assert_cmpint (gs_refine_cache_apply (cache2, app3, "stamp1",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN), ==, 0);
+
+	/* the entry is dropped once the plugin has a different stamp */
+	g_assert (!gs_refine_cache_is_dirty (cache2));
+	g_assert_cmpint (gs_refine_cache_apply (cache2, app2, "stamp2",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN), ==, 0);
+	g_assert (gs_refine_cache_is_dirty (cache2));
+	g_assert_cmpint (gs_refine_cache_apply (cache2, app2, "stamp1",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN), ==, 0);
+
+	/* all entries are removed when invalidated */
+	g_assert_cmpint (gs_refine_cache_apply (cache, app2, "stamp1",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN), ==,
+			 GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN);
+	g_assert_cmpint (gs_refine_cache_get_generation (cache), ==, 0);
+	gs_refine_cache_invalidate (cache);
+	g_assert_cmpint (gs_refine_cache_get_generation (cache), ==, 1);
+	g_assert_cmpint (gs_refine_cache_apply (cache, app2, "stamp1",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN), ==, 0);
+
+	/* and refines started before that are ignored */
+	gs_refine_cache_add (cache, app, "stamp1",
+			     GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN, 0);
+	g_assert_cmpint (gs_refine_cache_apply (cache, app2, "stamp1",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN), ==, 0);
+
+	/* but refines started afterwards are still remembered */
+	gs_refine_cache_add (cache, app, "stamp1",
+			     GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN,
+			     gs_refine_cache_get_generation (cache));
+	g_assert_cmpint (gs_refine_cache_apply (cache, app2, "stamp1",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN), ==,
+			 GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN);
+
+	/* entries from a long time ago are not loaded */
+	ret = g_file_set_contents (fn,
+				   "[GsRefineCache]\n"
+				   "Version=2\n"
+				   "[*/*/*/*/a.desktop/*]\n"
+				   "StateStamp=stamp1\n"
+				   "Flags=1024\n"
+				   "Timestamp=1\n"
+				   "Origin=fedora\n", -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	cache3 = gs_refine_cache_new (fn);
+	ret = gs_refine_cache_load (cache3, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (gs_refine_cache_apply (cache3, app2, "stamp1",
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN), ==, 0);
+
+	ret = gs_utils_rmtree (tmpdir, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
 }
 
 static void
@@ -617,9 +1234,16 @@ main (int argc, char **argv)
 	g_test_add_func ("/gnome-software/lib/app{addons}", gs_app_addons_func);
 	g_test_add_func ("/gnome-software/lib/app{unique-id}", gs_app_unique_id_func);
 	g_test_add_func ("/gnome-software/lib/app{thread}", gs_app_thread_func);
+	g_test_add_func ("/gnome-software/lib/app{notify}", gs_app_notify_func);
 	g_test_add_func ("/gnome-software/lib/plugin", gs_plugin_func);
 	g_test_add_func ("/gnome-software/lib/plugin{download-rewrite}", gs_plugin_download_rewrite_func);
+	g_test_add_func ("/gnome-software/lib/plugin{download-files}", gs_plugin_download_files_func);
+	g_test_add_func ("/gnome-software/lib/plugin{download-file-http}", gs_plugin_download_file_http_func);
+	g_test_add_func ("/gnome-software/lib/plugin{status-update}", gs_plugin_status_update_func);
 	g_test_add_func ("/gnome-software/lib/plugin{global-cache}", gs_plugin_global_cache_func);
+	g_test_add_func ("/gnome-software/lib/plugin{global-cache-trim}", gs_plugin_global_cache_trim_func);
+	g_test_add_func ("/gnome-software/lib/plugin{cache-lru}", gs_plugin_cache_lru_func);
+	g_test_add_func ("/gnome-software/lib/refine-cache", gs_refine_cache_func);
 	g_test_add_func ("/gnome-software/lib/auth{secret}", gs_auth_secret_func);
 
 	return g_test_run ();
@@ -21,6 +21,7 @@
 
 #include "config.h"
 
+#include <string.h>
 #include <gnome-software.h>
 
 #include "gs-appstream.h"
@@ -50,7 +51,9 @@ gs_appstream_create_app (GsPlugin *plugin, AsApp *item, GError **error)
 		app = gs_app_new_from_unique_id (unique_id);
 		gs_app_set_metadata (app, "GnomeSoftware::Creator",
 				     gs_plugin_get_name (plugin));
-		if (!gs_appstream_refine_app (plugin, app, item, error)) {
+		if (!gs_appstream_refine_app (plugin, app, item,
+					      GS_PLUGIN_REFINE_FLAGS_DEFAULT,
+					      error)) {
 			g_object_unref (app);
 			return NULL;
 		}
@@ -140,6 +143,7 @@ static gboolean
 gs_appstream_refine_add_addons (GsPlugin *plugin,
 				GsApp *app,
 				AsApp *item,
+				GsPluginRefineFlags refine_flags,
 				GError **error)
 {
 	GPtrArray *addons;
@@ -169,7 +173,8 @@ gs_appstream_refine_add_addons (GsPlugin *plugin,
 			return FALSE;
 
 		/* add all the data we can */
-		if (!gs_appstream_refine_app (plugin, addon, as_addon, error))
+		if (!gs_appstream_refine_app (plugin, addon, as_addon,
+					      refine_flags, error))
 			return FALSE;
 		gs_app_add_addon (app, addon);
 	}
@@ -557,6 +562,7 @@ gboolean
 gs_appstream_refine_app (GsPlugin *plugin,
 			 GsApp *app,
 			 AsApp *item,
+			 GsPluginRefineFlags refine_flags,
 			 GError **error)
 {
 	AsRequire *req;
@@ -712,9 +718,9 @@ gs_appstream_refine_app (GsPlugin *plugin,
 		}
 	}
 
-	/* set description */
+	/* set description, which is expensive to convert */
 	tmp = as_app_get_description (item, NULL);
-	if (tmp != NULL) {
+	if (tmp != NULL && refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_DESCRIPTION) {
 		g_autofree gchar *from_xml = NULL;
 		from_xml = as_markup_convert_simple (tmp, error);
 		if (from_xml == NULL) {
@@ -784,14 +790,20 @@ gs_appstream_refine_app (GsPlugin *plugin,
 		gs_app_set_sources (app, pkgnames);
 
 	/* set addons */
-	if (!gs_appstream_refine_add_addons (plugin, app, item, error))
-		return FALSE;
+	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ADDONS) {
+		if (!gs_appstream_refine_add_addons (plugin, app, item,
+						     refine_flags, error))
+			return FALSE;
+	}
 
-	/* set screenshots */
-	gs_appstream_refine_add_screenshots (app, item);
+	/* set screenshots, which firmware also uses for the update message */
+	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SCREENSHOTS ||
+	    gs_app_get_kind (app) == AS_APP_KIND_FIRMWARE)
+		gs_appstream_refine_add_screenshots (app, item);
 
 	/* set reviews */
-	gs_appstream_refine_add_reviews (app, item);
+	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEWS)
+		gs_appstream_refine_add_reviews (app, item);
 
 	/* set provides */
 	gs_appstream_refine_add_provides (app, item);
@@ -864,122 +876,863 @@ gs_appstream_refine_app (GsPlugin *plugin,
 	return TRUE;
 }
 
+/* an index of the apps in a store, so that searching and browsing only has
+ * to look at the apps that match rather than every app in the store */
+typedef struct {
+	guint		 entity;
+	guint		 mask;		/* of AsAppSearchMatch */
+} GsAppstreamPosting;
+
+typedef struct {
+	const gchar		*token;
+	const GsAppstreamPosting *postings;
+	guint			 n_postings;
+	GArray			*postings_buf;	/* owned, or NULL when mapped */
+} GsAppstreamToken;
+
+typedef struct {
+	guint64		 timestamp;
+	guint		 app;
+} GsAppstreamRelease;
+
+typedef struct {
+	volatile gint	 ref;
+	GPtrArray	*apps;		/* of AsApp, as_store_get_apps() order */
+	GPtrArray	*entities;	/* of AsApp, apps then any extra addons */
+	GPtrArray	*parents;	/* of GArray of app index, or NULL */
+	GMutex		 mutex;		/* for the parts built on demand */
+	gboolean	 has_tokens;
+	GPtrArray	*tokens;	/* of GsAppstreamToken, sorted */
+	GHashTable	*categories;	/* category : GArray of app index */
+	GArray		*popular;	/* of app index */
+	GArray		*featured;	/* of app index */
+	GArray		*releases;	/* of GsAppstreamRelease, newest first */
+	GStringChunk	*chunk;
+	GVariant	*data;		/* mapped from the cache, or NULL */
+	GMutex		 last_mutex;
+	gchar		**last_values;
+	GArray		*last_candidates; /* of entity */
+} GsAppstreamIndex;
+
+#define GS_APPSTREAM_INDEX_EXACT	(1u << 31)
+
+/* the posting lists are used without being byte-swapped, so the byte order
+ * of the machine that wrote the cache is stored and checked */
+#define GS_APPSTREAM_INDEX_CACHE_VERSION	2
+#define GS_APPSTREAM_INDEX_CACHE_TYPE		"(uusasa(sa(uu)))"
+
+static GMutex gs_appstream_index_mutex;
+
+static void
+gs_appstream_token_free (GsAppstreamToken *token)
+{
+	if (token->postings_buf != NULL)
+		g_array_unref (token->postings_buf);
+	g_slice_free (GsAppstreamToken, token);
+}
+
+static void
+gs_appstream_parents_free (GArray *parents)
+{
+	if (parents != NULL)
+		g_array_unref (parents);
+}
+
+static void
+gs_appstream_index_unref (GsAppstreamIndex *idx)
+{
+	if (!g_atomic_int_dec_and_test (&idx->ref))
+		return;
+	g_ptr_array_unref (idx->apps);
+	g_ptr_array_unref (idx->entities);
+	g_ptr_array_unref (idx->parents);
+	g_ptr_array_unref (idx->tokens);
+	if (idx->categories != NULL)
+		g_hash_table_unref (idx->categories);
+	if (idx->popular != NULL)
+		g_array_unref (idx->popular);
+	if (idx->featured != NULL)
+		g_array_unref (idx->featured);
+	if (idx->releases != NULL)
+		g_array_unref (idx->releases);
+	g_string_chunk_free (idx->chunk);
+	if (idx->data != NULL)
+		g_variant_unref (idx->data);
+	g_strfreev (idx->last_values);
+	if (idx->last_candidates != NULL)
+		g_array_unref (idx->last_candidates);
+	g_mutex_clear (&idx->last_mutex);
+	g_mutex_clear (&idx->mutex);
+	g_slice_free (GsAppstreamIndex, idx);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GsAppstreamIndex, gs_appstream_index_unref)
+
+static GsAppstreamIndex *
+gs_appstream_index_ref (GsAppstreamIndex *idx)
+{
+	g_atomic_int_inc (&idx->ref);
+	return idx;
+}
+
+static gint
+gs_appstream_token_cmp (gconstpointer a, gconstpointer b)
+{
+	GsAppstreamToken *token1 = *((GsAppstreamToken **) a);
+	GsAppstreamToken *token2 = *((GsAppstreamToken **) b);
+	return g_strcmp0 (token1->token, token2->token);
+}
+
+/* the index is only valid for exactly the same set of apps */
 static gboolean
-gs_appstream_store_search_item (GsPlugin *plugin,
-				AsApp *item,
-				gchar **values,
-				GsAppList *list,
-				GCancellable *cancellable,
-				GError **error)
+gs_appstream_index_is_valid (GsAppstreamIndex *idx, GPtrArray *apps)
 {
-	AsApp *item_tmp;
-	GPtrArray *addons;
-	guint i;
-	guint match_value;
-	g_autoptr(GsApp) app = NULL;
+	if (idx->apps->len != apps->len)
+		return FALSE;
+	return memcmp (idx->apps->pdata, apps->pdata,
+		       apps->len * sizeof (gpointer)) == 0;
+}
 
-	/* match against the app or any of the addons */
-	match_value = as_app_search_matches_all (item, values);
-	addons = as_app_get_addons (item);
-	for (i = 0; i < addons->len; i++) {
-		item_tmp = g_ptr_array_index (addons, i);
-		match_value |= as_app_search_matches_all (item_tmp, values);
+static guint
+gs_appstream_index_add_entity (GsAppstreamIndex *idx,
+			       GHashTable *entity_ids,
+			       AsApp *item)
+{
+	gpointer value;
+	guint entity;
+
+	if (g_hash_table_lookup_extended (entity_ids, item, NULL, &value))
+		return GPOINTER_TO_UINT (value);
+	entity = idx->entities->len;
+	g_ptr_array_add (idx->entities, g_object_ref (item));
+	g_ptr_array_add (idx->parents, NULL);
+	g_hash_table_insert (entity_ids, item, GUINT_TO_POINTER (entity));
+	return entity;
+}
+
+/* creates an index of the apps and addons in @store with no tokens */
+static GsAppstreamIndex *
+gs_appstream_index_new_empty (AsStore *store)
+{
+	GPtrArray *array = as_store_get_apps (store);
+	GsAppstreamIndex *idx = g_slice_new0 (GsAppstreamIndex);
+	g_autoptr(GHashTable) entity_ids = NULL;
+
+	idx->ref = 1;
+	idx->apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	idx->entities = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	idx->parents = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_appstream_parents_free);
+	idx->tokens = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_appstream_token_free);
+	idx->chunk = g_string_chunk_new (64 * 1024);
+	g_mutex_init (&idx->mutex);
+	g_mutex_init (&idx->last_mutex);
+
+	/* each app is an entity, and so is any addon that is not in the store */
+	entity_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (guint i = 0; i < array->len; i++) {
+		AsApp *item = g_ptr_array_index (array, i);
+		g_ptr_array_add (idx->apps, g_object_ref (item));
+		gs_appstream_index_add_entity (idx, entity_ids, item);
 	}
 
-	/* no match */
-	if (match_value == 0)
-		return TRUE;
+	/* a matching addon also matches each app it is an addon of */
+	for (guint i = 0; i < array->len; i++) {
+		AsApp *item = g_ptr_array_index (array, i);
+		GPtrArray *addons = as_app_get_addons (item);
+		for (guint j = 0; j < addons->len; j++) {
+			AsApp *addon = g_ptr_array_index (addons, j);
+			guint entity = gs_appstream_index_add_entity (idx, entity_ids, addon);
+			GArray *parents = g_ptr_array_index (idx->parents, entity);
+			if (parents == NULL) {
+				parents = g_array_new (FALSE, FALSE, sizeof (guint));
+				idx->parents->pdata[entity] = parents;
+			}
+			g_array_append_val (parents, i);
+		}
+	}
+	return idx;
+}
 
-	/* create app */
-	app = gs_appstream_create_app (plugin, item, error);
-	if (app == NULL)
-		return FALSE;
-	gs_app_set_match_value (app, match_value);
-	gs_app_list_add (list, app);
-	return TRUE;
+/* mutex must be held */
+static void
+gs_appstream_index_add_tokens (GsAppstreamIndex *idx)
+{
+	g_autoptr(GHashTable) tokens = NULL;
+
+	/* add the tokens of each entity, the match kind of an exact match
+	 * is the token cache value shifted up by two */
+	tokens = g_hash_table_new (g_str_hash, g_str_equal);
+	for (guint i = 0; i < idx->entities->len; i++) {
+		AsApp *item = g_ptr_array_index (idx->entities, i);
+		g_autoptr(GPtrArray) search_tokens = as_app_get_search_tokens (item);
+		for (guint j = 0; j < search_tokens->len; j++) {
+			const gchar *str = g_ptr_array_index (search_tokens, j);
+			GsAppstreamPosting posting;
+			GsAppstreamToken *token;
+
+			posting.entity = i;
+			posting.mask = as_app_search_matches (item, str) >> 2;
+			if (posting.mask == 0)
+				continue;
+			token = g_hash_table_lookup (tokens, str);
+			if (token == NULL) {
+				token = g_slice_new0 (GsAppstreamToken);
+				token->token = g_string_chunk_insert_const (idx->chunk, str);
+				token->postings_buf = g_array_new (FALSE, FALSE, sizeof (GsAppstreamPosting));
+				g_ptr_array_add (idx->tokens, token);
+				g_hash_table_insert (tokens, (gpointer) token->token, token);
+			}
+			g_array_append_val (token->postings_buf, posting);
+		}
+	}
+	for (guint i = 0; i < idx->tokens->len; i++) {
+		GsAppstreamToken *token = g_ptr_array_index (idx->tokens, i);
+		token->postings = (const GsAppstreamPosting *) token->postings_buf->data;
+		token->n_postings = token->postings_buf->len;
+	}
+	g_ptr_array_sort (idx->tokens, gs_appstream_token_cmp);
+	idx->has_tokens = TRUE;
 }
 
-gboolean
-gs_appstream_store_search (GsPlugin *plugin,
-			   AsStore *store,
-			   gchar **values,
-			   GsAppList *list,
-			   GCancellable *cancellable,
-			   GError **error)
+static void
+gs_appstream_checksum_update_strv (GChecksum *csum, GPtrArray *array)
+{
+	if (array == NULL)
+		return;
+	for (guint i = 0; i < array->len; i++) {
+		const gchar *tmp = g_ptr_array_index (array, i);
+		g_checksum_update (csum, (const guchar *) tmp, -1);
+		g_checksum_update (csum, (const guchar *) "\n", 1);
+	}
+}
+
+static void
+gs_appstream_checksum_update_str (GChecksum *csum, const gchar *tmp)
+{
+	if (tmp != NULL)
+		g_checksum_update (csum, (const guchar *) tmp, -1);
+	g_checksum_update (csum, (const guchar *) "\n", 1);
+}
+
+/* a checksum of everything the search tokens are created from, which is
+ * much quicker to compute than the tokens themselves */
+static gchar *
+gs_appstream_index_get_checksum (GsAppstreamIndex *idx, AsStore *store)
+{
+	const gchar * const *langs = g_get_language_names ();
+	guint search_match = as_store_get_search_match (store);
+	g_autoptr(GChecksum) csum = g_checksum_new (G_CHECKSUM_SHA1);
+
+	for (guint j = 0; langs[j] != NULL; j++)
+		gs_appstream_checksum_update_str (csum, langs[j]);
+	g_checksum_update (csum, (const guchar *) &search_match, sizeof (search_match));
+	for (guint i = 0; i < idx->entities->len; i++) {
+		AsApp *item = g_ptr_array_index (idx->entities, i);
+		guint item_search_match = as_app_get_search_match (item);
+
+		/* this includes if the origin is used as a keyword */
+		g_checksum_update (csum, (const guchar *) &item_search_match,
+				   sizeof (item_search_match));
+		gs_appstream_checksum_update_str (csum, as_app_get_unique_id (item));
+		gs_appstream_checksum_update_str (csum, as_app_get_id (item));
+		gs_appstream_checksum_update_str (csum, as_app_get_origin (item));
+		for (guint j = 0; langs[j] != NULL; j++) {
+			gs_appstream_checksum_update_str (csum, as_app_get_name (item, langs[j]));
+			gs_appstream_checksum_update_str (csum, as_app_get_comment (item, langs[j]));
+			gs_appstream_checksum_update_strv (csum, as_app_get_keywords (item, langs[j]));
+		}
+		gs_appstream_checksum_update_strv (csum, as_app_get_mimetypes (item));
+		gs_appstream_checksum_update_strv (csum, as_app_get_pkgnames (item));
+	}
+	return g_strdup (g_checksum_get_string (csum));
+}
+
+/* the tokens and posting lists are used directly from the mapped file */
+static GsAppstreamIndex *
+gs_appstream_index_new_from_file (AsStore *store,
+				  const gchar *filename,
+				  gchar **checksum,
+				  GError **error)
+{
+	const gchar *checksum_tmp = NULL;
+	guint32 byte_order = 0;
+	guint32 version = 0;
+	g_autoptr(GBytes) bytes = NULL;
+	g_autoptr(GMappedFile) mapped = NULL;
+	g_autoptr(GVariant) data = NULL;
+	g_autoptr(GVariant) ids = NULL;
+	g_autoptr(GVariant) tokens = NULL;
+	g_autoptr(GsAppstreamIndex) idx = gs_appstream_index_new_empty (store);
+
+	/* the caller needs this to save a new cache */
+	*checksum = gs_appstream_index_get_checksum (idx, store);
+
+	mapped = g_mapped_file_new (filename, FALSE, error);
+	if (mapped == NULL)
+		return NULL;
+	bytes = g_mapped_file_get_bytes (mapped);
+	data = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (GS_APPSTREAM_INDEX_CACHE_TYPE),
+							    bytes, FALSE));
+	g_variant_get (data, "(uu&s@as@a(sa(uu)))",
+		       &version, &byte_order, &checksum_tmp, &ids, &tokens);
+	if (version != GS_APPSTREAM_INDEX_CACHE_VERSION) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_INVALID_FORMAT,
+			     "search index version %u not supported",
+			     version);
+		return NULL;
+	}
+	if (byte_order != G_BYTE_ORDER) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_INVALID_FORMAT,
+			     "search index byte order %u not supported",
+			     byte_order);
+		return NULL;
+	}
+	if (g_strcmp0 (checksum_tmp, *checksum) != 0) {
+		g_set_error_literal (error,
+				     GS_PLUGIN_ERROR,
+				     GS_PLUGIN_ERROR_INVALID_FORMAT,
+				     "search index is out of date");
+		return NULL;
+	}
+
+	/* the entities have to be exactly the same */
+	if (g_variant_n_children (ids) != idx->entities->len) {
+		g_set_error_literal (error,
+				     GS_PLUGIN_ERROR,
+				     GS_PLUGIN_ERROR_INVALID_FORMAT,
+				     "search index has the wrong apps");
+		return NULL;
+	}
+	for (guint i = 0; i < idx->entities->len; i++) {
+		AsApp *item = g_ptr_array_index (idx->entities, i);
+		const gchar *id = NULL;
+		g_variant_get_child (ids, i, "&s", &id);
+		if (g_strcmp0 (id, as_app_get_unique_id (item)) != 0) {
+			g_set_error (error,
+				     GS_PLUGIN_ERROR,
+				     GS_PLUGIN_ERROR_INVALID_FORMAT,
+				     "search index has %s not %s",
+				     id, as_app_get_unique_id (item));
+			return NULL;
+		}
+	}
+
+	/* no need to copy anything as the index keeps the data alive */
+	for (gsize i = 0; i < g_variant_n_children (tokens); i++) {
+		GsAppstreamToken *token = g_slice_new0 (GsAppstreamToken);
+		gsize n_postings = 0;
+		g_autoptr(GVariant) postings = NULL;
+
+		g_ptr_array_add (idx->tokens, token);
+		g_variant_get_child (tokens, i, "(&s@a(uu))", &token->token, &postings);
+		token->postings = g_variant_get_fixed_array (postings, &n_postings,
+							     sizeof (GsAppstreamPosting));
+		token->n_postings = n_postings;
+		for (guint j = 0; j < token->n_postings; j++) {
+			if (token->postings[j].entity >= idx->entities->len) {
+				g_set_error (error,
+					     GS_PLUGIN_ERROR,
+					     GS_PLUGIN_ERROR_INVALID_FORMAT,
+					     "search index token %s is invalid",
+					     token->token);
+				return NULL;
+			}
+		}
+	}
+	idx->data = g_steal_pointer (&data);
+	idx->has_tokens = TRUE;
+	return g_steal_pointer (&idx);
+}
+
+static gboolean
+gs_appstream_index_save (GsAppstreamIndex *idx,
+			 const gchar *filename,
+			 const gchar *checksum,
+			 GError **error)
+{
+	GVariantBuilder builder_ids;
+	GVariantBuilder builder_tokens;
+	g_autoptr(GVariant) data = NULL;
+
+	g_variant_builder_init (&builder_ids, G_VARIANT_TYPE ("as"));
+	for (guint i = 0; i < idx->entities->len; i++) {
+		AsApp *item = g_ptr_array_index (idx->entities, i);
+		g_variant_builder_add (&builder_ids, "s", as_app_get_unique_id (item));
+	}
+	g_variant_builder_init (&builder_tokens, G_VARIANT_TYPE ("a(sa(uu))"));
+	for (guint i = 0; i < idx->tokens->len; i++) {
+		GsAppstreamToken *token = g_ptr_array_index (idx->tokens, i);
+		GVariant *postings;
+		postings = g_variant_new_fixed_array (G_VARIANT_TYPE ("(uu)"),
+						      token->postings,
+						      token->n_postings,
+						      sizeof (GsAppstreamPosting));
+		g_variant_builder_add (&builder_tokens, "(s@a(uu))",
+				       token->token, postings);
+	}
+	data = g_variant_ref_sink (g_variant_new (GS_APPSTREAM_INDEX_CACHE_TYPE,
+						  (guint32) GS_APPSTREAM_INDEX_CACHE_VERSION,
+						  (guint32) G_BYTE_ORDER,
+						  checksum,
+						  &builder_ids,
+						  &builder_tokens));
+	return g_file_set_contents (filename,
+				    g_variant_get_data (data),
+				    (gssize) g_variant_get_size (data),
+				    error);
+}
+
+/* returns a reference to the index for @store, creating a new one if the
+ * apps in the store have changed; each part is only built when needed */
+static GsAppstreamIndex *
+gs_appstream_index_get (AsStore *store)
+{
+	GsAppstreamIndex *idx;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&gs_appstream_index_mutex);
+
+	idx = g_object_get_data (G_OBJECT (store), "GsAppstream::index");
+	if (idx == NULL || !gs_appstream_index_is_valid (idx, as_store_get_apps (store))) {
+		idx = gs_appstream_index_new_empty (store);
+		g_object_set_data_full (G_OBJECT (store), "GsAppstream::index", idx,
+					(GDestroyNotify) gs_appstream_index_unref);
+	}
+	return gs_appstream_index_ref (idx);
+}
+
+static void
+gs_appstream_index_ensure_tokens (GsPlugin *plugin, GsAppstreamIndex *idx)
 {
-	AsApp *item;
-	GPtrArray *array;
-	gboolean ret = TRUE;
-	guint i;
 	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&idx->mutex);
 
-	/* search categories for the search term */
+	if (idx->has_tokens)
+		return;
 	ptask = as_profile_start_literal (gs_plugin_get_profile (plugin),
-					  "appstream::search");
+					  "appstream::search-index");
 	g_assert (ptask != NULL);
-	array = as_store_get_apps (store);
-	for (i = 0; i < array->len; i++) {
-		if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
-			gs_utils_error_convert_gio (error);
-			return FALSE;
-		}
+	gs_appstream_index_add_tokens (idx);
+	g_debug ("indexed %u tokens from %u apps",
+		 idx->tokens->len, idx->apps->len);
+}
 
-		item = g_ptr_array_index (array, i);
-		ret = gs_appstream_store_search_item (plugin, item,
-						      values, list,
-						      cancellable, error);
-		if (!ret)
-			return FALSE;
+static void
+gs_appstream_index_ensure_categories (GsPlugin *plugin, GsAppstreamIndex *idx)
+{
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&idx->mutex);
+
+	if (idx->categories != NULL)
+		return;
+	ptask = as_profile_start_literal (gs_plugin_get_profile (plugin),
+					  "appstream::category-index");
+	g_assert (ptask != NULL);
+
+	/* the apps of each category are in store order */
+	idx->categories = g_hash_table_new_full (g_str_hash, g_str_equal,
+						 NULL, (GDestroyNotify) g_array_unref);
+	for (guint i = 0; i < idx->apps->len; i++) {
+		AsApp *item = g_ptr_array_index (idx->apps, i);
+		GPtrArray *categories;
+
+		/* no ID is invalid */
+		if (as_app_get_id (item) == NULL)
+			continue;
+		categories = as_app_get_categories (item);
+		for (guint j = 0; j < categories->len; j++) {
+			const gchar *category = g_ptr_array_index (categories, j);
+			GArray *apps = g_hash_table_lookup (idx->categories, category);
+			if (apps == NULL) {
+				apps = g_array_new (FALSE, FALSE, sizeof (guint));
+				g_hash_table_insert (idx->categories,
+						     g_string_chunk_insert_const (idx->chunk, category),
+						     apps);
+			}
+			if (apps->len > 0 && g_array_index (apps, guint, apps->len - 1) == i)
+				continue;
+			g_array_append_val (apps, i);
+		}
 	}
-	return TRUE;
 }
 
-static gboolean
-_as_app_matches_desktop_group_set (AsApp *app, gchar **desktop_groups)
+static gint
+gs_appstream_release_cmp (gconstpointer a, gconstpointer b)
 {
-	guint i;
-	for (i = 0; desktop_groups[i] != NULL; i++) {
-		if (!as_app_has_category (app, desktop_groups[i]))
-			return FALSE;
+	const GsAppstreamRelease *rel1 = a;
+	const GsAppstreamRelease *rel2 = b;
+	if (rel1->timestamp > rel2->timestamp)
+		return -1;
+	if (rel1->timestamp < rel2->timestamp)
+		return 1;
+	return 0;
+}
+
+/* the popular, featured and recent apps are all found in one pass */
+static void
+gs_appstream_index_ensure_lists (GsPlugin *plugin, GsAppstreamIndex *idx)
+{
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&idx->mutex);
+
+	if (idx->popular != NULL)
+		return;
+	ptask = as_profile_start_literal (gs_plugin_get_profile (plugin),
+					  "appstream::list-index");
+	g_assert (ptask != NULL);
+	idx->popular = g_array_new (FALSE, FALSE, sizeof (guint));
+	idx->featured = g_array_new (FALSE, FALSE, sizeof (guint));
+	idx->releases = g_array_new (FALSE, FALSE, sizeof (GsAppstreamRelease));
+	for (guint i = 0; i < idx->apps->len; i++) {
+		AsApp *item = g_ptr_array_index (idx->apps, i);
+		AsRelease *rel;
+
+		/* no ID is invalid */
+		if (as_app_get_id (item) == NULL)
+			continue;
+		if (as_app_has_kudo (item, "GnomeSoftware::popular"))
+			g_array_append_val (idx->popular, i);
+		if (as_app_get_metadata_item (item, "GnomeSoftware::FeatureTile-css") != NULL)
+			g_array_append_val (idx->featured, i);
+		rel = as_app_get_release_default (item);
+		if (rel != NULL && as_release_get_timestamp (rel) != 0) {
+			GsAppstreamRelease release;
+			release.timestamp = as_release_get_timestamp (rel);
+			release.app = i;
+			g_array_append_val (idx->releases, release);
+		}
 	}
-	return TRUE;
+	g_array_sort (idx->releases, gs_appstream_release_cmp);
 }
 
-static gboolean
-_as_app_matches_desktop_group (AsApp *app, const gchar *desktop_group)
+/* returns the apps that are in all the categories of a desktop group such
+ * as "AudioVideo::Player", in store order */
+static GArray *
+gs_appstream_index_match_desktop_group (GsAppstreamIndex *idx,
+					const gchar *desktop_group)
 {
+	GArray *result = g_array_new (FALSE, FALSE, sizeof (guint));
 	g_auto(GStrv) split = g_strsplit (desktop_group, "::", -1);
-	return _as_app_matches_desktop_group_set (app, split);
+
+	/* no categories matches everything */
+	if (split[0] == NULL) {
+		for (guint i = 0; i < idx->apps->len; i++) {
+			AsApp *item = g_ptr_array_index (idx->apps, i);
+			if (as_app_get_id (item) != NULL)
+				g_array_append_val (result, i);
+		}
+		return result;
+	}
+
+	for (guint i = 0; split[i] != NULL; i++) {
+		GArray *apps = g_hash_table_lookup (idx->categories, split[i]);
+		guint k = 0;
+		guint n = 0;
+
+		if (apps == NULL) {
+			g_array_set_size (result, 0);
+			break;
+		}
+		if (i == 0) {
+			g_array_append_vals (result, apps->data, apps->len);
+			continue;
+		}
+
+		/* intersect the sorted lists */
+		for (guint j = 0; j < result->len; j++) {
+			guint app_idx = g_array_index (result, guint, j);
+			while (k < apps->len && g_array_index (apps, guint, k) < app_idx)
+				k++;
+			if (k < apps->len && g_array_index (apps, guint, k) == app_idx)
+				g_array_index (result, guint, n++) = app_idx;
+		}
+		g_array_set_size (result, n);
+	}
+	return result;
 }
 
+/* finds the first token that is not less than @value */
+static guint
+gs_appstream_index_lower_bound (GsAppstreamIndex *idx, const gchar *value)
+{
+	guint lo = 0;
+	guint hi = idx->tokens->len;
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		GsAppstreamToken *token = g_ptr_array_index (idx->tokens, mid);
+		if (g_strcmp0 (token->token, value) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* sets @matches to the match kinds of each entity for @value, adding each
+ * entity that matched to @touched, with the same semantics as
+ * as_app_search_matches() */
 static void
-gs_appstream_store_add_categories_for_app (GsCategory *parent, AsApp *app)
+gs_appstream_index_match_value (GsAppstreamIndex *idx,
+				const gchar *value,
+				guint *matches,
+				GArray *touched)
 {
-	GPtrArray *children;
-	GPtrArray *desktop_groups;
-	GsCategory *category;
-	guint i, j;
-
-	/* find all the sub-categories */
-	children = gs_category_get_children (parent);
-	for (j = 0; j < children->len; j++) {
-		gboolean matched = FALSE;
-		category = GS_CATEGORY (g_ptr_array_index (children, j));
-
-		/* do any desktop_groups match this application */
-		desktop_groups = gs_category_get_desktop_groups (category);
-		for (i = 0; i < desktop_groups->len; i++) {
-			const gchar *desktop_group = g_ptr_array_index (desktop_groups, i);
-			if (_as_app_matches_desktop_group (app, desktop_group)) {
-				matched = TRUE;
+	gsize len = strlen (value);
+
+	/* the exact token always sorts first, then any longer prefixed ones */
+	for (guint i = gs_appstream_index_lower_bound (idx, value); i < idx->tokens->len; i++) {
+		GsAppstreamToken *token = g_ptr_array_index (idx->tokens, i);
+		gboolean exact;
+		if (strncmp (token->token, value, len) != 0)
+			break;
+		exact = token->token[len] == '\0';
+		for (guint j = 0; j < token->n_postings; j++) {
+			const GsAppstreamPosting *posting = &token->postings[j];
+			guint *match = &matches[posting->entity];
+			if (*match == 0)
+				g_array_append_val (touched, posting->entity);
+			if (exact)
+				*match = (posting->mask << 2) | GS_APPSTREAM_INDEX_EXACT;
+			else if ((*match & GS_APPSTREAM_INDEX_EXACT) == 0)
+				*match |= posting->mask;
+		}
+	}
+}
+
+/* every value of @values_old is a prefix of at least one of @values, so the
+ * results can only be a subset of the results for @values_old */
+static gboolean
+gs_appstream_index_values_narrow (gchar **values_old, gchar **values)
+{
+	if (values_old == NULL)
+		return FALSE;
+	for (guint i = 0; values_old[i] != NULL; i++) {
+		gboolean found = FALSE;
+		for (guint j = 0; values[j] != NULL; j++) {
+			if (g_str_has_prefix (values[j], values_old[i])) {
+				found = TRUE;
 				break;
 			}
 		}
-		if (matched) {
-			gs_category_increment_size (category);
-			gs_category_increment_size (parent);
+		if (!found)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* returns the entities that match all of @values, with the same semantics
+ * as as_app_search_matches_all() */
+static GArray *
+gs_appstream_index_search_full (GsAppstreamIndex *idx, gchar **values, guint *results)
+{
+	GArray *candidates = g_array_new (FALSE, FALSE, sizeof (guint));
+	g_autofree guint *matches = g_new0 (guint, idx->entities->len);
+
+	for (guint i = 0; values[i] != NULL; i++) {
+		g_autoptr(GArray) touched = g_array_new (FALSE, FALSE, sizeof (guint));
+		gs_appstream_index_match_value (idx, values[i], matches, touched);
+
+		/* intersect with the entities that matched the other values */
+		if (i == 0) {
+			for (guint j = 0; j < touched->len; j++) {
+				guint entity = g_array_index (touched, guint, j);
+				guint match = matches[entity] & ~GS_APPSTREAM_INDEX_EXACT;
+				if (match == 0)
+					continue;
+				results[entity] = match;
+				g_array_append_val (candidates, entity);
+			}
+		} else {
+			guint n = 0;
+			for (guint j = 0; j < candidates->len; j++) {
+				guint entity = g_array_index (candidates, guint, j);
+				guint match = matches[entity] & ~GS_APPSTREAM_INDEX_EXACT;
+				if (match == 0) {
+					results[entity] = 0;
+					continue;
+				}
+				results[entity] |= match;
+				g_array_index (candidates, guint, n++) = entity;
+			}
+			g_array_set_size (candidates, n);
+		}
+
+		/* reset for the next value */
+		for (guint j = 0; j < touched->len; j++)
+			matches[g_array_index (touched, guint, j)] = 0;
+		if (candidates->len == 0)
+			break;
+	}
+	return candidates;
+}
+
+/* when typing, each query usually just extends the last one, so only the
+ * previous results need to be checked again rather than the whole index */
+static GArray *
+gs_appstream_index_search (GsAppstreamIndex *idx, gchar **values, guint *results)
+{
+	GArray *candidates = NULL;
+	g_autoptr(GArray) candidates_old = NULL;
+
+	g_mutex_lock (&idx->last_mutex);
+	if (gs_appstream_index_values_narrow (idx->last_values, values))
+		candidates_old = g_array_ref (idx->last_candidates);
+	g_mutex_unlock (&idx->last_mutex);
+
+	if (candidates_old != NULL) {
+		candidates = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+						candidates_old->len);
+		for (guint i = 0; i < candidates_old->len; i++) {
+			guint entity = g_array_index (candidates_old, guint, i);
+			AsApp *item = g_ptr_array_index (idx->entities, entity);
+			guint match = as_app_search_matches_all (item, values);
+			if (match == 0)
+				continue;
+			results[entity] = match;
+			g_array_append_val (candidates, entity);
 		}
+		g_debug ("narrowed %u previous results to %u",
+			 candidates_old->len, candidates->len);
+	} else {
+		candidates = gs_appstream_index_search_full (idx, values, results);
+	}
+
+	/* save for next time */
+	g_mutex_lock (&idx->last_mutex);
+	g_strfreev (idx->last_values);
+	idx->last_values = g_strdupv (values);
+	if (idx->last_candidates != NULL)
+		g_array_unref (idx->last_candidates);
+	idx->last_candidates = g_array_ref (candidates);
+	g_mutex_unlock (&idx->last_mutex);
+	return candidates;
+}
+
+/* uses the search index from @cache_fn if it matches @store, which avoids
+ * tokenizing every app in the store, otherwise saves a new one */
+void
+gs_appstream_store_load_search_index (GsPlugin *plugin,
+				      AsStore *store,
+				      const gchar *cache_fn)
+{
+	g_autofree gchar *checksum = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(GsAppstreamIndex) idx = NULL;
+	g_autoptr(AsProfileTask) ptask = NULL;
+
+	if (cache_fn == NULL) {
+		as_store_load_search_cache (store);
+		idx = gs_appstream_index_get (store);
+		gs_appstream_index_ensure_tokens (plugin, idx);
+		return;
 	}
+
+	ptask = as_profile_start_literal (gs_plugin_get_profile (plugin),
+					  "appstream::search-index-cache");
+	g_assert (ptask != NULL);
+	locker = g_mutex_locker_new (&gs_appstream_index_mutex);
+	idx = gs_appstream_index_new_from_file (store, cache_fn, &checksum, &error);
+	if (idx != NULL) {
+		g_debug ("loaded %u tokens from %s", idx->tokens->len, cache_fn);
+		g_object_set_data_full (G_OBJECT (store), "GsAppstream::index",
+					g_steal_pointer (&idx),
+					(GDestroyNotify) gs_appstream_index_unref);
+		return;
+	}
+	g_debug ("not using search index %s: %s", cache_fn, error->message);
+	g_clear_error (&error);
+	g_clear_pointer (&locker, g_mutex_locker_free);
+
+	/* tokenize in parallel, then build and save a new index */
+	as_store_load_search_cache (store);
+	idx = gs_appstream_index_get (store);
+	gs_appstream_index_ensure_tokens (plugin, idx);
+	if (!gs_appstream_index_save (idx, cache_fn, checksum, &error))
+		g_warning ("failed to save search index: %s", error->message);
+}
+
+static gint
+gs_appstream_uint_cmp (gconstpointer a, gconstpointer b)
+{
+	guint uint1 = *((guint *) a);
+	guint uint2 = *((guint *) b);
+	if (uint1 < uint2)
+		return -1;
+	if (uint1 > uint2)
+		return 1;
+	return 0;
+}
+
+gboolean
+gs_appstream_store_search (GsPlugin *plugin,
+			   AsStore *store,
+			   gchar **values,
+			   GsAppList *list,
+			   GCancellable *cancellable,
+			   GError **error)
+{
+	g_autofree guint *results = NULL;
+	g_autofree guint *app_matches = NULL;
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GArray) candidates = NULL;
+	g_autoptr(GArray) hits = NULL;
+	g_autoptr(GsAppstreamIndex) idx = NULL;
+
+	/* nothing to match */
+	if (values == NULL || values[0] == NULL)
+		return TRUE;
+
+	/* search categories for the search term */
+	idx = gs_appstream_index_get (store);
+	gs_appstream_index_ensure_tokens (plugin, idx);
+	ptask = as_profile_start_literal (gs_plugin_get_profile (plugin),
+					  "appstream::search");
+	g_assert (ptask != NULL);
+	results = g_new0 (guint, idx->entities->len);
+	candidates = gs_appstream_index_search (idx, values, results);
+
+	/* match against the app or any of the addons */
+	app_matches = g_new0 (guint, idx->apps->len);
+	hits = g_array_new (FALSE, FALSE, sizeof (guint));
+	for (guint i = 0; i < candidates->len; i++) {
+		guint entity = g_array_index (candidates, guint, i);
+		GArray *parents = g_ptr_array_index (idx->parents, entity);
+		if (entity < idx->apps->len) {
+			if (app_matches[entity] == 0)
+				g_array_append_val (hits, entity);
+			app_matches[entity] |= results[entity];
+		}
+		if (parents == NULL)
+			continue;
+		for (guint j = 0; j < parents->len; j++) {
+			guint parent = g_array_index (parents, guint, j);
+			if (app_matches[parent] == 0)
+				g_array_append_val (hits, parent);
+			app_matches[parent] |= results[entity];
+		}
+	}
+
+	/* create apps in the order of the store */
+	g_array_sort (hits, gs_appstream_uint_cmp);
+	for (guint i = 0; i < hits->len; i++) {
+		guint app_idx = g_array_index (hits, guint, i);
+		AsApp *item = g_ptr_array_index (idx->apps, app_idx);
+		g_autoptr(GsApp) app = NULL;
+
+		if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+			gs_utils_error_convert_gio (error);
+			return FALSE;
+		}
+		app = gs_appstream_create_app (plugin, item, error);
+		if (app == NULL)
+			return FALSE;
+		gs_app_set_match_value (app, app_matches[app_idx]);
+		gs_app_list_add (list, app);
+	}
+	return TRUE;
 }
 
 gboolean
@@ -990,40 +1743,31 @@ gs_appstream_store_add_category_apps (GsPlugin *plugin,
 				      GCancellable *cancellable,
 				      GError **error)
 {
-	GPtrArray *array;
 	GPtrArray *desktop_groups;
-	guint i;
-	guint j;
 	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GsAppstreamIndex) idx = NULL;
 
-	/* just look at each app in turn */
-	ptask = as_profile_start_literal (gs_plugin_get_profile (plugin),
-					  "appstream::add-category-apps");
-	g_assert (ptask != NULL);
-	array = as_store_get_apps (store);
+	/* just look at each app in the category */
 	desktop_groups = gs_category_get_desktop_groups (category);
 	if (desktop_groups->len == 0) {
 		g_warning ("no desktop_groups for %s", gs_category_get_id (category));
 		return TRUE;
 	}
-	for (j = 0; j < desktop_groups->len; j++) {
+	idx = gs_appstream_index_get (store);
+	gs_appstream_index_ensure_categories (plugin, idx);
+	ptask = as_profile_start_literal (gs_plugin_get_profile (plugin),
+					  "appstream::add-category-apps");
+	g_assert (ptask != NULL);
+	for (guint j = 0; j < desktop_groups->len; j++) {
 		const gchar *desktop_group = g_ptr_array_index (desktop_groups, j);
-		g_auto(GStrv) split = g_strsplit (desktop_group, "::", -1);
+		g_autoptr(GArray) apps = NULL;
 
-		/* match the app */
-		for (i = 0; i < array->len; i++) {
-			AsApp *item;
+		/* match all the desktop groups */
+		apps = gs_appstream_index_match_desktop_group (idx, desktop_group);
+		for (guint i = 0; i < apps->len; i++) {
+			AsApp *item = g_ptr_array_index (idx->apps, g_array_index (apps, guint, i));
 			g_autoptr(GsApp) app = NULL;
 
-			/* no ID is invalid */
-			item = g_ptr_array_index (array, i);
-			if (as_app_get_id (item) == NULL)
-				continue;
-
-			/* match all the desktop groups */
-			if (!_as_app_matches_desktop_group_set (item, split))
-				continue;
-
 			/* add all the data we can */
 			app = gs_appstream_create_app (plugin, item, error);
 			if (app == NULL)
@@ -1041,31 +1785,68 @@ gs_appstream_store_add_categories (GsPlugin *plugin,
 				   GCancellable *cancellable,
 				   GError **error)
 {
-	AsApp *app;
-	GPtrArray *array;
-	guint i;
-	guint j;
+	g_autofree guint8 *matched = NULL;
 	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GArray) hits = NULL;
+	g_autoptr(GsAppstreamIndex) idx = NULL;
 
 	/* find out how many packages are in each category */
+	idx = gs_appstream_index_get (store);
+	gs_appstream_index_ensure_categories (plugin, idx);
 	ptask = as_profile_start_literal (gs_plugin_get_profile (plugin),
 					  "appstream::add-categories");
 	g_assert (ptask != NULL);
-	array = as_store_get_apps (store);
-	for (i = 0; i < array->len; i++) {
-		app = g_ptr_array_index (array, i);
-		if (as_app_get_id (app) == NULL)
-			continue;
-		if (as_app_get_priority (app) < 0)
-			continue;
-		for (j = 0; j < list->len; j++) {
-			GsCategory *parent = GS_CATEGORY (g_ptr_array_index (list, j));
-			gs_appstream_store_add_categories_for_app (parent, app);
+	matched = g_new0 (guint8, idx->apps->len);
+	hits = g_array_new (FALSE, FALSE, sizeof (guint));
+	for (guint j = 0; j < list->len; j++) {
+		GsCategory *parent = GS_CATEGORY (g_ptr_array_index (list, j));
+		GPtrArray *children = gs_category_get_children (parent);
+
+		/* find all the sub-categories */
+		for (guint k = 0; k < children->len; k++) {
+			GsCategory *category = GS_CATEGORY (g_ptr_array_index (children, k));
+			GPtrArray *desktop_groups = gs_category_get_desktop_groups (category);
+
+			/* count each app once even if many desktop_groups match */
+			for (guint i = 0; i < desktop_groups->len; i++) {
+				const gchar *desktop_group = g_ptr_array_index (desktop_groups, i);
+				g_autoptr(GArray) apps = NULL;
+				apps = gs_appstream_index_match_desktop_group (idx, desktop_group);
+				for (guint l = 0; l < apps->len; l++) {
+					guint app_idx = g_array_index (apps, guint, l);
+					AsApp *item = g_ptr_array_index (idx->apps, app_idx);
+					if (matched[app_idx])
+						continue;
+					if (as_app_get_priority (item) < 0)
+						continue;
+					matched[app_idx] = TRUE;
+					g_array_append_val (hits, app_idx);
+				}
+			}
+			for (guint i = 0; i < hits->len; i++) {
+				gs_category_increment_size (category);
+				gs_category_increment_size (parent);
+				matched[g_array_index (hits, guint, i)] = FALSE;
+			}
+			g_array_set_size (hits, 0);
 		}
 	}
 	return TRUE;
 }
 
+static void
+gs_appstream_add_wildcard_apps (GsAppstreamIndex *idx,
+				GArray *apps,
+				GsAppList *list)
+{
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *item = g_ptr_array_index (idx->apps, g_array_index (apps, guint, i));
+		g_autoptr(GsApp) app = gs_app_new (as_app_get_id (item));
+		gs_app_add_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX);
+		gs_app_list_add (list, app);
+	}
+}
+
 gboolean
 gs_appstream_add_popular (GsPlugin *plugin,
 			  AsStore *store,
@@ -1073,47 +1854,19 @@ gs_appstream_add_popular (GsPlugin *plugin,
 			  GCancellable *cancellable,
 			  GError **error)
 {
-	AsApp *item;
-	GPtrArray *array;
-	guint i;
 	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GsAppstreamIndex) idx = NULL;
 
-	/* find out how many packages are in each category */
+	/* just look at the apps with the kudo */
+	idx = gs_appstream_index_get (store);
+	gs_appstream_index_ensure_lists (plugin, idx);
 	ptask = as_profile_start_literal (gs_plugin_get_profile (plugin),
 					  "appstream::add-popular");
 	g_assert (ptask != NULL);
-	array = as_store_get_apps (store);
-	for (i = 0; i < array->len; i++) {
-		g_autoptr(GsApp) app = NULL;
-		item = g_ptr_array_index (array, i);
-		if (as_app_get_id (item) == NULL)
-			continue;
-		if (!as_app_has_kudo (item, "GnomeSoftware::popular"))
-			continue;
-		app = gs_app_new (as_app_get_id (item));
-		gs_app_add_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX);
-		gs_app_list_add (list, app);
-	}
+	gs_appstream_add_wildcard_apps (idx, idx->popular, list);
 	return TRUE;
 }
 
-static gboolean
-_as_app_is_recent (AsApp *app, guint64 age)
-{
-	AsRelease *rel;
-	guint64 ts;
-	guint64 now;
-
-	rel = as_app_get_release_default (app);
-	if (rel == NULL)
-		return FALSE;
-	ts = as_release_get_timestamp (rel);
-	if (ts == 0)
-		return FALSE;
-	now = (guint64) g_get_real_time () / G_USEC_PER_SEC;
-	return (now - ts) < age;
-}
-
 gboolean
 gs_appstream_add_recent (GsPlugin *plugin,
 			 AsStore *store,
@@ -1122,22 +1875,44 @@ gs_appstream_add_recent (GsPlugin *plugin,
 			 GCancellable *cancellable,
 			 GError **error)
 {
-	GPtrArray *array;
+	guint64 now;
+	guint first = 0;
+	guint last = 0;
 	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GArray) apps = NULL;
+	g_autoptr(GsAppstreamIndex) idx = NULL;
 
-	/* find out how many packages are in each category */
+	/* the releases are newest first, so stop at the first one too old */
+	idx = gs_appstream_index_get (store);
+	gs_appstream_index_ensure_lists (plugin, idx);
 	ptask = as_profile_start_literal (gs_plugin_get_profile (plugin),
 					  "appstream::add-recent");
 	g_assert (ptask != NULL);
-	array = as_store_get_apps (store);
-	for (guint i = 0; i < array->len; i++) {
-		g_autoptr(GsApp) app = NULL;
-		AsApp *item = g_ptr_array_index (array, i);
-		if (as_app_get_id (item) == NULL)
-			continue;
-		if (!_as_app_is_recent (item, age))
+	now = (guint64) g_get_real_time () / G_USEC_PER_SEC;
+	for (; last < idx->releases->len; last++) {
+		GsAppstreamRelease *rel = &g_array_index (idx->releases,
+							  GsAppstreamRelease, last);
+
+		/* releases from the future are never recent */
+		if (rel->timestamp > now) {
+			first = last + 1;
 			continue;
-		app = gs_appstream_create_app (plugin, item, error);
+		}
+		if ((now - rel->timestamp) >= age)
+			break;
+	}
+
+	/* keep the order of the store */
+	apps = g_array_sized_new (FALSE, FALSE, sizeof (guint), last - first);
+	for (guint i = first; i < last; i++) {
+		GsAppstreamRelease *rel = &g_array_index (idx->releases,
+							  GsAppstreamRelease, i);
+		g_array_append_val (apps, rel->app);
+	}
+	g_array_sort (apps, gs_appstream_uint_cmp);
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *item = g_ptr_array_index (idx->apps, g_array_index (apps, guint, i));
+		g_autoptr(GsApp) app = gs_appstream_create_app (plugin, item, error);
 		if (app == NULL)
 			return FALSE;
 		gs_app_list_add (list, app);
@@ -1152,27 +1927,16 @@ gs_appstream_add_featured (GsPlugin *plugin,
 			   GCancellable *cancellable,
 			   GError **error)
 {
-	AsApp *item;
-	GPtrArray *array;
-	guint i;
 	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GsAppstreamIndex) idx = NULL;
 
-	/* find out how many packages are in each category */
+	/* just look at the apps with a feature tile */
+	idx = gs_appstream_index_get (store);
+	gs_appstream_index_ensure_lists (plugin, idx);
 	ptask = as_profile_start_literal (gs_plugin_get_profile (plugin),
 					  "appstream::add-featured");
 	g_assert (ptask != NULL);
-	array = as_store_get_apps (store);
-	for (i = 0; i < array->len; i++) {
-		g_autoptr(GsApp) app = NULL;
-		item = g_ptr_array_index (array, i);
-		if (as_app_get_id (item) == NULL)
-			continue;
-		if (as_app_get_metadata_item (item, "GnomeSoftware::FeatureTile-css") == NULL)
-			continue;
-		app = gs_app_new (as_app_get_id (item));
-		gs_app_add_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX);
-		gs_app_list_add (list, app);
-	}
+	gs_appstream_add_wildcard_apps (idx, idx->featured, list);
 	return TRUE;
 }
 
@@ -32,6 +32,7 @@ GsApp		*gs_appstream_create_app		(GsPlugin	*plugin,
 gboolean	 gs_appstream_refine_app		(GsPlugin	*plugin,
 							 GsApp		*app,
 							 AsApp		*item,
+							 GsPluginRefineFlags refine_flags,
 							 GError		**error);
 GsApp		*gs_appstream_create_runtime		(GsPlugin	*plugin,
 							 GsApp		*parent,
@@ -42,6 +43,9 @@ gboolean	 gs_appstream_store_search		(GsPlugin	*plugin,
 							 GsAppList	*list,
 							 GCancellable	*cancellable,
 							 GError		**error);
+void		 gs_appstream_store_load_search_index	(GsPlugin	*plugin,
+							 AsStore	*store,
+							 const gchar	*cache_fn);
 gboolean	 gs_appstream_store_add_categories	(GsPlugin	*plugin,
 							 AsStore	*store,
 							 GPtrArray	*list,
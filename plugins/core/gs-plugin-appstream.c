@@ -363,19 +363,13 @@ gs_plugin_url_to_app (GsPlugin *plugin,
 static gboolean
 gs_plugin_refine_from_id (GsPlugin *plugin,
 			  GsApp *app,
+			  GsPluginRefineFlags flags,
 			  gboolean *found,
 			  GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	const gchar *unique_id;
 	AsApp *item;
-	g_autoptr(AsProfileTask) ptask = NULL;
-
-	/* search categories for the search term */
-	ptask = as_profile_start (gs_plugin_get_profile (plugin),
-				  "appstream::refine-from-id{%s}",
-				  gs_app_get_unique_id (app));
-	g_assert (ptask != NULL);
 
 	/* unfound */
 	*found = FALSE;
@@ -405,7 +399,7 @@ gs_plugin_refine_from_id (GsPlugin *plugin,
 		if (apps != NULL) {
 			for (guint i = 0; i < apps->len; i++) {
 				item = g_ptr_array_index (apps, i);
-				if (!gs_appstream_refine_app (plugin, app, item, error))
+				if (!gs_appstream_refine_app (plugin, app, item, flags, error))
 					return FALSE;
 			}
 		}
@@ -413,7 +407,7 @@ gs_plugin_refine_from_id (GsPlugin *plugin,
 	}
 
 	/* set new properties */
-	if (!gs_appstream_refine_app (plugin, app, item, error))
+	if (!gs_appstream_refine_app (plugin, app, item, flags, error))
 		return FALSE;
 
 	*found = TRUE;
@@ -423,6 +417,7 @@ gs_plugin_refine_from_id (GsPlugin *plugin,
 static gboolean
 gs_plugin_refine_from_pkgname (GsPlugin *plugin,
 			       GsApp *app,
+			       GsPluginRefineFlags flags,
 			       GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
@@ -430,12 +425,6 @@ gs_plugin_refine_from_pkgname (GsPlugin *plugin,
 	GPtrArray *sources;
 	const gchar *pkgname;
 	guint i;
-	g_autoptr(AsProfileTask) ptask = NULL;
-
-	/* search categories for the search term */
-	ptask = as_profile_start_literal (gs_plugin_get_profile (plugin),
-					  "appstream::refine-from-pkgname");
-	g_assert (ptask != NULL);
 
 	/* find anything that matches the ID */
 	sources = gs_app_get_sources (app);
@@ -452,7 +441,7 @@ gs_plugin_refine_from_pkgname (GsPlugin *plugin,
 		return TRUE;
 
 	/* set new properties */
-	return gs_appstream_refine_app (plugin, app, item, error);
+	return gs_appstream_refine_app (plugin, app, item, flags, error);
 }
 
 gboolean
@@ -486,20 +475,37 @@ gs_plugin_add_distro_upgrades (GsPlugin *plugin,
 }
 
 gboolean
-gs_plugin_refine_app (GsPlugin *plugin,
-		      GsApp *app,
-		      GsPluginRefineFlags flags,
-		      GCancellable *cancellable,
-		      GError **error)
+gs_plugin_refine (GsPlugin *plugin,
+		  GsAppList *list,
+		  GsPluginRefineFlags flags,
+		  GCancellable *cancellable,
+		  GError **error)
 {
-	gboolean found = FALSE;
+	g_autoptr(AsProfileTask) ptask = NULL;
 
-	/* find by ID then package name */
-	if (!gs_plugin_refine_from_id (plugin, app, &found, error))
-		return FALSE;
-	if (!found) {
-		if (!gs_plugin_refine_from_pkgname (plugin, app, error))
-			return FALSE;
+	/* profile the entire list rather than each app */
+	ptask = as_profile_start (gs_plugin_get_profile (plugin),
+				  "appstream::refine{%u}",
+				  gs_app_list_length (list));
+	g_assert (ptask != NULL);
+
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		gboolean found = FALSE;
+		g_autoptr(GError) error_local = NULL;
+
+		/* handled in gs_plugin_refine_wildcard() */
+		if (gs_app_has_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX))
+			continue;
+
+		/* find by ID then package name, and do not let one bad
+		 * app stop the rest of the list being refined */
+		if (!gs_plugin_refine_from_id (plugin, app, flags, &found, &error_local) ||
+		    (!found && !gs_plugin_refine_from_pkgname (plugin, app, flags, &error_local))) {
+			g_warning ("failed to refine %s: %s",
+				   gs_app_get_unique_id (app),
+				   error_local->message);
+		}
 	}
 
 	/* sucess */
@@ -660,18 +666,17 @@ gs_plugin_add_recent (GsPlugin *plugin,
 					cancellable, error);
 }
 
-static gboolean
+static void
 gs_plugin_appstream_refresh_url (GsPlugin *plugin,
 				 const gchar *url,
 				 guint cache_age,
-				 GCancellable *cancellable,
-				 GError **error)
+				 GPtrArray *urls_dl,
+				 GPtrArray *filenames_dl)
 {
 	guint file_age;
 	g_autofree gchar *basename = NULL;
 	g_autofree gchar *fullpath = NULL;
 	g_autoptr(GFile) file = NULL;
-	g_autoptr(GsApp) app_dl = gs_app_new (gs_plugin_get_name (plugin));
 
 	/* check age */
 	basename = g_path_get_basename (url);
@@ -684,15 +689,12 @@ gs_plugin_appstream_refresh_url (GsPlugin *plugin,
 	file_age = gs_utils_get_file_age (file);
 	if (file_age < cache_age) {
 		g_debug ("skipping %s: cache age is older than file", fullpath);
-		return TRUE;
+		return;
 	}
 
-	/* download file */
-	gs_app_set_summary_missing (app_dl,
-				    /* TRANSLATORS: status text when downloading */
-				    _("Downloading extra metadata files…"));
-	return gs_plugin_download_file (plugin, app_dl, url, fullpath,
-					cancellable, error);
+	/* download file with the others */
+	g_ptr_array_add (urls_dl, g_strdup (url));
+	g_ptr_array_add (filenames_dl, g_steal_pointer (&fullpath));
 }
 
 gboolean
@@ -704,10 +706,26 @@ gs_plugin_refresh (GsPlugin *plugin,
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	g_auto(GStrv) appstream_urls = NULL;
-
-	/* ensure the token cache */
-	if (cache_age == G_MAXUINT)
-		as_store_load_search_cache (priv->store);
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GPtrArray) filenames_dl = NULL;
+	g_autoptr(GPtrArray) urls_dl = NULL;
+	g_autoptr(GsApp) app_dl = NULL;
+
+	/* ensure the search index, which only needs the token cache if the
+	 * index saved last time is out of date */
+	if (cache_age == G_MAXUINT) {
+		g_autofree gchar *cache_fn = NULL;
+		if (g_getenv ("GS_SELF_TEST_APPSTREAM_XML") == NULL) {
+			g_autoptr(GError) error_cache = NULL;
+			cache_fn = gs_utils_get_cache_filename ("appstream",
+								"search-index.gvariant",
+								GS_UTILS_CACHE_FLAG_WRITEABLE,
+								&error_cache);
+			if (cache_fn == NULL)
+				g_warning ("no search index cache: %s", error_cache->message);
+		}
+		gs_appstream_store_load_search_index (plugin, priv->store, cache_fn);
+	}
 
 	if ((flags & GS_PLUGIN_REFRESH_FLAGS_METADATA) == 0)
 		return TRUE;
@@ -720,21 +738,30 @@ gs_plugin_refresh (GsPlugin *plugin,
 	}
 	appstream_urls = g_settings_get_strv (priv->settings,
 					      "external-appstream-urls");
+	urls_dl = g_ptr_array_new_with_free_func (g_free);
+	filenames_dl = g_ptr_array_new_with_free_func (g_free);
 	for (guint i = 0; appstream_urls[i] != NULL; ++i) {
-		g_autoptr(GError) local_error = NULL;
 		if (!g_str_has_prefix (appstream_urls[i], "https")) {
 			g_warning ("cannot use AppStream source %s: use https://",
 				   appstream_urls[i]);
 			continue;
 		}
-		if (!gs_plugin_appstream_refresh_url (plugin,
-						      appstream_urls[i],
-						      cache_age,
-						      cancellable,
-						      &local_error)) {
-			g_warning ("failed to update external AppStream file: %s",
-				   local_error->message);
-		}
+		gs_plugin_appstream_refresh_url (plugin,
+						 appstream_urls[i],
+						 cache_age,
+						 urls_dl,
+						 filenames_dl);
+	}
+
+	/* download files */
+	app_dl = gs_app_new (gs_plugin_get_name (plugin));
+	gs_app_set_summary_missing (app_dl,
+				    /* TRANSLATORS: status text when downloading */
+				    _("Downloading extra metadata files…"));
+	if (!gs_plugin_download_files (plugin, app_dl, urls_dl, filenames_dl,
+				       cancellable, &error_local)) {
+		g_warning ("failed to update external AppStream file: %s",
+			   error_local->message);
 	}
 
 	return TRUE;
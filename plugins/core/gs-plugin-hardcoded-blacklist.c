@@ -37,11 +37,11 @@ gs_plugin_initialize (GsPlugin *plugin)
 }
 
 gboolean
-gs_plugin_refine_app (GsPlugin *plugin,
-		      GsApp *app,
-		      GsPluginRefineFlags flags,
-		      GCancellable *cancellable,
-		      GError **error)
+gs_plugin_refine (GsPlugin *plugin,
+		  GsAppList *list,
+		  GsPluginRefineFlags flags,
+		  GCancellable *cancellable,
+		  GError **error)
 {
 	guint i;
 	const gchar *app_globs[] = {
@@ -59,15 +59,25 @@ gs_plugin_refine_app (GsPlugin *plugin,
 		"wine-*.desktop",
 		NULL };
 
-	/* not set yet */
-	if (gs_app_get_id (app) == NULL)
-		return TRUE;
+	for (guint j = 0; j < gs_app_list_length (list); j++) {
+		GsApp *app = gs_app_list_index (list, j);
 
-	/* search */
-	for (i = 0; app_globs[i] != NULL; i++) {
-		if (fnmatch (app_globs[i], gs_app_get_id (app), 0) == 0) {
-			gs_app_add_category (app, "Blacklisted");
-			break;
+		/* not set yet */
+		if (gs_app_get_id (app) == NULL)
+			continue;
+		if (gs_app_has_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX))
+			continue;
+
+		/* already done */
+		if (gs_app_has_category (app, "Blacklisted"))
+			continue;
+
+		/* search */
+		for (i = 0; app_globs[i] != NULL; i++) {
+			if (fnmatch (app_globs[i], gs_app_get_id (app), 0) == 0) {
+				gs_app_add_category (app, "Blacklisted");
+				break;
+			}
 		}
 	}
 
@@ -23,6 +23,7 @@
 
 #define _GNU_SOURCE
 #include <string.h>
+#include <glib/gstdio.h>
 
 #include <gnome-software.h>
 
@@ -32,21 +33,47 @@
  *
  * It is provided so that each plugin handling icons does not
  * have to handle the download and caching functionality.
+ *
+ * Decoded icons are shared between applications, and any missing remote
+ * icons are downloaded in parallel before the applications are refined.
  */
 
+/* the number of decoded icons to keep in memory */
+#define GS_PLUGIN_ICONS_CACHE_MAX		512
+
+/* the number of remote icons to download at the same time */
+#define GS_PLUGIN_ICONS_DOWNLOAD_MAX		4
+
 struct GsPluginData {
 	GtkIconTheme		*icon_theme;
 	GMutex			 icon_theme_lock;
 	GHashTable		*icon_theme_paths;
+	GHashTable		*pixbuf_cache;	/* key:GdkPixbuf */
+	GMutex			 pixbuf_cache_lock;
 };
 
+typedef struct {
+	GsPlugin		*plugin;
+	GCancellable		*cancellable;
+	GHashTable		*failed;	/* filename, owned by the helper */
+	GMutex			 failed_lock;
+} GsPluginIconsHelper;
+
+typedef struct {
+	gchar			*uri;
+	gchar			*filename;
+} GsPluginIconsDownload;
+
 void
 gs_plugin_initialize (GsPlugin *plugin)
 {
 	GsPluginData *priv = gs_plugin_alloc_data (plugin, sizeof(GsPluginData));
 	priv->icon_theme = gtk_icon_theme_new ();
 	priv->icon_theme_paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	priv->pixbuf_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+						    g_free, (GDestroyNotify) g_object_unref);
 	g_mutex_init (&priv->icon_theme_lock);
+	g_mutex_init (&priv->pixbuf_cache_lock);
 
 	/* needs remote icons downloaded */
 	gs_plugin_add_rule (plugin, GS_PLUGIN_RULE_RUN_AFTER, "appstream");
@@ -59,7 +86,65 @@ gs_plugin_destroy (GsPlugin *plugin)
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	g_object_unref (priv->icon_theme);
 	g_hash_table_unref (priv->icon_theme_paths);
+	g_hash_table_unref (priv->pixbuf_cache);
 	g_mutex_clear (&priv->icon_theme_lock);
+	g_mutex_clear (&priv->pixbuf_cache_lock);
+}
+
+static gint
+gs_plugin_icons_get_size (GsPlugin *plugin)
+{
+	return (gint) (64 * gs_plugin_get_scale (plugin));
+}
+
+static gchar *
+gs_plugin_icons_get_cache_key (GsPlugin *plugin, const gchar *kind, const gchar *name)
+{
+	return g_strdup_printf ("%s:%i:%s", kind, gs_plugin_icons_get_size (plugin), name);
+}
+
+/* the file may be replaced by a newer icon with the same name */
+static gchar *
+gs_plugin_icons_get_file_key (GsPlugin *plugin, const gchar *filename)
+{
+	GStatBuf st = { 0 };
+	g_autofree gchar *name = NULL;
+	if (g_stat (filename, &st) != 0)
+		st.st_mtime = 0;
+	name = g_strdup_printf ("%s:%" G_GINT64_FORMAT, filename, (gint64) st.st_mtime);
+	return gs_plugin_icons_get_cache_key (plugin, "file", name);
+}
+
+static GdkPixbuf *
+gs_plugin_icons_cache_lookup (GsPlugin *plugin, const gchar *key)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	GdkPixbuf *pixbuf;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->pixbuf_cache_lock);
+	pixbuf = g_hash_table_lookup (priv->pixbuf_cache, key);
+	if (pixbuf == NULL)
+		return NULL;
+	return g_object_ref (pixbuf);
+}
+
+static void
+gs_plugin_icons_cache_add (GsPlugin *plugin, const gchar *key, GdkPixbuf *pixbuf)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->pixbuf_cache_lock);
+
+	/* the applications keep a ref to the icons they are using */
+	if (g_hash_table_size (priv->pixbuf_cache) >= GS_PLUGIN_ICONS_CACHE_MAX)
+		g_hash_table_remove_all (priv->pixbuf_cache);
+	g_hash_table_replace (priv->pixbuf_cache, g_strdup (key), g_object_ref (pixbuf));
+}
+
+static void
+gs_plugin_icons_download_free (GsPluginIconsDownload *download)
+{
+	g_free (download->uri);
+	g_free (download->filename);
+	g_slice_free (GsPluginIconsDownload, download);
 }
 
 static gboolean
@@ -69,6 +154,8 @@ gs_plugin_icons_download (GsPlugin *plugin,
 			  GError **error)
 {
 	guint status_code;
+	gint size = gs_plugin_icons_get_size (plugin);
+	g_autofree gchar *key = NULL;
 	g_autoptr(GdkPixbuf) pixbuf_new = NULL;
 	g_autoptr(GdkPixbuf) pixbuf = NULL;
 	g_autoptr(GInputStream) stream = NULL;
@@ -117,14 +204,57 @@ gs_plugin_icons_download (GsPlugin *plugin,
 		gs_utils_error_convert_gdk_pixbuf (error);
 		return FALSE;
 	}
+
+	/* no need to load the file again */
+	key = gs_plugin_icons_get_file_key (plugin, filename);
+	if (size == 64) {
+		gs_plugin_icons_cache_add (plugin, key, pixbuf_new);
+	} else {
+		g_autoptr(GdkPixbuf) pixbuf_scaled = NULL;
+		pixbuf_scaled = gdk_pixbuf_scale_simple (pixbuf, size, size,
+							 GDK_INTERP_BILINEAR);
+		gs_plugin_icons_cache_add (plugin, key, pixbuf_scaled);
+	}
 	return TRUE;
 }
 
+static gboolean
+gs_plugin_icons_helper_has_failed (GsPluginIconsHelper *helper, const gchar *filename)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&helper->failed_lock);
+	return g_hash_table_contains (helper->failed, filename);
+}
+
+static void
+gs_plugin_icons_download_cb (gpointer data, gpointer user_data)
+{
+	GsPluginIconsDownload *download = (GsPluginIconsDownload *) data;
+	GsPluginIconsHelper *helper = (GsPluginIconsHelper *) user_data;
+	g_autoptr(GError) error = NULL;
+
+	if (g_cancellable_is_cancelled (helper->cancellable)) {
+		gs_plugin_icons_download_free (download);
+		return;
+	}
+	if (!gs_mkdir_parent (download->filename, &error) ||
+	    !gs_plugin_icons_download (helper->plugin,
+				       download->uri,
+				       download->filename,
+				       &error)) {
+		g_debug ("failed to download icon: %s", error->message);
+		g_mutex_lock (&helper->failed_lock);
+		g_hash_table_add (helper->failed, g_steal_pointer (&download->filename));
+		g_mutex_unlock (&helper->failed_lock);
+	}
+	gs_plugin_icons_download_free (download);
+}
+
 static GdkPixbuf *
 gs_plugin_icons_load_local (GsPlugin *plugin, AsIcon *icon, GError **error)
 {
 	GdkPixbuf *pixbuf;
 	gint size;
+	g_autofree gchar *key = NULL;
 	if (as_icon_get_filename (icon) == NULL) {
 		g_set_error_literal (error,
 				     GS_PLUGIN_ERROR,
@@ -132,13 +262,21 @@ gs_plugin_icons_load_local (GsPlugin *plugin, AsIcon *icon, GError **error)
 				     "icon has no filename");
 		return NULL;
 	}
-	size = (gint) (64 * gs_plugin_get_scale (plugin));
+
+	/* already decoded for another application */
+	key = gs_plugin_icons_get_file_key (plugin, as_icon_get_filename (icon));
+	pixbuf = gs_plugin_icons_cache_lookup (plugin, key);
+	if (pixbuf != NULL)
+		return pixbuf;
+
+	size = gs_plugin_icons_get_size (plugin);
 	pixbuf = gdk_pixbuf_new_from_file_at_size (as_icon_get_filename (icon),
 						   size, size, error);
 	if (pixbuf == NULL) {
 		gs_utils_error_convert_gdk_pixbuf (error);
 		return NULL;
 	}
+	gs_plugin_icons_cache_add (plugin, key, pixbuf);
 	return pixbuf;
 }
 
@@ -154,8 +292,10 @@ gs_plugin_icons_get_cache_fn (AsIcon *icon)
 	return g_strdup_printf ("%s-%s", checksum, basename);
 }
 
-static GdkPixbuf *
-gs_plugin_icons_load_remote (GsPlugin *plugin, AsIcon *icon, GError **error)
+/* sets the cache filename of a remote icon, returning %TRUE if it needs to
+ * be downloaded */
+static gboolean
+gs_plugin_icons_ensure_remote_filename (AsIcon *icon, GError **error)
 {
 	const gchar *fn;
 	gchar *found;
@@ -166,7 +306,7 @@ gs_plugin_icons_load_remote (GsPlugin *plugin, AsIcon *icon, GError **error)
 				     GS_PLUGIN_ERROR,
 				     GS_PLUGIN_ERROR_NOT_SUPPORTED,
 				     "icon has no URL");
-		return NULL;
+		return FALSE;
 	}
 
 	/* set cache filename if not already set */
@@ -181,19 +321,19 @@ gs_plugin_icons_load_remote (GsPlugin *plugin, AsIcon *icon, GError **error)
 							GS_UTILS_CACHE_FLAG_WRITEABLE,
 							error);
 		if (fn_cache == NULL)
-			return NULL;
+			return FALSE;
 		as_icon_set_filename (icon, fn_cache);
 	}
 
 	/* already in cache */
 	if (g_file_test (as_icon_get_filename (icon), G_FILE_TEST_EXISTS))
-		return gs_plugin_icons_load_local (plugin, icon, error);
+		return FALSE;
 
 	/* a REMOTE that's really LOCAL */
 	if (g_str_has_prefix (as_icon_get_url (icon), "file://")) {
 		as_icon_set_filename (icon, as_icon_get_url (icon) + 7);
 		as_icon_set_kind (icon, AS_ICON_KIND_LOCAL);
-		return gs_plugin_icons_load_local (plugin, icon, error);
+		return FALSE;
 	}
 
 	/* convert filename from jpg to png */
@@ -202,6 +342,39 @@ gs_plugin_icons_load_remote (GsPlugin *plugin, AsIcon *icon, GError **error)
 	if (found != NULL)
 		memcpy (found, ".png", 4);
 
+	/* the converted filename may be in the cache */
+	return !g_file_test (fn, G_FILE_TEST_EXISTS);
+}
+
+static GdkPixbuf *
+gs_plugin_icons_load_remote (GsPlugin *plugin,
+			     GsPluginIconsHelper *helper,
+			     AsIcon *icon,
+			     GError **error)
+{
+	const gchar *fn;
+	g_autoptr(GError) error_local = NULL;
+
+	/* already in cache, or downloaded by the batch */
+	if (!gs_plugin_icons_ensure_remote_filename (icon, &error_local)) {
+		if (error_local != NULL) {
+			g_propagate_error (error, g_steal_pointer (&error_local));
+			return NULL;
+		}
+		return gs_plugin_icons_load_local (plugin, icon, error);
+	}
+
+	/* do not try again if the batch download failed */
+	fn = as_icon_get_filename (icon);
+	if (gs_plugin_icons_helper_has_failed (helper, fn)) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_DOWNLOAD_FAILED,
+			     "Failed to download icon %s",
+			     as_icon_get_url (icon));
+		return NULL;
+	}
+
 	/* create runtime dir and download */
 	if (!gs_mkdir_parent (fn, error))
 		return NULL;
@@ -223,13 +396,24 @@ gs_plugin_icons_add_theme_path (GsPlugin *plugin, const gchar *path)
 	}
 }
 
+static gchar *
+gs_plugin_icons_get_stock_key (GsPlugin *plugin, AsIcon *icon)
+{
+	g_autofree gchar *name = NULL;
+	name = g_strdup_printf ("%s/%s",
+				as_icon_get_prefix (icon) != NULL ? as_icon_get_prefix (icon) : "",
+				as_icon_get_name (icon));
+	return gs_plugin_icons_get_cache_key (plugin, "stock", name);
+}
+
+/* the icon_theme_lock must be held */
 static GdkPixbuf *
 gs_plugin_icons_load_stock (GsPlugin *plugin, AsIcon *icon, GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	GdkPixbuf *pixbuf;
 	gint size;
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->icon_theme_lock);
+	g_autofree gchar *key = NULL;
 
 	/* required */
 	if (as_icon_get_name (icon) == NULL) {
@@ -240,7 +424,7 @@ gs_plugin_icons_load_stock (GsPlugin *plugin, AsIcon *icon, GError **error)
 		return NULL;
 	}
 	gs_plugin_icons_add_theme_path (plugin, as_icon_get_prefix (icon));
-	size = (gint) (64 * gs_plugin_get_scale (plugin));
+	size = gs_plugin_icons_get_size (plugin);
 	pixbuf = gtk_icon_theme_load_icon (priv->icon_theme,
 					   as_icon_get_name (icon),
 					   size,
@@ -251,6 +435,8 @@ gs_plugin_icons_load_stock (GsPlugin *plugin, AsIcon *icon, GError **error)
 		gs_utils_error_convert_gdk_pixbuf (error);
 		return NULL;
 	}
+	key = gs_plugin_icons_get_stock_key (plugin, icon);
+	gs_plugin_icons_cache_add (plugin, key, pixbuf);
 	return pixbuf;
 }
 
@@ -265,24 +451,15 @@ gs_plugin_icons_load_cached (GsPlugin *plugin, AsIcon *icon, GError **error)
 	return g_object_ref (as_icon_get_pixbuf (icon));
 }
 
-gboolean
-gs_plugin_refine_app (GsPlugin *plugin,
-		      GsApp *app,
-		      GsPluginRefineFlags flags,
-		      GCancellable *cancellable,
-		      GError **error)
+static void
+gs_plugin_icons_refine_app (GsPlugin *plugin,
+			    GsPluginIconsHelper *helper,
+			    GsApp *app)
 {
+	GsPluginData *priv = gs_plugin_get_data (plugin);
 	GPtrArray *icons;
 	guint i;
 
-	/* not required */
-	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON) == 0)
-		return TRUE;
-
-	/* invalid */
-	if (gs_app_get_pixbuf (app) != NULL)
-		return TRUE;
-
 	/* process all icons */
 	icons = gs_app_get_icons (app);
 	for (i = 0; i < icons->len; i++) {
@@ -296,10 +473,20 @@ gs_plugin_refine_app (GsPlugin *plugin,
 			pixbuf = gs_plugin_icons_load_local (plugin, icon, &error_local);
 			break;
 		case AS_ICON_KIND_STOCK:
+			/* the theme is only needed if not already loaded */
+			if (as_icon_get_name (icon) != NULL) {
+				g_autofree gchar *key = NULL;
+				key = gs_plugin_icons_get_stock_key (plugin, icon);
+				pixbuf = gs_plugin_icons_cache_lookup (plugin, key);
+				if (pixbuf != NULL)
+					break;
+			}
+			g_mutex_lock (&priv->icon_theme_lock);
 			pixbuf = gs_plugin_icons_load_stock (plugin, icon, &error_local);
+			g_mutex_unlock (&priv->icon_theme_lock);
 			break;
 		case AS_ICON_KIND_REMOTE:
-			pixbuf = gs_plugin_icons_load_remote (plugin, icon, &error_local);
+			pixbuf = gs_plugin_icons_load_remote (plugin, helper, icon, &error_local);
 			break;
 		case AS_ICON_KIND_CACHED:
 			pixbuf = gs_plugin_icons_load_cached (plugin, icon, &error_local);
@@ -322,6 +509,125 @@ gs_plugin_refine_app (GsPlugin *plugin,
 			 gs_app_get_id (app),
 			 error_local->message);
 	}
+}
+
+/* downloads the first remote icon of each app that needs one, several at
+ * the same time, so that refining the apps only has to load them */
+static void
+gs_plugin_icons_download_missing (GsPlugin *plugin,
+				  GsPluginIconsHelper *helper,
+				  GsAppList *list)
+{
+	GThreadPool *pool = NULL;
+	g_autoptr(GHashTable) queued = NULL;
+	g_autoptr(GError) error = NULL;
+
+	queued = g_hash_table_new (g_str_hash, g_str_equal);
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		GPtrArray *icons;
+		GsPluginIconsDownload *download;
+		AsIcon *icon = NULL;
+		g_autoptr(GError) error_local = NULL;
+
+		if (gs_app_has_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX))
+			continue;
+		if (gs_app_get_pixbuf (app) != NULL)
+			continue;
+
+		/* only the first icon that could be used */
+		icons = gs_app_get_icons (app);
+		if (icons->len == 0)
+			continue;
+		icon = g_ptr_array_index (icons, 0);
+		if (as_icon_get_kind (icon) != AS_ICON_KIND_REMOTE)
+			continue;
+		if (!gs_plugin_icons_ensure_remote_filename (icon, &error_local))
+			continue;
+
+		/* several apps may use the same icon */
+		if (g_hash_table_contains (queued, as_icon_get_filename (icon)))
+			continue;
+		g_hash_table_add (queued, (gpointer) as_icon_get_filename (icon));
+
+		if (pool == NULL) {
+			pool = g_thread_pool_new (gs_plugin_icons_download_cb,
+						  helper,
+						  GS_PLUGIN_ICONS_DOWNLOAD_MAX,
+						  FALSE,
+						  &error);
+			if (pool == NULL) {
+				g_warning ("failed to create pool: %s", error->message);
+				return;
+			}
+		}
+		download = g_slice_new0 (GsPluginIconsDownload);
+		download->uri = g_strdup (as_icon_get_url (icon));
+		download->filename = g_strdup (as_icon_get_filename (icon));
+		if (!g_thread_pool_push (pool, download, &error)) {
+			g_warning ("failed to queue download: %s", error->message);
+			gs_plugin_icons_download_free (download);
+			break;
+		}
+	}
+
+	/* wait for all the downloads to complete */
+	if (pool != NULL) {
+		g_debug ("downloading %u icons", g_hash_table_size (queued));
+		g_thread_pool_free (pool, FALSE, TRUE);
+	}
+}
+
+gboolean
+gs_plugin_refine (GsPlugin *plugin,
+		  GsAppList *list,
+		  GsPluginRefineFlags flags,
+		  GCancellable *cancellable,
+		  GError **error)
+{
+	GsPluginIconsHelper helper = { plugin, cancellable, NULL };
+
+	/* not required */
+	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON) == 0)
+		return TRUE;
+
+	/* get any remote icons first */
+	helper.failed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	g_mutex_init (&helper.failed_lock);
+	gs_plugin_icons_download_missing (plugin, &helper, list);
+
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		if (gs_app_has_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX))
+			continue;
+
+		/* already set */
+		if (gs_app_get_pixbuf (app) != NULL)
+			continue;
+		gs_plugin_icons_refine_app (plugin, &helper, app);
+	}
+	g_hash_table_unref (helper.failed);
+	g_mutex_clear (&helper.failed_lock);
+	return TRUE;
+}
 
+gboolean
+gs_plugin_refresh (GsPlugin *plugin,
+		   guint cache_age,
+		   GsPluginRefreshFlags flags,
+		   GCancellable *cancellable,
+		   GError **error)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+
+	/* the themes and the icons in the new metadata may have changed */
+	if ((flags & GS_PLUGIN_REFRESH_FLAGS_METADATA) == 0)
+		return TRUE;
+	g_mutex_lock (&priv->icon_theme_lock);
+	gtk_icon_theme_rescan_if_needed (priv->icon_theme);
+	g_mutex_unlock (&priv->icon_theme_lock);
+	g_mutex_lock (&priv->pixbuf_cache_lock);
+	g_hash_table_remove_all (priv->pixbuf_cache);
+	g_mutex_unlock (&priv->pixbuf_cache_lock);
 	return TRUE;
 }
@@ -23,30 +23,41 @@
 
 #include <gnome-software.h>
 
+/* the number of icons to remember the key colors of */
+#define GS_PLUGIN_KEY_COLORS_CACHE_MAX		1000
+
+struct GsPluginData {
+	GHashTable		*cache;		/* checksum:GPtrArray of GdkRGBA */
+	GMutex			 cache_mutex;
+};
+
 void
 gs_plugin_initialize (GsPlugin *plugin)
 {
+	GsPluginData *priv = gs_plugin_alloc_data (plugin, sizeof(GsPluginData));
+
+	/* many apps share the same icon, e.g. for the different branches */
+	priv->cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     g_free, (GDestroyNotify) g_ptr_array_unref);
+	g_mutex_init (&priv->cache_mutex);
+
 	/* need icon */
 	gs_plugin_add_rule (plugin, GS_PLUGIN_RULE_RUN_AFTER, "icons");
 }
 
-typedef struct {
-	guint8		 R;
-	guint8		 G;
-	guint8		 B;
-} CdColorRGB8;
-
-static guint32
-cd_color_rgb8_to_uint32 (CdColorRGB8 *rgb)
+void
+gs_plugin_destroy (GsPlugin *plugin)
 {
-	return (guint32) rgb->R |
-		(guint32) rgb->G << 8 |
-		(guint32) rgb->B << 16;
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	g_hash_table_unref (priv->cache);
+	g_mutex_clear (&priv->cache_mutex);
 }
 
 typedef struct {
-	GdkRGBA		color;
-	guint		cnt;
+	guint32		cnt;
+	guint32		red;
+	guint32		green;
+	guint32		blue;
 } GsColorBin;
 
 static gint
@@ -61,127 +72,255 @@ gs_color_bin_sort_cb (gconstpointer a, gconstpointer b)
 	return 0;
 }
 
+static gint
+gs_color_code_sort_cb (gconstpointer a, gconstpointer b)
+{
+	guint32 c1 = *((guint32 *) a);
+	guint32 c2 = *((guint32 *) b);
+	if (c1 < c2)
+		return -1;
+	if (c1 > c2)
+		return 1;
+	return 0;
+}
+
+/* spread the bits of 0..255 out so there are two zero bits between each */
+static guint32
+_spread_bits (guint8 val)
+{
+	guint32 tmp = val;
+	tmp = (tmp | tmp << 8) & 0x00f00f;
+	tmp = (tmp | tmp << 4) & 0x0c30c3;
+	tmp = (tmp | tmp << 2) & 0x249249;
+	return tmp;
+}
+
+/* interleave the bits so that colors in the same bin of any size, i.e. with
+ * the same number of high bits of each channel, share a prefix */
+static guint32
+_color_to_code (const guchar *p)
+{
+	return _spread_bits (p[0]) << 2 |
+		_spread_bits (p[1]) << 1 |
+		_spread_bits (p[2]);
+}
+
+static void
+_code_to_color (guint32 code, guint8 *rgb)
+{
+	rgb[0] = rgb[1] = rgb[2] = 0;
+	for (guint i = 0; i < 8; i++) {
+		rgb[0] |= (guint8) (((code >> (i * 3 + 2)) & 1) << i);
+		rgb[1] |= (guint8) (((code >> (i * 3 + 1)) & 1) << i);
+		rgb[2] |= (guint8) (((code >> (i * 3)) & 1) << i);
+	}
+}
+
+/* the number of bits per channel needed to tell the codes apart */
+static guint
+_code_get_bits (guint32 code1, guint32 code2)
+{
+	gint msb = g_bit_nth_msf (code1 ^ code2, -1);
+	return (guint) (24 - msb + 2) / 3;
+}
+
 /* convert range of 0..255 to 0..1 */
 static gdouble
-_convert_from_rgb8 (guchar val)
+_convert_from_rgb8 (guint32 val, guint32 cnt)
 {
-	return (gdouble) val / 255.f;
+	return ((gdouble) val / cnt) / 255.f;
 }
 
-static void
-gs_plugin_key_colors_set_for_pixbuf (GsApp *app, GdkPixbuf *pb, guint number)
+static GPtrArray *
+gs_plugin_key_colors_get_for_pixbuf (GdkPixbuf *pb, guint number)
 {
-	GList *l;
+	GPtrArray *key_colors;
 	gint rowstride, n_channels;
-	gint x, y;
-	guchar *pixels, *p;
-	guint bin_size = 200;
-	guint i;
-	guint number_of_bins;
-	g_autoptr(AsImage) im = NULL;
-
-	/* go through each pixel */
+	gint width, height;
+	guchar *pixels;
+	guint bits;
+	guint distinct[9] = { 0 };
+	guint32 prefix_last = 0;
+	g_autoptr(GArray) bins = NULL;
+	g_autoptr(GArray) codes = NULL;
+
+	/* get the color of each opaque pixel in one pass */
 	n_channels = gdk_pixbuf_get_n_channels (pb);
 	rowstride = gdk_pixbuf_get_rowstride (pb);
 	pixels = gdk_pixbuf_get_pixels (pb);
-	for (bin_size = 250; bin_size > 0; bin_size -= 2) {
-		g_autoptr(GHashTable) hash = NULL;
-		hash = g_hash_table_new_full (g_direct_hash,  g_direct_equal,
-					      NULL, g_free);
-		for (y = 0; y < gdk_pixbuf_get_height (pb); y++) {
-			for (x = 0; x < gdk_pixbuf_get_width (pb); x++) {
-				CdColorRGB8 tmp;
-				GsColorBin *s;
-				gpointer key;
-
-				/* disregard any with alpha */
-				p = pixels + y * rowstride + x * n_channels;
-				if (p[3] != 255)
-					continue;
-
-				/* find in cache */
-				tmp.R = (guint8) (p[0] / bin_size);
-				tmp.G = (guint8) (p[1] / bin_size);
-				tmp.B = (guint8) (p[2] / bin_size);
-				key = GUINT_TO_POINTER (cd_color_rgb8_to_uint32 (&tmp));
-				s = g_hash_table_lookup (hash, key);
-				if (s != NULL) {
-					s->color.red += _convert_from_rgb8 (p[0]);
-					s->color.green += _convert_from_rgb8 (p[1]);
-					s->color.blue += _convert_from_rgb8 (p[2]);
-					s->cnt++;
-					continue;
-				}
-
-				/* add to hash table */
-				s = g_new0 (GsColorBin, 1);
-				s->color.red = _convert_from_rgb8 (p[0]);
-				s->color.green = _convert_from_rgb8 (p[1]);
-				s->color.blue = _convert_from_rgb8 (p[2]);
-				s->color.alpha = 1.0;
-				s->cnt = 1;
-				g_hash_table_insert (hash, key, s);
-			}
+	width = gdk_pixbuf_get_width (pb);
+	height = gdk_pixbuf_get_height (pb);
+	codes = g_array_sized_new (FALSE, FALSE, sizeof(guint32),
+				   (guint) (width * height));
+	for (gint y = 0; y < height; y++) {
+		const guchar *row = pixels + y * rowstride;
+		for (gint x = 0; x < width; x++) {
+			const guchar *p = row + x * n_channels;
+			guint32 code;
+
+			/* disregard any with alpha */
+			if (n_channels == 4 && p[3] != 255)
+				continue;
+			code = _color_to_code (p);
+			g_array_append_val (codes, code);
 		}
+	}
+	key_colors = g_ptr_array_new_with_free_func (g_free);
+	if (codes->len == 0)
+		goto out;
+
+	/* when sorted, each bin is a run of codes with the same prefix, so
+	 * the number of bins for every bin size can be counted at once */
+	g_array_sort (codes, gs_color_code_sort_cb);
+	for (guint i = 1; i < codes->len; i++) {
+		guint32 code1 = g_array_index (codes, guint32, i - 1);
+		guint32 code2 = g_array_index (codes, guint32, i);
+		if (code1 == code2)
+			continue;
+		distinct[_code_get_bits (code1, code2)]++;
+	}
+	distinct[0] = 1;
+	for (bits = 1; bits <= 8; bits++) {
+		distinct[bits] += distinct[bits - 1];
+		if (distinct[bits] >= number)
+			break;
+	}
+	if (bits > 8)
+		goto out;
 
-		number_of_bins = g_hash_table_size (hash);
-//		g_debug ("number of colors: %i", number_of_bins);
-		if (number_of_bins >= number) {
-			g_autoptr(GList) values = NULL;
-
-			/* order by most popular */
-			values = g_hash_table_get_values (hash);
-			values = g_list_sort (values, gs_color_bin_sort_cb);
-			for (l = values; l != NULL; l = l->next) {
-				GsColorBin *s = l->data;
-				g_autofree GdkRGBA *color = g_new0 (GdkRGBA, 1);
-				color->red = s->color.red / s->cnt;
-				color->green = s->color.green / s->cnt;
-				color->blue = s->color.blue / s->cnt;
-				gs_app_add_key_color (app, color);
-			}
-			return;
+	/* use the largest bins that give enough colors */
+	bins = g_array_sized_new (FALSE, TRUE, sizeof(GsColorBin), distinct[bits]);
+	for (guint i = 0; i < codes->len; i++) {
+		guint32 code = g_array_index (codes, guint32, i);
+		guint32 prefix = code >> (24 - bits * 3);
+		guint8 rgb[3];
+		GsColorBin *s;
+
+		/* start a new bin */
+		if (bins->len == 0 || prefix != prefix_last) {
+			GsColorBin tmp = { 0, 0, 0, 0 };
+			g_array_append_val (bins, tmp);
+			prefix_last = prefix;
 		}
+		s = &g_array_index (bins, GsColorBin, bins->len - 1);
+		_code_to_color (code, rgb);
+		s->red += rgb[0];
+		s->green += rgb[1];
+		s->blue += rgb[2];
+		s->cnt++;
 	}
 
+	/* order by most popular */
+	g_array_sort (bins, gs_color_bin_sort_cb);
+	for (guint i = 0; i < bins->len; i++) {
+		GsColorBin *s = &g_array_index (bins, GsColorBin, i);
+		GdkRGBA *color = g_new0 (GdkRGBA, 1);
+		color->red = _convert_from_rgb8 (s->red, s->cnt);
+		color->green = _convert_from_rgb8 (s->green, s->cnt);
+		color->blue = _convert_from_rgb8 (s->blue, s->cnt);
+		color->alpha = 1.0;
+		g_ptr_array_add (key_colors, color);
+	}
+out:
 	/* the algorithm failed, so just return a monochrome ramp */
-	for (i = 0; i < 3; i++) {
-		g_autofree GdkRGBA *color = g_new0 (GdkRGBA, 1);
-		color->red = (gdouble) i / 3.f;
-		color->green = color->red;
-		color->blue = color->red;
-		color->alpha = 1.0f;
-		gs_app_add_key_color (app, color);
+	if (key_colors->len == 0) {
+		for (guint i = 0; i < 3; i++) {
+			GdkRGBA *color = g_new0 (GdkRGBA, 1);
+			color->red = (gdouble) i / 3.f;
+			color->green = color->red;
+			color->blue = color->red;
+			color->alpha = 1.0f;
+			g_ptr_array_add (key_colors, color);
+		}
 	}
+	return key_colors;
 }
 
-gboolean
-gs_plugin_refine_app (GsPlugin *plugin,
-		      GsApp *app,
-		      GsPluginRefineFlags flags,
-		      GCancellable *cancellable,
-		      GError **error)
+static gchar *
+gs_plugin_key_colors_get_checksum (GdkPixbuf *pb)
+{
+	g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA1);
+	gint height = gdk_pixbuf_get_height (pb);
+	gint rowstride = gdk_pixbuf_get_rowstride (pb);
+	gsize rowlen = (gsize) gdk_pixbuf_get_width (pb) *
+			(gsize) gdk_pixbuf_get_n_channels (pb);
+	const guchar *pixels = gdk_pixbuf_read_pixels (pb);
+
+	/* the padding at the end of each row is undefined */
+	for (gint y = 0; y < height; y++)
+		g_checksum_update (checksum, pixels + y * rowstride, (gssize) rowlen);
+	g_checksum_update (checksum, (const guchar *) &height, sizeof(height));
+	return g_strdup (g_checksum_get_string (checksum));
+}
+
+static GPtrArray *
+gs_plugin_key_colors_get_for_icon (GsPlugin *plugin, GdkPixbuf *pb)
 {
-	GdkPixbuf *pb;
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	GPtrArray *key_colors;
+	g_autofree gchar *checksum = NULL;
 	g_autoptr(GdkPixbuf) pb_small = NULL;
 
+	/* already done for this icon */
+	checksum = gs_plugin_key_colors_get_checksum (pb);
+	g_mutex_lock (&priv->cache_mutex);
+	key_colors = g_hash_table_lookup (priv->cache, checksum);
+	if (key_colors != NULL)
+		g_ptr_array_ref (key_colors);
+	g_mutex_unlock (&priv->cache_mutex);
+	if (key_colors != NULL)
+		return key_colors;
+
+	/* get a list of key colors */
+	pb_small = gdk_pixbuf_scale_simple (pb, 32, 32, GDK_INTERP_BILINEAR);
+	key_colors = gs_plugin_key_colors_get_for_pixbuf (pb_small, 10);
+
+	/* save for next time */
+	g_mutex_lock (&priv->cache_mutex);
+	if (g_hash_table_size (priv->cache) >= GS_PLUGIN_KEY_COLORS_CACHE_MAX)
+		g_hash_table_remove_all (priv->cache);
+	g_hash_table_replace (priv->cache,
+			      g_steal_pointer (&checksum),
+			      g_ptr_array_ref (key_colors));
+	g_mutex_unlock (&priv->cache_mutex);
+	return key_colors;
+}
+
+gboolean
+gs_plugin_refine (GsPlugin *plugin,
+		  GsAppList *list,
+		  GsPluginRefineFlags flags,
+		  GCancellable *cancellable,
+		  GError **error)
+{
 	/* add a rating */
 	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_KEY_COLORS) == 0)
 		return TRUE;
 
-	/* already set */
-	if (gs_app_get_key_colors(app)->len > 0)
-		return TRUE;
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		GdkPixbuf *pb;
+		g_autoptr(GPtrArray) key_colors = NULL;
 
-	/* no pixbuf */
-	pb = gs_app_get_pixbuf (app);
-	if (pb == NULL) {
-		g_debug ("no pixbuf, so no key colors");
-		return TRUE;
-	}
+		/* not a real app */
+		if (gs_app_has_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX))
+			continue;
 
-	/* get a list of key colors */
-	pb_small = gdk_pixbuf_scale_simple (pb, 32, 32, GDK_INTERP_BILINEAR);
-	gs_plugin_key_colors_set_for_pixbuf (app, pb_small, 10);
+		/* already set */
+		if (gs_app_get_key_colors (app)->len > 0)
+			continue;
+
+		/* no pixbuf */
+		pb = gs_app_get_pixbuf (app);
+		if (pb == NULL) {
+			g_debug ("no pixbuf, so no key colors");
+			continue;
+		}
+
+		/* get a list of key colors */
+		key_colors = gs_plugin_key_colors_get_for_icon (plugin, pb);
+		for (guint j = 0; j < key_colors->len; j++)
+			gs_app_add_key_color (app, g_ptr_array_index (key_colors, j));
+	}
 	return TRUE;
 }
@@ -81,49 +81,54 @@ gs_plugin_destroy (GsPlugin *plugin)
 	g_object_unref (priv->settings);
 }
 
-gboolean
-gs_plugin_refine_app (GsPlugin *plugin,
-		      GsApp *app,
-		      GsPluginRefineFlags flags,
-		      GCancellable *cancellable,
-		      GError **error)
+static gboolean
+gs_plugin_provenance_app_is_official (GsApp *app, gchar **sources)
 {
-	GsPluginData *priv = gs_plugin_get_data (plugin);
 	const gchar *origin;
-	gchar **sources;
-
-	/* not required */
-	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_PROVENANCE) == 0)
-		return TRUE;
-	if (gs_app_has_quirk (app, AS_APP_QUIRK_PROVENANCE))
-		return TRUE;
-
-	/* nothing to search */
-	sources = priv->sources;
-	if (sources == NULL || sources[0] == NULL) {
-		gs_app_add_quirk (app, AS_APP_QUIRK_PROVENANCE);
-		return TRUE;
-	}
 
 	/* simple case */
 	origin = gs_app_get_origin (app);
-	if (origin != NULL && gs_utils_strv_fnmatch (sources, origin)) {
-		gs_app_add_quirk (app, AS_APP_QUIRK_PROVENANCE);
+	if (origin != NULL && gs_utils_strv_fnmatch (sources, origin))
 		return TRUE;
-	}
 
 	/* this only works for packages */
 	origin = gs_app_get_source_id_default (app);
 	if (origin == NULL)
-		return TRUE;
+		return FALSE;
 	origin = g_strrstr (origin, ";");
 	if (origin == NULL)
-		return TRUE;
+		return FALSE;
 	if (g_str_has_prefix (origin + 1, "installed:"))
 		origin += 10;
-	if (gs_utils_strv_fnmatch (sources, origin + 1)) {
-		gs_app_add_quirk (app, AS_APP_QUIRK_PROVENANCE);
+	return gs_utils_strv_fnmatch (sources, origin + 1);
+}
+
+gboolean
+gs_plugin_refine (GsPlugin *plugin,
+		  GsAppList *list,
+		  GsPluginRefineFlags flags,
+		  GCancellable *cancellable,
+		  GError **error)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	gchar **sources;
+
+	/* not required */
+	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_PROVENANCE) == 0)
 		return TRUE;
+
+	sources = priv->sources;
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		if (gs_app_has_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX))
+			continue;
+		if (gs_app_has_quirk (app, AS_APP_QUIRK_PROVENANCE))
+			continue;
+
+		/* nothing to search */
+		if (sources == NULL || sources[0] == NULL ||
+		    gs_plugin_provenance_app_is_official (app, sources))
+			gs_app_add_quirk (app, AS_APP_QUIRK_PROVENANCE);
 	}
 	return TRUE;
 }
@@ -21,6 +21,9 @@
 
 #include "config.h"
 
+#include <string.h>
+#include <glib/gstdio.h>
+
 #include "gnome-software-private.h"
 
 #include "gs-appstream.h"
@@ -120,6 +123,478 @@ gs_plugins_core_search_repo_name_func (GsPluginLoader *plugin_loader)
 	g_assert_cmpint (gs_app_get_kind (app), ==, AS_APP_KIND_DESKTOP);
 }
 
+/* loads the XML the same way as the appstream plugin does for
+ * GS_SELF_TEST_APPSTREAM_XML */
+static AsStore *
+gs_plugins_core_store_new_from_xml (const gchar *xml)
+{
+	const gchar *test_icon_root = g_getenv ("GS_SELF_TEST_APPSTREAM_ICON_ROOT");
+	gboolean ret;
+	g_autoptr(AsStore) store = as_store_new ();
+	g_autoptr(GError) error = NULL;
+
+	ret = as_store_from_xml (store, xml, test_icon_root, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	return g_steal_pointer (&store);
+}
+
+/* an app with an addon, apps in overlapping categories, and releases that
+ * are recent, old and in the future */
+static gchar *
+gs_plugins_core_index_xml_new (void)
+{
+	guint64 now = (guint64) g_get_real_time () / G_USEC_PER_SEC;
+	return g_strdup_printf ("<?xml version=\"1.0\"?>\n"
+				"<components origin=\"index\" version=\"0.9\">\n"
+				"  <component type=\"desktop\">\n"
+				"    <id>gimp.desktop</id>\n"
+				"    <name>GIMP</name>\n"
+				"    <summary>Image editor</summary>\n"
+				"    <keywords>\n"
+				"      <keyword>paint</keyword>\n"
+				"      <keyword>photo</keyword>\n"
+				"    </keywords>\n"
+				"    <categories>\n"
+				"      <category>Graphics</category>\n"
+				"      <category>RasterGraphics</category>\n"
+				"    </categories>\n"
+				"    <releases>\n"
+				"      <release version=\"2.8\" timestamp=\"%" G_GUINT64_FORMAT "\"/>\n"
+				"    </releases>\n"
+				"  </component>\n"
+				"  <component type=\"addon\">\n"
+				"    <id>gimp-help</id>\n"
+				"    <extends>gimp.desktop</extends>\n"
+				"    <name>GIMP Help</name>\n"
+				"    <summary>Manual in many languages</summary>\n"
+				"    <keywords>\n"
+				"      <keyword>handbook</keyword>\n"
+				"    </keywords>\n"
+				"  </component>\n"
+				"  <component type=\"desktop\">\n"
+				"    <id>inkscape.desktop</id>\n"
+				"    <name>Inkscape</name>\n"
+				"    <summary>Vector graphics editor</summary>\n"
+				"    <keywords>\n"
+				"      <keyword>drawing</keyword>\n"
+				"    </keywords>\n"
+				"    <categories>\n"
+				"      <category>Graphics</category>\n"
+				"      <category>VectorGraphics</category>\n"
+				"    </categories>\n"
+				"    <releases>\n"
+				"      <release version=\"0.92\" timestamp=\"%" G_GUINT64_FORMAT "\"/>\n"
+				"    </releases>\n"
+				"  </component>\n"
+				"  <component type=\"desktop\">\n"
+				"    <id>gedit.desktop</id>\n"
+				"    <name>gedit</name>\n"
+				"    <summary>Text editor</summary>\n"
+				"    <keywords>\n"
+				"      <keyword>edit</keyword>\n"
+				"    </keywords>\n"
+				"    <categories>\n"
+				"      <category>Utility</category>\n"
+				"      <category>TextEditor</category>\n"
+				"    </categories>\n"
+				"    <releases>\n"
+				"      <release version=\"3.22\" timestamp=\"%" G_GUINT64_FORMAT "\"/>\n"
+				"    </releases>\n"
+				"  </component>\n"
+				"  <component type=\"desktop\">\n"
+				"    <id>totem.desktop</id>\n"
+				"    <name>Videos</name>\n"
+				"    <summary>Play movies</summary>\n"
+				"    <categories>\n"
+				"      <category>AudioVideo</category>\n"
+				"      <category>Video</category>\n"
+				"      <category>Player</category>\n"
+				"    </categories>\n"
+				"    <releases>\n"
+				"      <release version=\"3.24\" timestamp=\"%" G_GUINT64_FORMAT "\"/>\n"
+				"    </releases>\n"
+				"  </component>\n"
+				"</components>\n",
+				now - 3 * 24 * 60 * 60,
+				now - 30 * 24 * 60 * 60,
+				now - 1 * 24 * 60 * 60,
+				now + 2 * 24 * 60 * 60);
+}
+
+/* what the search returned before there was an index: each app in the
+ * store that matches, or that has an addon that matches */
+static gchar *
+gs_plugins_core_search_expected (AsStore *store, gchar **values)
+{
+	GPtrArray *apps = as_store_get_apps (store);
+	GString *str = g_string_new (NULL);
+
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *item = g_ptr_array_index (apps, i);
+		GPtrArray *addons = as_app_get_addons (item);
+		guint match_value = as_app_search_matches_all (item, values);
+		for (guint j = 0; j < addons->len; j++) {
+			AsApp *addon = g_ptr_array_index (addons, j);
+			match_value |= as_app_search_matches_all (addon, values);
+		}
+		if (match_value == 0)
+			continue;
+		g_string_append_printf (str, "%s:%x;", as_app_get_id (item), match_value);
+	}
+	return g_string_free (str, FALSE);
+}
+
+static gchar *
+gs_plugins_core_search_actual (GsPlugin *plugin, AsStore *store, gchar **values)
+{
+	gboolean ret;
+	GString *str = g_string_new (NULL);
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+
+	ret = gs_appstream_store_search (plugin, store, values, list, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		g_string_append_printf (str, "%s:%x;",
+					gs_app_get_id (app),
+					gs_app_get_match_value (app));
+	}
+	return g_string_free (str, FALSE);
+}
+
+static void
+gs_plugins_core_search_check (GsPlugin *plugin, AsStore *store, const gchar *search)
+{
+	g_auto(GStrv) values = g_strsplit (search, " ", -1);
+	g_autofree gchar *expected = gs_plugins_core_search_expected (store, values);
+	g_autofree gchar *actual = gs_plugins_core_search_actual (plugin, store, values);
+	g_assert_cmpstr (actual, ==, expected);
+}
+
+static gchar *
+gs_plugins_core_app_list_to_string (GsAppList *list)
+{
+	GString *str = g_string_new (NULL);
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		g_string_append_printf (str, "%s;", gs_app_get_id (app));
+	}
+	return g_string_free (str, FALSE);
+}
+
+static void
+gs_plugins_core_search_index_func (GsPluginLoader *plugin_loader)
+{
+	GsPlugin *plugin;
+	const gchar *searches[] = {
+		"gimp", "gim", "g", "edit", "editor", "image edit",
+		"image editor", "paint photo", "handbook", "gimp handbook",
+		"help", "vector", "test", "tes", "workstation", "zzz",
+		NULL };
+	g_autofree gchar *actual = NULL;
+	g_autofree gchar *xml = gs_plugins_core_index_xml_new ();
+	g_autoptr(AsStore) store = NULL;
+	g_autoptr(AsStore) store_env = NULL;
+	g_auto(GStrv) values = NULL;
+
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "appstream");
+	g_assert (plugin != NULL);
+
+	/* exact and prefix matches have the same match values as checking
+	 * every app and addon in the store */
+	store = gs_plugins_core_store_new_from_xml (xml);
+	g_assert_cmpint (as_app_get_addons (as_store_get_app_by_id (store, "gimp.desktop"))->len, ==, 1);
+	store_env = gs_plugins_core_store_new_from_xml (g_getenv ("GS_SELF_TEST_APPSTREAM_XML"));
+	for (guint i = 0; searches[i] != NULL; i++) {
+		gs_plugins_core_search_check (plugin, store, searches[i]);
+		gs_plugins_core_search_check (plugin, store_env, searches[i]);
+	}
+
+	/* an addon that matches every value also returns its parent, even
+	 * though the parent does not match all of them itself */
+	values = g_strsplit ("gimp handbook", " ", -1);
+	actual = gs_plugins_core_search_actual (plugin, store, values);
+	g_assert (g_str_has_prefix (actual, "gimp.desktop:"));
+	g_assert (strstr (actual, "gimp-help:") != NULL);
+	g_assert (strstr (actual, "inkscape.desktop:") == NULL);
+}
+
+static void
+gs_plugins_core_search_narrow_func (GsPluginLoader *plugin_loader)
+{
+	GsPlugin *plugin;
+	const gchar *searches[] = {
+		"g", "gi", "gim", "gimp", "gimp h", "gimp he", "gimp help",
+		"gimp helpx", "gimp helpxy", "gimp", "e", "ed", "edi", "edit",
+		"edito", "editor", "image editor", "ink",
+		NULL };
+	g_autofree gchar *xml = gs_plugins_core_index_xml_new ();
+	g_autoptr(AsStore) store = NULL;
+
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "appstream");
+	g_assert (plugin != NULL);
+
+	/* typing narrows the previous results, and anything else searches
+	 * the whole index again, with the same results either way */
+	store = gs_plugins_core_store_new_from_xml (xml);
+	for (guint i = 0; searches[i] != NULL; i++)
+		gs_plugins_core_search_check (plugin, store, searches[i]);
+}
+
+static void
+gs_plugins_core_search_index_cache_check (GsPlugin *plugin,
+					  const gchar *xml,
+					  const gchar *cache_fn,
+					  const gchar *data_valid,
+					  gsize len_valid,
+					  gboolean use_cache)
+{
+	GStatBuf st;
+	gboolean ret;
+	gsize len = 0;
+	guint64 ino;
+	g_autofree gchar *data = NULL;
+	g_autoptr(AsStore) store = gs_plugins_core_store_new_from_xml (xml);
+	g_autoptr(GError) error = NULL;
+
+	/* a cache that is not used is saved again */
+	g_assert_cmpint (g_stat (cache_fn, &st), ==, 0);
+	ino = st.st_ino;
+	gs_appstream_store_load_search_index (plugin, store, cache_fn);
+	g_assert_cmpint (g_stat (cache_fn, &st), ==, 0);
+	if (use_cache)
+		g_assert_cmpint (st.st_ino, ==, ino);
+	else
+		g_assert_cmpint (st.st_ino, !=, ino);
+	ret = g_file_get_contents (cache_fn, &data, &len, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (len, ==, len_valid);
+	g_assert (memcmp (data, data_valid, len) == 0);
+
+	/* the results do not depend on where the index came from */
+	gs_plugins_core_search_check (plugin, store, "gim");
+	gs_plugins_core_search_check (plugin, store, "handbook");
+	gs_plugins_core_search_check (plugin, store, "image edit");
+}
+
+static void
+gs_plugins_core_search_index_cache_func (GsPluginLoader *plugin_loader)
+{
+	GsPlugin *plugin;
+	GVariantBuilder builder;
+	const gchar *checksum = NULL;
+	const gchar *id_bad = "*/*/index/desktop/bad.desktop/*";
+	gboolean ret;
+	gsize len = 0;
+	guint32 byte_order = 0;
+	guint32 version = 0;
+	g_autofree gchar *cache_fn = NULL;
+	g_autofree gchar *data_valid = NULL;
+	g_autofree gchar *tmpdir = NULL;
+	g_autofree gchar *xml = gs_plugins_core_index_xml_new ();
+	g_autoptr(AsStore) store = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) invalid = NULL;
+	g_autoptr(GVariant) data = NULL;
+	g_autoptr(GVariant) ids = NULL;
+	g_autoptr(GVariant) tokens = NULL;
+
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "appstream");
+	g_assert (plugin != NULL);
+	tmpdir = g_dir_make_tmp ("gs-self-test-XXXXXX", &error);
+	g_assert_no_error (error);
+	g_assert (tmpdir != NULL);
+	cache_fn = g_build_filename (tmpdir, "search-index.gvariant", NULL);
+
+	/* no cache, so a new one is saved */
+	store = gs_plugins_core_store_new_from_xml (xml);
+	gs_appstream_store_load_search_index (plugin, store, cache_fn);
+	gs_plugins_core_search_check (plugin, store, "image edit");
+	ret = g_file_get_contents (cache_fn, &data_valid, &len, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* the same apps use the cache as it is */
+	gs_plugins_core_search_index_cache_check (plugin, xml, cache_fn,
+						  data_valid, len, TRUE);
+
+	/* a cache from a different version, byte order, set of inputs or set
+	 * of apps is replaced, as is one with postings for apps that do not
+	 * exist */
+	data = g_variant_ref_sink (g_variant_new_from_data (G_VARIANT_TYPE ("(uusasa(sa(uu)))"),
+							    data_valid, len, TRUE,
+							    NULL, NULL));
+	g_variant_get (data, "(uu&s@as@a(sa(uu)))",
+		       &version, &byte_order, &checksum, &ids, &tokens);
+	invalid = g_ptr_array_new_with_free_func ((GDestroyNotify) g_variant_unref);
+	g_ptr_array_add (invalid, g_variant_ref_sink (g_variant_new ("(uus@as@a(sa(uu)))",
+								     version + 1, byte_order,
+								     checksum, ids, tokens)));
+	g_ptr_array_add (invalid, g_variant_ref_sink (g_variant_new ("(uus@as@a(sa(uu)))",
+								     version,
+								     byte_order == G_LITTLE_ENDIAN ?
+								     G_BIG_ENDIAN : G_LITTLE_ENDIAN,
+								     checksum, ids, tokens)));
+	g_ptr_array_add (invalid, g_variant_ref_sink (g_variant_new ("(uus@as@a(sa(uu)))",
+								     version, byte_order,
+								     "0", ids, tokens)));
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
+	for (gsize i = 1; i < g_variant_n_children (ids); i++) {
+		const gchar *id = NULL;
+		g_variant_get_child (ids, i, "&s", &id);
+		g_variant_builder_add (&builder, "s", id);
+	}
+	g_ptr_array_add (invalid, g_variant_ref_sink (g_variant_new ("(uusas@a(sa(uu)))",
+								     version, byte_order,
+								     checksum, &builder, tokens)));
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
+	g_variant_builder_add (&builder, "s", id_bad);
+	for (gsize i = 1; i < g_variant_n_children (ids); i++) {
+		const gchar *id = NULL;
+		g_variant_get_child (ids, i, "&s", &id);
+		g_variant_builder_add (&builder, "s", id);
+	}
+	g_ptr_array_add (invalid, g_variant_ref_sink (g_variant_new ("(uusas@a(sa(uu)))",
+								     version, byte_order,
+								     checksum, &builder, tokens)));
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa(uu))"));
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("(sa(uu))"));
+	g_variant_builder_add (&builder, "s", "gimp");
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(uu)"));
+	g_variant_builder_add (&builder, "(uu)", (guint32) g_variant_n_children (ids), (guint32) 1);
+	g_variant_builder_close (&builder);
+	g_variant_builder_close (&builder);
+	g_ptr_array_add (invalid, g_variant_ref_sink (g_variant_new ("(uus@asa(sa(uu)))",
+								     version, byte_order,
+								     checksum, ids, &builder)));
+	for (guint i = 0; i < invalid->len; i++) {
+		GVariant *tmp = g_ptr_array_index (invalid, i);
+		ret = g_file_set_contents (cache_fn,
+					   g_variant_get_data (tmp),
+					   (gssize) g_variant_get_size (tmp),
+					   &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+		gs_plugins_core_search_index_cache_check (plugin, xml, cache_fn,
+							  data_valid, len, FALSE);
+	}
+
+	ret = gs_utils_rmtree (tmpdir, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+}
+
+static void
+gs_plugins_core_category_index_func (GsPluginLoader *plugin_loader)
+{
+	GsPlugin *plugin;
+	gboolean ret;
+	g_autofree gchar *xml = gs_plugins_core_index_xml_new ();
+	g_autoptr(AsStore) store = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) list = NULL;
+	g_autoptr(GsCategory) parent = NULL;
+	g_autoptr(GsCategory) category_all = NULL;
+	g_autoptr(GsCategory) category_vector = NULL;
+	g_autoptr(GsCategory) category_both = NULL;
+	g_autoptr(GsCategory) category_none = NULL;
+	struct {
+		GsCategory	*category;
+		const gchar	*apps;
+	} tests[] = {
+		{ NULL, "gimp.desktop;inkscape.desktop;" },
+		{ NULL, "inkscape.desktop;" },
+		{ NULL, "gimp.desktop;inkscape.desktop;" },
+		{ NULL, "" } };
+
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "appstream");
+	g_assert (plugin != NULL);
+	store = gs_plugins_core_store_new_from_xml (xml);
+
+	/* an app has to be in every category of a desktop group */
+	category_all = gs_category_new ("all");
+	gs_category_add_desktop_group (category_all, "Graphics");
+	category_vector = gs_category_new ("vector");
+	gs_category_add_desktop_group (category_vector, "Graphics::VectorGraphics");
+	category_both = gs_category_new ("both");
+	gs_category_add_desktop_group (category_both, "Graphics::RasterGraphics");
+	gs_category_add_desktop_group (category_both, "Graphics::VectorGraphics");
+	category_none = gs_category_new ("none");
+	gs_category_add_desktop_group (category_none, "Graphics::Video");
+	tests[0].category = category_all;
+	tests[1].category = category_vector;
+	tests[2].category = category_both;
+	tests[3].category = category_none;
+	for (guint i = 0; i < G_N_ELEMENTS (tests); i++) {
+		g_autofree gchar *apps = NULL;
+		g_autoptr(GsAppList) apps_list = gs_app_list_new ();
+		ret = gs_appstream_store_add_category_apps (plugin, store,
+							    tests[i].category,
+							    apps_list, NULL, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+		apps = gs_plugins_core_app_list_to_string (apps_list);
+		g_assert_cmpstr (apps, ==, tests[i].apps);
+	}
+
+	/* each app is only counted once in a category, even if more than one
+	 * desktop group matches */
+	parent = gs_category_new ("graphics");
+	gs_category_add_child (parent, category_all);
+	gs_category_add_child (parent, category_vector);
+	gs_category_add_child (parent, category_both);
+	gs_category_add_child (parent, category_none);
+	list = g_ptr_array_new ();
+	g_ptr_array_add (list, parent);
+	ret = gs_appstream_store_add_categories (plugin, store, list, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (gs_category_get_size (category_all), ==, 2);
+	g_assert_cmpint (gs_category_get_size (category_vector), ==, 1);
+	g_assert_cmpint (gs_category_get_size (category_both), ==, 2);
+	g_assert_cmpint (gs_category_get_size (category_none), ==, 0);
+	g_assert_cmpint (gs_category_get_size (parent), ==, 5);
+}
+
+static void
+gs_plugins_core_recent_index_func (GsPluginLoader *plugin_loader)
+{
+	GsPlugin *plugin;
+	gboolean ret;
+	g_autofree gchar *apps_month = NULL;
+	g_autofree gchar *apps_week = NULL;
+	g_autofree gchar *xml = gs_plugins_core_index_xml_new ();
+	g_autoptr(AsStore) store = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsAppList) list_month = gs_app_list_new ();
+	g_autoptr(GsAppList) list_week = gs_app_list_new ();
+
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "appstream");
+	g_assert (plugin != NULL);
+	store = gs_plugins_core_store_new_from_xml (xml);
+
+	/* gedit has the newest release, but the apps are in store order, and
+	 * a release in the future is never recent */
+	ret = gs_appstream_add_recent (plugin, store, list_week,
+				       7 * 24 * 60 * 60, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	apps_week = gs_plugins_core_app_list_to_string (list_week);
+	g_assert_cmpstr (apps_week, ==, "gimp.desktop;gedit.desktop;");
+
+	/* older releases are included when the age allows it */
+	ret = gs_appstream_add_recent (plugin, store, list_month,
+				       60 * 24 * 60 * 60, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	apps_month = gs_plugins_core_app_list_to_string (list_month);
+	g_assert_cmpstr (apps_month, ==, "gimp.desktop;inkscape.desktop;gedit.desktop;");
+}
+
 static void
 gs_plugins_core_os_release_func (GsPluginLoader *plugin_loader)
 {
@@ -249,6 +724,21 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/gnome-software/plugins/core/os-release",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_core_os_release_func);
+	g_test_add_data_func ("/gnome-software/plugins/core/search-index",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_core_search_index_func);
+	g_test_add_data_func ("/gnome-software/plugins/core/search-narrow",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_core_search_narrow_func);
+	g_test_add_data_func ("/gnome-software/plugins/core/search-index-cache",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_core_search_index_cache_func);
+	g_test_add_data_func ("/gnome-software/plugins/core/category-index",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_core_category_index_func);
+	g_test_add_data_func ("/gnome-software/plugins/core/recent-index",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_core_recent_index_func);
 	return g_test_run ();
 }
 
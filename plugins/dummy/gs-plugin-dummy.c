@@ -37,6 +37,7 @@ struct GsPluginData {
 	GsApp			*cached_origin;
 	GHashTable		*installed_apps;	/* id:1 */
 	GHashTable		*available_apps;	/* id:1 */
+	gint			 search_count;		/* atomic */
 };
 
 /* just flip-flop this every few seconds */
@@ -64,6 +65,10 @@ gs_plugin_initialize (GsPlugin *plugin)
 	/* set plugin flags */
 	gs_plugin_add_flags (plugin, GS_PLUGIN_FLAGS_GLOBAL_CACHE);
 
+	/* so the self tests can check how often the searches are run */
+	g_object_set_data (G_OBJECT (plugin), "GsPluginDummy::search-count",
+			   &priv->search_count);
+
 	/* toggle this */
 	if (g_getenv ("GS_SELF_TEST_TOGGLE_ALLOW_UPDATES") != NULL) {
 		priv->allow_updates_id = g_timeout_add_seconds (10,
@@ -235,6 +240,8 @@ gs_plugin_add_search (GsPlugin *plugin,
 	g_autoptr(GsApp) app = NULL;
 	g_autoptr(AsIcon) ic = NULL;
 
+	g_atomic_int_inc (&priv->search_count);
+
 	/* we're very specific */
 	if (g_strcmp0 (values[0], "chiron") != 0)
 		return TRUE;
@@ -370,6 +370,75 @@ gs_plugins_dummy_search_func (GsPluginLoader *plugin_loader)
 	g_assert_cmpint (gs_app_get_kind (app), ==, AS_APP_KIND_DESKTOP);
 }
 
+typedef struct {
+	GMainLoop	*loop;
+	GPtrArray	*lists;
+} GsPluginsDummySharedHelper;
+
+static void
+gs_plugins_dummy_search_shared_cb (GObject *source_object,
+				   GAsyncResult *res,
+				   gpointer user_data)
+{
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source_object);
+	GsPluginsDummySharedHelper *helper = (GsPluginsDummySharedHelper *) user_data;
+	g_autoptr(GError) error = NULL;
+	GsAppList *list;
+
+	list = gs_plugin_loader_job_process_finish (plugin_loader, res, &error);
+	g_assert_no_error (error);
+	g_assert (list != NULL);
+	g_ptr_array_add (helper->lists, list);
+	if (helper->lists->len == 2)
+		g_main_loop_quit (helper->loop);
+}
+
+static void
+gs_plugins_dummy_search_shared_func (GsPluginLoader *plugin_loader)
+{
+	GsPlugin *plugin;
+	GsPluginsDummySharedHelper helper;
+	gint *search_count;
+	gint search_count_old;
+	g_autoptr(GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+	g_autoptr(GPtrArray) lists = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+
+	/* count how many times the search vfunc is run */
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "dummy");
+	g_assert (plugin != NULL);
+	search_count = g_object_get_data (G_OBJECT (plugin), "GsPluginDummy::search-count");
+	g_assert (search_count != NULL);
+	search_count_old = g_atomic_int_get (search_count);
+
+	/* run the same search twice at once */
+	helper.loop = loop;
+	helper.lists = lists;
+	for (guint i = 0; i < 2; i++) {
+		g_autoptr(GsPluginJob) plugin_job = NULL;
+		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_SEARCH,
+						 "search", "spell",
+						 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+						 NULL);
+		gs_plugin_loader_job_process_async (plugin_loader, plugin_job,
+						    NULL,
+						    gs_plugins_dummy_search_shared_cb,
+						    &helper);
+	}
+	g_main_loop_run (loop);
+	gs_test_flush_main_context ();
+
+	/* the plugins were only asked once */
+	g_assert_cmpint (g_atomic_int_get (search_count) - search_count_old, ==, 1);
+
+	/* both callers get the same results, but in their own list */
+	g_assert (g_ptr_array_index (lists, 0) != g_ptr_array_index (lists, 1));
+	for (guint i = 0; i < lists->len; i++) {
+		GsAppList *list = g_ptr_array_index (lists, i);
+		g_assert_cmpint (gs_app_list_length (list), ==, 1);
+		g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 0)), ==, "zeus.desktop");
+	}
+}
+
 static void
 gs_plugins_dummy_search_invalid_func (GsPluginLoader *plugin_loader)
 {
@@ -708,6 +777,9 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/gnome-software/plugins/dummy/search{invalid}",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_search_invalid_func);
+	g_test_add_data_func ("/gnome-software/plugins/dummy/search{shared}",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_search_shared_func);
 	g_test_add_data_func ("/gnome-software/plugins/dummy/url-to-app",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_url_to_app_func);
@@ -207,6 +207,9 @@ gs_plugin_flatpak_changed_cb (GFileMonitor *monitor,
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GError) error_md = NULL;
 
+	/* anything refined from now on cannot be reused in the next session */
+	gs_plugin_set_state_stamp (self->plugin, NULL);
+
 	/* don't refresh when it's us ourselves doing the change */
 	if (gs_plugin_has_flags (self->plugin, GS_PLUGIN_FLAGS_RUNNING_SELF))
 		return;
@@ -1931,7 +1934,10 @@ gs_flatpak_refine_appstream_release (AsApp *item, GsApp *app)
 }
 
 static gboolean
-gs_flatpak_refine_appstream (GsFlatpak *self, GsApp *app, GError **error)
+gs_flatpak_refine_appstream (GsFlatpak *self,
+			     GsApp *app,
+			     GsPluginRefineFlags flags,
+			     GError **error)
 {
 	AsApp *item;
 	const gchar *unique_id = gs_app_get_unique_id (app);
@@ -1962,7 +1968,7 @@ gs_flatpak_refine_appstream (GsFlatpak *self, GsApp *app, GError **error)
 		return TRUE;
 	}
 
-	if (!gs_appstream_refine_app (self->plugin, app, item, error))
+	if (!gs_appstream_refine_app (self->plugin, app, item, flags, error))
 		return FALSE;
 
 	/* use the default release as the version number */
@@ -1989,7 +1995,7 @@ gs_flatpak_refine_app (GsFlatpak *self,
 	g_assert (ptask != NULL);
 
 	/* always do AppStream properties */
-	if (!gs_flatpak_refine_appstream (self, app, error))
+	if (!gs_flatpak_refine_appstream (self, app, flags, error))
 		return FALSE;
 
 	/* flatpak apps can always be removed */
@@ -2012,7 +2018,7 @@ gs_flatpak_refine_app (GsFlatpak *self,
 
 	/* if the state was changed, perhaps set the version from the release */
 	if (old_state != gs_app_get_state (app)) {
-		if (!gs_flatpak_refine_appstream (self, app, error))
+		if (!gs_flatpak_refine_appstream (self, app, flags, error))
 			return FALSE;
 	}
 
@@ -2804,7 +2810,9 @@ gs_flatpak_app_install (GsFlatpak *self,
 	gs_app_set_state (app, AS_APP_STATE_INSTALLED);
 
 	/* set new version */
-	if (!gs_flatpak_refine_appstream (self, app, error))
+	if (!gs_flatpak_refine_appstream (self, app,
+					  GS_PLUGIN_REFINE_FLAGS_DEFAULT,
+					  error))
 		return FALSE;
 
 	return TRUE;
@@ -2904,7 +2912,9 @@ gs_flatpak_update_app (GsFlatpak *self,
 	gs_app_set_update_urgency (app, AS_URGENCY_KIND_UNKNOWN);
 
 	/* set new version */
-	if (!gs_flatpak_refine_appstream (self, app, error))
+	if (!gs_flatpak_refine_appstream (self, app,
+					  GS_PLUGIN_REFINE_FLAGS_DEFAULT,
+					  error))
 		return FALSE;
 
 	return TRUE;
@@ -3012,8 +3022,14 @@ gs_flatpak_file_to_app_bundle (GsFlatpak *self,
 			return FALSE;
 		}
 
-		/* copy details from AppStream to app */
-		if (!gs_appstream_refine_app (self->plugin, app, item, error))
+		/* copy details from AppStream to app, as the bundle
+		 * metadata is not available when refining later */
+		if (!gs_appstream_refine_app (self->plugin, app, item,
+					      GS_PLUGIN_REFINE_FLAGS_REQUIRE_DESCRIPTION |
+					      GS_PLUGIN_REFINE_FLAGS_REQUIRE_ADDONS |
+					      GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEWS |
+					      GS_PLUGIN_REFINE_FLAGS_REQUIRE_SCREENSHOTS,
+					      error))
 			return FALSE;
 	} else {
 		g_warning ("no appstream metadata in file");
@@ -129,10 +129,27 @@ gs_plugin_flatpak_add_installation (GsPlugin *plugin,
 	return TRUE;
 }
 
+/* flatpak touches this file whenever anything is installed or removed */
+static void
+gs_plugin_flatpak_append_state_stamp (GString *state_stamp,
+				      FlatpakInstallation *installation)
+{
+	g_autoptr(GFile) path = flatpak_installation_get_path (installation);
+	g_autoptr(GFile) file = g_file_get_child (path, ".changed");
+	g_autoptr(GFileInfo) info = NULL;
+
+	info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				  G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	g_string_append_printf (state_stamp, "%s:%" G_GUINT64_FORMAT ";",
+				flatpak_installation_get_is_user (installation) ? "user" : "system",
+				info != NULL ? g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) : 0);
+}
+
 gboolean
 gs_plugin_setup (GsPlugin *plugin, GCancellable *cancellable, GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	g_autoptr(GString) state_stamp = g_string_new (NULL);
 
 	/* clear in case we're called from resetup in the self tests */
 	g_ptr_array_set_size (priv->flatpaks, 0);
@@ -152,6 +169,7 @@ gs_plugin_setup (GsPlugin *plugin, GCancellable *cancellable, GError **error)
 								 cancellable, error)) {
 				return FALSE;
 			}
+			gs_plugin_flatpak_append_state_stamp (state_stamp, installation);
 		}
 	}
 
@@ -190,6 +208,10 @@ gs_plugin_setup (GsPlugin *plugin, GCancellable *cancellable, GError **error)
 							 cancellable, error)) {
 			return FALSE;
 		}
+		gs_plugin_flatpak_append_state_stamp (state_stamp, installation);
+
+		/* allow the loader to reuse refine results from last time */
+		gs_plugin_set_state_stamp (plugin, state_stamp->str);
 	}
 
 	/* add temporary installation for flatpakref files */
@@ -35,15 +35,50 @@
 #define ODRS_REVIEW_CACHE_AGE_MAX		237000 /* 1 week */
 #define ODRS_REVIEW_NUMBER_RESULTS_MAX		20
 
+/* the ratings are converted to a sorted table that can be used directly
+ * from the mapped file: the version, the modification time, size and
+ * checksum of the JSON file, the app IDs and six star counts for each */
+#define ODRS_RATINGS_INDEX_VERSION		1
+#define ODRS_RATINGS_INDEX_TYPE			"(uttsasau)"
+#define ODRS_RATINGS_N_STARS			6
+
+/* the reviews of all apps are cached in one file as the app ID, the time
+ * they were fetched and the JSON data returned by the server */
+#define ODRS_REVIEWS_CACHE_VERSION		1
+#define ODRS_REVIEWS_CACHE_TYPE			"(ua{s(ts)})"
+
+/* the number of apps to fetch reviews for at the same time */
+#define ODRS_REVIEWS_FETCH_MAX			4
+
+typedef struct {
+	guint64			 timestamp;
+	gchar			*json;
+} GsPluginOdrsReviews;
+
 struct GsPluginData {
 	GSettings		*settings;
 	gchar			*distro;
 	gchar			*user_hash;
 	gchar			*review_server;
-	GHashTable		*ratings;
+	GVariant		*ratings_ids;
+	GVariant		*ratings_stars;
+	GMutex			 ratings_mutex;
+	GHashTable		*reviews;	/* app-id:GsPluginOdrsReviews */
+	GHashTable		*reviews_pending; /* app-id being fetched */
+	gboolean		 reviews_loaded;
+	gboolean		 reviews_dirty;
+	GMutex			 reviews_mutex;
+	GCond			 reviews_cond;
 	GsApp			*cached_origin;
 };
 
+static void
+gs_plugin_odrs_reviews_free (GsPluginOdrsReviews *item)
+{
+	g_free (item->json);
+	g_slice_free (GsPluginOdrsReviews, item);
+}
+
 void
 gs_plugin_initialize (GsPlugin *plugin)
 {
@@ -54,8 +89,16 @@ gs_plugin_initialize (GsPlugin *plugin)
 	priv->settings = g_settings_new ("org.gnome.software");
 	priv->review_server = g_settings_get_string (priv->settings,
 						     "review-server");
-	priv->ratings = g_hash_table_new_full (g_str_hash, g_str_equal,
-					       g_free, (GDestroyNotify) g_array_unref);
+	g_mutex_init (&priv->ratings_mutex);
+	priv->reviews = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					       (GDestroyNotify) gs_plugin_odrs_reviews_free);
+	priv->reviews_pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+						       g_free, NULL);
+	g_mutex_init (&priv->reviews_mutex);
+	g_cond_init (&priv->reviews_cond);
+
+	/* do not hammer the review server when refining many apps at once */
+	gs_plugin_set_max_jobs (plugin, 2);
 
 	/* get the machine+user ID hash value */
 	priv->user_hash = gs_utils_get_user_hash (&error);
@@ -96,44 +139,56 @@ gs_plugin_initialize (GsPlugin *plugin)
 	gs_plugin_set_appstream_id (plugin, "org.gnome.Software.Plugin.Odrs");
 }
 
-static GArray *
-gs_plugin_odrs_load_ratings_for_app (JsonObject *json_app)
+typedef struct {
+	const gchar		*app_id;
+	guint32			 stars[ODRS_RATINGS_N_STARS];
+} GsPluginOdrsRating;
+
+static gboolean
+gs_plugin_odrs_load_ratings_for_app (JsonObject *json_app, GsPluginOdrsRating *rating)
 {
-	GArray *ratings;
-	guint64 tmp;
-	guint i;
 	const gchar *names[] = { "star0", "star1", "star2", "star3",
 				 "star4", "star5", NULL };
 
-	ratings = g_array_sized_new (FALSE, TRUE, sizeof(guint32), 6);
-	for (i = 0; names[i] != NULL; i++) {
+	for (guint i = 0; names[i] != NULL; i++) {
 		if (!json_object_has_member (json_app, names[i]))
-			continue;
-		tmp = (guint64) json_object_get_int_member (json_app, names[i]);
-		g_array_append_val (ratings, tmp);
+			return FALSE;
+		rating->stars[i] = (guint32) json_object_get_int_member (json_app, names[i]);
 	}
+	return TRUE;
+}
 
-	return ratings;
+static gint
+gs_plugin_odrs_rating_cmp (gconstpointer a, gconstpointer b)
+{
+	const GsPluginOdrsRating *r1 = (const GsPluginOdrsRating *) a;
+	const GsPluginOdrsRating *r2 = (const GsPluginOdrsRating *) b;
+	return strcmp (r1->app_id, r2->app_id);
 }
 
-static gboolean
-gs_plugin_odrs_load_ratings (GsPlugin *plugin, const gchar *fn, GError **error)
+/* parses the JSON file, which is only needed when it has changed */
+static GVariant *
+gs_plugin_odrs_ratings_index_build (const gchar *data,
+				    gsize data_len,
+				    guint64 mtime,
+				    const gchar *checksum,
+				    GError **error)
 {
-	GsPluginData *priv = gs_plugin_get_data (plugin);
 	GList *l;
+	GVariantBuilder builder_ids;
+	GVariant *stars;
 	JsonNode *json_root;
 	JsonObject *json_item;
+	g_autoptr(GArray) ratings = NULL;
+	g_autoptr(GArray) stars_buf = NULL;
 	g_autoptr(GList) apps = NULL;
 	g_autoptr(JsonParser) json_parser = NULL;
 
-	/* remove all existing */
-	g_hash_table_remove_all (priv->ratings);
-
 	/* parse the data and find the success */
 	json_parser = json_parser_new ();
-	if (!json_parser_load_from_file (json_parser, fn, error)) {
+	if (!json_parser_load_from_data (json_parser, data, (gssize) data_len, error)) {
 		gs_utils_error_convert_json_glib (error);
-		return FALSE;
+		return NULL;
 	}
 	json_root = json_parser_get_root (json_parser);
 	if (json_root == NULL) {
@@ -141,33 +196,260 @@ gs_plugin_odrs_load_ratings (GsPlugin *plugin, const gchar *fn, GError **error)
 				     GS_PLUGIN_ERROR,
 				     GS_PLUGIN_ERROR_INVALID_FORMAT,
 				     "no ratings root");
-		return FALSE;
+		return NULL;
 	}
 	if (json_node_get_node_type (json_root) != JSON_NODE_OBJECT) {
 		g_set_error_literal (error,
 				     GS_PLUGIN_ERROR,
 				     GS_PLUGIN_ERROR_INVALID_FORMAT,
 				     "no ratings array");
-		return FALSE;
+		return NULL;
 	}
 
 	/* parse each app */
 	json_item = json_node_get_object (json_root);
 	apps = json_object_get_members (json_item);
+	ratings = g_array_sized_new (FALSE, FALSE, sizeof(GsPluginOdrsRating),
+				     g_list_length (apps));
 	for (l = apps; l != NULL; l = l->next) {
 		const gchar *app_id = (const gchar *) l->data;
 		JsonObject *json_app = json_object_get_object_member (json_item, app_id);
-		g_autoptr(GArray) ratings = NULL;;
-		ratings = gs_plugin_odrs_load_ratings_for_app (json_app);
-		if (ratings->len == 6) {
-			g_hash_table_insert (priv->ratings,
-					     g_strdup (app_id),
-					     g_array_ref (ratings));
-		}
+		GsPluginOdrsRating rating;
+		if (json_app == NULL)
+			continue;
+		rating.app_id = app_id;
+		if (!gs_plugin_odrs_load_ratings_for_app (json_app, &rating))
+			continue;
+		g_array_append_val (ratings, rating);
+	}
+
+	/* sort by ID so that the app can be found with a binary search */
+	g_array_sort (ratings, gs_plugin_odrs_rating_cmp);
+	g_variant_builder_init (&builder_ids, G_VARIANT_TYPE ("as"));
+	stars_buf = g_array_sized_new (FALSE, FALSE, sizeof(guint32),
+				       ratings->len * ODRS_RATINGS_N_STARS);
+	for (guint i = 0; i < ratings->len; i++) {
+		GsPluginOdrsRating *rating = &g_array_index (ratings, GsPluginOdrsRating, i);
+		g_variant_builder_add (&builder_ids, "s", rating->app_id);
+		g_array_append_vals (stars_buf, rating->stars, ODRS_RATINGS_N_STARS);
+	}
+	stars = g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+					   stars_buf->data, stars_buf->len,
+					   sizeof(guint32));
+	return g_variant_ref_sink (g_variant_new (ODRS_RATINGS_INDEX_TYPE,
+						  (guint32) ODRS_RATINGS_INDEX_VERSION,
+						  mtime,
+						  (guint64) data_len,
+						  checksum,
+						  &builder_ids,
+						  stars));
+}
+
+static GVariant *
+gs_plugin_odrs_ratings_index_load (const gchar *filename, GError **error)
+{
+	guint32 version = 0;
+	g_autoptr(GBytes) bytes = NULL;
+	g_autoptr(GMappedFile) mapped = NULL;
+	g_autoptr(GVariant) data = NULL;
+
+	mapped = g_mapped_file_new (filename, FALSE, error);
+	if (mapped == NULL)
+		return NULL;
+	bytes = g_mapped_file_get_bytes (mapped);
+	data = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (ODRS_RATINGS_INDEX_TYPE),
+							    bytes, FALSE));
+	g_variant_get_child (data, 0, "u", &version);
+	if (version != ODRS_RATINGS_INDEX_VERSION) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_INVALID_FORMAT,
+			     "ratings index version %u not supported",
+			     version);
+		return NULL;
+	}
+	return g_steal_pointer (&data);
+}
+
+static gboolean
+gs_plugin_odrs_ratings_index_save (GVariant *data,
+				   const gchar *filename,
+				   GError **error)
+{
+	if (!g_file_set_contents (filename,
+				  g_variant_get_data (data),
+				  (gssize) g_variant_get_size (data),
+				  error)) {
+		gs_utils_error_convert_gio (error);
+		return FALSE;
 	}
 	return TRUE;
 }
 
+/* the JSON file is touched when the server says it has not changed, so
+ * the size and checksum are used to tell if the index is still valid */
+static GVariant *
+gs_plugin_odrs_ratings_index_ensure (const gchar *fn, const gchar *fn_index, GError **error)
+{
+	guint64 mtime;
+	guint64 mtime_index = 0;
+	guint64 size_index = 0;
+	const gchar *checksum_index = NULL;
+	g_autofree gchar *checksum = NULL;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GFile) file = g_file_new_for_path (fn);
+	g_autoptr(GFileInfo) info = NULL;
+	g_autoptr(GMappedFile) mapped = NULL;
+	g_autoptr(GVariant) data = NULL;
+	g_autoptr(GVariant) data_new = NULL;
+
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL, error);
+	if (info == NULL) {
+		gs_utils_error_convert_gio (error);
+		return NULL;
+	}
+	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+	/* the index is up to date */
+	data = gs_plugin_odrs_ratings_index_load (fn_index, &error_local);
+	if (data != NULL) {
+		g_variant_get (data, "(utt&sasau)",
+			       NULL, &mtime_index, &size_index,
+			       &checksum_index, NULL, NULL);
+		if (mtime_index == mtime &&
+		    size_index == (guint64) g_file_info_get_size (info))
+			return g_steal_pointer (&data);
+	} else {
+		g_debug ("no ratings index: %s", error_local->message);
+	}
+
+	/* the file might just have been touched */
+	mapped = g_mapped_file_new (fn, FALSE, &error_local);
+	if (mapped == NULL) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_FAILED,
+			     "failed to load %s: %s",
+			     fn, error_local->message);
+		return NULL;
+	}
+	checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1,
+						(const guchar *) g_mapped_file_get_contents (mapped),
+						g_mapped_file_get_length (mapped));
+	if (data != NULL &&
+	    size_index == g_mapped_file_get_length (mapped) &&
+	    g_strcmp0 (checksum_index, checksum) == 0) {
+		g_autoptr(GVariant) ids = g_variant_get_child_value (data, 4);
+		g_autoptr(GVariant) stars = g_variant_get_child_value (data, 5);
+		g_debug ("ratings are unchanged");
+		data_new = g_variant_ref_sink (g_variant_new (ODRS_RATINGS_INDEX_TYPE,
+							      (guint32) ODRS_RATINGS_INDEX_VERSION,
+							      mtime,
+							      size_index,
+							      checksum,
+							      ids,
+							      stars));
+	} else {
+		g_debug ("building ratings index");
+		data_new = gs_plugin_odrs_ratings_index_build (g_mapped_file_get_contents (mapped),
+								g_mapped_file_get_length (mapped),
+								mtime, checksum, error);
+		if (data_new == NULL)
+			return NULL;
+	}
+
+	/* use the new index in memory if it cannot be saved */
+	if (!gs_plugin_odrs_ratings_index_save (data_new, fn_index, &error_local))
+		g_warning ("failed to save ratings index: %s", error_local->message);
+	return g_steal_pointer (&data_new);
+}
+
+static gboolean
+gs_plugin_odrs_load_ratings (GsPlugin *plugin, const gchar *fn, GError **error)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	gsize n_stars = 0;
+	g_autofree gchar *fn_index = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(GVariant) data = NULL;
+	g_autoptr(GVariant) ids = NULL;
+	g_autoptr(GVariant) stars = NULL;
+
+	fn_index = gs_utils_get_cache_filename ("ratings",
+						"odrs.gvariant",
+						GS_UTILS_CACHE_FLAG_WRITEABLE,
+						error);
+	if (fn_index == NULL)
+		return FALSE;
+	data = gs_plugin_odrs_ratings_index_ensure (fn, fn_index, error);
+	if (data == NULL)
+		return FALSE;
+
+	/* there are six star counts for each app */
+	ids = g_variant_get_child_value (data, 4);
+	stars = g_variant_get_child_value (data, 5);
+	g_variant_get_fixed_array (stars, &n_stars, sizeof(guint32));
+	if (n_stars != g_variant_n_children (ids) * ODRS_RATINGS_N_STARS) {
+		g_set_error_literal (error,
+				     GS_PLUGIN_ERROR,
+				     GS_PLUGIN_ERROR_INVALID_FORMAT,
+				     "ratings index is invalid");
+		return FALSE;
+	}
+
+	/* replace all existing */
+	locker = g_mutex_locker_new (&priv->ratings_mutex);
+	g_clear_pointer (&priv->ratings_ids, g_variant_unref);
+	g_clear_pointer (&priv->ratings_stars, g_variant_unref);
+	priv->ratings_ids = g_steal_pointer (&ids);
+	priv->ratings_stars = g_steal_pointer (&stars);
+	return TRUE;
+}
+
+/* returns a new array of the star counts, or %NULL if unknown */
+static GArray *
+gs_plugin_odrs_get_ratings (GsPlugin *plugin, const gchar *app_id)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	gsize lo = 0;
+	gsize hi;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->ratings_mutex);
+
+	if (priv->ratings_ids == NULL || app_id == NULL)
+		return NULL;
+	hi = g_variant_n_children (priv->ratings_ids);
+	while (lo < hi) {
+		gsize mid = lo + (hi - lo) / 2;
+		const gchar *tmp = NULL;
+		gint rc;
+
+		g_variant_get_child (priv->ratings_ids, mid, "&s", &tmp);
+		rc = strcmp (app_id, tmp);
+		if (rc == 0) {
+			GArray *ratings;
+			const guint32 *stars;
+			gsize n_stars = 0;
+			stars = g_variant_get_fixed_array (priv->ratings_stars,
+							   &n_stars, sizeof(guint32));
+			ratings = g_array_sized_new (FALSE, FALSE, sizeof(guint32),
+						     ODRS_RATINGS_N_STARS);
+			g_array_append_vals (ratings,
+					     stars + mid * ODRS_RATINGS_N_STARS,
+					     ODRS_RATINGS_N_STARS);
+			return ratings;
+		}
+		if (rc < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
+}
+
 static gboolean
 gs_plugin_odrs_refresh_ratings (GsPlugin *plugin,
 				guint cache_age,
@@ -234,7 +516,15 @@ gs_plugin_destroy (GsPlugin *plugin)
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	g_free (priv->user_hash);
 	g_free (priv->distro);
-	g_hash_table_unref (priv->ratings);
+	if (priv->ratings_ids != NULL)
+		g_variant_unref (priv->ratings_ids);
+	if (priv->ratings_stars != NULL)
+		g_variant_unref (priv->ratings_stars);
+	g_mutex_clear (&priv->ratings_mutex);
+	g_hash_table_unref (priv->reviews);
+	g_hash_table_unref (priv->reviews_pending);
+	g_mutex_clear (&priv->reviews_mutex);
+	g_cond_clear (&priv->reviews_cond);
 	g_object_unref (priv->settings);
 	g_object_unref (priv->cached_origin);
 }
@@ -483,10 +773,9 @@ gs_plugin_odrs_refine_ratings (GsPlugin *plugin,
 			       GCancellable *cancellable,
 			       GError **error)
 {
-	GsPluginData *priv = gs_plugin_get_data (plugin);
-	GArray *review_ratings;
 	gint rating;
 	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GArray) review_ratings = NULL;
 
 	/* profile */
 	ptask = as_profile_start_literal (gs_plugin_get_profile (plugin),
@@ -494,8 +783,7 @@ gs_plugin_odrs_refine_ratings (GsPlugin *plugin,
 	g_assert (ptask != NULL);
 
 	/* get ratings */
-	review_ratings = g_hash_table_lookup (priv->ratings,
-					      gs_app_get_id (app));
+	review_ratings = gs_plugin_odrs_get_ratings (plugin, gs_app_get_id (app));
 	if (review_ratings == NULL)
 		return TRUE;
 	gs_app_set_review_ratings (app, review_ratings);
@@ -511,43 +799,183 @@ gs_plugin_odrs_refine_ratings (GsPlugin *plugin,
 	return TRUE;
 }
 
+static gchar *
+gs_plugin_odrs_reviews_get_cache_fn (GError **error)
+{
+	return gs_utils_get_cache_filename ("reviews",
+					    "odrs-reviews.gvariant",
+					    GS_UTILS_CACHE_FLAG_WRITEABLE,
+					    error);
+}
+
+/* reviews_mutex must be held */
+static void
+gs_plugin_odrs_reviews_ensure_loaded (GsPlugin *plugin)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	GVariantIter iter;
+	const gchar *app_id;
+	const gchar *json;
+	guint32 version = 0;
+	guint64 now = (guint64) g_get_real_time () / G_USEC_PER_SEC;
+	guint64 timestamp;
+	g_autofree gchar *cache_fn = NULL;
+	g_autoptr(GBytes) bytes = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GMappedFile) mapped = NULL;
+	g_autoptr(GVariant) data = NULL;
+	g_autoptr(GVariant) items = NULL;
+
+	if (priv->reviews_loaded)
+		return;
+	priv->reviews_loaded = TRUE;
+
+	cache_fn = gs_plugin_odrs_reviews_get_cache_fn (&error);
+	if (cache_fn == NULL) {
+		g_warning ("no reviews cache: %s", error->message);
+		return;
+	}
+	if (!g_file_test (cache_fn, G_FILE_TEST_EXISTS))
+		return;
+	mapped = g_mapped_file_new (cache_fn, FALSE, &error);
+	if (mapped == NULL) {
+		g_warning ("failed to load reviews cache: %s", error->message);
+		return;
+	}
+	bytes = g_mapped_file_get_bytes (mapped);
+	data = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (ODRS_REVIEWS_CACHE_TYPE),
+							    bytes, FALSE));
+	g_variant_get (data, "(u@a{s(ts)})", &version, &items);
+	if (version != ODRS_REVIEWS_CACHE_VERSION) {
+		g_debug ("reviews cache version %u not supported", version);
+		return;
+	}
+
+	/* only keep the reviews that are still fresh */
+	g_variant_iter_init (&iter, items);
+	while (g_variant_iter_next (&iter, "{&s(t&s)}", &app_id, &timestamp, &json)) {
+		GsPluginOdrsReviews *item;
+		if (timestamp > now || now - timestamp >= ODRS_REVIEW_CACHE_AGE_MAX) {
+			priv->reviews_dirty = TRUE;
+			continue;
+		}
+		item = g_slice_new0 (GsPluginOdrsReviews);
+		item->timestamp = timestamp;
+		item->json = g_strdup (json);
+		g_hash_table_insert (priv->reviews, g_strdup (app_id), item);
+	}
+}
+
+static void
+gs_plugin_odrs_reviews_save (GsPlugin *plugin)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	GHashTableIter iter;
+	GVariantBuilder builder;
+	gpointer key;
+	gpointer value;
+	g_autofree gchar *cache_fn = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->reviews_mutex);
+	g_autoptr(GVariant) data = NULL;
+
+	if (!priv->reviews_dirty)
+		return;
+	cache_fn = gs_plugin_odrs_reviews_get_cache_fn (&error);
+	if (cache_fn == NULL) {
+		g_warning ("no reviews cache: %s", error->message);
+		return;
+	}
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(ts)}"));
+	g_hash_table_iter_init (&iter, priv->reviews);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		GsPluginOdrsReviews *item = (GsPluginOdrsReviews *) value;
+		g_variant_builder_add (&builder, "{s(ts)}",
+				       (const gchar *) key,
+				       item->timestamp,
+				       item->json);
+	}
+	data = g_variant_ref_sink (g_variant_new (ODRS_REVIEWS_CACHE_TYPE,
+						  (guint32) ODRS_REVIEWS_CACHE_VERSION,
+						  &builder));
+	if (!g_file_set_contents (cache_fn,
+				  g_variant_get_data (data),
+				  (gssize) g_variant_get_size (data),
+				  &error)) {
+		g_warning ("failed to save reviews cache: %s", error->message);
+		return;
+	}
+	priv->reviews_dirty = FALSE;
+}
+
+static void
+gs_plugin_odrs_reviews_invalidate (GsPlugin *plugin, const gchar *app_id)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	g_mutex_lock (&priv->reviews_mutex);
+	gs_plugin_odrs_reviews_ensure_loaded (plugin);
+	if (app_id != NULL && g_hash_table_remove (priv->reviews, app_id))
+		priv->reviews_dirty = TRUE;
+	g_mutex_unlock (&priv->reviews_mutex);
+	gs_plugin_odrs_reviews_save (plugin);
+}
+
+/* returns the cached JSON, waiting if another thread is fetching it; if
+ * %NULL is returned the caller has to fetch the reviews itself */
+static gchar *
+gs_plugin_odrs_reviews_lookup (GsPlugin *plugin, const gchar *app_id)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	guint64 now = (guint64) g_get_real_time () / G_USEC_PER_SEC;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->reviews_mutex);
+
+	gs_plugin_odrs_reviews_ensure_loaded (plugin);
+	while (TRUE) {
+		GsPluginOdrsReviews *item = g_hash_table_lookup (priv->reviews, app_id);
+		if (item != NULL && now - item->timestamp < ODRS_REVIEW_CACHE_AGE_MAX)
+			return g_strdup (item->json);
+		if (!g_hash_table_contains (priv->reviews_pending, app_id))
+			break;
+		g_cond_wait (&priv->reviews_cond, &priv->reviews_mutex);
+	}
+
+	/* the caller now owns the fetch */
+	g_hash_table_add (priv->reviews_pending, g_strdup (app_id));
+	return NULL;
+}
+
+/* @json is %NULL if the fetch failed */
+static void
+gs_plugin_odrs_reviews_fetched (GsPlugin *plugin, const gchar *app_id, const gchar *json)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->reviews_mutex);
+
+	if (json != NULL) {
+		GsPluginOdrsReviews *item = g_slice_new0 (GsPluginOdrsReviews);
+		item->timestamp = (guint64) g_get_real_time () / G_USEC_PER_SEC;
+		item->json = g_strdup (json);
+		g_hash_table_replace (priv->reviews, g_strdup (app_id), item);
+		priv->reviews_dirty = TRUE;
+	}
+	g_hash_table_remove (priv->reviews_pending, app_id);
+	g_cond_broadcast (&priv->reviews_cond);
+}
+
 static GPtrArray *
-gs_plugin_odrs_fetch_for_app (GsPlugin *plugin, GsApp *app, GError **error)
+gs_plugin_odrs_fetch_for_app_remote (GsPlugin *plugin, GsApp *app, GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	const gchar *version;
 	guint status_code;
-	g_autofree gchar *cachefn_basename = NULL;
-	g_autofree gchar *cachefn = NULL;
 	g_autofree gchar *data = NULL;
+	g_autofree gchar *json = NULL;
 	g_autofree gchar *uri = NULL;
-	g_autoptr(GFile) cachefn_file = NULL;
 	g_autoptr(GPtrArray) reviews = NULL;
 	g_autoptr(JsonBuilder) builder = NULL;
 	g_autoptr(JsonGenerator) json_generator = NULL;
 	g_autoptr(JsonNode) json_root = NULL;
 	g_autoptr(SoupMessage) msg = NULL;
-
-	/* look in the cache */
-	cachefn_basename = g_strdup_printf ("%s.json", gs_app_get_id (app));
-	cachefn = gs_utils_get_cache_filename ("reviews",
-					       cachefn_basename,
-					       GS_UTILS_CACHE_FLAG_WRITEABLE,
-					       error);
-	if (cachefn == NULL)
-		return NULL;
-	cachefn_file = g_file_new_for_path (cachefn);
-	if (gs_utils_get_file_age (cachefn_file) < ODRS_REVIEW_CACHE_AGE_MAX) {
-		g_autofree gchar *json_data = NULL;
-		if (!g_file_get_contents (cachefn, &json_data, NULL, error))
-			return NULL;
-		g_debug ("got review data for %s from %s",
-			 gs_app_get_id (app), cachefn);
-		return gs_plugin_odrs_parse_reviews (plugin,
-						     json_data, -1,
-						     error);
-	}
-
 	/* not always available */
 	version = gs_app_get_version (app);
 	if (version == NULL)
@@ -605,16 +1033,116 @@ gs_plugin_odrs_fetch_for_app (GsPlugin *plugin, GsApp *app, GError **error)
 	g_debug ("odrs returned: %s", msg->response_body->data);
 
 	/* save to the cache */
-	if (!g_file_set_contents (cachefn,
-				  msg->response_body->data,
-				  msg->response_body->length,
-				  error))
-		return NULL;
+	json = g_strndup (msg->response_body->data,
+			  (gsize) msg->response_body->length);
+	gs_plugin_odrs_reviews_fetched (plugin, gs_app_get_id (app), json);
 
 	/* success */
 	return g_steal_pointer (&reviews);
 }
 
+static GPtrArray *
+gs_plugin_odrs_fetch_for_app (GsPlugin *plugin, GsApp *app, GError **error)
+{
+	GPtrArray *reviews;
+	g_autofree gchar *json_data = NULL;
+
+	/* look in the cache */
+	json_data = gs_plugin_odrs_reviews_lookup (plugin, gs_app_get_id (app));
+	if (json_data != NULL) {
+		g_debug ("got review data for %s from the cache",
+			 gs_app_get_id (app));
+		return gs_plugin_odrs_parse_reviews (plugin, json_data, -1, error);
+	}
+
+	/* get from the server, waking up anything waiting on failure */
+	reviews = gs_plugin_odrs_fetch_for_app_remote (plugin, app, error);
+	if (reviews == NULL)
+		gs_plugin_odrs_reviews_fetched (plugin, gs_app_get_id (app), NULL);
+	return reviews;
+}
+
+static void
+gs_plugin_odrs_fetch_cb (gpointer data, gpointer user_data)
+{
+	GsApp *app = GS_APP (data);
+	GsPlugin *plugin = GS_PLUGIN (user_data);
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) reviews = NULL;
+
+	reviews = gs_plugin_odrs_fetch_for_app (plugin, app, &error);
+	if (reviews == NULL) {
+		g_debug ("failed to fetch reviews for %s: %s",
+			 gs_app_get_id (app),
+			 error != NULL ? error->message : "unknown error");
+	}
+	g_object_unref (app);
+}
+
+static gboolean
+gs_plugin_odrs_app_needs_reviews (GsApp *app)
+{
+	if (gs_app_get_kind (app) == AS_APP_KIND_ADDON)
+		return FALSE;
+	if (gs_app_get_id (app) == NULL)
+		return FALSE;
+	if (gs_app_has_quirk (app, AS_APP_QUIRK_MATCH_ANY_PREFIX))
+		return FALSE;
+	return gs_app_get_reviews (app)->len == 0;
+}
+
+/* fetches the reviews for several apps at the same time, so that
+ * gs_plugin_refine_app() finds them in the cache */
+gboolean
+gs_plugin_refine (GsPlugin *plugin,
+		  GsAppList *list,
+		  GsPluginRefineFlags flags,
+		  GCancellable *cancellable,
+		  GError **error)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	GThreadPool *pool;
+	guint64 now = (guint64) g_get_real_time () / G_USEC_PER_SEC;
+	g_autoptr(GPtrArray) apps = g_ptr_array_new ();
+
+	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEWS) == 0)
+		return TRUE;
+
+	/* find the apps not in the cache or being fetched */
+	g_mutex_lock (&priv->reviews_mutex);
+	gs_plugin_odrs_reviews_ensure_loaded (plugin);
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		GsPluginOdrsReviews *item;
+		if (!gs_plugin_odrs_app_needs_reviews (app))
+			continue;
+		item = g_hash_table_lookup (priv->reviews, gs_app_get_id (app));
+		if (item != NULL && now - item->timestamp < ODRS_REVIEW_CACHE_AGE_MAX)
+			continue;
+		if (g_hash_table_contains (priv->reviews_pending, gs_app_get_id (app)))
+			continue;
+		g_ptr_array_add (apps, app);
+	}
+	g_mutex_unlock (&priv->reviews_mutex);
+
+	/* gs_plugin_refine_app() will do it */
+	if (apps->len < 2)
+		return TRUE;
+
+	pool = g_thread_pool_new (gs_plugin_odrs_fetch_cb, plugin,
+				  (gint) MIN (apps->len, ODRS_REVIEWS_FETCH_MAX),
+				  FALSE, error);
+	if (pool == NULL)
+		return FALSE;
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		g_thread_pool_push (pool, g_object_ref (app), NULL);
+	}
+	g_thread_pool_free (pool, FALSE, TRUE);
+	gs_plugin_odrs_reviews_save (plugin);
+	return TRUE;
+}
+
 static gboolean
 gs_plugin_odrs_refine_reviews (GsPlugin *plugin,
 			       GsApp *app,
@@ -636,6 +1164,7 @@ gs_plugin_odrs_refine_reviews (GsPlugin *plugin,
 	reviews = gs_plugin_odrs_fetch_for_app (plugin, app, error);
 	if (reviews == NULL)
 		return FALSE;
+	gs_plugin_odrs_reviews_save (plugin);
 	for (i = 0; i < reviews->len; i++) {
 		review = g_ptr_array_index (reviews, i);
 
@@ -722,28 +1251,6 @@ gs_plugin_odrs_sanitize_version (const gchar *version)
 	return tmp;
 }
 
-static gboolean
-gs_plugin_odrs_invalidate_cache (AsReview *review, GError **error)
-{
-	g_autofree gchar *cachefn_basename = NULL;
-	g_autofree gchar *cachefn = NULL;
-	g_autoptr(GFile) cachefn_file = NULL;
-
-	/* look in the cache */
-	cachefn_basename = g_strdup_printf ("%s.json",
-					    as_review_get_metadata_item (review, "app_id"));
-	cachefn = gs_utils_get_cache_filename ("reviews",
-					       cachefn_basename,
-					       GS_UTILS_CACHE_FLAG_WRITEABLE,
-					       error);
-	if (cachefn == NULL)
-		return FALSE;
-	cachefn_file = g_file_new_for_path (cachefn);
-	if (!g_file_query_exists (cachefn_file, NULL))
-		return TRUE;
-	return g_file_delete (cachefn_file, NULL, error);
-}
-
 gboolean
 gs_plugin_review_submit (GsPlugin *plugin,
 			 GsApp *app,
@@ -801,8 +1308,8 @@ gs_plugin_review_submit (GsPlugin *plugin,
 	data = json_generator_to_data (json_generator, NULL);
 
 	/* clear cache */
-	if (!gs_plugin_odrs_invalidate_cache (review, error))
-		return FALSE;
+	gs_plugin_odrs_reviews_invalidate (plugin,
+					   as_review_get_metadata_item (review, "app_id"));
 
 	/* POST */
 	uri = g_strdup_printf ("%s/submit", priv->review_server);
@@ -852,8 +1359,8 @@ gs_plugin_odrs_vote (GsPlugin *plugin, AsReview *review,
 		return FALSE;
 
 	/* clear cache */
-	if (!gs_plugin_odrs_invalidate_cache (review, error))
-		return FALSE;
+	gs_plugin_odrs_reviews_invalidate (plugin,
+					   as_review_get_metadata_item (review, "app_id"));
 
 	/* send to server */
 	if (!gs_plugin_odrs_json_post (gs_plugin_get_soup_session (plugin),
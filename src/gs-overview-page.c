@@ -31,9 +31,11 @@
 #include "gs-feature-tile.h"
 #include "gs-category-tile.h"
 #include "gs-hiding-box.h"
+#include "gs-screenshot-image.h"
 #include "gs-common.h"
 
 #define N_TILES 9
+#define N_TILES_PREFETCH 3	/* the popular tiles likely to be clicked */
 
 typedef struct
 {
@@ -151,6 +153,28 @@ gs_overview_page_decrement_action_cnt (GsOverviewPage *self)
 	gs_shell_profile_dump (priv->shell);
 }
 
+static void
+gs_overview_page_prefetch_cb (GObject *source_object,
+			      GAsyncResult *res,
+			      gpointer user_data)
+{
+	GsOverviewPage *self = GS_OVERVIEW_PAGE (user_data);
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source_object);
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsAppList) list = NULL;
+
+	list = gs_plugin_loader_job_process_finish (plugin_loader, res, &error);
+	if (list == NULL) {
+		if (!g_error_matches (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_CANCELLED))
+			g_debug ("failed to get screenshots: %s", error->message);
+		return;
+	}
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		gs_screenshot_image_prefetch (app, (guint) gtk_widget_get_scale_factor (GTK_WIDGET (self)));
+	}
+}
+
 static void
 gs_overview_page_get_popular_cb (GObject *source_object,
                                  GAsyncResult *res,
@@ -164,6 +188,7 @@ gs_overview_page_get_popular_cb (GObject *source_object,
 	GtkWidget *tile;
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GsAppList) list_prefetch = gs_app_list_new ();
 
 	/* get popular apps */
 	list = gs_plugin_loader_job_process_finish (plugin_loader, res, &error);
@@ -186,6 +211,23 @@ gs_overview_page_get_popular_cb (GObject *source_object,
 		g_signal_connect (tile, "clicked",
 			  G_CALLBACK (app_tile_clicked), self);
 		gtk_container_add (GTK_CONTAINER (priv->box_popular), tile);
+		if (i < N_TILES_PREFETCH)
+			gs_app_list_add (list_prefetch, app);
+	}
+
+	/* only the screenshots of the first few tiles are worth getting */
+	if (gs_app_list_length (list_prefetch) > 0) {
+		g_autoptr(GsPluginJob) plugin_job = NULL;
+		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
+						 "list", list_prefetch,
+						 "failure-flags", GS_PLUGIN_FAILURE_FLAGS_NONE,
+						 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_SCREENSHOTS,
+						 NULL);
+		gs_plugin_loader_job_process_async (plugin_loader,
+						    plugin_job,
+						    priv->cancellable,
+						    gs_overview_page_prefetch_cb,
+						    self);
 	}
 
 	priv->empty = FALSE;
@@ -395,6 +437,7 @@ gs_overview_page_get_featured_cb (GObject *source_object,
 
 	gtk_container_add (GTK_CONTAINER (priv->bin_featured), tile);
 	gtk_widget_show (priv->featured_heading);
+	gs_screenshot_image_prefetch (app, (guint) gtk_widget_get_scale_factor (GTK_WIDGET (self)));
 
 	priv->empty = FALSE;
 
@@ -550,7 +593,8 @@ gs_overview_page_load (GsOverviewPage *self)
 		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_GET_FEATURED,
 						 "max-results", 5,
 						 "failure-flags", GS_PLUGIN_FAILURE_FLAGS_USE_EVENTS,
-						 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+						 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON |
+								 GS_PLUGIN_REFINE_FLAGS_REQUIRE_SCREENSHOTS,
 						 NULL);
 		gs_plugin_loader_job_process_async (priv->plugin_loader,
 						    plugin_job,
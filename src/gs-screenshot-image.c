@@ -33,6 +33,15 @@
 #include "gs-screenshot-image.h"
 #include "gs-common.h"
 
+#define GS_SCREENSHOT_IMAGE_CACHE_SIZE_MAX	(64 * 1024 * 1024)	/* bytes */
+
+typedef enum {
+	GS_SCREENSHOT_IMAGE_DECODE_FLAG_NONE		= 0,
+	GS_SCREENSHOT_IMAGE_DECODE_FLAG_BLUR		= 1 << 0,
+	GS_SCREENSHOT_IMAGE_DECODE_FLAG_BACKGROUND	= 1 << 1,
+	GS_SCREENSHOT_IMAGE_DECODE_FLAG_LAST
+} GsScreenshotImageDecodeFlags;
+
 struct _GsScreenshotImage
 {
 	GtkBin		 parent_instance;
@@ -46,6 +55,8 @@ struct _GsScreenshotImage
 	GSettings	*settings;
 	SoupSession	*session;
 	SoupMessage	*message;
+	GCancellable	*cancellable_decode;
+	GCancellable	*cancellable_blur;
 	gchar		*filename;
 	const gchar	*current_image;
 	gboolean	 use_desktop_background;
@@ -57,6 +68,138 @@ struct _GsScreenshotImage
 
 G_DEFINE_TYPE (GsScreenshotImage, gs_screenshot_image, GTK_TYPE_BIN)
 
+/* the decoded images are shared by all the widgets, and are only ever
+ * accessed from the main thread */
+typedef struct {
+	gchar		*key;
+	gchar		*filename;
+	GdkPixbuf	*pixbuf;
+} GsScreenshotImageCacheItem;
+
+static GHashTable	*pixbuf_cache = NULL;		/* key : GList of item */
+static GQueue		 pixbuf_cache_lru = G_QUEUE_INIT; /* most recent first */
+static gsize		 pixbuf_cache_size = 0;
+static GHashTable	*prefetch_pending = NULL;	/* filename */
+static SoupSession	*prefetch_session = NULL;
+#ifdef HAVE_GNOME_DESKTOP
+static GSettings	*background_settings = NULL;
+#endif
+
+static void
+gs_screenshot_image_cache_item_free (GsScreenshotImageCacheItem *item)
+{
+	g_free (item->key);
+	g_free (item->filename);
+	g_object_unref (item->pixbuf);
+	g_slice_free (GsScreenshotImageCacheItem, item);
+}
+
+/* composited pixbufs are only valid for the current desktop background */
+static gchar *
+gs_screenshot_image_get_background_id (void)
+{
+#ifdef HAVE_GNOME_DESKTOP
+	g_autofree gchar *uri = NULL;
+	g_autofree gchar *color = NULL;
+	if (background_settings == NULL)
+		background_settings = g_settings_new ("org.gnome.desktop.background");
+	uri = g_settings_get_string (background_settings, "picture-uri");
+	color = g_settings_get_string (background_settings, "primary-color");
+	return g_strdup_printf ("%s;%s", uri, color);
+#else
+	return g_strdup ("");
+#endif
+}
+
+static gchar *
+gs_screenshot_image_cache_key (const gchar *filename,
+			       guint width,
+			       guint height,
+			       guint scale,
+			       GsScreenshotImageDecodeFlags flags)
+{
+	g_autofree gchar *background = NULL;
+	if (flags & GS_SCREENSHOT_IMAGE_DECODE_FLAG_BACKGROUND)
+		background = gs_screenshot_image_get_background_id ();
+	return g_strdup_printf ("%s:%ux%u@%u:%u:%s",
+				filename, width, height, scale, (guint) flags,
+				background != NULL ? background : "");
+}
+
+static GdkPixbuf *
+gs_screenshot_image_cache_lookup (const gchar *key)
+{
+	GList *link;
+	GsScreenshotImageCacheItem *item;
+
+	if (pixbuf_cache == NULL)
+		return NULL;
+	link = g_hash_table_lookup (pixbuf_cache, key);
+	if (link == NULL)
+		return NULL;
+
+	/* move to the front so it gets evicted last */
+	g_queue_unlink (&pixbuf_cache_lru, link);
+	g_queue_push_head_link (&pixbuf_cache_lru, link);
+	item = link->data;
+	return item->pixbuf;
+}
+
+static void
+gs_screenshot_image_cache_remove_link (GList *link)
+{
+	GsScreenshotImageCacheItem *item = link->data;
+	g_hash_table_remove (pixbuf_cache, item->key);
+	g_queue_delete_link (&pixbuf_cache_lru, link);
+	pixbuf_cache_size -= gdk_pixbuf_get_byte_length (item->pixbuf);
+	gs_screenshot_image_cache_item_free (item);
+}
+
+static void
+gs_screenshot_image_cache_add (const gchar *key,
+			       const gchar *filename,
+			       GdkPixbuf *pixbuf)
+{
+	GList *link;
+	GsScreenshotImageCacheItem *item;
+	gsize size = gdk_pixbuf_get_byte_length (pixbuf);
+
+	/* not worth throwing everything else away for */
+	if (size > GS_SCREENSHOT_IMAGE_CACHE_SIZE_MAX / 4)
+		return;
+
+	if (pixbuf_cache == NULL)
+		pixbuf_cache = g_hash_table_new (g_str_hash, g_str_equal);
+	link = g_hash_table_lookup (pixbuf_cache, key);
+	if (link != NULL)
+		gs_screenshot_image_cache_remove_link (link);
+	while (pixbuf_cache_size + size > GS_SCREENSHOT_IMAGE_CACHE_SIZE_MAX &&
+	       pixbuf_cache_lru.tail != NULL)
+		gs_screenshot_image_cache_remove_link (pixbuf_cache_lru.tail);
+
+	item = g_slice_new0 (GsScreenshotImageCacheItem);
+	item->key = g_strdup (key);
+	item->filename = g_strdup (filename);
+	item->pixbuf = g_object_ref (pixbuf);
+	g_queue_push_head (&pixbuf_cache_lru, item);
+	g_hash_table_insert (pixbuf_cache, item->key, pixbuf_cache_lru.head);
+	pixbuf_cache_size += size;
+}
+
+static void
+gs_screenshot_image_cache_invalidate (const gchar *filename)
+{
+	GList *link;
+	GList *next;
+
+	for (link = pixbuf_cache_lru.head; link != NULL; link = next) {
+		GsScreenshotImageCacheItem *item = link->data;
+		next = link->next;
+		if (g_strcmp0 (item->filename, filename) == 0)
+			gs_screenshot_image_cache_remove_link (link);
+	}
+}
+
 AsScreenshot *
 gs_screenshot_image_get_screenshot (GsScreenshotImage *ssimg)
 {
@@ -80,7 +223,7 @@ gs_screenshot_image_set_error (GsScreenshotImage *ssimg, const gchar *message)
 }
 
 static GdkPixbuf *
-gs_screenshot_image_get_desktop_pixbuf (GsScreenshotImage *ssimg)
+gs_screenshot_image_get_desktop_pixbuf (guint width, guint height)
 {
 #ifdef HAVE_GNOME_DESKTOP
 	g_autoptr(GnomeBG) bg = NULL;
@@ -93,77 +236,180 @@ gs_screenshot_image_get_desktop_pixbuf (GsScreenshotImage *ssimg)
 	gnome_bg_load_from_preferences (bg, settings);
 	return gnome_bg_create_thumbnail (bg, factory,
 					  gdk_screen_get_default (),
-					  (gint) ssimg->width,
-					  (gint) ssimg->height);
+					  (gint) width,
+					  (gint) height);
 #else
 	return NULL;
 #endif
 }
 
 static gboolean
-gs_screenshot_image_use_desktop_background (GsScreenshotImage *ssimg, GdkPixbuf *pixbuf)
+gs_screenshot_image_has_internal_alpha (GdkPixbuf *pixbuf)
 {
 	g_autoptr(AsImage) im = NULL;
 
-	/* nothing to show, means no background mode */
-	if (pixbuf == NULL)
-		return FALSE;
-	/* background mode explicitly disabled */
-	if (!ssimg->use_desktop_background)
-		return FALSE;
-
 	/* use a temp AsImage */
 	im = as_image_new ();
 	as_image_set_pixbuf (im, pixbuf);
 	return (as_image_get_alpha_flags (im) & AS_IMAGE_ALPHA_FLAG_INTERNAL) > 0;
 }
 
+typedef struct {
+	gchar				*filename;
+	gchar				*key;
+	guint				 width;
+	guint				 height;
+	guint				 scale;
+	GsScreenshotImageDecodeFlags	 flags;
+	gboolean			 composite;
+} GsScreenshotImageDecodeHelper;
+
+static void
+gs_screenshot_image_decode_helper_free (GsScreenshotImageDecodeHelper *helper)
+{
+	g_free (helper->filename);
+	g_free (helper->key);
+	g_slice_free (GsScreenshotImageDecodeHelper, helper);
+}
+
 static void
-as_screenshot_show_image (GsScreenshotImage *ssimg)
+gs_screenshot_image_decode_thread_cb (GTask *task,
+				      gpointer source_object,
+				      gpointer task_data,
+				      GCancellable *cancellable)
 {
-	g_autoptr(GdkPixbuf) pixbuf_bg = NULL;
+	GsScreenshotImageDecodeHelper *helper = task_data;
+	GError *error = NULL;
 	g_autoptr(GdkPixbuf) pixbuf = NULL;
 
-	/* no need to composite */
-	if (ssimg->width == G_MAXUINT || ssimg->height == G_MAXUINT) {
-		pixbuf_bg = gdk_pixbuf_new_from_file (ssimg->filename, NULL);
+	if (g_task_return_error_if_cancelled (task))
+		return;
+
+	if (helper->flags & GS_SCREENSHOT_IMAGE_DECODE_FLAG_BLUR) {
+		g_autoptr(AsImage) im = NULL;
+
+		/* create an helper which can do the blurring for us */
+		im = as_image_new ();
+		if (!as_image_load_filename (im, helper->filename, &error)) {
+			g_task_return_error (task, error);
+			return;
+		}
+		pixbuf = as_image_save_pixbuf (im,
+					       helper->width * helper->scale,
+					       helper->height * helper->scale,
+					       AS_IMAGE_SAVE_FLAG_BLUR);
+		if (pixbuf == NULL) {
+			g_task_return_new_error (task,
+						 G_IO_ERROR,
+						 G_IO_ERROR_FAILED,
+						 "failed to blur %s",
+						 helper->filename);
+			return;
+		}
+	} else if (helper->width == G_MAXUINT || helper->height == G_MAXUINT) {
+		/* no need to scale or composite */
+		pixbuf = gdk_pixbuf_new_from_file (helper->filename, &error);
 	} else {
 		/* this is always going to have alpha */
-		pixbuf = gdk_pixbuf_new_from_file_at_scale (ssimg->filename,
-							    (gint) (ssimg->width * ssimg->scale),
-							    (gint) (ssimg->height * ssimg->scale),
-							    FALSE, NULL);
-		if (pixbuf != NULL) {
-			if (gs_screenshot_image_use_desktop_background (ssimg, pixbuf)) {
-				pixbuf_bg = gs_screenshot_image_get_desktop_pixbuf (ssimg);
-				if (pixbuf_bg == NULL) {
-					pixbuf_bg = g_object_ref (pixbuf);
-				} else {
-					gdk_pixbuf_composite (pixbuf, pixbuf_bg,
-							      0, 0,
-							      (gint) ssimg->width,
-							      (gint) ssimg->height,
-							      0, 0, 1.0f, 1.0f,
-							      GDK_INTERP_NEAREST, 255);
-				}
-			} else {
-				pixbuf_bg = g_object_ref (pixbuf);
-			}
+		pixbuf = gdk_pixbuf_new_from_file_at_scale (helper->filename,
+							    (gint) (helper->width * helper->scale),
+							    (gint) (helper->height * helper->scale),
+							    FALSE, &error);
+		if (pixbuf != NULL &&
+		    helper->flags & GS_SCREENSHOT_IMAGE_DECODE_FLAG_BACKGROUND)
+			helper->composite = gs_screenshot_image_has_internal_alpha (pixbuf);
+	}
+	if (pixbuf == NULL) {
+		g_task_return_error (task, error);
+		return;
+	}
+	g_task_return_pointer (task, g_steal_pointer (&pixbuf), g_object_unref);
+}
+
+static void
+gs_screenshot_image_decode_async (gpointer source_object,
+				  const gchar *filename,
+				  guint width,
+				  guint height,
+				  guint scale,
+				  GsScreenshotImageDecodeFlags flags,
+				  GCancellable *cancellable,
+				  GAsyncReadyCallback callback,
+				  gpointer user_data)
+{
+	GsScreenshotImageDecodeHelper *helper;
+	g_autoptr(GTask) task = NULL;
+
+	helper = g_slice_new0 (GsScreenshotImageDecodeHelper);
+	helper->filename = g_strdup (filename);
+	helper->key = gs_screenshot_image_cache_key (filename, width, height,
+						     scale, flags);
+	helper->width = width;
+	helper->height = height;
+	helper->scale = scale;
+	helper->flags = flags;
+
+	task = g_task_new (source_object, cancellable, callback, user_data);
+	g_task_set_task_data (task, helper,
+			      (GDestroyNotify) gs_screenshot_image_decode_helper_free);
+	g_task_run_in_thread (task, gs_screenshot_image_decode_thread_cb);
+}
+
+/* the desktop background needs GDK, so is composited in the main thread */
+static GdkPixbuf *
+gs_screenshot_image_decode_finish (GAsyncResult *res, GError **error)
+{
+	GsScreenshotImageDecodeHelper *helper = g_task_get_task_data (G_TASK (res));
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+
+	pixbuf = g_task_propagate_pointer (G_TASK (res), error);
+	if (pixbuf == NULL)
+		return NULL;
+	if (helper->composite) {
+		g_autoptr(GdkPixbuf) pixbuf_bg = NULL;
+		pixbuf_bg = gs_screenshot_image_get_desktop_pixbuf (helper->width,
+								    helper->height);
+		if (pixbuf_bg != NULL) {
+			gdk_pixbuf_composite (pixbuf, pixbuf_bg,
+					      0, 0,
+					      (gint) helper->width,
+					      (gint) helper->height,
+					      0, 0, 1.0f, 1.0f,
+					      GDK_INTERP_NEAREST, 255);
+			g_object_unref (pixbuf);
+			pixbuf = g_steal_pointer (&pixbuf_bg);
 		}
 	}
+	gs_screenshot_image_cache_add (helper->key, helper->filename, pixbuf);
+	return g_steal_pointer (&pixbuf);
+}
+
+static GsScreenshotImageDecodeFlags
+gs_screenshot_image_get_decode_flags (GsScreenshotImage *ssimg)
+{
+	if (ssimg->use_desktop_background)
+		return GS_SCREENSHOT_IMAGE_DECODE_FLAG_BACKGROUND;
+	return GS_SCREENSHOT_IMAGE_DECODE_FLAG_NONE;
+}
+
+static void
+gs_screenshot_image_show_pixbuf (GsScreenshotImage *ssimg, GdkPixbuf *pixbuf)
+{
+	/* a late blurred thumbnail must not replace this */
+	g_cancellable_cancel (ssimg->cancellable_blur);
 
 	/* show icon */
 	if (g_strcmp0 (ssimg->current_image, "image1") == 0) {
-		if (pixbuf_bg != NULL) {
+		if (pixbuf != NULL) {
 			gs_image_set_from_pixbuf_with_scale (GTK_IMAGE (ssimg->image2),
-							     pixbuf_bg, (gint) ssimg->scale);
+							     pixbuf, (gint) ssimg->scale);
 		}
 		gtk_stack_set_visible_child_name (GTK_STACK (ssimg->stack), "image2");
 		ssimg->current_image = "image2";
 	} else {
-		if (pixbuf_bg != NULL) {
+		if (pixbuf != NULL) {
 			gs_image_set_from_pixbuf_with_scale (GTK_IMAGE (ssimg->image1),
-							     pixbuf_bg, (gint) ssimg->scale);
+							     pixbuf, (gint) ssimg->scale);
 		}
 		gtk_stack_set_visible_child_name (GTK_STACK (ssimg->stack), "image1");
 		ssimg->current_image = "image1";
@@ -174,23 +420,64 @@ as_screenshot_show_image (GsScreenshotImage *ssimg)
 }
 
 static void
-gs_screenshot_image_show_blurred (GsScreenshotImage *ssimg,
-				  const gchar *filename_thumb)
+gs_screenshot_image_show_image_cb (GObject *source_object,
+				   GAsyncResult *res,
+				   gpointer user_data)
 {
-	g_autoptr(AsImage) im = NULL;
-	g_autoptr(GdkPixbuf) pb = NULL;
+	GsScreenshotImage *ssimg = GS_SCREENSHOT_IMAGE (source_object);
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	g_autoptr(GError) error = NULL;
 
-	/* create an helper which can do the blurring for us */
-	im = as_image_new ();
-	if (!as_image_load_filename (im, filename_thumb, NULL))
+	pixbuf = gs_screenshot_image_decode_finish (res, &error);
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
 		return;
-	pb = as_image_save_pixbuf (im,
-				   ssimg->width * ssimg->scale,
-				   ssimg->height * ssimg->scale,
-				   AS_IMAGE_SAVE_FLAG_BLUR);
-	if (pb == NULL)
+
+	/* we're in destruction */
+	if (ssimg->session == NULL)
+		return;
+	if (pixbuf == NULL)
+		g_debug ("failed to load screenshot: %s", error->message);
+	gs_screenshot_image_show_pixbuf (ssimg, pixbuf);
+}
+
+static void
+as_screenshot_show_image (GsScreenshotImage *ssimg)
+{
+	GdkPixbuf *pixbuf;
+	GsScreenshotImageDecodeFlags flags = gs_screenshot_image_get_decode_flags (ssimg);
+	g_autofree gchar *key = NULL;
+
+	/* any earlier load is now out of date */
+	g_cancellable_cancel (ssimg->cancellable_decode);
+	g_clear_object (&ssimg->cancellable_decode);
+
+	/* already decoded for this size */
+	key = gs_screenshot_image_cache_key (ssimg->filename,
+					     ssimg->width, ssimg->height,
+					     ssimg->scale, flags);
+	pixbuf = gs_screenshot_image_cache_lookup (key);
+	if (pixbuf != NULL) {
+		gs_screenshot_image_show_pixbuf (ssimg, pixbuf);
 		return;
+	}
 
+	/* large images take a while to decode and scale */
+	ssimg->cancellable_decode = g_cancellable_new ();
+	gs_screenshot_image_decode_async (ssimg,
+					  ssimg->filename,
+					  ssimg->width,
+					  ssimg->height,
+					  ssimg->scale,
+					  flags,
+					  ssimg->cancellable_decode,
+					  gs_screenshot_image_show_image_cb,
+					  NULL);
+}
+
+static void
+gs_screenshot_image_show_blurred_pixbuf (GsScreenshotImage *ssimg,
+					 GdkPixbuf *pb)
+{
 	if (g_strcmp0 (ssimg->current_image, "image1") == 0) {
 		gs_image_set_from_pixbuf_with_scale (GTK_IMAGE (ssimg->image1),
 						     pb, (gint) ssimg->scale);
@@ -200,8 +487,101 @@ gs_screenshot_image_show_blurred (GsScreenshotImage *ssimg,
 	}
 }
 
+static void
+gs_screenshot_image_show_blurred_cb (GObject *source_object,
+				     GAsyncResult *res,
+				     gpointer user_data)
+{
+	GsScreenshotImage *ssimg = GS_SCREENSHOT_IMAGE (source_object);
+	g_autoptr(GdkPixbuf) pb = NULL;
+	g_autoptr(GError) error = NULL;
+
+	pb = gs_screenshot_image_decode_finish (res, &error);
+	if (pb == NULL) {
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_debug ("failed to blur thumbnail: %s", error->message);
+		return;
+	}
+
+	/* in destruction, or the real image got there first */
+	if (ssimg->session == NULL || ssimg->showing_image)
+		return;
+	gs_screenshot_image_show_blurred_pixbuf (ssimg, pb);
+}
+
+static void
+gs_screenshot_image_show_blurred (GsScreenshotImage *ssimg,
+				  const gchar *filename_thumb)
+{
+	GdkPixbuf *pb;
+	g_autofree gchar *key = NULL;
+
+	key = gs_screenshot_image_cache_key (filename_thumb,
+					     ssimg->width, ssimg->height,
+					     ssimg->scale,
+					     GS_SCREENSHOT_IMAGE_DECODE_FLAG_BLUR);
+	pb = gs_screenshot_image_cache_lookup (key);
+	if (pb != NULL) {
+		gs_screenshot_image_show_blurred_pixbuf (ssimg, pb);
+		return;
+	}
+
+	g_cancellable_cancel (ssimg->cancellable_blur);
+	g_clear_object (&ssimg->cancellable_blur);
+	ssimg->cancellable_blur = g_cancellable_new ();
+	gs_screenshot_image_decode_async (ssimg,
+					  filename_thumb,
+					  ssimg->width,
+					  ssimg->height,
+					  ssimg->scale,
+					  GS_SCREENSHOT_IMAGE_DECODE_FLAG_BLUR,
+					  ssimg->cancellable_blur,
+					  gs_screenshot_image_show_blurred_cb,
+					  NULL);
+}
+
+typedef struct {
+	GBytes		*bytes;
+	gchar		*filename;
+	gchar		*filename_counterpart;
+	AsScreenshot	*screenshot;
+	guint		 width;
+	guint		 height;
+	guint		 scale;
+} GsScreenshotImageSaveHelper;
+
+static GsScreenshotImageSaveHelper *
+gs_screenshot_image_save_helper_new (const gchar *filename,
+				     AsScreenshot *screenshot,
+				     guint width,
+				     guint height,
+				     guint scale)
+{
+	GsScreenshotImageSaveHelper *helper;
+	helper = g_slice_new0 (GsScreenshotImageSaveHelper);
+	helper->filename = g_strdup (filename);
+	if (screenshot != NULL)
+		helper->screenshot = g_object_ref (screenshot);
+	helper->width = width;
+	helper->height = height;
+	helper->scale = scale;
+	return helper;
+}
+
+static void
+gs_screenshot_image_save_helper_free (GsScreenshotImageSaveHelper *helper)
+{
+	if (helper->bytes != NULL)
+		g_bytes_unref (helper->bytes);
+	if (helper->screenshot != NULL)
+		g_object_unref (helper->screenshot);
+	g_free (helper->filename);
+	g_free (helper->filename_counterpart);
+	g_slice_free (GsScreenshotImageSaveHelper, helper);
+}
+
 static gboolean
-gs_screenshot_image_save_downloaded_img (GsScreenshotImage *ssimg,
+gs_screenshot_image_save_downloaded_img (GsScreenshotImageSaveHelper *helper,
 					 GdkPixbuf *pixbuf,
 					 GError **error)
 {
@@ -213,26 +593,26 @@ gs_screenshot_image_save_downloaded_img (GsScreenshotImage *ssimg,
 	g_autofree char *size_dir = NULL;
 	g_autofree char *cache_kind = NULL;
 	g_autofree char *basename = NULL;
-	guint width = ssimg->width;
-	guint height = ssimg->height;
+	guint width = helper->width;
+	guint height = helper->height;
 
 	/* save to file, using the same code as the AppStream builder
 	 * so the preview looks the same */
 	im = as_image_new ();
 	as_image_set_pixbuf (im, pixbuf);
-	ret = as_image_save_filename (im, ssimg->filename,
-				      ssimg->width * ssimg->scale,
-				      ssimg->height * ssimg->scale,
+	ret = as_image_save_filename (im, helper->filename,
+				      helper->width * helper->scale,
+				      helper->height * helper->scale,
 				      AS_IMAGE_SAVE_FLAG_PAD_16_9,
 				      error);
 
 	if (!ret)
 		return FALSE;
 
-	if (ssimg->screenshot == NULL)
+	if (helper->screenshot == NULL)
 		return TRUE;
 
-	images = as_screenshot_get_images (ssimg->screenshot);
+	images = as_screenshot_get_images (helper->screenshot);
 	if (images->len > 1)
 		return TRUE;
 
@@ -245,9 +625,9 @@ gs_screenshot_image_save_downloaded_img (GsScreenshotImage *ssimg,
 		height = AS_IMAGE_THUMBNAIL_HEIGHT;
 	}
 
-	width *= ssimg->scale;
-	height *= ssimg->scale;
-	basename = g_path_get_basename (ssimg->filename);
+	width *= helper->scale;
+	height *= helper->scale;
+	basename = g_path_get_basename (helper->filename);
 	size_dir = g_strdup_printf ("%ux%u", width, height);
 	cache_kind = g_build_filename ("screenshots", size_dir, NULL);
 	filename = gs_utils_get_cache_filename (cache_kind, basename,
@@ -274,22 +654,125 @@ gs_screenshot_image_save_downloaded_img (GsScreenshotImage *ssimg,
 		 * operation */
                 g_warning ("Failed to save screenshot '%s': %s", filename,
                            local_error->message);
+                return TRUE;
         }
+	helper->filename_counterpart = g_steal_pointer (&filename);
 
 	return TRUE;
 }
 
+/* decoding and resampling the download is too slow for the main thread */
+static void
+gs_screenshot_image_save_thread_cb (GTask *task,
+				    gpointer source_object,
+				    gpointer task_data,
+				    GCancellable *cancellable)
+{
+	GsScreenshotImageSaveHelper *helper = task_data;
+	GError *error = NULL;
+	gconstpointer data;
+	gsize length;
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	g_autoptr(GInputStream) stream = NULL;
+
+	/* load the image */
+	stream = g_memory_input_stream_new_from_bytes (helper->bytes);
+	pixbuf = gdk_pixbuf_new_from_stream (stream, cancellable, NULL);
+	if (pixbuf == NULL) {
+		g_task_return_new_error (task,
+					 G_IO_ERROR,
+					 G_IO_ERROR_INVALID_DATA,
+					 "%s",
+					 /* TRANSLATORS: possibly image file corrupt or not an image */
+					 _("Failed to load image"));
+		return;
+	}
+
+	/* is image size destination size unknown or exactly the correct size */
+	if (helper->width == G_MAXUINT || helper->height == G_MAXUINT ||
+	    (helper->width * helper->scale == (guint) gdk_pixbuf_get_width (pixbuf) &&
+	     helper->height * helper->scale == (guint) gdk_pixbuf_get_height (pixbuf))) {
+		data = g_bytes_get_data (helper->bytes, &length);
+		if (!g_file_set_contents (helper->filename,
+					  data, (gssize) length,
+					  &error)) {
+			g_task_return_error (task, error);
+			return;
+		}
+	} else if (!gs_screenshot_image_save_downloaded_img (helper, pixbuf,
+							     &error)) {
+		g_task_return_error (task, error);
+		return;
+	}
+	g_task_return_boolean (task, TRUE);
+}
+
+static void
+gs_screenshot_image_save_async (gpointer source_object,
+				GsScreenshotImageSaveHelper *helper,
+				SoupMessage *msg,
+				GAsyncReadyCallback callback,
+				gpointer user_data)
+{
+	g_autoptr(GTask) task = NULL;
+
+	helper->bytes = g_bytes_new (msg->response_body->data,
+				     (gsize) msg->response_body->length);
+	task = g_task_new (source_object, NULL, callback, user_data);
+	g_task_set_task_data (task, helper,
+			      (GDestroyNotify) gs_screenshot_image_save_helper_free);
+	g_task_run_in_thread (task, gs_screenshot_image_save_thread_cb);
+}
+
+static GsScreenshotImageSaveHelper *
+gs_screenshot_image_save_finish (GAsyncResult *res, GError **error)
+{
+	GsScreenshotImageSaveHelper *helper = g_task_get_task_data (G_TASK (res));
+
+	if (!g_task_propagate_boolean (G_TASK (res), error))
+		return NULL;
+
+	/* the decoded copies are now out of date */
+	gs_screenshot_image_cache_invalidate (helper->filename);
+	if (helper->filename_counterpart != NULL)
+		gs_screenshot_image_cache_invalidate (helper->filename_counterpart);
+	return helper;
+}
+
+static void
+gs_screenshot_image_saved_cb (GObject *source_object,
+			      GAsyncResult *res,
+			      gpointer user_data)
+{
+	GsScreenshotImage *ssimg = GS_SCREENSHOT_IMAGE (source_object);
+	GsScreenshotImageSaveHelper *helper;
+	g_autoptr(GError) error = NULL;
+
+	helper = gs_screenshot_image_save_finish (res, &error);
+
+	/* we're in destruction */
+	if (ssimg->session == NULL)
+		return;
+	if (helper == NULL) {
+		gs_screenshot_image_set_error (ssimg, error->message);
+		return;
+	}
+
+	/* a different screenshot was requested in the meantime */
+	if (g_strcmp0 (helper->filename, ssimg->filename) != 0)
+		return;
+
+	/* got image, so show */
+	as_screenshot_show_image (ssimg);
+}
+
 static void
 gs_screenshot_image_complete_cb (SoupSession *session,
 				 SoupMessage *msg,
 				 gpointer user_data)
 {
 	g_autoptr(GsScreenshotImage) ssimg = GS_SCREENSHOT_IMAGE (user_data);
-	gboolean ret;
-	g_autoptr(GError) error = NULL;
-	g_autoptr(AsImage) im = NULL;
-	g_autoptr(GdkPixbuf) pixbuf = NULL;
-	g_autoptr(GInputStream) stream = NULL;
+	GsScreenshotImageSaveHelper *helper;
 
 	/* return immediately if the message was cancelled or if we're in destruction */
 	if (msg->status_code == SOUP_STATUS_CANCELLED || ssimg->session == NULL)
@@ -314,41 +797,14 @@ gs_screenshot_image_complete_cb (SoupSession *session,
 		return;
 	}
 
-	/* create a buffer with the data */
-	stream = g_memory_input_stream_new_from_data (msg->response_body->data,
-						      msg->response_body->length,
-						      NULL);
-	if (stream == NULL)
-		return;
-
-	/* load the image */
-	pixbuf = gdk_pixbuf_new_from_stream (stream, NULL, NULL);
-	if (pixbuf == NULL) {
-		/* TRANSLATORS: possibly image file corrupt or not an image */
-		gs_screenshot_image_set_error (ssimg, _("Failed to load image"));
-		return;
-	}
-
-	/* is image size destination size unknown or exactly the correct size */
-	if (ssimg->width == G_MAXUINT || ssimg->height == G_MAXUINT ||
-	    (ssimg->width * ssimg->scale == (guint) gdk_pixbuf_get_width (pixbuf) &&
-	     ssimg->height * ssimg->scale == (guint) gdk_pixbuf_get_height (pixbuf))) {
-		ret = g_file_set_contents (ssimg->filename,
-					   msg->response_body->data,
-					   msg->response_body->length,
-					   &error);
-		if (!ret) {
-			gs_screenshot_image_set_error (ssimg, error->message);
-			return;
-		}
-	} else if (!gs_screenshot_image_save_downloaded_img (ssimg, pixbuf,
-							     &error)) {
-		gs_screenshot_image_set_error (ssimg, error->message);
-		return;
-	}
-
-	/* got image, so show */
-	as_screenshot_show_image (ssimg);
+	/* save the data, then show it */
+	helper = gs_screenshot_image_save_helper_new (ssimg->filename,
+						      ssimg->screenshot,
+						      ssimg->width,
+						      ssimg->height,
+						      ssimg->scale);
+	gs_screenshot_image_save_async (ssimg, helper, msg,
+					gs_screenshot_image_saved_cb, NULL);
 }
 
 void
@@ -401,6 +857,27 @@ gs_screenshot_get_cachefn_for_url (const gchar *url)
 	return g_strdup_printf ("%s-%s", checksum, basename);
 }
 
+static gchar *
+gs_screenshot_image_get_cache_filename (const gchar *url,
+					guint width,
+					guint height,
+					guint scale,
+					GsUtilsCacheFlags flags)
+{
+	g_autofree gchar *basename = NULL;
+	g_autofree gchar *cache_kind = NULL;
+	g_autofree gchar *sizedir = NULL;
+
+	basename = gs_screenshot_get_cachefn_for_url (url);
+	if (width == G_MAXUINT || height == G_MAXUINT) {
+		sizedir = g_strdup ("unknown");
+	} else {
+		sizedir = g_strdup_printf ("%ux%u", width * scale, height * scale);
+	}
+	cache_kind = g_build_filename ("screenshots", sizedir, NULL);
+	return gs_utils_get_cache_filename (cache_kind, basename, flags, NULL);
+}
+
 static void
 gs_screenshot_soup_msg_set_modified_request (SoupMessage *msg, GFile *file)
 {
@@ -430,10 +907,8 @@ gs_screenshot_image_load_async (GsScreenshotImage *ssimg,
 {
 	AsImage *im = NULL;
 	const gchar *url;
-	g_autofree gchar *basename = NULL;
-	g_autofree gchar *cache_kind = NULL;
+	gboolean cached = FALSE;
 	g_autofree gchar *cachefn_thumb = NULL;
-	g_autofree gchar *sizedir = NULL;
 	g_autoptr(SoupURI) base_uri = NULL;
 
 	g_return_if_fail (GS_IS_SCREENSHOT_IMAGE (ssimg));
@@ -465,6 +940,7 @@ gs_screenshot_image_load_async (GsScreenshotImage *ssimg,
 	/* check if the URL points to a local file */
 	url = as_image_get_url (im);
 	if (g_str_has_prefix (url, "file://")) {
+		g_free (ssimg->filename);
 		ssimg->filename = g_strdup (url + 7);
 		if (g_file_test (ssimg->filename, G_FILE_TEST_EXISTS)) {
 			as_screenshot_show_image (ssimg);
@@ -472,17 +948,12 @@ gs_screenshot_image_load_async (GsScreenshotImage *ssimg,
 		}
 	}
 
-	basename = gs_screenshot_get_cachefn_for_url (url);
-	if (ssimg->width == G_MAXUINT || ssimg->height == G_MAXUINT) {
-		sizedir = g_strdup ("unknown");
-	} else {
-		sizedir = g_strdup_printf ("%ux%u", ssimg->width * ssimg->scale, ssimg->height * ssimg->scale);
-	}
-	cache_kind = g_build_filename ("screenshots", sizedir, NULL);
-	ssimg->filename = gs_utils_get_cache_filename (cache_kind,
-						       basename,
-						       GS_UTILS_CACHE_FLAG_NONE,
-						       NULL);
+	g_free (ssimg->filename);
+	ssimg->filename = gs_screenshot_image_get_cache_filename (url,
+								  ssimg->width,
+								  ssimg->height,
+								  ssimg->scale,
+								  GS_UTILS_CACHE_FLAG_NONE);
 	if (ssimg->filename == NULL) {
 		/* TRANSLATORS: this is when we try create the cache directory
 		 * but we were out of space or permission was denied */
@@ -498,6 +969,7 @@ gs_screenshot_image_load_async (GsScreenshotImage *ssimg,
 		/* show the image we have in cache while we're checking for the
 		 * new screenshot (which probably won't have changed) */
 		as_screenshot_show_image (ssimg);
+		cached = TRUE;
 
 		/* verify the cache age against the maximum allowed */
 		age_max = g_settings_get_uint (ssimg->settings,
@@ -511,22 +983,19 @@ gs_screenshot_image_load_async (GsScreenshotImage *ssimg,
 
 	/* if we're not showing a full-size image, we try loading a blurred
 	 * smaller version of it straight away */
-	if (!ssimg->showing_image &&
+	if (!ssimg->showing_image && !cached &&
 	    ssimg->width > AS_IMAGE_THUMBNAIL_WIDTH &&
 	    ssimg->height > AS_IMAGE_THUMBNAIL_HEIGHT) {
 		const gchar *url_thumb;
-		g_autofree gchar *basename_thumb = NULL;
-		g_autofree gchar *cache_kind_thumb = NULL;
 		im = as_screenshot_get_image (ssimg->screenshot,
 					      AS_IMAGE_THUMBNAIL_WIDTH * ssimg->scale,
 					      AS_IMAGE_THUMBNAIL_HEIGHT * ssimg->scale);
 		url_thumb = as_image_get_url (im);
-		basename_thumb = gs_screenshot_get_cachefn_for_url (url_thumb);
-		cache_kind_thumb = g_build_filename ("screenshots", "112x63", NULL);
-		cachefn_thumb = gs_utils_get_cache_filename (cache_kind_thumb,
-							     basename_thumb,
-							     GS_UTILS_CACHE_FLAG_NONE,
-							     NULL);
+		cachefn_thumb = gs_screenshot_image_get_cache_filename (url_thumb,
+									AS_IMAGE_THUMBNAIL_WIDTH,
+									AS_IMAGE_THUMBNAIL_HEIGHT,
+									ssimg->scale,
+									GS_UTILS_CACHE_FLAG_NONE);
 		if (cachefn_thumb == NULL)
 			return;
 		if (g_file_test (cachefn_thumb, G_FILE_TEST_EXISTS))
@@ -536,10 +1005,11 @@ gs_screenshot_image_load_async (GsScreenshotImage *ssimg,
 	/* re-request the cache filename, which might be different as it needs
 	 * to be writable this time */
 	g_free (ssimg->filename);
-	ssimg->filename = gs_utils_get_cache_filename (cache_kind,
-						       basename,
-						       GS_UTILS_CACHE_FLAG_WRITEABLE,
-						       NULL);
+	ssimg->filename = gs_screenshot_image_get_cache_filename (url,
+								  ssimg->width,
+								  ssimg->height,
+								  ssimg->scale,
+								  GS_UTILS_CACHE_FLAG_WRITEABLE);
 
 	/* download file */
 	g_debug ("downloading %s to %s", url, ssimg->filename);
@@ -580,6 +1050,180 @@ gs_screenshot_image_load_async (GsScreenshotImage *ssimg,
 				    g_object_ref (ssimg));
 }
 
+static void
+gs_screenshot_image_prefetch_decoded_cb (GObject *source_object,
+					 GAsyncResult *res,
+					 gpointer user_data)
+{
+	g_autofree gchar *filename = (gchar *) user_data;
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	g_autoptr(GError) error = NULL;
+
+	/* this adds it to the cache */
+	pixbuf = gs_screenshot_image_decode_finish (res, &error);
+	if (pixbuf == NULL)
+		g_debug ("failed to prefetch %s: %s", filename, error->message);
+	g_hash_table_remove (prefetch_pending, filename);
+}
+
+static void
+gs_screenshot_image_prefetch_decode (const gchar *filename, guint scale)
+{
+	/* the thumbnail widgets composite onto the desktop background */
+	g_hash_table_add (prefetch_pending, g_strdup (filename));
+	gs_screenshot_image_decode_async (NULL,
+					  filename,
+					  AS_IMAGE_THUMBNAIL_WIDTH,
+					  AS_IMAGE_THUMBNAIL_HEIGHT,
+					  scale,
+					  GS_SCREENSHOT_IMAGE_DECODE_FLAG_BACKGROUND,
+					  NULL,
+					  gs_screenshot_image_prefetch_decoded_cb,
+					  g_strdup (filename));
+}
+
+static void
+gs_screenshot_image_prefetch_saved_cb (GObject *source_object,
+				       GAsyncResult *res,
+				       gpointer user_data)
+{
+	GsScreenshotImageSaveHelper *helper = g_task_get_task_data (G_TASK (res));
+	g_autoptr(GError) error = NULL;
+
+	g_hash_table_remove (prefetch_pending, helper->filename);
+	if (gs_screenshot_image_save_finish (res, &error) == NULL) {
+		g_debug ("failed to prefetch %s: %s",
+			 helper->filename, error->message);
+		return;
+	}
+	gs_screenshot_image_prefetch_decode (helper->filename, helper->scale);
+}
+
+static void
+gs_screenshot_image_prefetch_complete_cb (SoupSession *session,
+					  SoupMessage *msg,
+					  gpointer user_data)
+{
+	GsScreenshotImageSaveHelper *helper = user_data;
+
+	if (msg->status_code != SOUP_STATUS_OK) {
+		g_debug ("failed to prefetch %s: %s",
+			 helper->filename, msg->reason_phrase);
+		g_hash_table_remove (prefetch_pending, helper->filename);
+		gs_screenshot_image_save_helper_free (helper);
+		return;
+	}
+	gs_screenshot_image_save_async (NULL, helper, msg,
+					gs_screenshot_image_prefetch_saved_cb,
+					NULL);
+}
+
+static void
+gs_screenshot_image_prefetch_screenshot (AsScreenshot *ss, guint scale)
+{
+	AsImage *im;
+	const gchar *url;
+	GsScreenshotImageSaveHelper *helper;
+	g_autofree gchar *filename = NULL;
+	g_autofree gchar *key = NULL;
+	SoupMessage *msg;
+	g_autoptr(SoupURI) base_uri = NULL;
+
+	/* use the same image as the thumbnail widget would */
+	im = as_screenshot_get_image (ss,
+				      AS_IMAGE_THUMBNAIL_WIDTH * scale,
+				      AS_IMAGE_THUMBNAIL_HEIGHT * scale);
+	if (im == NULL && scale > 1) {
+		scale = 1;
+		im = as_screenshot_get_image (ss,
+					      AS_IMAGE_THUMBNAIL_WIDTH,
+					      AS_IMAGE_THUMBNAIL_HEIGHT);
+	}
+	if (im == NULL)
+		return;
+	url = as_image_get_url (im);
+	if (g_str_has_prefix (url, "file://")) {
+		filename = g_strdup (url + 7);
+	} else {
+		filename = gs_screenshot_image_get_cache_filename (url,
+								   AS_IMAGE_THUMBNAIL_WIDTH,
+								   AS_IMAGE_THUMBNAIL_HEIGHT,
+								   scale,
+								   GS_UTILS_CACHE_FLAG_NONE);
+		if (filename == NULL)
+			return;
+	}
+
+	/* already decoded, or in progress */
+	key = gs_screenshot_image_cache_key (filename,
+					     AS_IMAGE_THUMBNAIL_WIDTH,
+					     AS_IMAGE_THUMBNAIL_HEIGHT,
+					     scale,
+					     GS_SCREENSHOT_IMAGE_DECODE_FLAG_BACKGROUND);
+	if (gs_screenshot_image_cache_lookup (key) != NULL)
+		return;
+	if (g_hash_table_contains (prefetch_pending, filename))
+		return;
+
+	/* on disk, so just decode */
+	if (g_file_test (filename, G_FILE_TEST_EXISTS)) {
+		gs_screenshot_image_prefetch_decode (filename, scale);
+		return;
+	}
+	if (g_str_has_prefix (url, "file://"))
+		return;
+
+	/* download to where the widget would put it */
+	g_free (filename);
+	filename = gs_screenshot_image_get_cache_filename (url,
+							   AS_IMAGE_THUMBNAIL_WIDTH,
+							   AS_IMAGE_THUMBNAIL_HEIGHT,
+							   scale,
+							   GS_UTILS_CACHE_FLAG_WRITEABLE);
+	if (filename == NULL)
+		return;
+	base_uri = soup_uri_new (url);
+	if (base_uri == NULL || !SOUP_URI_VALID_FOR_HTTP (base_uri))
+		return;
+	msg = soup_message_new_from_uri (SOUP_METHOD_GET, base_uri);
+	if (msg == NULL)
+		return;
+	if (prefetch_session == NULL) {
+		prefetch_session = soup_session_new_with_options (SOUP_SESSION_USER_AGENT,
+								  gs_user_agent (),
+								  NULL);
+	}
+	g_debug ("prefetching %s to %s", url, filename);
+	g_hash_table_add (prefetch_pending, g_strdup (filename));
+	helper = gs_screenshot_image_save_helper_new (filename, ss,
+						      AS_IMAGE_THUMBNAIL_WIDTH,
+						      AS_IMAGE_THUMBNAIL_HEIGHT,
+						      scale);
+	soup_session_queue_message (prefetch_session,
+				    msg /* transfer full */,
+				    gs_screenshot_image_prefetch_complete_cb,
+				    helper);
+}
+
+/* downloads and decodes the first screenshot thumbnail of an application
+ * in the background, which the details page shows as the placeholder */
+void
+gs_screenshot_image_prefetch (GsApp *app, guint scale)
+{
+	GPtrArray *screenshots;
+
+	g_return_if_fail (GS_IS_APP (app));
+
+	screenshots = gs_app_get_screenshots (app);
+	if (screenshots->len == 0)
+		return;
+	if (prefetch_pending == NULL)
+		prefetch_pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+							  g_free, NULL);
+	gs_screenshot_image_prefetch_screenshot (g_ptr_array_index (screenshots, 0),
+						 MAX (scale, 1));
+}
+
 static void
 gs_screenshot_image_destroy (GtkWidget *widget)
 {
@@ -591,6 +1235,10 @@ gs_screenshot_image_destroy (GtkWidget *widget)
 		                             SOUP_STATUS_CANCELLED);
 		g_clear_object (&ssimg->message);
 	}
+	g_cancellable_cancel (ssimg->cancellable_decode);
+	g_cancellable_cancel (ssimg->cancellable_blur);
+	g_clear_object (&ssimg->cancellable_decode);
+	g_clear_object (&ssimg->cancellable_blur);
 	g_clear_object (&ssimg->screenshot);
 	g_clear_object (&ssimg->session);
 	g_clear_object (&ssimg->settings);
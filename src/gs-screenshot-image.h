@@ -47,6 +47,8 @@ void		 gs_screenshot_image_set_use_desktop_background
 							 gboolean		 use_desktop_background);
 void		 gs_screenshot_image_load_async		(GsScreenshotImage	*ssimg,
 							 GCancellable		*cancellable);
+void		 gs_screenshot_image_prefetch		(GsApp			*app,
+							 guint			 scale);
 
 G_END_DECLS
 
@@ -214,6 +214,10 @@ handle_get_subsearch_result_set (GsShellSearchProvider2	*skeleton,
 	GsShellSearchProvider *self = user_data;
 
 	g_debug ("****** GetSubSearchResultSet");
+
+	/* previous_results only has the top few results, so it cannot be
+	 * narrowed here; the plugins narrow their own complete results when
+	 * the new terms extend the old ones */
 	execute_search (self, invocation, terms);
 	return TRUE;
 }